@@ -0,0 +1,781 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/param.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "archive.h"
+#include "mapplane.h"
+
+/*
+ * Log layout: ARCHIVE_MAGIC, then records of a tag byte, a little endian
+ * 32 bit payload size and the payload. Numbers in payloads are LEB128
+ * varints.
+ *
+ *   'B' blob:  hash (8 bytes), size, depth, [base offset if depth > 0], ops
+ *   'T' turn:  name length, name (nul terminated), file size, chunk count,
+ *              blob offset of every chunk
+ *
+ * A blob is decoded by starting from its base blob (or zeros, at depth 0)
+ * and running its ops, each a count of bytes to skip followed by a count
+ * of bytes to xor in, and those bytes.
+ */
+
+#define ARCHIVE_MAGIC "viceroy-archive 1\n"
+#define ARCHIVE_MAGIC_SIZE (sizeof (ARCHIVE_MAGIC) - 1)
+
+#define RECORD_BLOB 'B'
+#define RECORD_TURN 'T'
+#define RECORD_HEADER 5
+
+/* Map chunks are this many rows of one layer */
+#define MAP_CHUNK_ROWS 8
+
+/* Scratch buffers past the decode levels, for encoding into */
+#define SCRATCH_ENCODE (ARCHIVE_MAX_DEPTH + 1)
+
+struct archive_blob {
+	uint64_t hash;
+	uint64_t offset; // 0 for an empty slot
+};
+
+struct chunk {
+	uint32_t slot;   // section << 24 | record, the same chunk from save to save
+	size_t offset;
+	size_t size;
+};
+
+#define SLOT(section, record) ((uint32_t) (section) << 24 | (uint32_t) (record))
+
+static size_t put_varint(uint8_t *p, uint64_t v)
+{
+	size_t n = 0;
+	while (v >= 0x80) {
+		p[n++] = (uint8_t) v | 0x80;
+		v >>= 7;
+	}
+	p[n++] = (uint8_t) v;
+	return n;
+}
+
+static int get_varint(const uint8_t **p, const uint8_t *end, uint64_t *v)
+{
+	*v = 0;
+	for (int shift = 0; *p < end && shift < 64; shift += 7) {
+		uint8_t b = *(*p)++;
+		*v |= (uint64_t) (b & 0x7f) << shift;
+		if (!(b & 0x80))
+			return 0;
+	}
+	errno = EINVAL;
+	return -1;
+}
+
+static int write_full(int fd, const void *buf, size_t len, off_t off)
+{
+	const uint8_t *p = (const uint8_t *) buf;
+
+	while (len > 0) {
+		ssize_t n = pwrite(fd, p, len, off);
+		if (n == -1) {
+			if (errno == EINTR)
+				continue;
+			return -1;
+		}
+		p += n;
+		off += n;
+		len -= n;
+	}
+	return 0;
+}
+
+static uint8_t *scratch(struct archive *ar, int level, size_t size)
+{
+	if (ar->scratch_cap[level] < size) {
+		ar->scratch_cap[level] = MAX(size, 4096);
+		ar->scratch[level] = (uint8_t *) realloc(ar->scratch[level], ar->scratch_cap[level]);
+	}
+	return ar->scratch[level];
+}
+
+/* Makes sure [0, end) of the log is mapped */
+static int log_map(struct archive *ar, size_t end)
+{
+	if (end <= ar->map_size)
+		return 0;
+	if (end > ar->end) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	if (ar->map)
+		munmap(ar->map, ar->map_size);
+
+	ar->map = (uint8_t *) mmap(NULL, ar->end, PROT_READ, MAP_SHARED, ar->fd, 0);
+	if (ar->map == MAP_FAILED) {
+		ar->map = NULL;
+		ar->map_size = 0;
+		return -1;
+	}
+	ar->map_size = ar->end;
+	return 0;
+}
+
+struct record {
+	int tag;
+	const uint8_t *data;
+	const uint8_t *end;
+	size_t next; // offset of the record after this one
+};
+
+static int record_at(struct archive *ar, uint64_t off, struct record *r)
+{
+	if (off + RECORD_HEADER > ar->end || log_map(ar, off + RECORD_HEADER) == -1) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	const uint8_t *p = ar->map + off;
+	size_t size = p[1] | p[2] << 8 | p[3] << 16 | (size_t) p[4] << 24;
+
+	if (off + RECORD_HEADER + size > ar->end || log_map(ar, off + RECORD_HEADER + size) == -1) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	p = ar->map + off;
+	r->tag = p[0];
+	r->data = p + RECORD_HEADER;
+	r->end = r->data + size;
+	r->next = off + RECORD_HEADER + size;
+	return 0;
+}
+
+struct blob {
+	uint64_t hash;
+	uint64_t size;
+	uint64_t depth;
+	uint64_t base;
+	const uint8_t *ops;
+	const uint8_t *end;
+};
+
+static int blob_at(struct archive *ar, uint64_t off, struct blob *b)
+{
+	struct record r;
+	if (record_at(ar, off, &r) == -1)
+		return -1;
+
+	const uint8_t *p = r.data;
+	if (r.tag != RECORD_BLOB || r.end - p < 8) {
+		errno = EINVAL;
+		return -1;
+	}
+	memcpy(&b->hash, p, 8);
+	p += 8;
+
+	b->base = 0;
+	if (get_varint(&p, r.end, &b->size) == -1 || get_varint(&p, r.end, &b->depth) == -1)
+		return -1;
+	if (b->depth > 0 && get_varint(&p, r.end, &b->base) == -1)
+		return -1;
+
+	b->ops = p;
+	b->end = r.end;
+	return 0;
+}
+
+/* Decodes the blob at off into the level scratch buffer */
+static int blob_decode(struct archive *ar, uint64_t off, int level, const uint8_t **data, size_t *size)
+{
+	struct blob b;
+
+	if (level > ARCHIVE_MAX_DEPTH || blob_at(ar, off, &b) == -1 || b.depth > ARCHIVE_MAX_DEPTH) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	uint8_t *out = scratch(ar, level, b.size);
+
+	if (b.depth > 0) {
+		const uint8_t *base;
+		size_t base_size;
+		if (b.base >= off || blob_decode(ar, b.base, level + 1, &base, &base_size) == -1)
+			return -1;
+		size_t n = MIN(base_size, b.size);
+		memcpy(out, base, n);
+		memset(out + n, 0, b.size - n);
+		blob_at(ar, off, &b); // the mapping may have moved
+	} else {
+		memset(out, 0, b.size);
+	}
+
+	const uint8_t *p = b.ops;
+	size_t pos = 0;
+	while (p < b.end) {
+		uint64_t skip, n;
+		if (get_varint(&p, b.end, &skip) == -1 || get_varint(&p, b.end, &n) == -1)
+			return -1;
+		pos += skip;
+		if (pos + n > b.size || n > (size_t) (b.end - p)) {
+			errno = EINVAL;
+			return -1;
+		}
+		for (size_t i = 0; i < n; ++i)
+			out[pos + i] ^= p[i];
+		pos += n;
+		p += n;
+	}
+
+	*data = out;
+	*size = b.size;
+	return 0;
+}
+
+/*
+ * Encodes data as ops against base (zeros past its end, or everywhere if
+ * base is NULL). Differences less than four bytes apart go into one op.
+ * out needs room for 2 * n + 16 bytes.
+ */
+static size_t encode_ops(uint8_t *out, const uint8_t *data, size_t n, const uint8_t *base, size_t base_n)
+{
+	#define B(i) ((i) < base_n ? base[i] : 0)
+	uint8_t *o = out;
+	size_t i = 0, last = 0;
+
+	while (i < n) {
+		while (i < n && data[i] == B(i))
+			++i;
+		if (i == n)
+			break;
+
+		size_t start = i;
+		while (i < n) {
+			if (data[i] != B(i)) {
+				++i;
+				continue;
+			}
+			size_t j = i;
+			while (j < n && j - i < 4 && data[j] == B(j))
+				++j;
+			if (j == n || j - i >= 4)
+				break;
+			i = j;
+		}
+
+		o += put_varint(o, start - last);
+		o += put_varint(o, i - start);
+		for (size_t k = start; k < i; ++k)
+			*o++ = data[k] ^ B(k);
+		last = i;
+	}
+
+	return o - out;
+	#undef B
+}
+
+/*
+ * Chunks
+ */
+
+/* Cuts a savegame into chunks, in file order. Returns the count, or -1 */
+static int savegame_chunks(const uint8_t *data, size_t size, struct chunk **chunks)
+{
+	if (size < sizeof (struct savegame::head)) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	struct section_table st;
+	section_table((const struct savegame::head *) data, &st);
+	if (st.offset[SECTION_COUNT] > size) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	size_t max = 1 + st.count[SECTION_COLONY] + 4 + 8 + 12 + MAP_LAYERS * (MAP_HEIGHT / MAP_CHUNK_ROWS + 1) + SECTION_COUNT + 1;
+	struct chunk *c = (struct chunk *) malloc(sizeof (struct chunk) * max);
+	int n = 0;
+
+	for (int s = 0; s < SECTION_COUNT; ++s) {
+		size_t off = st.offset[s], len = st.offset[s + 1] - st.offset[s];
+		if (len == 0)
+			continue;
+
+		switch (s) {
+			case SECTION_PLAYER:
+			case SECTION_COLONY:
+			case SECTION_NATION:
+			case SECTION_INDIAN:
+			case SECTION_ROUTE:
+				for (size_t r = 0; r < st.count[s]; ++r)
+					c[n++] = (struct chunk) { SLOT(s, r), off + r * st.record[s], st.record[s] };
+				break;
+
+			case SECTION_MAP: {
+				size_t block = MAP_CHUNK_ROWS * MAP_WIDTH;
+				for (size_t r = 0; r * block < len; ++r)
+					c[n++] = (struct chunk) { SLOT(s, r), off + r * block, MIN(block, len - r * block) };
+				break;
+			}
+
+			default:
+				c[n++] = (struct chunk) { SLOT(s, 0), off, len };
+				break;
+		}
+	}
+
+	/* Anything after the last section is kept as well, to restore the file exactly */
+	if (size > st.offset[SECTION_COUNT])
+		c[n++] = (struct chunk) { SLOT(SECTION_COUNT, 0), st.offset[SECTION_COUNT], size - st.offset[SECTION_COUNT] };
+
+	*chunks = c;
+	return n;
+}
+
+/*
+ * Turns
+ */
+
+static void add_turn(struct archive *ar, uint64_t off)
+{
+	if (ar->turn_count == ar->turn_cap) {
+		ar->turn_cap = ar->turn_cap ? 2 * ar->turn_cap : 256;
+		ar->turn = (uint64_t *) realloc(ar->turn, sizeof (uint64_t) * ar->turn_cap);
+	}
+	ar->turn[ar->turn_count++] = off;
+}
+
+struct turn {
+	const char *name;
+	uint64_t size;
+	uint64_t count;
+	const uint8_t *refs;
+	const uint8_t *end;
+};
+
+static int turn_at(struct archive *ar, int n, struct turn *t)
+{
+	struct record r;
+
+	if (n < 0 || n >= ar->turn_count || record_at(ar, ar->turn[n], &r) == -1 || r.tag != RECORD_TURN) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	const uint8_t *p = r.data;
+	uint64_t name_len;
+	if (get_varint(&p, r.end, &name_len) == -1)
+		return -1;
+	if (name_len == 0 || name_len > (uint64_t) (r.end - p) || p[name_len - 1] != '\0') {
+		errno = EINVAL;
+		return -1;
+	}
+	t->name = (const char *) p;
+	p += name_len;
+
+	if (get_varint(&p, r.end, &t->size) == -1 || get_varint(&p, r.end, &t->count) == -1)
+		return -1;
+
+	t->refs = p;
+	t->end = r.end;
+	return 0;
+}
+
+int archive_extract(struct archive *ar, int n, struct savegame_buffer *buf, size_t *size, const char **name)
+{
+	struct turn t;
+
+	/* Map all of it up front, so decoding doesn't move t.refs */
+	if (log_map(ar, ar->end) == -1 || turn_at(ar, n, &t) == -1)
+		return -1;
+
+	if (buf->cap < t.size) {
+		free(buf->data);
+		buf->data = (uint8_t *) malloc(t.size);
+		buf->cap = t.size;
+	}
+
+	const uint8_t *p = t.refs;
+	size_t pos = 0;
+	for (uint64_t i = 0; i < t.count; ++i) {
+		uint64_t ref;
+		const uint8_t *data;
+		size_t len;
+
+		if (get_varint(&p, t.end, &ref) == -1 || blob_decode(ar, ref, 0, &data, &len) == -1)
+			return -1;
+		if (pos + len > t.size) {
+			errno = EINVAL;
+			return -1;
+		}
+		memcpy(buf->data + pos, data, len);
+		pos += len;
+	}
+
+	if (pos != t.size) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	*name = t.name;
+	*size = t.size;
+	return 0;
+}
+
+/*
+ * Appending
+ */
+
+static void blob_insert(struct archive *ar, uint64_t hash, uint64_t offset)
+{
+	if (2 * (ar->blob_count + 1) > ar->blob_cap) {
+		size_t cap = ar->blob_cap ? 2 * ar->blob_cap : 1024;
+		struct archive_blob *blob = (struct archive_blob *) calloc(cap, sizeof (*blob));
+		for (size_t i = 0; i < ar->blob_cap; ++i) {
+			if (!ar->blob[i].offset)
+				continue;
+			size_t k = ar->blob[i].hash & (cap - 1);
+			while (blob[k].offset)
+				k = (k + 1) & (cap - 1);
+			blob[k] = ar->blob[i];
+		}
+		free(ar->blob);
+		ar->blob = blob;
+		ar->blob_cap = cap;
+	}
+
+	size_t k = hash & (ar->blob_cap - 1);
+	while (ar->blob[k].offset)
+		k = (k + 1) & (ar->blob_cap - 1);
+	ar->blob[k].hash = hash;
+	ar->blob[k].offset = offset;
+	ar->blob_count++;
+}
+
+/* Offset of a blob holding exactly data, or 0 */
+static uint64_t blob_find(struct archive *ar, uint64_t hash, const uint8_t *data, size_t size)
+{
+	if (!ar->blob_cap)
+		return 0;
+
+	for (size_t k = hash & (ar->blob_cap - 1); ar->blob[k].offset; k = (k + 1) & (ar->blob_cap - 1)) {
+		if (ar->blob[k].hash != hash)
+			continue;
+
+		const uint8_t *p;
+		size_t n;
+		if (blob_decode(ar, ar->blob[k].offset, 0, &p, &n) == 0 && n == size && memcmp(p, data, n) == 0)
+			return ar->blob[k].offset;
+	}
+	return 0;
+}
+
+/* Appends a record, returns its offset or 0 */
+static uint64_t record_append(struct archive *ar, int tag, const uint8_t *head, size_t head_size, const uint8_t *data, size_t size)
+{
+	uint64_t off = ar->end;
+	size_t total = head_size + size;
+	uint8_t header[RECORD_HEADER] = { (uint8_t) tag, (uint8_t) total, (uint8_t) (total >> 8), (uint8_t) (total >> 16), (uint8_t) (total >> 24) };
+
+	if (write_full(ar->fd, header, RECORD_HEADER, off) == -1 ||
+	    write_full(ar->fd, head, head_size, off + RECORD_HEADER) == -1 ||
+	    write_full(ar->fd, data, size, off + RECORD_HEADER + head_size) == -1)
+		return 0;
+
+	ar->end = off + RECORD_HEADER + total;
+	return off;
+}
+
+/* Stores one chunk, against the same chunk of the previous turn if that is smaller */
+static uint64_t blob_store(struct archive *ar, const uint8_t *data, size_t size, uint64_t base_off)
+{
+	uint64_t hash = content_hash(data, size);
+	uint64_t off = blob_find(ar, hash, data, size);
+	if (off)
+		return off;
+
+	uint8_t *ops = scratch(ar, SCRATCH_ENCODE, 2 * size + 16);
+	size_t ops_size = encode_ops(ops, data, size, NULL, 0);
+	uint64_t depth = 0;
+
+	struct blob base;
+	if (base_off && blob_at(ar, base_off, &base) == 0 && base.depth < ARCHIVE_MAX_DEPTH) {
+		const uint8_t *bd;
+		size_t bn;
+		if (blob_decode(ar, base_off, 0, &bd, &bn) == 0) {
+			uint8_t *delta = scratch(ar, SCRATCH_ENCODE + 1, 2 * size + 16);
+			size_t delta_size = encode_ops(delta, data, size, bd, bn);
+			if (delta_size < ops_size) {
+				ops = delta;
+				ops_size = delta_size;
+				depth = base.depth + 1;
+			}
+		}
+	}
+
+	uint8_t head[8 + 3 * 10];
+	size_t n = 8;
+	memcpy(head, &hash, 8);
+	n += put_varint(head + n, size);
+	n += put_varint(head + n, depth);
+	if (depth)
+		n += put_varint(head + n, base_off);
+
+	off = record_append(ar, RECORD_BLOB, head, n, ops, ops_size);
+	if (off)
+		blob_insert(ar, hash, off);
+	return off;
+}
+
+/* Remembers the chunks of turn n as the delta bases for the next one */
+static int remember_turn(struct archive *ar, int n)
+{
+	struct turn t;
+	const uint8_t *head;
+	size_t head_size;
+	struct chunk *c;
+	uint64_t ref;
+
+	ar->last_count = 0;
+	if (log_map(ar, ar->end) == -1 || turn_at(ar, n, &t) == -1)
+		return -1;
+
+	const uint8_t *p = t.refs;
+	if (get_varint(&p, t.end, &ref) == -1 || blob_decode(ar, ref, 0, &head, &head_size) == -1)
+		return -1;
+
+	/* Only the head is needed to cut the save into chunks again */
+	uint8_t *file = (uint8_t *) calloc(1, t.size > head_size ? t.size : head_size);
+	memcpy(file, head, head_size);
+	int count = savegame_chunks(file, t.size, &c);
+	free(file);
+	if (count == -1 || (uint64_t) count != t.count) {
+		if (count != -1)
+			free(c);
+		errno = EINVAL;
+		return -1;
+	}
+
+	ar->last = (uint64_t *) realloc(ar->last, sizeof (uint64_t) * count);
+	ar->last_slot = (uint32_t *) realloc(ar->last_slot, sizeof (uint32_t) * count);
+
+	p = t.refs;
+	for (int i = 0; i < count; ++i) {
+		if (get_varint(&p, t.end, &ar->last[i]) == -1) {
+			free(c);
+			return -1;
+		}
+		ar->last_slot[i] = c[i].slot;
+	}
+	ar->last_count = count;
+
+	free(c);
+	return 0;
+}
+
+int archive_append(struct archive *ar, const char *name, const uint8_t *data, size_t size)
+{
+	struct chunk *c;
+	int count = savegame_chunks(data, size, &c);
+	if (count == -1)
+		return -1;
+
+	size_t name_len = strlen(name) + 1;
+	uint8_t *rec = (uint8_t *) malloc(name_len + 10 * (count + 3));
+	size_t n = 0;
+
+	n += put_varint(rec + n, name_len);
+	memcpy(rec + n, name, name_len);
+	n += name_len;
+	n += put_varint(rec + n, size);
+	n += put_varint(rec + n, count);
+
+	/* Chunks and the previous turn's are both in slot order */
+	int k = 0;
+	for (int i = 0; i < count; ++i) {
+		while (k < ar->last_count && ar->last_slot[k] < c[i].slot)
+			++k;
+		uint64_t base = (k < ar->last_count && ar->last_slot[k] == c[i].slot) ? ar->last[k] : 0;
+
+		uint64_t off = blob_store(ar, data + c[i].offset, c[i].size, base);
+		if (!off) {
+			free(rec);
+			free(c);
+			return -1;
+		}
+		n += put_varint(rec + n, off);
+	}
+
+	uint64_t off = record_append(ar, RECORD_TURN, rec, n, NULL, 0);
+	free(rec);
+	free(c);
+	if (!off)
+		return -1;
+
+	if (write_full(ar->idx_fd, &off, sizeof (off), (off_t) ar->turn_count * sizeof (off)) == -1)
+		return -1;
+
+	add_turn(ar, off);
+
+	return remember_turn(ar, ar->turn_count - 1);
+}
+
+/*
+ * Opening
+ */
+
+/* Reads the turn offsets from the index, 0 if it matches the log */
+static int load_index(struct archive *ar)
+{
+	struct stat st;
+	if (ar->idx_fd == -1 || fstat(ar->idx_fd, &st) == -1 || st.st_size % sizeof (uint64_t))
+		return -1;
+
+	int count = st.st_size / sizeof (uint64_t);
+	ar->turn_count = 0;
+	ar->turn_cap = count;
+	ar->turn = (uint64_t *) realloc(ar->turn, sizeof (uint64_t) * (count + 1));
+	if (count && pread(ar->idx_fd, ar->turn, st.st_size, 0) != st.st_size)
+		return -1;
+	ar->turn_count = count;
+
+	/* The last turn must be the last record in the log */
+	struct record r;
+	if (count == 0)
+		return (ar->end == ARCHIVE_MAGIC_SIZE) ? 0 : -1;
+	if (record_at(ar, ar->turn[count - 1], &r) == -1 || r.tag != RECORD_TURN || r.next != ar->end)
+		return -1;
+	return 0;
+}
+
+/* Walks the log, collecting blobs and turns, and cuts off a torn last record */
+static int scan_log(struct archive *ar)
+{
+	size_t off = ARCHIVE_MAGIC_SIZE, good = off;
+	struct record r;
+
+	ar->turn_count = 0;
+	while (record_at(ar, off, &r) == 0) {
+		if (r.tag == RECORD_BLOB && r.end - r.data >= 8) {
+			uint64_t hash;
+			memcpy(&hash, r.data, 8);
+			if (ar->writable)
+				blob_insert(ar, hash, off);
+		} else if (r.tag == RECORD_TURN) {
+			add_turn(ar, off);
+			good = r.next;
+		} else {
+			break;
+		}
+		off = r.next;
+	}
+
+	/* Blobs after the last turn belong to an append that didn't finish */
+	if (ar->writable && good != ar->end) {
+		if (ftruncate(ar->fd, good) == -1)
+			return -1;
+		ar->end = good;
+		if (ar->map_size > good) {
+			munmap(ar->map, ar->map_size);
+			ar->map = NULL;
+			ar->map_size = 0;
+		}
+		ar->blob_count = 0;
+		memset(ar->blob, 0, sizeof (*ar->blob) * ar->blob_cap);
+		for (off = ARCHIVE_MAGIC_SIZE; off < good; off = r.next) {
+			record_at(ar, off, &r);
+			if (r.tag == RECORD_BLOB) {
+				uint64_t hash;
+				memcpy(&hash, r.data, 8);
+				blob_insert(ar, hash, off);
+			}
+		}
+	}
+
+	return 0;
+}
+
+int archive_open(struct archive *ar, const char *path, int writable)
+{
+	memset(ar, 0, sizeof (*ar));
+	ar->idx_fd = -1;
+	ar->writable = writable;
+
+	ar->fd = open(path, writable ? O_RDWR | O_CREAT : O_RDONLY, 0666);
+	if (ar->fd == -1)
+		return -1;
+
+	struct stat st;
+	if (fstat(ar->fd, &st) == -1)
+		goto fail;
+
+	if (st.st_size == 0 && writable) {
+		if (write_full(ar->fd, ARCHIVE_MAGIC, ARCHIVE_MAGIC_SIZE, 0) == -1)
+			goto fail;
+		st.st_size = ARCHIVE_MAGIC_SIZE;
+	}
+	ar->end = st.st_size;
+
+	if (ar->end < ARCHIVE_MAGIC_SIZE || log_map(ar, ar->end) == -1 ||
+	    memcmp(ar->map, ARCHIVE_MAGIC, ARCHIVE_MAGIC_SIZE) != 0) {
+		errno = EINVAL;
+		goto fail;
+	}
+
+	{
+		char idx[PATH_MAX];
+		snprintf(idx, sizeof (idx), "%s.idx", path);
+		ar->idx_fd = open(idx, writable ? O_RDWR | O_CREAT : O_RDONLY, 0666);
+		if (ar->idx_fd == -1 && writable)
+			goto fail;
+	}
+
+	/* Appending needs every blob hash, so it always walks the log */
+	if (writable || load_index(ar) == -1) {
+		if (scan_log(ar) == -1)
+			goto fail;
+
+		if (writable) {
+			if (ftruncate(ar->idx_fd, 0) == -1 ||
+			    write_full(ar->idx_fd, ar->turn, sizeof (uint64_t) * ar->turn_count, 0) == -1)
+				goto fail;
+		}
+	}
+
+	if (writable && ar->turn_count > 0 && remember_turn(ar, ar->turn_count - 1) == -1)
+		goto fail;
+
+	return 0;
+
+fail:
+	int saved_errno = errno;
+	archive_close(ar);
+	errno = saved_errno;
+	return -1;
+}
+
+void archive_close(struct archive *ar)
+{
+	if (ar->map)
+		munmap(ar->map, ar->map_size);
+	if (ar->fd != -1)
+		close(ar->fd);
+	if (ar->idx_fd != -1)
+		close(ar->idx_fd);
+
+	free(ar->turn);
+	free(ar->blob);
+	free(ar->last);
+	free(ar->last_slot);
+	for (int i = 0; i < ARCHIVE_SCRATCH; ++i)
+		free(ar->scratch[i]);
+
+	memset(ar, 0, sizeof (*ar));
+	ar->fd = -1;
+	ar->idx_fd = -1;
+}
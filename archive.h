@@ -0,0 +1,75 @@
+#ifndef ARCHIVE_H
+#define ARCHIVE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "loader.h"
+
+/*
+ * Append-only savegame archive, for keeping every autosave of a campaign.
+ *
+ * The archive is a log of records. Each save added is cut into chunks along
+ * its sections (head, each player, colony, nation, indian and trade route
+ * record, the unit and tribe lists, the map in blocks of rows, ...), and
+ * every chunk not already in the log is appended as a blob, encoded as the
+ * bytes that differ from the same chunk of the previous save. A turn record
+ * then lists the blobs a save is made of. Identical chunks are found by
+ * content hash and stored once.
+ *
+ * Next to the log, <archive>.idx holds the offset of every turn record, so
+ * any save is restored with one index lookup and a bounded number of blob
+ * decodes (delta chains are cut at ARCHIVE_MAX_DEPTH).
+ */
+
+#define ARCHIVE_MAX_DEPTH 8
+#define ARCHIVE_SCRATCH   (ARCHIVE_MAX_DEPTH + 3) // a buffer per decode level, two to encode into
+
+struct archive_blob; // hash table entry
+
+struct archive {
+	int fd;
+	int idx_fd;
+	int writable;
+
+	uint8_t *map;     // read-only mapping of the log, remapped as it grows
+	size_t map_size;
+	size_t end;       // log size
+
+	uint64_t *turn;   // turn record offsets
+	int turn_count;
+	int turn_cap;
+
+	/* For appending: blobs by content hash, and the previous save's chunks */
+	struct archive_blob *blob;
+	size_t blob_cap;
+	size_t blob_count;
+	uint64_t *last;
+	uint32_t *last_slot;
+	int last_count;
+
+	uint8_t *scratch[ARCHIVE_SCRATCH];
+	size_t scratch_cap[ARCHIVE_SCRATCH];
+};
+
+/*
+ * Opens the archive at path, creating it if writable. A log with a torn
+ * record at the end (from a crash during an append) is cut back to its last
+ * whole record, and a missing or stale index is rebuilt.
+ *
+ * Returns 0 on success, -1 with errno set.
+ */
+int archive_open(struct archive *ar, const char *path, int writable);
+void archive_close(struct archive *ar);
+
+/* Appends size bytes of savegame data as a new turn. Returns 0 or -1 with errno set */
+int archive_append(struct archive *ar, const char *name, const uint8_t *data, size_t size);
+
+/*
+ * Restores turn n into buf, byte for byte as it was added. Sets *size and
+ * *name (the name it was added under, owned by the archive). Returns 0, or
+ * -1 with errno set (EINVAL for a damaged archive).
+ */
+int archive_extract(struct archive *ar, int n, struct savegame_buffer *buf, size_t *size, const char **name);
+
+#endif
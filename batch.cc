@@ -0,0 +1,162 @@
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "batch.h"
+#include "stats.h"
+
+/* How far ahead of the output the workers may run, per worker */
+#define BATCH_WINDOW 4
+
+struct batch_result {
+	struct sink *out;
+	int status;
+	int done;
+};
+
+struct batch {
+	int (*fn)(int index, struct sink *out, void *arg);
+	void *arg;
+
+	int count;
+	int next;    // next index to hand out
+	int emitted; // results [0, emitted) are written to stdout
+	int window;
+	int failed;
+
+	struct batch_result *result;
+
+	/* Emitted sinks are kept for reuse, so buffers are allocated once */
+	struct sink **spare;
+	int spare_count;
+
+	pthread_mutex_t lock;
+	pthread_cond_t  cond;
+};
+
+static void *batch_worker(void *data)
+{
+	struct batch *b = (struct batch *) data;
+
+	pthread_mutex_lock(&b->lock);
+	for (;;) {
+		while (!b->failed && b->next < b->count && b->next >= b->emitted + b->window)
+			pthread_cond_wait(&b->cond, &b->lock);
+
+		if (b->failed || b->next >= b->count)
+			break;
+
+		int i = b->next++;
+
+		struct sink *out;
+		if (b->spare_count > 0) {
+			out = b->spare[--b->spare_count];
+		} else {
+			out = (struct sink *) malloc(sizeof (struct sink));
+			stats_allocs(1);
+			sink_init(out, -1);
+		}
+		pthread_mutex_unlock(&b->lock);
+
+		int status = b->fn(i, out, b->arg);
+
+		pthread_mutex_lock(&b->lock);
+		b->result[i].out = out;
+		b->result[i].status = status;
+		b->result[i].done = 1;
+		pthread_cond_broadcast(&b->cond);
+	}
+	pthread_mutex_unlock(&b->lock);
+
+	return NULL;
+}
+
+int batch_run(int jobs, int count, int (*fn)(int index, struct sink *out, void *arg), void *arg)
+{
+	fflush(stdout);
+
+	if (jobs <= 1) {
+		struct sink out;
+		int status = 0;
+
+		sink_init(&out, STDOUT_FILENO);
+		for (int i = 0; i < count && status == 0; ++i) {
+			status = fn(i, &out, arg);
+			sink_flush(&out);
+		}
+		sink_free(&out);
+
+		return status;
+	}
+
+	struct batch b;
+	b.fn      = fn;
+	b.arg     = arg;
+	b.count   = count;
+	b.next    = 0;
+	b.emitted = 0;
+	b.window  = jobs * BATCH_WINDOW;
+	b.failed  = 0;
+	b.result  = (struct batch_result *) calloc(count, sizeof (struct batch_result));
+	b.spare   = (struct sink **) calloc(b.window + jobs, sizeof (struct sink *));
+	b.spare_count = 0;
+	pthread_mutex_init(&b.lock, NULL);
+	pthread_cond_init(&b.cond, NULL);
+
+	pthread_t *thread = (pthread_t *) calloc(jobs, sizeof (pthread_t));
+	for (int t = 0; t < jobs; ++t)
+		pthread_create(&thread[t], NULL, batch_worker, &b);
+
+	int status = 0;
+
+	for (int i = 0; i < count; ++i) {
+		struct batch_result *r = &b.result[i];
+
+		pthread_mutex_lock(&b.lock);
+		while (!r->done)
+			pthread_cond_wait(&b.cond, &b.lock);
+		pthread_mutex_unlock(&b.lock);
+
+		r->out->fd = STDOUT_FILENO;
+		sink_flush(r->out);
+		r->out->fd = -1;
+
+		pthread_mutex_lock(&b.lock);
+		b.spare[b.spare_count++] = r->out;
+		r->out = NULL;
+		b.emitted = i + 1;
+		if (r->status) {
+			status = r->status;
+			b.failed = 1;
+		}
+		pthread_cond_broadcast(&b.cond);
+		pthread_mutex_unlock(&b.lock);
+
+		if (status)
+			break;
+	}
+
+	for (int t = 0; t < jobs; ++t)
+		pthread_join(thread[t], NULL);
+
+	/* Results finished after a failure are dropped */
+	for (int i = 0; i < count; ++i) {
+		if (b.result[i].out) {
+			sink_free(b.result[i].out);
+			free(b.result[i].out);
+		}
+	}
+	for (int i = 0; i < b.spare_count; ++i) {
+		sink_free(b.spare[i]);
+		free(b.spare[i]);
+	}
+
+	pthread_cond_destroy(&b.cond);
+	pthread_mutex_destroy(&b.lock);
+	free(thread);
+	free(b.spare);
+	free(b.result);
+
+	return status;
+}
@@ -0,0 +1,19 @@
+#ifndef BATCH_H
+#define BATCH_H
+
+#include "sink.h"
+
+/*
+ * Runs fn(index, out, arg) for every index in [0, count) on a pool of
+ * jobs worker threads. Each call writes into its own sink, and the sinks
+ * are written to stdout in index order, so the output is the same as
+ * calling fn in a loop on a stdout sink. Indices are handed out
+ * one at a time, so a few slow entries don't leave the other workers idle.
+ *
+ * If fn returns non-zero, its output is still emitted, but nothing after
+ * it, and batch_run() returns that value. With jobs <= 1 fn runs on the
+ * calling thread, on one stdout sink flushed after every index.
+ */
+int batch_run(int jobs, int count, int (*fn)(int index, struct sink *out, void *arg), void *arg);
+
+#endif
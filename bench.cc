@@ -0,0 +1,524 @@
+/*
+ * savegame-bench: times the loader, every print_* function, the --colony10
+ * writer and whole batch runs, over a corpus of synthetic savegames that
+ * is the same for the same --seed on any machine.
+ *
+ * Each benchmark is one pass over the corpus, run --warmup times untimed
+ * and then --runs times, and reported as percentiles of the pass time.
+ * --format=tsv writes the same numbers for a script; --compare with such a
+ * file from another build adds the change of each median.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/param.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "savegame.h"
+#include "generate.h"
+#include "loader.h"
+#include "patch.h"
+#include "print.h"
+#include "sink.h"
+#include "spatial.h"
+#include "stats.h"
+
+/* savegame.cc */
+int savegame_main(int argc, char *argv[]); // main, renamed by SAVEGAME_MAIN
+
+enum bench_kind { BENCH_LOAD, BENCH_PRINT, BENCH_COLONY10, BENCH_BATCH };
+
+enum {
+	LOAD_OPEN, LOAD_HEAD, LOAD_COPY,
+};
+
+enum {
+	PRINT_HEAD, PRINT_PLAYER, PRINT_OTHER, PRINT_COLONY, PRINT_UNIT, PRINT_NATION, PRINT_TRIBE,
+	PRINT_INDIAN, PRINT_STUFF, PRINT_MAP, PRINT_TAIL, PRINT_ROUTE, PRINT_TERRAIN, PRINT_NEAR,
+	PRINT_MANIFEST, PRINT_TOTALS, PRINT_TERRITORY, PRINT_PATH,
+};
+
+static const struct bench {
+	const char *name;
+	enum bench_kind kind;
+	int which; // LOAD_ or PRINT_, or the jobs of a batch run (0 for --jobs)
+} benches[] = {
+	{ "load.open",      BENCH_LOAD,  LOAD_OPEN },
+	{ "load.head",      BENCH_LOAD,  LOAD_HEAD },
+	{ "load.copy",      BENCH_LOAD,  LOAD_COPY },
+	{ "print.head",     BENCH_PRINT, PRINT_HEAD },
+	{ "print.player",   BENCH_PRINT, PRINT_PLAYER },
+	{ "print.other",    BENCH_PRINT, PRINT_OTHER },
+	{ "print.colony",   BENCH_PRINT, PRINT_COLONY },
+	{ "print.unit",     BENCH_PRINT, PRINT_UNIT },
+	{ "print.nation",   BENCH_PRINT, PRINT_NATION },
+	{ "print.tribe",    BENCH_PRINT, PRINT_TRIBE },
+	{ "print.indian",   BENCH_PRINT, PRINT_INDIAN },
+	{ "print.stuff",    BENCH_PRINT, PRINT_STUFF },
+	{ "print.map",      BENCH_PRINT, PRINT_MAP },
+	{ "print.tail",     BENCH_PRINT, PRINT_TAIL },
+	{ "print.route",    BENCH_PRINT, PRINT_ROUTE },
+	{ "print.terrain",  BENCH_PRINT, PRINT_TERRAIN },
+	{ "print.near",     BENCH_PRINT, PRINT_NEAR },
+	{ "print.manifest", BENCH_PRINT, PRINT_MANIFEST },
+	{ "print.totals",   BENCH_PRINT, PRINT_TOTALS },
+	{ "print.territory", BENCH_PRINT, PRINT_TERRITORY },
+	{ "print.path",     BENCH_PRINT, PRINT_PATH },
+	{ "colony10",       BENCH_COLONY10, 0 },
+	{ "batch.j1",       BENCH_BATCH, 1 },
+	{ "batch.jN",       BENCH_BATCH, 0 },
+};
+
+#define BENCH_COUNT ((int) (sizeof (benches) / sizeof (benches[0])))
+
+static int opt_runs = 25, opt_warmup = 3, opt_files = 64, opt_jobs = 0;
+static uint64_t opt_seed = 1;
+static const char *opt_corpus = NULL, *opt_filter = NULL, *opt_compare = NULL;
+static int opt_tsv = 0;
+
+struct corpus {
+	char dir[PATH_MAX];
+	int keep; // --corpus, rather than a temporary directory
+
+	int count;
+	char **path;
+	size_t bytes;
+	uint64_t hash;
+
+	/* Every file read once, for the print benchmarks */
+	struct savegame_view *sv;
+	struct savegame_buffer *buf;
+};
+
+/* A file in the corpus directory: the directory, a slash and a short name */
+#define CORPUS_PATH_MAX (PATH_MAX + 32)
+
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static void print_help(const char *prog)
+{
+	printf("Usage: %s [options]\n", prog);
+	printf("  -n, --runs=N         timed passes of each benchmark (%d)\n", opt_runs);
+	printf("  -w, --warmup=N       untimed passes before them (%d)\n", opt_warmup);
+	printf("  -f, --files=N        savegames in the corpus (%d)\n", opt_files);
+	printf("  -s, --seed=N         seed of the corpus (%llu)\n", (unsigned long long) opt_seed);
+	printf("  -j, --jobs=N         workers of batch.jN (online CPUs)\n");
+	printf("  -b, --bench=TEXT     only the benchmarks with TEXT in their name\n");
+	printf("      --corpus=DIR     write the corpus to DIR and keep it\n");
+	printf("      --format=tsv     tab separated, nanoseconds per pass\n");
+	printf("      --compare=FILE   change of each median against an earlier --format=tsv\n");
+	printf("  -h, --help           this help\n");
+}
+
+/* The shape of file i, so the corpus has every size of each section */
+static void corpus_shape(int i, struct generate_options *go)
+{
+	go->colonies = (i * 7) % 49;
+	go->units    = (i * 37) % 301;
+	go->tribes   = (i * 13) % 61;
+	go->routes   = i % 13;
+	go->flips    = 0;
+}
+
+static int corpus_create(struct corpus *c)
+{
+	if (opt_corpus) {
+		c->keep = 1;
+		if (snprintf(c->dir, sizeof (c->dir), "%s", opt_corpus) >= (int) sizeof (c->dir)) {
+			fprintf(stderr, "Corpus directory name too long: %s\n", opt_corpus);
+			return -1;
+		}
+		if (mkdir(c->dir, 0777) == -1 && errno != EEXIST) {
+			fprintf(stderr, "Could not create %s: %s\n", c->dir, strerror(errno));
+			return -1;
+		}
+	} else {
+		const char *tmp = getenv("TMPDIR");
+		snprintf(c->dir, sizeof (c->dir), "%s/savegame-bench.XXXXXX", tmp ? tmp : "/tmp");
+		if (!mkdtemp(c->dir)) {
+			fprintf(stderr, "Could not create %s: %s\n", c->dir, strerror(errno));
+			return -1;
+		}
+	}
+
+	c->count = opt_files;
+	c->path = (char **) calloc(c->count, sizeof (char *));
+	c->sv = (struct savegame_view *) calloc(c->count, sizeof (struct savegame_view));
+	c->buf = (struct savegame_buffer *) calloc(c->count, sizeof (struct savegame_buffer));
+
+	for (int i = 0; i < c->count; ++i) {
+		struct generate_options go;
+		corpus_shape(i, &go);
+
+		size_t n = generate_savegame(opt_seed * 1000003 + i, &go, &c->sv[i], &c->buf[i]);
+		c->bytes += n;
+		c->hash = c->hash * 31 + content_hash(c->buf[i].data, n);
+
+		char path[CORPUS_PATH_MAX];
+		snprintf(path, sizeof (path), "%s/SYNTH%03d.SAV", c->dir, i);
+		c->path[i] = strdup(path);
+
+		FILE *fp = fopen(path, "w");
+		int ok = fp && fwrite(c->buf[i].data, n, 1, fp) == 1;
+		if (fp && fclose(fp) != 0)
+			ok = 0;
+		if (!ok) {
+			fprintf(stderr, "Could not write %s\n", path);
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
+static void corpus_remove(struct corpus *c)
+{
+	char path[CORPUS_PATH_MAX];
+
+	if (c->keep)
+		return;
+
+	for (int i = 0; i < c->count; ++i)
+		if (c->path[i])
+			unlink(c->path[i]);
+	snprintf(path, sizeof (path), "%s/COLONY10.SAV", c->dir);
+	unlink(path);
+	rmdir(c->dir);
+}
+
+static void print_section(int which, struct sink *out, const struct savegame_view *sv, const char *filename)
+{
+	static struct spatial_index si;
+
+	switch (which) {
+		case PRINT_HEAD:     print_head(out, sv); break;
+		case PRINT_PLAYER:   print_player(out, sv); break;
+		case PRINT_OTHER:    print_other(out, sv); break;
+		case PRINT_COLONY:   print_colony(out, sv); break;
+		case PRINT_UNIT:     print_unit(out, sv); break;
+		case PRINT_NATION:   print_nation(out, sv); break;
+		case PRINT_TRIBE:    print_tribe(out, sv); break;
+		case PRINT_INDIAN:   print_indian(out, sv); break;
+		case PRINT_STUFF:    print_stuff(out, sv); break;
+		case PRINT_MAP:      print_map(out, sv); break;
+		case PRINT_TAIL:     print_tail(out, sv); break;
+		case PRINT_ROUTE:    print_route(out, sv); break;
+		case PRINT_TERRAIN:  print_terrain(out, sv, filename); break;
+		case PRINT_MANIFEST: print_manifest(out, sv); break;
+		case PRINT_TOTALS:   print_totals(out, sv, filename); break;
+		case PRINT_TERRITORY: print_territory(out, sv, filename); break;
+		case PRINT_PATH:     print_path(out, sv, filename); break;
+		case PRINT_NEAR:
+			spatial_build(&si, sv);
+			print_near(out, sv, &si, 3);
+			break;
+	}
+}
+
+/*
+ * A plain "savegame -j JOBS <every section> FILE..." over the corpus, run
+ * by the tool's own main, so what is timed is its process_file()
+ */
+static int batch_pass(struct corpus *c, int jobs)
+{
+	static const char *const sections[] = { "-H", "-p", "-o", "-c", "-u", "-n", "-t", "-i", "-s", "-m", "-T", "-r" };
+	static char **argv;
+	char jobs_arg[16];
+	int argc = 0;
+
+	if (!argv)
+		argv = (char **) calloc(c->count + sizeof (sections) / sizeof (sections[0]) + 3, sizeof (char *));
+
+	snprintf(jobs_arg, sizeof (jobs_arg), "-j%d", jobs);
+	argv[argc++] = (char *) "savegame";
+	argv[argc++] = jobs_arg;
+	for (size_t i = 0; i < sizeof (sections) / sizeof (sections[0]); ++i)
+		argv[argc++] = (char *) sections[i];
+	for (int i = 0; i < c->count; ++i)
+		argv[argc++] = c->path[i];
+	argv[argc] = NULL;
+
+	optind = 0; // getopt_long() starts over
+	return savegame_main(argc, argv) == EXIT_SUCCESS ? 0 : -1;
+}
+
+/* One pass of b over the corpus */
+static int run_pass(const struct bench *b, struct corpus *c)
+{
+	static struct savegame_buffer buf;
+	static struct sink out;
+	static struct patch *colony10;
+	static struct patch_writer *writer;
+	static struct patch_dirty dirty;
+	struct savegame_view sv;
+	struct savegame_select sel;
+	char path[CORPUS_PATH_MAX];
+
+	switch (b->kind) {
+		case BENCH_LOAD:
+			savegame_select_none(&sel);
+			for (int i = 0; i < c->count; ++i) {
+				int res;
+				if (b->which == LOAD_OPEN)
+					res = savegame_open(c->path[i], &sv);
+				else if (b->which == LOAD_HEAD)
+					res = savegame_read(c->path[i], &sv, &sel, &buf);
+				else
+					res = savegame_copy(c->path[i], &sv, &buf);
+				if (res == -1)
+					return -1;
+				if (b->which != LOAD_COPY)
+					savegame_close(&sv);
+			}
+			return 0;
+
+		case BENCH_PRINT:
+			if (!out.buf)
+				sink_init(&out, -1);
+			for (int i = 0; i < c->count; ++i) {
+				out.len = 0;
+				print_section(b->which, &out, &c->sv[i], c->path[i]);
+			}
+			return 0;
+
+		case BENCH_COLONY10:
+			if (!colony10 && !(colony10 = patch_compile(patch_colony10, "--colony10")))
+				return -1;
+			if (!writer)
+				writer = patch_writer_new(0);
+			snprintf(path, sizeof (path), "%s/COLONY10.SAV", c->dir);
+			for (int i = 0; i < c->count; ++i) {
+				if (savegame_open(c->path[i], &sv, SAVEGAME_PRIVATE) == -1)
+					return -1;
+				patch_apply(colony10, &sv, &dirty);
+				int res = patch_writer_put(writer, &sv, &dirty, c->path[i], path);
+				savegame_close(&sv);
+				if (res == -1)
+					return -1;
+			}
+			return 0;
+
+		case BENCH_BATCH:
+			return batch_pass(c, b->which ? b->which : opt_jobs);
+	}
+
+	return -1;
+}
+
+struct result {
+	int runs;
+	uint64_t min, p50, p90, p99, max, mean;
+};
+
+static int run_bench(const struct bench *b, struct corpus *c, struct result *r)
+{
+	uint64_t *sample = (uint64_t *) malloc(sizeof (uint64_t) * opt_runs);
+	int devnull = -1, saved = -1, res = 0;
+
+	/* Batch runs write to stdout, which is where the report goes */
+	if (b->kind == BENCH_BATCH) {
+		fflush(stdout);
+		devnull = open("/dev/null", O_WRONLY);
+		saved = dup(STDOUT_FILENO);
+		dup2(devnull, STDOUT_FILENO);
+	}
+
+	for (int i = 0; i < opt_warmup && res == 0; ++i)
+		res = run_pass(b, c);
+
+	for (int i = 0; i < opt_runs && res == 0; ++i) {
+		uint64_t start = now_ns();
+		res = run_pass(b, c);
+		sample[i] = now_ns() - start;
+	}
+
+	if (saved != -1) {
+		dup2(saved, STDOUT_FILENO);
+		close(saved);
+		close(devnull);
+	}
+
+	if (res) {
+		fprintf(stderr, "%s: failed\n", b->name);
+		free(sample);
+		return -1;
+	}
+
+	stats_sort(sample, opt_runs);
+
+	uint64_t sum = 0;
+	for (int i = 0; i < opt_runs; ++i)
+		sum += sample[i];
+
+	r->runs = opt_runs;
+	r->min  = sample[0];
+	r->p50  = stats_percentile(sample, opt_runs, 50);
+	r->p90  = stats_percentile(sample, opt_runs, 90);
+	r->p99  = stats_percentile(sample, opt_runs, 99);
+	r->max  = sample[opt_runs - 1];
+	r->mean = sum / opt_runs;
+
+	free(sample);
+	return 0;
+}
+
+/* Medians of an earlier --format=tsv, by benchmark; 0 for the ones it doesn't have */
+static int read_compare(const char *path, uint64_t corpus_hash, uint64_t *p50)
+{
+	FILE *fp = fopen(path, "r");
+	char line[512];
+
+	if (!fp) {
+		fprintf(stderr, "Could not open %s: %s\n", path, strerror(errno));
+		return -1;
+	}
+
+	while (fgets(line, sizeof (line), fp)) {
+		char name[64];
+		unsigned long long hash, runs, min, median;
+
+		if (sscanf(line, "# corpus %llx", &hash) == 1) {
+			if (hash != corpus_hash)
+				fprintf(stderr, "%s: made from another corpus, compare with care\n", path);
+			continue;
+		}
+		if (sscanf(line, "%63s %llu %llu %llu", name, &runs, &min, &median) != 4)
+			continue;
+		for (int i = 0; i < BENCH_COUNT; ++i)
+			if (strcmp(benches[i].name, name) == 0)
+				p50[i] = median;
+	}
+
+	fclose(fp);
+	return 0;
+}
+
+int main(int argc, char *argv[])
+{
+	enum { OPT_CORPUS = 0x100, OPT_FORMAT, OPT_COMPARE };
+	int c, optindex = 0;
+
+	static struct option long_options[] = {
+		{ "runs",    required_argument, NULL, 'n' },
+		{ "warmup",  required_argument, NULL, 'w' },
+		{ "files",   required_argument, NULL, 'f' },
+		{ "seed",    required_argument, NULL, 's' },
+		{ "jobs",    required_argument, NULL, 'j' },
+		{ "bench",   required_argument, NULL, 'b' },
+		{ "corpus",  required_argument, NULL, OPT_CORPUS },
+		{ "format",  required_argument, NULL, OPT_FORMAT },
+		{ "compare", required_argument, NULL, OPT_COMPARE },
+		{ "help",    no_argument,       NULL, 'h' },
+		{ NULL,      no_argument,       NULL, 0 }
+	};
+
+	while ((c = getopt_long(argc, argv, "n:w:f:s:j:b:h", long_options, &optindex)) != -1) {
+		switch (c) {
+			case 'n': opt_runs   = atoi(optarg); break;
+			case 'w': opt_warmup = atoi(optarg); break;
+			case 'f': opt_files  = atoi(optarg); break;
+			case 's': opt_seed   = strtoull(optarg, NULL, 0); break;
+			case 'j': opt_jobs   = atoi(optarg); break;
+			case 'b': opt_filter = optarg; break;
+
+			case OPT_CORPUS:  opt_corpus  = optarg; break;
+			case OPT_COMPARE: opt_compare = optarg; break;
+			case OPT_FORMAT:
+				if (strcmp(optarg, "tsv") == 0)
+					opt_tsv = 1;
+				else if (strcmp(optarg, "text") == 0)
+					opt_tsv = 0;
+				else {
+					fprintf(stderr, "Unknown format: %s\n", optarg);
+					exit(EXIT_FAILURE);
+				}
+				break;
+
+			case 'h':
+				print_help(argv[0]);
+				exit(EXIT_SUCCESS);
+			default:
+				print_help(argv[0]);
+				exit(EXIT_FAILURE);
+		}
+	}
+
+	if (opt_runs < 1 || opt_warmup < 0 || opt_files < 1) {
+		fprintf(stderr, "--runs and --files need to be at least 1\n");
+		exit(EXIT_FAILURE);
+	}
+	if (opt_jobs < 1)
+		opt_jobs = MAX(sysconf(_SC_NPROCESSORS_ONLN), 1);
+
+	struct corpus corpus;
+	memset(&corpus, 0, sizeof (corpus));
+	if (corpus_create(&corpus) == -1) {
+		corpus_remove(&corpus);
+		exit(EXIT_FAILURE);
+	}
+
+	uint64_t before[BENCH_COUNT] = { 0 };
+	if (opt_compare && read_compare(opt_compare, corpus.hash, before) == -1) {
+		corpus_remove(&corpus);
+		exit(EXIT_FAILURE);
+	}
+
+	if (opt_tsv) {
+		printf("# corpus %016llx files %d bytes %zu seed %llu runs %d warmup %d jobs %d\n",
+			(unsigned long long) corpus.hash, corpus.count, corpus.bytes,
+			(unsigned long long) opt_seed, opt_runs, opt_warmup, opt_jobs);
+		printf("# name\truns\tmin_ns\tp50_ns\tp90_ns\tp99_ns\tmax_ns\tmean_ns\n");
+	} else {
+		printf("%d files, %zu bytes, corpus %016llx, %d runs after %d warm-up, batch.jN with %d jobs\n",
+			corpus.count, corpus.bytes, (unsigned long long) corpus.hash, opt_runs, opt_warmup, opt_jobs);
+		printf("%-16s %10s %10s %10s %10s %10s %8s%s\n", "benchmark", "min us", "p50 us", "p90 us",
+			"p99 us", "max us", "MB/s", opt_compare ? "   p50 change" : "");
+	}
+	fflush(stdout);
+
+	int failed = 0;
+	for (int i = 0; i < BENCH_COUNT; ++i) {
+		const struct bench *b = &benches[i];
+		struct result r;
+
+		if (opt_filter && !strstr(b->name, opt_filter))
+			continue;
+
+		if (run_bench(b, &corpus, &r) == -1) {
+			failed = 1;
+			continue;
+		}
+
+		if (opt_tsv) {
+			printf("%s\t%d\t%llu\t%llu\t%llu\t%llu\t%llu\t%llu\n", b->name, r.runs,
+				(unsigned long long) r.min, (unsigned long long) r.p50, (unsigned long long) r.p90,
+				(unsigned long long) r.p99, (unsigned long long) r.max, (unsigned long long) r.mean);
+		} else {
+			printf("%-16s %10.1f %10.1f %10.1f %10.1f %10.1f %8.1f", b->name,
+				r.min / 1e3, r.p50 / 1e3, r.p90 / 1e3, r.p99 / 1e3, r.max / 1e3,
+				corpus.bytes / (r.p50 / 1e9) / 1e6);
+			if (opt_compare && before[i])
+				printf("   %+10.1f%%", 100.0 * ((double) r.p50 - before[i]) / before[i]);
+			putchar('\n');
+		}
+		fflush(stdout);
+	}
+
+	for (int i = 0; i < corpus.count; ++i)
+		free(corpus.buf[i].data);
+	corpus_remove(&corpus);
+
+	return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,587 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/mman.h>
+#include <sys/param.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "catalog.h"
+#include "fields.h"
+#include "loader.h"
+#include "where.h"
+
+/*
+ * File layout, native byte order:
+ *
+ *   struct catalog_header
+ *   uint64_t column_offset[columns]
+ *   the columns, rows values each at their type's width, 8-byte aligned
+ *   struct catalog_file[rows]
+ *   strings: file paths and names, nul terminated
+ *   struct catalog_name[names], sorted by kind and name ignoring case
+ *   uint32_t posting[postings], the rows of each name in ascending order
+ */
+
+#define CATALOG_MAGIC "viceroy-catalog 1\n"
+
+struct catalog_header {
+	char magic[24];
+	uint32_t rows;
+	uint32_t columns;
+	uint32_t names;
+	uint32_t postings;
+	uint64_t file_offset;
+	uint64_t string_offset;
+	uint64_t string_size;
+	uint64_t name_offset;
+	uint64_t posting_offset;
+};
+
+struct catalog_file {
+	uint64_t fingerprint; // of the sections read
+	int64_t  mtime;
+	uint32_t size;
+	uint32_t path;        // into the strings
+};
+
+enum name_kind { NAME_COLONY, NAME_PLAYER, NAME_ROUTE, NAME_KINDS };
+
+static const char *name_kind[NAME_KINDS] = { "colony", "player", "route" };
+
+struct catalog_name {
+	uint32_t kind;
+	uint32_t text;        // into the strings
+	uint32_t first;       // into the postings
+	uint32_t count;
+};
+
+/*
+ * Schema
+ */
+
+#define GETTER(fn, expr) \
+	static int64_t fn(const struct savegame_view *sv, int i, int arg) { (void) sv; (void) i; (void) arg; return (expr); }
+
+GETTER(head_get,    field_get(sv->head, 0, arg))
+GETTER(control_get, field_get(sv->player, arg, FIELD_REF(player_fields, "control"))) // arg is the player
+
+static int one_row(const struct savegame_view *sv) { (void) sv; return 1; }
+
+#define NAMES(list) list, (int) (sizeof (list) / sizeof (list[0]))
+#define NO_NAMES NULL, 0
+
+/* difficulty_list is padded for printing */
+static const char *difficulty_names[] = { "Discoverer", "Explorer", "Conquistador", "Governor", "Viceroy" };
+
+#define HEAD(name, type, field, names) { name, type, head_get, FIELD_REF(head_fields, field), names }
+#define CONTROL(name, player) { "control." name, COL_U8, control_get, player, NAMES(control_list) }
+#define FATHER(name, i) { "father." name, COL_I8, head_get, FIELD_REF(head_fields, "founding_father", i), NAMES(nation_list) }
+
+static struct column catalog_columns[] = {
+	HEAD("year",       COL_U16, "year",              NO_NAMES),
+	HEAD("autumn",     COL_U8,  "autumn",            NO_NAMES),
+	HEAD("turn",       COL_U16, "turn",              NO_NAMES),
+	HEAD("difficulty", COL_U8,  "difficulty",        NAMES(difficulty_names)),
+	HEAD("colonies",   COL_U16, "colony_count",      NO_NAMES),
+	HEAD("units",      COL_U16, "unit_count",        NO_NAMES),
+	HEAD("tribes",     COL_U16, "tribe_count",       NO_NAMES),
+	HEAD("routes",     COL_U16, "trade_route_count", NO_NAMES),
+	CONTROL("england",     0),
+	CONTROL("france",      1),
+	CONTROL("spain",       2),
+	CONTROL("netherlands", 3),
+	FATHER("adam_smith",             0),
+	FATHER("jakob_fugger",           1),
+	FATHER("peter_minuit",           2),
+	FATHER("peter_stuyvesant",       3),
+	FATHER("jan_de_witt",            4),
+	FATHER("ferdinand_magellan",     5),
+	FATHER("francisco_de_coronado",  6),
+	FATHER("hernando_de_soto",       7),
+	FATHER("henry_hudson",           8),
+	FATHER("sieur_de_la_salle",      9),
+	FATHER("hernan_cortes",         10),
+	FATHER("george_washington",     11),
+	FATHER("paul_revere",           12),
+	FATHER("francis_drake",         13),
+	FATHER("john_paul_jones",       14),
+	FATHER("thomas_jefferson",      15),
+	FATHER("pocahontas",            16),
+	FATHER("thomas_paine",          17),
+	FATHER("founding18",            18),
+	FATHER("benjamin_franklin",     19),
+	FATHER("william_brewster",      20),
+	FATHER("william_penn",          21),
+	FATHER("jean_de_brebeuf",       22),
+	FATHER("juan_de_sepulveda",     23),
+	FATHER("bartolme_de_las_casas", 24),
+};
+
+struct table catalog_table = {
+	"save", SECTION_HEAD, one_row, catalog_columns, (int) (sizeof (catalog_columns) / sizeof (catalog_columns[0]))
+};
+
+static const size_t type_size[] = { 1, 1, 2, 2, 4, 4 };
+
+static int64_t value_at(const void *data, enum column_type type, uint32_t row)
+{
+	switch (type) {
+		case COL_U8:  return ((const uint8_t  *) data)[row];
+		case COL_I8:  return ((const int8_t   *) data)[row];
+		case COL_U16: return ((const uint16_t *) data)[row];
+		case COL_I16: return ((const int16_t  *) data)[row];
+		case COL_U32: return ((const uint32_t *) data)[row];
+		case COL_I32: return ((const int32_t  *) data)[row];
+	}
+	return 0;
+}
+
+static void value_put(struct sink *s, enum column_type type, int64_t v)
+{
+	switch (type) {
+		case COL_U8:  { uint8_t  x = v; sink_write(s, &x, sizeof (x)); break; }
+		case COL_I8:  { int8_t   x = v; sink_write(s, &x, sizeof (x)); break; }
+		case COL_U16: { uint16_t x = v; sink_write(s, &x, sizeof (x)); break; }
+		case COL_I16: { int16_t  x = v; sink_write(s, &x, sizeof (x)); break; }
+		case COL_U32: { uint32_t x = v; sink_write(s, &x, sizeof (x)); break; }
+		case COL_I32: { int32_t  x = v; sink_write(s, &x, sizeof (x)); break; }
+	}
+}
+
+static void pad8(struct sink *s)
+{
+	while (s->len % 8)
+		sink_putc(s, '\0');
+}
+
+/*
+ * Building
+ */
+
+struct entry {
+	int32_t *value;          // a row of catalog_columns
+	struct catalog_file file;
+	const char *path;
+};
+
+struct name_ref {
+	uint32_t text;           // into the build's name pool
+	uint32_t row;            // entry, then row once sorted
+	uint32_t kind;
+};
+
+/* For the comparisons, which qsort gives no argument */
+static const char *name_pool;
+
+static int compare_entries(const void *a, const void *b)
+{
+	const struct entry *x = (const struct entry *) a, *y = (const struct entry *) b;
+
+	for (int c = 0; c < 3; ++c) // year, autumn, turn
+		if (x->value[c] != y->value[c])
+			return x->value[c] < y->value[c] ? -1 : 1;
+	return strcmp(x->path, y->path);
+}
+
+static int compare_names(const void *a, const void *b)
+{
+	const struct name_ref *x = (const struct name_ref *) a, *y = (const struct name_ref *) b;
+
+	if (x->kind != y->kind)
+		return x->kind < y->kind ? -1 : 1;
+	int cmp = strcasecmp(name_pool + x->text, name_pool + y->text);
+	if (cmp)
+		return cmp;
+	return (x->row > y->row) - (x->row < y->row);
+}
+
+static void add_name(struct sink *pool, struct name_ref **refs, size_t *count, size_t *cap,
+                     int kind, const char *name, size_t size, uint32_t row)
+{
+	size_t n = strnlen(name, size);
+	if (n == 0)
+		return;
+
+	if (*count == *cap) {
+		*cap = *cap ? 2 * *cap : 1024;
+		*refs = (struct name_ref *) realloc(*refs, sizeof (struct name_ref) * *cap);
+	}
+
+	struct name_ref *r = &(*refs)[(*count)++];
+	r->text = pool->len;
+	r->row = row;
+	r->kind = kind;
+	sink_write(pool, name, n);
+	sink_putc(pool, '\0');
+}
+
+int catalog_build(const char *path, int count, char **files)
+{
+	const struct table *t = &catalog_table;
+
+	struct savegame_select sel;
+	savegame_select_none(&sel);
+	sel.sections = SECTION_BIT(SECTION_PLAYER) | SECTION_BIT(SECTION_COLONY) | SECTION_BIT(SECTION_ROUTE);
+
+	struct entry *entry = (struct entry *) calloc(count ? count : 1, sizeof (struct entry));
+	int32_t *values = (int32_t *) malloc(sizeof (int32_t) * t->column_count * (count ? count : 1));
+	struct savegame_buffer buf = { NULL, 0 };
+
+	struct sink pool;
+	struct name_ref *refs = NULL;
+	size_t ref_count = 0, ref_cap = 0;
+	sink_init(&pool, -1);
+
+	int rows = 0;
+	for (int fi = 0; fi < count; ++fi) {
+		struct savegame_view sv;
+		struct stat st;
+
+		if (stat(files[fi], &st) == -1 || savegame_read(files[fi], &sv, &sel, &buf) == -1) {
+			fprintf(stderr, "Skipping %s: %s\n", files[fi], (errno == EINVAL) ? "truncated savegame" : strerror(errno));
+			continue;
+		}
+
+		struct section_table stab;
+		section_table(sv.head, &stab);
+
+		struct entry *e = &entry[rows];
+		e->value = values + (size_t) rows * t->column_count;
+		for (int c = 0; c < t->column_count; ++c)
+			e->value[c] = t->column[c].get(&sv, 0, t->column[c].arg);
+
+		uint64_t h[3] = {
+			content_hash(sv.base, stab.offset[SECTION_OTHER]), // head and players
+			content_hash(sv.colony, stab.offset[SECTION_COLONY + 1] - stab.offset[SECTION_COLONY]),
+			content_hash(sv.trade_route, stab.offset[SECTION_ROUTE + 1] - stab.offset[SECTION_ROUTE]),
+		};
+		e->file.fingerprint = content_hash(h, sizeof (h));
+		e->file.mtime = st.st_mtime;
+		e->file.size = st.st_size;
+		e->path = files[fi];
+
+		for (int i = 0; i < sv.head->colony_count; ++i)
+			add_name(&pool, &refs, &ref_count, &ref_cap, NAME_COLONY, sv.colony[i].name, sizeof (sv.colony[i].name), rows);
+		for (int i = 0; i < 4; ++i)
+			add_name(&pool, &refs, &ref_count, &ref_cap, NAME_PLAYER, sv.player[i].name, sizeof (sv.player[i].name), rows);
+		for (int i = 0; i < MIN(sv.head->trade_route_count, 12); ++i)
+			add_name(&pool, &refs, &ref_count, &ref_cap, NAME_ROUTE, sv.trade_route[i].name, sizeof (sv.trade_route[i].name), rows);
+
+		savegame_close(&sv);
+		++rows;
+	}
+	free(buf.data);
+
+	/* Rows by date, and the names' rows renumbered to match */
+	uint32_t *row_of = (uint32_t *) malloc(sizeof (uint32_t) * (rows ? rows : 1));
+	for (int i = 0; i < rows; ++i)
+		entry[i].file.path = i; // original index, until sorted
+	qsort(entry, rows, sizeof (struct entry), compare_entries);
+	for (int i = 0; i < rows; ++i)
+		row_of[entry[i].file.path] = i;
+	for (size_t i = 0; i < ref_count; ++i)
+		refs[i].row = row_of[refs[i].row];
+	free(row_of);
+
+	name_pool = pool.buf;
+	qsort(refs, ref_count, sizeof (struct name_ref), compare_names);
+
+	/* Strings: paths, then each distinct name once */
+	struct sink strings, names, postings;
+	sink_init(&strings, -1);
+	sink_init(&names, -1);
+	sink_init(&postings, -1);
+
+	for (int i = 0; i < rows; ++i) {
+		entry[i].file.path = strings.len;
+		sink_puts(&strings, entry[i].path);
+		sink_putc(&strings, '\0');
+	}
+
+	uint32_t name_count = 0, posting_count = 0;
+	for (size_t i = 0; i < ref_count; ) {
+		struct catalog_name cn = { refs[i].kind, (uint32_t) strings.len, posting_count, 0 };
+		const char *text = pool.buf + refs[i].text;
+
+		sink_puts(&strings, text);
+		sink_putc(&strings, '\0');
+
+		size_t j = i;
+		for (; j < ref_count && refs[j].kind == refs[i].kind && strcasecmp(pool.buf + refs[j].text, text) == 0; ++j) {
+			if (j > i && refs[j].row == refs[j - 1].row)
+				continue;
+			sink_write(&postings, &refs[j].row, sizeof (uint32_t));
+			++cn.count;
+		}
+		posting_count += cn.count;
+		sink_write(&names, &cn, sizeof (cn));
+		++name_count;
+		i = j;
+	}
+
+	/* Header, column offsets and columns */
+	struct sink out;
+	sink_init(&out, -1);
+
+	struct catalog_header head;
+	memset(&head, 0, sizeof (head));
+	memcpy(head.magic, CATALOG_MAGIC, sizeof (CATALOG_MAGIC) - 1);
+	head.rows = rows;
+	head.columns = t->column_count;
+	head.names = name_count;
+	head.postings = posting_count;
+	sink_write(&out, &head, sizeof (head));
+
+	size_t offsets = out.len;
+	uint64_t zero = 0;
+	for (int c = 0; c < t->column_count; ++c)
+		sink_write(&out, &zero, sizeof (zero)); // filled in below
+	pad8(&out);
+
+	for (int c = 0; c < t->column_count; ++c) {
+		uint64_t off = out.len;
+		memcpy(out.buf + offsets + c * sizeof (uint64_t), &off, sizeof (off));
+		for (int i = 0; i < rows; ++i)
+			value_put(&out, t->column[c].type, entry[i].value[c]);
+		pad8(&out);
+	}
+
+	head.file_offset = out.len;
+	for (int i = 0; i < rows; ++i)
+		sink_write(&out, &entry[i].file, sizeof (struct catalog_file));
+
+	head.string_offset = out.len;
+	head.string_size = strings.len;
+	sink_write(&out, strings.buf, strings.len);
+	pad8(&out);
+
+	head.name_offset = out.len;
+	sink_write(&out, names.buf, names.len);
+
+	head.posting_offset = out.len;
+	sink_write(&out, postings.buf, postings.len);
+
+	memcpy(out.buf, &head, sizeof (head));
+
+	int res = 0;
+	int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+	if (fd == -1) {
+		fprintf(stderr, "Could not create %s: %s\n", path, strerror(errno));
+		res = -1;
+	} else {
+		out.fd = fd;
+		sink_flush(&out);
+		close(fd);
+		printf("%d saves, %u names, %zu bytes\n", rows, name_count, (size_t) (head.posting_offset + postings.len));
+	}
+
+	sink_free(&out);
+	sink_free(&strings);
+	sink_free(&names);
+	sink_free(&postings);
+	sink_free(&pool);
+	free(refs);
+	free(entry);
+	free(values);
+	return res;
+}
+
+/*
+ * Reading
+ */
+
+struct catalog {
+	void *base;
+	size_t size;
+	const struct catalog_header *head;
+	const uint64_t *column_offset;
+	const struct catalog_file *file;
+	const char *strings;
+	const struct catalog_name *name;
+	const uint32_t *posting;
+};
+
+static int catalog_open(struct catalog *cat, const char *path)
+{
+	int fd = open(path, O_RDONLY);
+	if (fd == -1) {
+		fprintf(stderr, "Could not open catalogue %s: %s\n", path, strerror(errno));
+		return -1;
+	}
+
+	struct stat st;
+	if (fstat(fd, &st) == -1 || st.st_size < (off_t) sizeof (struct catalog_header)) {
+		fprintf(stderr, "Not a catalogue: %s\n", path);
+		close(fd);
+		return -1;
+	}
+
+	cat->size = st.st_size;
+	cat->base = mmap(NULL, cat->size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (cat->base == MAP_FAILED) {
+		fprintf(stderr, "Could not map catalogue %s: %s\n", path, strerror(errno));
+		return -1;
+	}
+
+	const uint8_t *p = (const uint8_t *) cat->base;
+	const struct catalog_header *h = cat->head = (const struct catalog_header *) p;
+
+	uint64_t columns_end = sizeof (struct catalog_header) + (uint64_t) catalog_table.column_count * sizeof (uint64_t);
+	int ok = memcmp(h->magic, CATALOG_MAGIC, sizeof (CATALOG_MAGIC) - 1) == 0 &&
+	         h->columns == (uint32_t) catalog_table.column_count &&
+	         columns_end <= h->file_offset && h->file_offset <= cat->size &&
+	         h->file_offset + (uint64_t) h->rows * sizeof (struct catalog_file) <= h->string_offset &&
+	         h->string_offset <= cat->size && h->string_size <= cat->size &&
+	         h->string_offset + h->string_size <= h->name_offset && h->name_offset <= cat->size &&
+	         h->name_offset + (uint64_t) h->names * sizeof (struct catalog_name) <= h->posting_offset &&
+	         h->posting_offset + (uint64_t) h->postings * sizeof (uint32_t) <= cat->size;
+
+	cat->column_offset = (const uint64_t *) (p + sizeof (struct catalog_header));
+	for (int c = 0; ok && c < catalog_table.column_count; ++c)
+		ok = cat->column_offset[c] >= columns_end && cat->column_offset[c] <= h->file_offset &&
+		     cat->column_offset[c] + (uint64_t) h->rows * type_size[catalog_table.column[c].type] <= h->file_offset;
+
+	if (!ok) {
+		fprintf(stderr, "Not a catalogue, or a different version: %s\n", path);
+		munmap(cat->base, cat->size);
+		return -1;
+	}
+
+	cat->file = (const struct catalog_file *) (p + h->file_offset);
+	cat->strings = (const char *) (p + h->string_offset);
+	cat->name = (const struct catalog_name *) (p + h->name_offset);
+	cat->posting = (const uint32_t *) (p + h->posting_offset);
+	return 0;
+}
+
+static void catalog_close(struct catalog *cat)
+{
+	munmap(cat->base, cat->size);
+}
+
+static int64_t column_at(const struct catalog *cat, int c, uint32_t row)
+{
+	return value_at((const uint8_t *) cat->base + cat->column_offset[c], catalog_table.column[c].type, row);
+}
+
+/* year season  turn N  difficulty  path, from the first four columns */
+static void print_row(struct sink *out, const struct catalog *cat, uint32_t row)
+{
+	int difficulty = column_at(cat, 3, row);
+
+	sink_dec(out, column_at(cat, 0, row), 5);
+	sink_str(out, column_at(cat, 1, row) ? " Autumn" : " Spring");
+	sink_str(out, "  turn ");
+	sink_dec(out, column_at(cat, 2, row), 4);
+	sink_str(out, "  ");
+	sink_str(out, (difficulty >= 0 && difficulty < 5) ? difficulty_list[difficulty] : "?           ");
+	sink_str(out, "  ");
+	sink_str(out, cat->strings + cat->file[row].path);
+	sink_putc(out, '\n');
+}
+
+int catalog_query(const char *path, const char *filter, struct sink *out)
+{
+	struct where *w = where_compile(filter, &catalog_table);
+	if (!w)
+		return -1;
+
+	struct catalog cat;
+	if (catalog_open(&cat, path) == -1) {
+		where_free(w);
+		return -1;
+	}
+
+	uint32_t rows = cat.head->rows;
+	const int *column;
+	int k = where_columns(w, &column);
+
+	/* Widen just the columns the filter reads */
+	int32_t *values = (int32_t *) malloc(sizeof (int32_t) * ((size_t) k * rows + 1));
+	const int32_t *value[k ? k : 1];
+	for (int j = 0; j < k; ++j) {
+		int32_t *v = values + (size_t) j * rows;
+		const void *data = (const uint8_t *) cat.base + cat.column_offset[column[j]];
+		enum column_type type = catalog_table.column[column[j]].type;
+		for (uint32_t i = 0; i < rows; ++i)
+			v[i] = value_at(data, type, i);
+		value[j] = v;
+	}
+
+	uint8_t *mask = (uint8_t *) malloc(rows + 1);
+	where_eval_values(w, rows, value, mask);
+
+	for (uint32_t i = 0; i < rows; ++i)
+		if (mask[i])
+			print_row(out, &cat, i);
+
+	free(mask);
+	free(values);
+	catalog_close(&cat);
+	where_free(w);
+	return 0;
+}
+
+/* First name of kind not before text, comparing at most n characters */
+static uint32_t lower_bound(const struct catalog *cat, uint32_t kind, const char *text, size_t n)
+{
+	uint32_t lo = 0, hi = cat->head->names;
+
+	while (lo < hi) {
+		uint32_t mid = lo + (hi - lo) / 2;
+		const struct catalog_name *cn = &cat->name[mid];
+		int cmp = (cn->kind != kind) ? (cn->kind < kind ? -1 : 1) : strncasecmp(cat->strings + cn->text, text, n);
+		if (cmp < 0)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return lo;
+}
+
+int catalog_find(const char *path, const char *name, struct sink *out)
+{
+	int first = 0, last = NAME_KINDS - 1;
+
+	for (int k = 0; k < NAME_KINDS; ++k) {
+		size_t n = strlen(name_kind[k]);
+		if (strncasecmp(name, name_kind[k], n) == 0 && name[n] == ':') {
+			first = last = k;
+			name += n + 1;
+			break;
+		}
+	}
+
+	size_t n = strlen(name);
+	int prefix = (n > 0 && name[n - 1] == '*');
+	if (prefix)
+		--n;
+	else
+		++n; // and the nul, for a whole-name match
+
+	struct catalog cat;
+	if (catalog_open(&cat, path) == -1)
+		return -1;
+
+	for (int k = first; k <= last; ++k) {
+		for (uint32_t i = lower_bound(&cat, k, name, n); i < cat.head->names; ++i) {
+			const struct catalog_name *cn = &cat.name[i];
+			if (cn->kind != (uint32_t) k || strncasecmp(cat.strings + cn->text, name, n) != 0)
+				break;
+
+			for (uint32_t j = cn->first; j < cn->first + cn->count; ++j) {
+				sink_str(out, name_kind[k], -7);
+				sink_str(out, cat.strings + cn->text, -25);
+				print_row(out, &cat, cat.posting[j]);
+			}
+		}
+	}
+
+	catalog_close(&cat);
+	return 0;
+}
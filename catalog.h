@@ -0,0 +1,39 @@
+#ifndef CATALOG_H
+#define CATALOG_H
+
+#include "columns.h"
+#include "sink.h"
+
+/*
+ * Catalogue of a savegame corpus, for finding saves without opening them.
+ *
+ * Building it reads only the head, the players, and the colony and trade
+ * route sections of each file. Every save becomes a row of catalog_table:
+ * year, turn, difficulty, counts, the control of each player and the owner
+ * of each founding father, kept one column after the other at the width of
+ * its type, with rows sorted by date. Next to that are each file's path,
+ * size, modification time and a fingerprint of what was read, and an
+ * inverted index from colony, player and trade route names to the rows
+ * they appear in.
+ *
+ * Queries are --where expressions over catalog_table, run over the
+ * columns they use, and name lookups by binary search of the names; both
+ * from the index file alone.
+ */
+
+extern struct table catalog_table;
+
+/* Writes an index of count files to path. Returns 0, or -1 after printing an error */
+int catalog_build(const char *path, int count, char **files);
+
+/* The saves matching filter, e.g. "difficulty == Viceroy && year > 1700 && control.spain != Withdrawn" */
+int catalog_query(const char *path, const char *filter, struct sink *out);
+
+/*
+ * The saves with a colony, player or trade route called name, ignoring
+ * case. "colony:", "player:" or "route:" in front narrows it to one kind,
+ * and a * at the end matches every name starting with the rest.
+ */
+int catalog_find(const char *path, const char *name, struct sink *out);
+
+#endif
@@ -0,0 +1,810 @@
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "columns.h"
+#include "fields.h"
+#include "loader.h"
+#include "where.h"
+
+#define QUERY_MAX_KEYS 8
+#define QUERY_MAX_AGGS 16
+
+/*
+ * Column getters
+ */
+
+#define GETTER(fn, expr) \
+	static int64_t fn(const struct savegame_view *sv, int i, int arg) { (void) sv; (void) i; (void) arg; return (expr); }
+
+GETTER(get_year, sv->head->year)
+GETTER(get_turn, sv->head->turn)
+GETTER(get_row,  i)
+
+/* Everything else goes through the field tables, arg being a FIELD_REF() */
+GETTER(unit_get,   field_get(sv->unit,   i, arg))
+GETTER(colony_get, field_get(sv->colony, i, arg))
+GETTER(tribe_get,  field_get(sv->tribe,  i, arg))
+GETTER(nation_get, field_get(sv->nation, i, arg))
+
+static int unit_rows(const struct savegame_view *sv)   { return sv->head->unit_count; }
+static int colony_rows(const struct savegame_view *sv) { return sv->head->colony_count; }
+static int tribe_rows(const struct savegame_view *sv)  { return sv->head->tribe_count; }
+static int nation_rows(const struct savegame_view *)   { return 4; }
+
+/*
+ * Schema
+ */
+
+#define NAMES(list) list, (int) (sizeof (list) / sizeof (list[0]))
+
+/* file is always column 0, and is filled in by the exporter */
+#define COMMON_COLUMNS \
+	{ "file", COL_U32, NULL,     0, NULL, 0 }, \
+	{ "year", COL_U16, get_year, 0, NULL, 0 }, \
+	{ "turn", COL_U16, get_turn, 0, NULL, 0 }
+
+/* The getter and arg reading element of field from table's records */
+#define FROM(table, field, element) table##_get, FIELD_REF(table##_fields, field, element)
+
+#define GOODS(prefix, type, table, field, names) \
+	{ prefix "food",        type, FROM(table, field,  0), names }, \
+	{ prefix "sugar",       type, FROM(table, field,  1), names }, \
+	{ prefix "tobacco",     type, FROM(table, field,  2), names }, \
+	{ prefix "cotton",      type, FROM(table, field,  3), names }, \
+	{ prefix "furs",        type, FROM(table, field,  4), names }, \
+	{ prefix "lumber",      type, FROM(table, field,  5), names }, \
+	{ prefix "ore",         type, FROM(table, field,  6), names }, \
+	{ prefix "silver",      type, FROM(table, field,  7), names }, \
+	{ prefix "horses",      type, FROM(table, field,  8), names }, \
+	{ prefix "rum",         type, FROM(table, field,  9), names }, \
+	{ prefix "cigars",      type, FROM(table, field, 10), names }, \
+	{ prefix "cloth",       type, FROM(table, field, 11), names }, \
+	{ prefix "coats",       type, FROM(table, field, 12), names }, \
+	{ prefix "trade_goods", type, FROM(table, field, 13), names }, \
+	{ prefix "tools",       type, FROM(table, field, 14), names }, \
+	{ prefix "muskets",     type, FROM(table, field, 15), names }
+
+#define NO_NAMES NULL, 0
+
+static struct column unit_columns[] = {
+	COMMON_COLUMNS,
+	{ "index",      COL_U16, get_row, 0, NO_NAMES },
+	{ "x",          COL_U8,  FROM(unit, "x", 0),              NO_NAMES },
+	{ "y",          COL_U8,  FROM(unit, "y", 0),              NO_NAMES },
+	{ "type",       COL_U8,  FROM(unit, "type", 0),           NAMES(unit_type_list) },
+	{ "owner",      COL_U8,  FROM(unit, "owner", 0),          NAMES(nation_list) },
+	{ "profession", COL_U8,  FROM(unit, "profession", 0),     NO_NAMES },
+	{ "moves",      COL_U8,  FROM(unit, "moves", 0),          NO_NAMES },
+	{ "order",      COL_U8,  FROM(unit, "order", 0),          NO_NAMES },
+	{ "holds",      COL_U8,  FROM(unit, "holds_occupied", 0), NO_NAMES },
+	{ "cargo0",     COL_U8,  FROM(unit, "cargo_item_0", 0),   NAMES(cargo_list) },
+	{ "cargo1",     COL_U8,  FROM(unit, "cargo_item_1", 0),   NAMES(cargo_list) },
+	{ "cargo2",     COL_U8,  FROM(unit, "cargo_item_2", 0),   NAMES(cargo_list) },
+	{ "cargo3",     COL_U8,  FROM(unit, "cargo_item_3", 0),   NAMES(cargo_list) },
+	{ "cargo4",     COL_U8,  FROM(unit, "cargo_item_4", 0),   NAMES(cargo_list) },
+	{ "cargo5",     COL_U8,  FROM(unit, "cargo_item_5", 0),   NAMES(cargo_list) },
+	{ "amount0",    COL_U8,  FROM(unit, "cargo_hold", 0),     NO_NAMES },
+	{ "amount1",    COL_U8,  FROM(unit, "cargo_hold", 1),     NO_NAMES },
+	{ "amount2",    COL_U8,  FROM(unit, "cargo_hold", 2),     NO_NAMES },
+	{ "amount3",    COL_U8,  FROM(unit, "cargo_hold", 3),     NO_NAMES },
+	{ "amount4",    COL_U8,  FROM(unit, "cargo_hold", 4),     NO_NAMES },
+	{ "amount5",    COL_U8,  FROM(unit, "cargo_hold", 5),     NO_NAMES },
+	{ "next",       COL_I16, FROM(unit, "transport_chain.next_unit_idx", 0), NO_NAMES },
+	{ "prev",       COL_I16, FROM(unit, "transport_chain.prev_unit_idx", 0), NO_NAMES },
+};
+
+#define BUILDING(name) { "buildings." name, COL_U8, FROM(colony, "buildings." name, 0), NO_NAMES }
+
+static struct column colony_columns[] = {
+	COMMON_COLUMNS,
+	{ "index",      COL_U16, get_row, 0, NO_NAMES },
+	{ "x",          COL_U8,  FROM(colony, "x", 0),          NO_NAMES },
+	{ "y",          COL_U8,  FROM(colony, "y", 0),          NO_NAMES },
+	{ "nation",     COL_U8,  FROM(colony, "nation", 0),     NAMES(nation_list) },
+	{ "population", COL_U8,  FROM(colony, "population", 0), NO_NAMES },
+	{ "hammers",    COL_U16, FROM(colony, "hammers", 0),    NO_NAMES },
+	{ "production", COL_U8,  FROM(colony, "building_in_production", 0), NO_NAMES },
+	{ "rebel_dividend", COL_U32, FROM(colony, "rebel_dividend", 0), NO_NAMES },
+	{ "rebel_divisor",  COL_U32, FROM(colony, "rebel_divisor", 0),  NO_NAMES },
+	GOODS("stock.", COL_I16, colony, "stock", NO_NAMES),
+	BUILDING("stockade"),
+	BUILDING("armory"),
+	BUILDING("docks"),
+	BUILDING("town_hall"),
+	BUILDING("schoolhouse"),
+	BUILDING("warehouse"),
+	BUILDING("stables"),
+	BUILDING("custom_house"),
+	BUILDING("printing_press"),
+	BUILDING("weavers_house"),
+	BUILDING("tobacconists_house"),
+	BUILDING("rum_distillers_house"),
+	BUILDING("capitol"),
+	BUILDING("fur_traders_house"),
+	BUILDING("carpenters_shop"),
+	BUILDING("church"),
+	BUILDING("blacksmiths_house"),
+};
+
+static struct column tribe_columns[] = {
+	COMMON_COLUMNS,
+	{ "index",      COL_U16, get_row, 0, NO_NAMES },
+	{ "x",          COL_U8,  FROM(tribe, "x", 0),             NO_NAMES },
+	{ "y",          COL_U8,  FROM(tribe, "y", 0),             NO_NAMES },
+	{ "nation",     COL_U8,  FROM(tribe, "nation", 0),        NAMES(nation_list) },
+	{ "population", COL_U8,  FROM(tribe, "population", 0),    NO_NAMES },
+	{ "mission",    COL_I8,  FROM(tribe, "mission", 0),       NAMES(nation_list) },
+	{ "panic",      COL_U8,  FROM(tribe, "panic", 0),         NO_NAMES },
+	{ "capital",    COL_U8,  FROM(tribe, "state.capital", 0), NO_NAMES },
+	{ "learned",    COL_U8,  FROM(tribe, "state.learned", 0), NO_NAMES },
+	{ "scouted",    COL_U8,  FROM(tribe, "state.scouted", 0), NO_NAMES },
+	{ "last_cargo_bought", COL_I8, FROM(tribe, "last_cargo_bought", 0), NAMES(cargo_list) },
+	{ "last_cargo_sold",   COL_I8, FROM(tribe, "last_cargo_sold", 0),   NAMES(cargo_list) },
+};
+
+static struct column nation_columns[] = {
+	COMMON_COLUMNS,
+	{ "nation",     COL_U8,  get_row, 0, NAMES(nation_list) },
+	{ "gold",       COL_U32, FROM(nation, "gold", 0),     NO_NAMES },
+	{ "tax_rate",   COL_U8,  FROM(nation, "tax_rate", 0), NO_NAMES },
+	{ "liberty_bells_total",     COL_U16, FROM(nation, "liberty_bells_total", 0),     NO_NAMES },
+	{ "liberty_bells_last_turn", COL_U16, FROM(nation, "liberty_bells_last_turn", 0), NO_NAMES },
+	{ "crosses",    COL_U16, FROM(nation, "crosses", 0), NO_NAMES },
+	{ "founding_fathers", COL_U16, FROM(nation, "founding_father_count", 0), NO_NAMES },
+	{ "artillery_count",  COL_U16, FROM(nation, "artillery_count", 0),       NO_NAMES },
+	{ "boycott",    COL_U16, FROM(nation, "boycott_bitmap", 0), NO_NAMES },
+	GOODS("euro_price.", COL_U8,  nation, "trade.euro_price", NO_NAMES),
+	GOODS("trade_nr.",   COL_I16, nation, "trade.nr",         NO_NAMES),
+	GOODS("trade_gold.", COL_I32, nation, "trade.gold",       NO_NAMES),
+	GOODS("tons.",       COL_I32, nation, "trade.tons",       NO_NAMES),
+	GOODS("tons2.",      COL_I32, nation, "trade.tons2",      NO_NAMES),
+};
+
+#define TABLE(name, section, rows, columns) \
+	{ name, section, rows, columns, (int) (sizeof (columns) / sizeof (columns[0])) }
+
+struct table column_tables[] = {
+	TABLE("unit",   SECTION_UNIT,   unit_rows,   unit_columns),
+	TABLE("colony", SECTION_COLONY, colony_rows, colony_columns),
+	TABLE("tribe",  SECTION_TRIBE,  tribe_rows,  tribe_columns),
+	TABLE("nation", SECTION_NATION, nation_rows, nation_columns),
+};
+
+const int column_table_count = sizeof (column_tables) / sizeof (column_tables[0]);
+
+static const char *column_type_name[] = { "u8", "i8", "u16", "i16", "u32", "i32" };
+static const size_t column_type_size[] = { 1, 1, 2, 2, 4, 4 };
+
+const struct table *column_table(const char *name)
+{
+	for (int t = 0; t < column_table_count; ++t)
+		if (strcasecmp(column_tables[t].name, name) == 0)
+			return &column_tables[t];
+	return NULL;
+}
+
+int column_find(const struct table *t, const char *name)
+{
+	for (int c = 0; c < t->column_count; ++c)
+		if (strcasecmp(t->column[c].name, name) == 0)
+			return c;
+	return -1;
+}
+
+/*
+ * Export
+ */
+
+static void column_put(struct sink *s, enum column_type type, int64_t v)
+{
+	switch (type) {
+		case COL_U8:  { uint8_t  x = v; sink_write(s, &x, sizeof (x)); break; }
+		case COL_I8:  { int8_t   x = v; sink_write(s, &x, sizeof (x)); break; }
+		case COL_U16: { uint16_t x = v; sink_write(s, &x, sizeof (x)); break; }
+		case COL_I16: { int16_t  x = v; sink_write(s, &x, sizeof (x)); break; }
+		case COL_U32: { uint32_t x = v; sink_write(s, &x, sizeof (x)); break; }
+		case COL_I32: { int32_t  x = v; sink_write(s, &x, sizeof (x)); break; }
+	}
+}
+
+static int open_out(const char *dir, const char *name)
+{
+	char path[4096];
+	snprintf(path, sizeof (path), "%s/%s", dir, name);
+
+	int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+	if (fd == -1)
+		fprintf(stderr, "Could not create %s: %s\n", path, strerror(errno));
+	return fd;
+}
+
+/* Closes and frees the column files of an export that failed */
+static void discard_sinks(struct sink **sinks)
+{
+	for (int t = 0; t < column_table_count; ++t) {
+		if (!sinks[t])
+			continue;
+		for (int c = 0; c < column_tables[t].column_count; ++c) {
+			if (sinks[t][c].buf) {
+				close(sinks[t][c].fd);
+				sink_free(&sinks[t][c]);
+			}
+		}
+		free(sinks[t]);
+	}
+}
+
+int columns_export(const char *dir, int count, char **files, struct where *const *filter)
+{
+	if (mkdir(dir, 0777) == -1 && errno != EEXIST) {
+		fprintf(stderr, "Could not create %s: %s\n", dir, strerror(errno));
+		return -1;
+	}
+
+	struct sink *sinks[column_table_count];
+	uint64_t rows[column_table_count];
+
+	for (int t = 0; t < column_table_count; ++t)
+		sinks[t] = NULL;
+
+	for (int t = 0; t < column_table_count; ++t) {
+		const struct table *tab = &column_tables[t];
+
+		rows[t] = 0;
+		sinks[t] = (struct sink *) calloc(tab->column_count, sizeof (struct sink));
+
+		for (int c = 0; c < tab->column_count; ++c) {
+			char name[128];
+			snprintf(name, sizeof (name), "%s.%s", tab->name, tab->column[c].name);
+
+			int fd = open_out(dir, name);
+			if (fd == -1) {
+				discard_sinks(sinks);
+				return -1;
+			}
+			sink_init(&sinks[t][c], fd, 16 * 1024);
+		}
+	}
+
+	int fd = open_out(dir, "FILES");
+	if (fd == -1) {
+		discard_sinks(sinks);
+		return -1;
+	}
+	struct sink names;
+	sink_init(&names, fd);
+
+	struct savegame_select sel;
+	savegame_select_none(&sel);
+	for (int t = 0; t < column_table_count; ++t)
+		sel.sections |= SECTION_BIT(column_tables[t].section);
+
+	struct savegame_buffer buf = { NULL, 0 };
+	uint8_t *mask = NULL;
+	size_t mask_cap = 0;
+
+	for (int fi = 0; fi < count; ++fi) {
+		struct savegame_view sv;
+
+		if (savegame_read(files[fi], &sv, &sel, &buf) == -1) {
+			fprintf(stderr, "Skipping %s: %s\n", files[fi], (errno == EINVAL) ? "truncated savegame" : strerror(errno));
+			continue;
+		}
+
+		sink_dec(&names, fi);
+		sink_putc(&names, '\t');
+		sink_puts(&names, files[fi]);
+		sink_putc(&names, '\n');
+
+		for (int t = 0; t < column_table_count; ++t) {
+			const struct table *tab = &column_tables[t];
+			int n = tab->rows(&sv);
+
+			if (filter && filter[t]) {
+				if (mask_cap < (size_t) n) {
+					mask_cap = n;
+					mask = (uint8_t *) realloc(mask, mask_cap);
+				}
+				where_eval(filter[t], &sv, mask);
+			}
+
+			for (int i = 0; i < n; ++i) {
+				if (filter && filter[t] && !mask[i])
+					continue;
+				column_put(&sinks[t][0], COL_U32, fi);
+				for (int c = 1; c < tab->column_count; ++c)
+					column_put(&sinks[t][c], tab->column[c].type, tab->column[c].get(&sv, i, tab->column[c].arg));
+				rows[t]++;
+			}
+		}
+
+		savegame_close(&sv);
+	}
+	free(buf.data);
+	free(mask);
+
+	sink_flush(&names);
+	close(names.fd);
+	sink_free(&names);
+
+	fd = open_out(dir, "MANIFEST");
+	if (fd == -1) {
+		discard_sinks(sinks);
+		return -1;
+	}
+	struct sink manifest;
+	sink_init(&manifest, fd);
+	sink_puts(&manifest, "viceroy-columns 1\n");
+
+	for (int t = 0; t < column_table_count; ++t) {
+		const struct table *tab = &column_tables[t];
+
+		for (int c = 0; c < tab->column_count; ++c) {
+			sink_flush(&sinks[t][c]);
+			close(sinks[t][c].fd);
+			sink_free(&sinks[t][c]);
+
+			sink_printf(&manifest, "%s %s %s %llu\n", tab->name, tab->column[c].name,
+				column_type_name[tab->column[c].type], (unsigned long long) rows[t]);
+		}
+		free(sinks[t]);
+	}
+
+	sink_flush(&manifest);
+	close(manifest.fd);
+	sink_free(&manifest);
+
+	return 0;
+}
+
+/*
+ * Query
+ */
+
+enum agg_op { AGG_COUNT, AGG_SUM, AGG_MIN, AGG_MAX, AGG_AVG };
+
+static const char *agg_name[] = { "count", "sum", "min", "max", "avg" };
+
+struct query {
+	const struct table *table;
+
+	int key[QUERY_MAX_KEYS];
+	int key_count;
+
+	enum agg_op op[QUERY_MAX_AGGS];
+	int agg[QUERY_MAX_AGGS]; // column, -1 for count(*)
+	char agg_column[QUERY_MAX_AGGS][64];
+	int agg_count;
+
+	char key_column[QUERY_MAX_KEYS][64];
+	char from[64];
+};
+
+/* A mapped column file */
+struct column_data {
+	const void *data;
+	size_t size;
+	enum column_type type;
+};
+
+static inline int64_t column_value(const struct column_data *cd, uint64_t row)
+{
+	switch (cd->type) {
+		case COL_U8:  return ((const uint8_t  *) cd->data)[row];
+		case COL_I8:  return ((const int8_t   *) cd->data)[row];
+		case COL_U16: return ((const uint16_t *) cd->data)[row];
+		case COL_I16: return ((const int16_t  *) cd->data)[row];
+		case COL_U32: return ((const uint32_t *) cd->data)[row];
+		case COL_I32: return ((const int32_t  *) cd->data)[row];
+	}
+	return 0;
+}
+
+static const char *skip_space(const char *p)
+{
+	while (*p == ' ' || *p == '\t' || *p == ',')
+		++p;
+	return p;
+}
+
+/* Reads an identifier (letters, digits, '_', '.' or '*') into word */
+static const char *parse_word(const char *p, char *word, size_t size)
+{
+	size_t n = 0;
+
+	p = skip_space(p);
+	while (*p && (isalnum((unsigned char) *p) || *p == '_' || *p == '.' || *p == '*')) {
+		if (n + 1 < size)
+			word[n++] = *p;
+		++p;
+	}
+	word[n] = '\0';
+	return p;
+}
+
+static int parse_query(const char *text, struct query *q)
+{
+	memset(q, 0, sizeof (*q));
+
+	const char *p = text;
+	char word[64];
+	int mode = 0; // 0 aggregates, 1 keys, 2 from
+
+	for (;;) {
+		p = parse_word(p, word, sizeof (word));
+		if (word[0] == '\0')
+			break;
+
+		if (strcasecmp(word, "by") == 0) {
+			mode = 1;
+			continue;
+		}
+		if (strcasecmp(word, "from") == 0) {
+			mode = 2;
+			continue;
+		}
+
+		if (mode == 0) {
+			int op = -1;
+			for (int i = 0; i < 5; ++i)
+				if (strcasecmp(word, agg_name[i]) == 0)
+					op = i;
+
+			p = skip_space(p);
+			if (op == -1 || *p != '(') {
+				fprintf(stderr, "Query: expected count, sum, min, max or avg(column), got '%s'\n", word);
+				return -1;
+			}
+			if (q->agg_count == QUERY_MAX_AGGS) {
+				fprintf(stderr, "Query: too many aggregates\n");
+				return -1;
+			}
+
+			p = parse_word(p + 1, q->agg_column[q->agg_count], sizeof (q->agg_column[0]));
+			p = skip_space(p);
+			if (*p != ')') {
+				fprintf(stderr, "Query: expected ')' after '%s'\n", q->agg_column[q->agg_count]);
+				return -1;
+			}
+			++p;
+
+			if (op != AGG_COUNT && strcmp(q->agg_column[q->agg_count], "*") == 0) {
+				fprintf(stderr, "Query: only count takes *\n");
+				return -1;
+			}
+			q->op[q->agg_count++] = (enum agg_op) op;
+		} else if (mode == 1) {
+			if (q->key_count == QUERY_MAX_KEYS) {
+				fprintf(stderr, "Query: too many group keys\n");
+				return -1;
+			}
+			strcpy(q->key_column[q->key_count++], word);
+		} else {
+			strcpy(q->from, word);
+		}
+	}
+
+	if (*skip_space(p) != '\0') {
+		fprintf(stderr, "Query: unexpected '%s'\n", skip_space(p));
+		return -1;
+	}
+
+	if (q->agg_count == 0) {
+		fprintf(stderr, "Query: no aggregates\n");
+		return -1;
+	}
+
+	return 0;
+}
+
+/* Does t have every column the query names? */
+static int query_fits(const struct query *q, const struct table *t)
+{
+	for (int i = 0; i < q->agg_count; ++i)
+		if (strcmp(q->agg_column[i], "*") != 0 && column_find(t, q->agg_column[i]) == -1)
+			return 0;
+	for (int i = 0; i < q->key_count; ++i)
+		if (column_find(t, q->key_column[i]) == -1)
+			return 0;
+	return 1;
+}
+
+static int resolve_query(struct query *q)
+{
+	if (q->from[0]) {
+		q->table = column_table(q->from);
+		if (q->table == NULL) {
+			fprintf(stderr, "Query: no table '%s'\n", q->from);
+			return -1;
+		}
+		if (!query_fits(q, q->table)) {
+			fprintf(stderr, "Query: table '%s' lacks some of the columns\n", q->from);
+			return -1;
+		}
+	} else {
+		int fits = 0;
+		for (int t = 0; t < column_table_count; ++t) {
+			if (query_fits(q, &column_tables[t])) {
+				q->table = &column_tables[t];
+				++fits;
+			}
+		}
+		if (fits == 0) {
+			fprintf(stderr, "Query: no table has all of the columns\n");
+			return -1;
+		}
+		if (fits > 1) {
+			fprintf(stderr, "Query: more than one table fits, add 'from <table>'\n");
+			return -1;
+		}
+	}
+
+	for (int i = 0; i < q->agg_count; ++i)
+		q->agg[i] = strcmp(q->agg_column[i], "*") ? column_find(q->table, q->agg_column[i]) : -1;
+	for (int i = 0; i < q->key_count; ++i)
+		q->key[i] = column_find(q->table, q->key_column[i]);
+
+	return 0;
+}
+
+/* Reads the row count of table from dir/MANIFEST, -1 on error */
+static int64_t manifest_rows(const char *dir, const char *table)
+{
+	char path[4096];
+	snprintf(path, sizeof (path), "%s/MANIFEST", dir);
+
+	FILE *fp = fopen(path, "r");
+	if (fp == NULL) {
+		fprintf(stderr, "Could not open %s: %s\n", path, strerror(errno));
+		return -1;
+	}
+
+	char line[256], t[64], c[64], type[16];
+	unsigned long long rows;
+	int64_t res = -1;
+
+	if (fgets(line, sizeof (line), fp) == NULL || strncmp(line, "viceroy-columns 1", 17) != 0) {
+		fprintf(stderr, "%s: not a column store manifest\n", path);
+		fclose(fp);
+		return -1;
+	}
+
+	while (fgets(line, sizeof (line), fp)) {
+		if (sscanf(line, "%63s %63s %15s %llu", t, c, type, &rows) == 4 && strcmp(t, table) == 0) {
+			res = rows;
+			break;
+		}
+	}
+	fclose(fp);
+
+	if (res == -1)
+		fprintf(stderr, "%s: no table '%s'\n", path, table);
+	return res;
+}
+
+static int map_column(const char *dir, const struct table *t, int c, uint64_t rows, struct column_data *cd)
+{
+	char path[4096];
+	snprintf(path, sizeof (path), "%s/%s.%s", dir, t->name, t->column[c].name);
+
+	cd->type = t->column[c].type;
+	cd->size = rows * column_type_size[cd->type];
+	cd->data = NULL;
+
+	if (cd->size == 0)
+		return 0;
+
+	int fd = open(path, O_RDONLY);
+	struct stat st;
+	if (fd == -1 || fstat(fd, &st) == -1 || (size_t) st.st_size < cd->size) {
+		fprintf(stderr, "Could not read column %s\n", path);
+		if (fd != -1)
+			close(fd);
+		return -1;
+	}
+
+	cd->data = mmap(NULL, cd->size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+
+	if (cd->data == MAP_FAILED) {
+		fprintf(stderr, "Could not map column %s: %s\n", path, strerror(errno));
+		cd->data = NULL;
+		return -1;
+	}
+
+	madvise((void *) cd->data, cd->size, MADV_SEQUENTIAL);
+	return 0;
+}
+
+static void unmap_columns(struct column_data *cd, int count)
+{
+	for (int i = 0; i < count; ++i)
+		if (cd[i].data)
+			munmap((void *) cd[i].data, cd[i].size);
+}
+
+struct group {
+	int64_t key[QUERY_MAX_KEYS];
+	int64_t sum[QUERY_MAX_AGGS];
+	int64_t min[QUERY_MAX_AGGS];
+	int64_t max[QUERY_MAX_AGGS];
+	uint64_t count;
+};
+
+static int group_key_count; // for group_compare()
+
+static int group_compare(const void *a, const void *b)
+{
+	const struct group *ga = *(const struct group **) a;
+	const struct group *gb = *(const struct group **) b;
+
+	for (int k = 0; k < group_key_count; ++k) {
+		if (ga->key[k] < gb->key[k]) return -1;
+		if (ga->key[k] > gb->key[k]) return  1;
+	}
+	return 0;
+}
+
+static uint64_t hash_keys(const int64_t *key, int n)
+{
+	uint64_t h = 0x9e3779b97f4a7c15ull;
+	for (int k = 0; k < n; ++k) {
+		h ^= (uint64_t) key[k];
+		h *= 0xff51afd7ed558ccdull;
+		h ^= h >> 32;
+	}
+	return h;
+}
+
+int columns_query(const char *dir, const char *text, struct sink *out)
+{
+	struct query q;
+
+	if (parse_query(text, &q) == -1 || resolve_query(&q) == -1)
+		return -1;
+
+	int64_t rows = manifest_rows(dir, q.table->name);
+	if (rows == -1)
+		return -1;
+
+	/* Zeroed, so whatever is mapped when one fails can be unmapped */
+	struct column_data keys[QUERY_MAX_KEYS] = {}, aggs[QUERY_MAX_AGGS] = {};
+	int res = 0;
+	for (int k = 0; k < q.key_count && res == 0; ++k)
+		res = map_column(dir, q.table, q.key[k], rows, &keys[k]);
+	for (int a = 0; a < q.agg_count && res == 0; ++a)
+		if (q.agg[a] != -1)
+			res = map_column(dir, q.table, q.agg[a], rows, &aggs[a]);
+	if (res == -1) {
+		unmap_columns(keys, q.key_count);
+		unmap_columns(aggs, q.agg_count);
+		return -1;
+	}
+
+	/* Open addressing hash of group index + 1, 0 is empty */
+	size_t group_cap = 1024, group_count = 0;
+	struct group *groups = (struct group *) malloc(group_cap * sizeof (struct group));
+	size_t slot_mask = 2 * group_cap - 1;
+	uint32_t *slot = (uint32_t *) calloc(slot_mask + 1, sizeof (uint32_t));
+
+	int64_t key[QUERY_MAX_KEYS];
+
+	for (int64_t r = 0; r < rows; ++r) {
+		for (int k = 0; k < q.key_count; ++k)
+			key[k] = column_value(&keys[k], r);
+
+		size_t h = hash_keys(key, q.key_count) & slot_mask;
+		struct group *g = NULL;
+
+		while (slot[h]) {
+			struct group *cand = &groups[slot[h] - 1];
+			if (memcmp(cand->key, key, q.key_count * sizeof (int64_t)) == 0) {
+				g = cand;
+				break;
+			}
+			h = (h + 1) & slot_mask;
+		}
+
+		if (g == NULL) {
+			if (group_count == group_cap) {
+				group_cap *= 2;
+				groups = (struct group *) realloc(groups, group_cap * sizeof (struct group));
+
+				slot_mask = 2 * group_cap - 1;
+				free(slot);
+				slot = (uint32_t *) calloc(slot_mask + 1, sizeof (uint32_t));
+				for (size_t i = 0; i < group_count; ++i) {
+					size_t s = hash_keys(groups[i].key, q.key_count) & slot_mask;
+					while (slot[s])
+						s = (s + 1) & slot_mask;
+					slot[s] = i + 1;
+				}
+
+				h = hash_keys(key, q.key_count) & slot_mask;
+				while (slot[h])
+					h = (h + 1) & slot_mask;
+			}
+
+			g = &groups[group_count++];
+			memset(g, 0, sizeof (*g));
+			memcpy(g->key, key, q.key_count * sizeof (int64_t));
+			for (int a = 0; a < q.agg_count; ++a) {
+				g->min[a] = INT64_MAX;
+				g->max[a] = INT64_MIN;
+			}
+			slot[h] = group_count;
+		}
+
+		g->count++;
+		for (int a = 0; a < q.agg_count; ++a) {
+			if (q.agg[a] == -1)
+				continue;
+			int64_t v = column_value(&aggs[a], r);
+			g->sum[a] += v;
+			if (v < g->min[a]) g->min[a] = v;
+			if (v > g->max[a]) g->max[a] = v;
+		}
+	}
+
+	/* No rows and no keys is still one (empty) group */
+	if (group_count == 0 && q.key_count == 0) {
+		memset(&groups[0], 0, sizeof (groups[0]));
+		group_count = 1;
+	}
+
+	struct group **sorted = (struct group **) malloc(group_count * sizeof (struct group *));
+	for (size_t i = 0; i < group_count; ++i)
+		sorted[i] = &groups[i];
+	group_key_count = q.key_count;
+	qsort(sorted, group_count, sizeof (struct group *), group_compare);
+
+	for (int k = 0; k < q.key_count; ++k) {
+		sink_puts(out, q.table->column[q.key[k]].name);
+		sink_putc(out, '\t');
+	}
+	for (int a = 0; a < q.agg_count; ++a) {
+		sink_printf(out, "%s(%s)", agg_name[q.op[a]], q.agg_column[a]);
+		sink_putc(out, (a + 1 < q.agg_count) ? '\t' : '\n');
+	}
+
+	for (size_t i = 0; i < group_count; ++i) {
+		const struct group *g = sorted[i];
+
+		for (int k = 0; k < q.key_count; ++k) {
+			const struct column *col = &q.table->column[q.key[k]];
+			if (col->names && g->key[k] >= 0 && g->key[k] < col->name_count)
+				sink_puts(out, col->names[g->key[k]]);
+			else
+				sink_dec(out, g->key[k]);
+			sink_putc(out, '\t');
+		}
+
+		for (int a = 0; a < q.agg_count; ++a) {
+			switch (q.op[a]) {
+				case AGG_COUNT: sink_dec(out, g->count); break;
+				case AGG_SUM:   sink_dec(out, g->sum[a]); break;
+				case AGG_MIN:   sink_dec(out, g->count ? g->min[a] : 0); break;
+				case AGG_MAX:   sink_dec(out, g->count ? g->max[a] : 0); break;
+				case AGG_AVG:   sink_printf(out, "%.2f", g->count ? (double) g->sum[a] / g->count : 0.0); break;
+			}
+			sink_putc(out, (a + 1 < q.agg_count) ? '\t' : '\n');
+		}
+	}
+
+	free(sorted);
+	free(slot);
+	free(groups);
+
+	unmap_columns(keys, q.key_count);
+	unmap_columns(aggs, q.agg_count);
+
+	return 0;
+}
@@ -0,0 +1,66 @@
+#ifndef COLUMNS_H
+#define COLUMNS_H
+
+#include <stdint.h>
+
+#include "savegame.h"
+#include "sink.h"
+
+/*
+ * Columnar corpus store. Every table (unit, colony, tribe, nation) is a
+ * directory of typed column files, one little-endian value per row, plus
+ * a MANIFEST listing each column's type and row count, and FILES mapping
+ * the file column back to savegame paths. Every row carries the file id,
+ * year and turn of the savegame it came from.
+ */
+
+enum column_type { COL_U8, COL_I8, COL_U16, COL_I16, COL_U32, COL_I32 };
+
+struct column {
+	const char *name;
+	enum column_type type;
+	int64_t (*get)(const struct savegame_view *sv, int row, int arg);
+	int arg;
+	const char **names; // value names, for printing, or NULL
+	int name_count;
+};
+
+struct table {
+	const char *name;
+	int section;        // enum section the rows come from
+	int (*rows)(const struct savegame_view *sv);
+	struct column *column;
+	int column_count;
+};
+
+extern struct table column_tables[];
+extern const int column_table_count;
+
+/* Finds table, NULL if there is no such table */
+const struct table *column_table(const char *name);
+
+/* Finds column in t by name, case-insensitive, -1 if there is no such column */
+int column_find(const struct table *t, const char *name);
+
+struct where;
+
+/*
+ * Writes count savegames to a new store in dir. filter, if given, has an
+ * entry per column_tables entry, and only rows matching a non-NULL filter
+ * are written (see where.h). Returns 0 on success, -1 after printing an
+ * error message to stderr.
+ */
+int columns_export(const char *dir, int count, char **files, struct where *const *filter = NULL);
+
+/*
+ * Runs query over the store in dir, results go to out as tab separated
+ * text with a header line:
+ *
+ *   agg(column)[, agg(column)...] [by column[, column...]] [from table]
+ *
+ * with agg one of count, sum, min, max or avg; count takes * as well.
+ * Without a from clause the table is the one that has all the columns.
+ */
+int columns_query(const char *dir, const char *query, struct sink *out);
+
+#endif
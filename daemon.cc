@@ -0,0 +1,741 @@
+#include <dirent.h>
+#include <errno.h>
+#include <limits.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/inotify.h>
+#include <sys/param.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "daemon.h"
+
+#define ANSWER_SLOTS    8    // answers kept per file, replaced round robin
+#define REQUEST_MAX     4096 // longest request line
+#define LATENCY_BUCKETS 24   // powers of two microseconds
+
+#define WATCH_EVENTS (IN_CLOSE_WRITE | IN_MOVED_TO | IN_DELETE | IN_MOVED_FROM)
+
+struct answer {
+	char *query;       // NULL for a free slot
+	uint32_t sections; // made from these
+	struct sink text;
+};
+
+struct watched {
+	char *path;
+	const char *name;  // in path, after the directory
+	int error;         // errno of the last load, 0 when sv is valid
+	struct savegame_buffer buf;
+	struct savegame_view sv;
+	uint64_t hash;
+	uint64_t section_hash[SECTION_COUNT];
+	struct answer answer[ANSWER_SLOTS];
+	int next_slot;
+};
+
+/* bucket[0] counts under 1 us, bucket[b] from 2^(b-1) to 2^b us, the last one everything above */
+struct latency {
+	uint64_t count;
+	uint64_t total_ns, max_ns;
+	uint64_t bucket[LATENCY_BUCKETS];
+};
+
+struct client {
+	int fd;
+	int eof;
+	char line[REQUEST_MAX];
+	size_t line_len;
+	struct sink out;   // answers not sent yet
+	size_t sent;
+};
+
+struct daemon {
+	daemon_query_fn query;
+
+	int count;
+	char **dirs;
+	int *wd;
+	int inotify;
+
+	struct watched **file; // sorted by path
+	int file_count, file_cap;
+
+	struct client **client;
+	int client_count, client_cap;
+
+	struct savegame_buffer scratch; // files are read into this first
+	struct sink reply;              // for answers that aren't kept
+
+	struct latency request, parse;
+	uint64_t hits, failed, unchanged, sections_updated;
+};
+
+static volatile sig_atomic_t stop;
+
+static void on_signal(int sig)
+{
+	(void) sig;
+	stop = 1;
+}
+
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static void account(struct latency *l, uint64_t start)
+{
+	uint64_t ns = now_ns() - start;
+	uint64_t us = ns / 1000;
+	int b = 0;
+
+	while (us && b < LATENCY_BUCKETS - 1) {
+		us >>= 1;
+		++b;
+	}
+
+	++l->count;
+	++l->bucket[b];
+	l->total_ns += ns;
+	if (ns > l->max_ns)
+		l->max_ns = ns;
+}
+
+static int is_savegame(const char *name)
+{
+	size_t n = strlen(name);
+	return n > 4 && strcasecmp(name + n - 4, ".SAV") == 0;
+}
+
+/* Index of path in d->file, or where it would go as -1 - index */
+static int find(const struct daemon *d, const char *path)
+{
+	int lo = 0, hi = d->file_count;
+
+	while (lo < hi) {
+		int mid = (lo + hi) / 2;
+		int cmp = strcmp(path, d->file[mid]->path);
+		if (cmp == 0)
+			return mid;
+		if (cmp < 0)
+			hi = mid;
+		else
+			lo = mid + 1;
+	}
+	return -1 - lo;
+}
+
+/* A file by its path, or by its name alone */
+static struct watched *lookup(const struct daemon *d, const char *name)
+{
+	int i = find(d, name);
+	if (i >= 0)
+		return d->file[i];
+
+	if (strchr(name, '/'))
+		return NULL;
+
+	for (i = 0; i < d->file_count; ++i)
+		if (strcmp(d->file[i]->name, name) == 0)
+			return d->file[i];
+	return NULL;
+}
+
+static struct watched *add(struct daemon *d, const char *path)
+{
+	int i = find(d, path);
+	if (i >= 0)
+		return d->file[i];
+	i = -1 - i;
+
+	if (d->file_count == d->file_cap) {
+		d->file_cap = d->file_cap ? 2 * d->file_cap : 64;
+		d->file = (struct watched **) realloc(d->file, sizeof (struct watched *) * d->file_cap);
+	}
+
+	struct watched *f = (struct watched *) calloc(1, sizeof (struct watched));
+	f->path = strdup(path);
+	f->name = strrchr(f->path, '/') + 1;
+	f->error = ENOENT;
+
+	memmove(d->file + i + 1, d->file + i, sizeof (struct watched *) * (d->file_count - i));
+	d->file[i] = f;
+	++d->file_count;
+	return f;
+}
+
+static void forget(struct daemon *d, const char *path)
+{
+	int i = find(d, path);
+	if (i < 0)
+		return;
+
+	struct watched *f = d->file[i];
+	for (int s = 0; s < ANSWER_SLOTS; ++s) {
+		free(f->answer[s].query);
+		sink_free(&f->answer[s].text);
+	}
+	free(f->buf.data);
+	free(f->path);
+	free(f);
+
+	--d->file_count;
+	memmove(d->file + i, d->file + i + 1, sizeof (struct watched *) * (d->file_count - i));
+}
+
+static void drop_answers(struct watched *f, uint32_t changed)
+{
+	for (int s = 0; s < ANSWER_SLOTS; ++s) {
+		struct answer *a = &f->answer[s];
+		if (a->query && (a->sections & changed)) {
+			free(a->query);
+			a->query = NULL;
+		}
+	}
+}
+
+/*
+ * Reads f again. If it changed, the sections that differ are copied into
+ * the resident view, or all of it swapped in if the counts in the head
+ * (and so the layout) changed, and answers made from them are dropped.
+ */
+static void load(struct daemon *d, struct watched *f)
+{
+	uint64_t start = now_ns();
+	struct savegame_view sv;
+
+	if (savegame_copy(f->path, &sv, &d->scratch) == -1) {
+		f->error = errno;
+		drop_answers(f, SECTION_ALL);
+		account(&d->parse, start);
+		return;
+	}
+
+	uint64_t hash = content_hash(sv.base, sv.size);
+	if (f->error == 0 && hash == f->hash) {
+		++d->unchanged;
+		account(&d->parse, start);
+		return;
+	}
+
+	struct section_table st;
+	section_table(sv.head, &st);
+
+	uint64_t section_hash[SECTION_COUNT];
+	uint32_t changed = 0;
+	for (int s = 0; s < SECTION_COUNT; ++s) {
+		section_hash[s] = content_hash((uint8_t *) sv.base + st.offset[s], st.offset[s + 1] - st.offset[s]);
+		if (f->error || section_hash[s] != f->section_hash[s])
+			changed |= SECTION_BIT(s);
+	}
+
+	if (f->error == 0 && !(changed & SECTION_BIT(SECTION_HEAD))) {
+		for (int s = 0; s < SECTION_COUNT; ++s) {
+			if (!(changed & SECTION_BIT(s)))
+				continue;
+			memcpy(f->buf.data + st.offset[s], d->scratch.data + st.offset[s], st.offset[s + 1] - st.offset[s]);
+			++d->sections_updated;
+		}
+	} else {
+		struct savegame_buffer t = f->buf;
+		f->buf = d->scratch;
+		d->scratch = t;
+		d->sections_updated += SECTION_COUNT;
+	}
+
+	savegame_view_init(&f->sv, f->buf.data, &st);
+	f->sv.base = f->buf.data;
+	f->sv.size = sv.size;
+	f->sv.mapped = 0;
+
+	f->hash = hash;
+	memcpy(f->section_hash, section_hash, sizeof (section_hash));
+	f->error = 0;
+
+	drop_answers(f, changed);
+	account(&d->parse, start);
+}
+
+/* Loads every savegame in directory number i */
+static void scan(struct daemon *d, int i)
+{
+	DIR *dir = opendir(d->dirs[i]);
+	if (dir == NULL)
+		return;
+
+	struct dirent *de;
+	while ((de = readdir(dir)) != NULL) {
+		char path[PATH_MAX];
+
+		if (!is_savegame(de->d_name) || (de->d_type != DT_REG && de->d_type != DT_UNKNOWN))
+			continue;
+		snprintf(path, sizeof (path), "%s/%s", d->dirs[i], de->d_name);
+		load(d, add(d, path));
+	}
+	closedir(dir);
+}
+
+static void read_events(struct daemon *d)
+{
+	char buf[16 * 1024] __attribute__ ((aligned (__alignof__ (struct inotify_event))));
+	ssize_t n;
+
+	while ((n = read(d->inotify, buf, sizeof (buf))) > 0) {
+		const struct inotify_event *ev;
+
+		for (char *p = buf; p < buf + n; p += sizeof (struct inotify_event) + ev->len) {
+			ev = (const struct inotify_event *) p;
+
+			/* Events were lost, so look at everything again */
+			if (ev->mask & IN_Q_OVERFLOW) {
+				for (int i = 0; i < d->file_count; ++i)
+					load(d, d->file[i]);
+				for (int i = 0; i < d->count; ++i)
+					scan(d, i);
+				continue;
+			}
+
+			if (ev->len == 0 || !is_savegame(ev->name))
+				continue;
+
+			for (int i = 0; i < d->count; ++i) {
+				if (d->wd[i] != ev->wd)
+					continue;
+
+				char path[PATH_MAX];
+				snprintf(path, sizeof (path), "%s/%s", d->dirs[i], ev->name);
+				if (ev->mask & (IN_DELETE | IN_MOVED_FROM))
+					forget(d, path);
+				else
+					load(d, add(d, path));
+			}
+		}
+	}
+}
+
+static void reply(struct client *c, const char *data, size_t n)
+{
+	sink_printf(&c->out, "OK %zu\n", n);
+	sink_write(&c->out, data, n);
+}
+
+/* One line, whatever the message had */
+static void reply_error(struct client *c, const char *msg, size_t n)
+{
+	while (n > 0 && msg[n - 1] == '\n')
+		--n;
+
+	sink_puts(&c->out, "ERR ");
+	for (size_t i = 0; i < n; ++i)
+		sink_putc(&c->out, msg[i] == '\n' ? ' ' : msg[i]);
+	sink_putc(&c->out, '\n');
+}
+
+static void print_latency(struct sink *out, const struct latency *l)
+{
+	sink_printf(out, "  mean %.1f us, max %.1f us\n", l->count ? l->total_ns / 1000.0 / l->count : 0.0, l->max_ns / 1000.0);
+
+	for (int b = 0; b < LATENCY_BUCKETS; ++b) {
+		if (!l->bucket[b])
+			continue;
+		if (b == LATENCY_BUCKETS - 1)
+			sink_printf(out, "  >= %8llu us %10llu\n", 1ull << (b - 1), (unsigned long long) l->bucket[b]);
+		else
+			sink_printf(out, "   < %8llu us %10llu\n", 1ull << b, (unsigned long long) l->bucket[b]);
+	}
+}
+
+static void print_stats(struct sink *out, const struct daemon *d)
+{
+	int loaded = 0;
+	for (int i = 0; i < d->file_count; ++i)
+		if (d->file[i]->error == 0)
+			++loaded;
+
+	sink_printf(out, "files %d, %d loaded\n", d->file_count, loaded);
+	sink_printf(out, "requests %llu, %llu answered from cache, %llu failed\n", (unsigned long long) d->request.count,
+	            (unsigned long long) d->hits, (unsigned long long) d->failed);
+	print_latency(out, &d->request);
+	sink_printf(out, "parses %llu, %llu unchanged, %llu sections updated\n", (unsigned long long) d->parse.count,
+	            (unsigned long long) d->unchanged, (unsigned long long) d->sections_updated);
+	print_latency(out, &d->parse);
+}
+
+static void print_list(struct sink *out, const struct daemon *d)
+{
+	for (int i = 0; i < d->file_count; ++i) {
+		const struct watched *f = d->file[i];
+
+		if (f->error == EINVAL)
+			sink_printf(out, "%s Truncated savegame\n", f->path);
+		else if (f->error)
+			sink_printf(out, "%s %s\n", f->path, strerror(f->error));
+		else
+			sink_printf(out, "%s %zu %016llx\n", f->path, f->sv.size, (unsigned long long) f->hash);
+	}
+}
+
+/* Answers one request line */
+static void handle(struct daemon *d, struct client *c, char *line)
+{
+	uint64_t start = now_ns();
+	char query[REQUEST_MAX], msg[PATH_MAX + 64];
+	const char *file = NULL;
+	size_t len = 0;
+	char *save;
+
+	/* The words but the last make the query, the last one names the file */
+	query[0] = '\0';
+	for (char *w = strtok_r(line, " \t\r", &save); w; w = strtok_r(NULL, " \t\r", &save)) {
+		if (file) {
+			len += sprintf(query + len, len ? " %s" : "%s", file);
+		}
+		file = w;
+	}
+
+	if (file == NULL) {
+		reply_error(c, "Empty request", 13);
+		++d->failed;
+	} else if (len == 0 && strcmp(file, "stats") == 0) {
+		d->reply.len = 0;
+		print_stats(&d->reply, d);
+		reply(c, d->reply.buf, d->reply.len);
+	} else if (len == 0 && strcmp(file, "list") == 0) {
+		d->reply.len = 0;
+		print_list(&d->reply, d);
+		reply(c, d->reply.buf, d->reply.len);
+	} else {
+		struct watched *f = lookup(d, file);
+		struct answer *a = NULL;
+
+		if (f == NULL || f->error) {
+			int n = snprintf(msg, sizeof (msg), "%s: %s", (f && f->error == EINVAL) ? "Truncated savegame" : "Could not open file", file);
+			reply_error(c, msg, MIN(n, (int) sizeof (msg) - 1));
+			++d->failed;
+			account(&d->request, start);
+			return;
+		}
+
+		for (int s = 0; s < ANSWER_SLOTS && !a; ++s)
+			if (f->answer[s].query && strcmp(f->answer[s].query, query) == 0)
+				a = &f->answer[s];
+
+		if (a) {
+			++d->hits;
+		} else {
+			a = &f->answer[f->next_slot];
+			f->next_slot = (f->next_slot + 1) % ANSWER_SLOTS;
+
+			free(a->query);
+			a->query = NULL;
+			if (a->text.buf == NULL)
+				sink_init(&a->text, -1, 4096);
+			a->text.len = 0;
+
+			if (d->query(&a->text, &f->sv, f->path, query, &a->sections) == -1) {
+				reply_error(c, a->text.buf, a->text.len);
+				++d->failed;
+				account(&d->request, start);
+				return;
+			}
+			a->query = strdup(query);
+		}
+		reply(c, a->text.buf, a->text.len);
+	}
+
+	account(&d->request, start);
+}
+
+static void client_close(struct daemon *d, int i)
+{
+	struct client *c = d->client[i];
+
+	close(c->fd);
+	sink_free(&c->out);
+	free(c);
+	d->client[i] = d->client[--d->client_count];
+}
+
+/* Answers the complete lines the client sent. Returns -1 to drop it */
+static int client_read(struct daemon *d, struct client *c)
+{
+	for (;;) {
+		ssize_t n = read(c->fd, c->line + c->line_len, sizeof (c->line) - c->line_len);
+		if (n == -1)
+			return (errno == EAGAIN || errno == EINTR) ? 0 : -1;
+		if (n == 0) {
+			c->eof = 1;
+			return 0;
+		}
+
+		size_t end = c->line_len + n, from = 0;
+		for (size_t i = c->line_len; i < end; ++i) {
+			if (c->line[i] != '\n')
+				continue;
+			c->line[i] = '\0';
+			handle(d, c, c->line + from);
+			from = i + 1;
+		}
+		memmove(c->line, c->line + from, end - from);
+		c->line_len = end - from;
+
+		if (c->line_len == sizeof (c->line))
+			return -1;
+	}
+}
+
+static int client_write(struct client *c)
+{
+	while (c->sent < c->out.len) {
+		ssize_t n = send(c->fd, c->out.buf + c->sent, c->out.len - c->sent, MSG_NOSIGNAL);
+		if (n == -1)
+			return (errno == EAGAIN || errno == EINTR) ? 0 : -1;
+		c->sent += n;
+	}
+	c->out.len = c->sent = 0;
+	return 0;
+}
+
+static void accept_clients(struct daemon *d, int listener)
+{
+	int fd;
+
+	while ((fd = accept4(listener, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC)) != -1) {
+		if (d->client_count == d->client_cap) {
+			d->client_cap = d->client_cap ? 2 * d->client_cap : 16;
+			d->client = (struct client **) realloc(d->client, sizeof (struct client *) * d->client_cap);
+		}
+
+		struct client *c = (struct client *) calloc(1, sizeof (struct client));
+		c->fd = fd;
+		sink_init(&c->out, -1);
+		d->client[d->client_count++] = c;
+	}
+}
+
+static int listen_on(const char *path)
+{
+	struct sockaddr_un addr;
+	struct stat st;
+
+	memset(&addr, 0, sizeof (addr));
+	addr.sun_family = AF_UNIX;
+	if (strlen(path) >= sizeof (addr.sun_path)) {
+		errno = ENAMETOOLONG;
+		return -1;
+	}
+	strcpy(addr.sun_path, path);
+
+	/* A socket left behind by an earlier run, but nothing else */
+	if (lstat(path, &st) == 0 && S_ISSOCK(st.st_mode))
+		unlink(path);
+
+	int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+	if (fd == -1)
+		return -1;
+
+	if (bind(fd, (struct sockaddr *) &addr, sizeof (addr)) == -1 || listen(fd, 64) == -1) {
+		int saved_errno = errno;
+		close(fd);
+		errno = saved_errno;
+		return -1;
+	}
+	return fd;
+}
+
+int daemon_run(const char *socket_path, int count, char **dirs, daemon_query_fn query)
+{
+	struct daemon d;
+
+	memset(&d, 0, sizeof (d));
+	d.query = query;
+	d.count = count;
+	d.dirs = dirs;
+	d.wd = (int *) calloc(count, sizeof (int));
+
+	d.inotify = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	if (d.inotify == -1) {
+		perror("inotify_init1");
+		return -1;
+	}
+
+	/* Watch before scanning, so nothing written in between is missed */
+	for (int i = 0; i < count; ++i) {
+		d.wd[i] = inotify_add_watch(d.inotify, dirs[i], WATCH_EVENTS);
+		if (d.wd[i] == -1) {
+			fprintf(stderr, "Could not watch %s: %s\n", dirs[i], strerror(errno));
+			close(d.inotify);
+			free(d.wd);
+			return -1;
+		}
+	}
+
+	int listener = listen_on(socket_path);
+	if (listener == -1) {
+		fprintf(stderr, "Could not listen on %s: %s\n", socket_path, strerror(errno));
+		close(d.inotify);
+		free(d.wd);
+		return -1;
+	}
+
+	for (int i = 0; i < count; ++i)
+		scan(&d, i);
+
+	sink_init(&d.reply, -1);
+
+	struct sigaction sa;
+	memset(&sa, 0, sizeof (sa));
+	sa.sa_handler = on_signal; // no SA_RESTART, so poll() returns
+	sigaction(SIGINT, &sa, NULL);
+	sigaction(SIGTERM, &sa, NULL);
+
+	struct pollfd *pfd = NULL;
+	int pfd_cap = 0;
+
+	while (!stop) {
+		int n = d.client_count + 2;
+		if (pfd_cap < n) {
+			pfd_cap = 2 * n;
+			pfd = (struct pollfd *) realloc(pfd, sizeof (struct pollfd) * pfd_cap);
+		}
+
+		pfd[0].fd = listener;
+		pfd[0].events = POLLIN;
+		pfd[1].fd = d.inotify;
+		pfd[1].events = POLLIN;
+		for (int i = 0; i < d.client_count; ++i) {
+			struct client *c = d.client[i];
+			pfd[i + 2].fd = c->fd;
+			pfd[i + 2].events = (c->eof ? 0 : POLLIN) | (c->out.len ? POLLOUT : 0);
+		}
+
+		if (poll(pfd, n, -1) == -1) {
+			if (errno == EINTR)
+				continue;
+			perror("poll");
+			break;
+		}
+
+		/* Files first, so requests that came with a change see it */
+		if (pfd[1].revents)
+			read_events(&d);
+
+		/* Backwards, as closing moves the last client into the gap */
+		for (int i = n - 3; i >= 0; --i) {
+			struct client *c = d.client[i];
+			short revents = pfd[i + 2].revents;
+
+			if (revents & POLLIN && client_read(&d, c) == -1) {
+				client_close(&d, i);
+				continue;
+			}
+			if ((revents & (POLLERR | POLLHUP) && !(revents & POLLIN)) ||
+			    client_write(c) == -1 || (c->eof && c->out.len == 0))
+				client_close(&d, i);
+		}
+
+		if (pfd[0].revents)
+			accept_clients(&d, listener);
+	}
+
+	while (d.client_count)
+		client_close(&d, 0);
+	while (d.file_count)
+		forget(&d, d.file[0]->path);
+
+	close(listener);
+	unlink(socket_path);
+	close(d.inotify);
+
+	free(pfd);
+	free(d.client);
+	free(d.file);
+	free(d.wd);
+	free(d.scratch.data);
+	sink_free(&d.reply);
+
+	return 0;
+}
+
+int daemon_ask(const char *socket_path, const char *request, struct sink *out)
+{
+	struct sockaddr_un addr;
+
+	memset(&addr, 0, sizeof (addr));
+	addr.sun_family = AF_UNIX;
+	if (strlen(socket_path) >= sizeof (addr.sun_path)) {
+		fprintf(stderr, "Could not connect to %s: %s\n", socket_path, strerror(ENAMETOOLONG));
+		return -1;
+	}
+	strcpy(addr.sun_path, socket_path);
+
+	int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if (fd == -1 || connect(fd, (struct sockaddr *) &addr, sizeof (addr)) == -1) {
+		fprintf(stderr, "Could not connect to %s: %s\n", socket_path, strerror(errno));
+		if (fd != -1)
+			close(fd);
+		return -1;
+	}
+
+	struct sink answer;
+	sink_init(&answer, -1);
+	sink_puts(&answer, request);
+	sink_putc(&answer, '\n');
+
+	for (size_t sent = 0; sent < answer.len; ) {
+		ssize_t n = send(fd, answer.buf + sent, answer.len - sent, MSG_NOSIGNAL);
+		if (n == -1) {
+			if (errno == EINTR)
+				continue;
+			fprintf(stderr, "Could not send to %s: %s\n", socket_path, strerror(errno));
+			close(fd);
+			sink_free(&answer);
+			return -1;
+		}
+		sent += n;
+	}
+	shutdown(fd, SHUT_WR);
+
+	answer.len = 0;
+	for (;;) {
+		char *p = sink_reserve(&answer, 64 * 1024);
+		ssize_t n = read(fd, p, 64 * 1024);
+		if (n == -1 && errno == EINTR)
+			continue;
+		if (n <= 0)
+			break;
+		answer.len += n;
+	}
+	close(fd);
+
+	int res = -1;
+	char *nl = (char *) memchr(answer.buf, '\n', answer.len);
+
+	if (nl && answer.len > 3 && memcmp(answer.buf, "OK ", 3) == 0) {
+		size_t n = strtoull(answer.buf + 3, NULL, 10);
+		size_t at = nl + 1 - answer.buf;
+		if (at + n <= answer.len) {
+			sink_write(out, nl + 1, n);
+			res = 0;
+		}
+	} else if (nl && answer.len > 4 && memcmp(answer.buf, "ERR ", 4) == 0) {
+		fprintf(stderr, "%.*s\n", (int) (nl - answer.buf - 4), answer.buf + 4);
+		sink_free(&answer);
+		return -1;
+	}
+
+	if (res == -1)
+		fprintf(stderr, "Bad answer from %s\n", socket_path);
+	sink_free(&answer);
+	return res;
+}
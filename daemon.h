@@ -0,0 +1,45 @@
+#ifndef DAEMON_H
+#define DAEMON_H
+
+#include <stdint.h>
+
+#include "loader.h"
+#include "sink.h"
+
+/*
+ * Resident mode: keeps every *.SAV file of some directories loaded, and
+ * answers queries about them on a local (AF_UNIX) stream socket.
+ *
+ * Directories are watched with inotify. A file written or moved in is read
+ * again, and if its content hash changed, hashed section by section; only
+ * the sections that differ are copied into the resident view, and only
+ * answers made from those sections are thrown away. Answers are kept per
+ * file and query, so asking the same thing of an unchanged file costs a
+ * copy.
+ *
+ * Requests are one line each, answered in order:
+ *
+ *   <query> <file>   e.g. "-H -u3 COLONY00.SAV", file by path or name
+ *   list             the files loaded, with their size and hash
+ *   stats            request and parse counts and latencies
+ *
+ * and the answer is "OK <bytes>\n" followed by that many bytes, or
+ * "ERR <message>\n".
+ */
+
+/*
+ * Renders query (the request up to the file name, words separated by one
+ * space) of sv into out, and sets *sections to the SECTION_BIT mask of the
+ * sections the answer was made from. Returns -1 with a message in out for
+ * a query it doesn't understand.
+ */
+typedef int (*daemon_query_fn)(struct sink *out, const struct savegame_view *sv, const char *filename,
+                               const char *query, uint32_t *sections);
+
+/* Serves until SIGINT or SIGTERM. Returns 0, or -1 if it couldn't start */
+int daemon_run(const char *socket_path, int count, char **dirs, daemon_query_fn query);
+
+/* Sends request to the daemon at socket_path, and the answer to out */
+int daemon_ask(const char *socket_path, const char *request, struct sink *out);
+
+#endif
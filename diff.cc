@@ -0,0 +1,482 @@
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/param.h>
+
+#include "diff.h"
+#include "fields.h"
+#include "mapplane.h"
+
+/* Past this many unit inserts and deletes, units are paired up by index */
+#define DIFF_MAX_EDITS 1024
+
+/*
+ * Field level diff
+ */
+
+static void put_value(struct sink *out, const struct field *f, int64_t v)
+{
+	if (f->type == FT_HEX) {
+		sink_puts(out, "0x");
+		for (int i = f->size - 1; i >= 0; --i)
+			sink_hex02(out, v >> (8 * i));
+		return;
+	}
+
+	sink_dec(out, v);
+	if (f->names && v >= 0 && v < f->name_count) {
+		sink_str(out, " (");
+		sink_str(out, f->names[v]);
+		sink_putc(out, ')');
+	}
+}
+
+static void put_string(struct sink *out, const uint8_t *p, size_t n)
+{
+	sink_putc(out, '"');
+	sink_write(out, p, strnlen((const char *) p, n));
+	sink_putc(out, '"');
+}
+
+/* Lines look like "<prefix><field>[i]: a -> b" */
+static int diff_fields(struct sink *out, const char *prefix, const struct field *fields, int count,
+                       const uint8_t *a, const uint8_t *b)
+{
+	int lines = 0;
+
+	for (const struct field *f = fields; f < fields + count; ++f) {
+		size_t bytes = (size_t) f->size * f->count;
+		if (memcmp(a + f->offset, b + f->offset, bytes) == 0)
+			continue;
+
+		if (f->type == FT_CHAR) {
+			sink_puts(out, prefix);
+			sink_puts(out, f->name);
+			sink_puts(out, ": ");
+			put_string(out, a + f->offset, f->size);
+			sink_puts(out, " -> ");
+			put_string(out, b + f->offset, f->size);
+			sink_putc(out, '\n');
+			++lines;
+			continue;
+		}
+
+		for (int i = 0; i < f->count; ++i) {
+			const uint8_t *pa = a + f->offset + i * f->size;
+			const uint8_t *pb = b + f->offset + i * f->size;
+			int64_t va = field_value(f, pa), vb = field_value(f, pb);
+			if (va == vb)
+				continue;
+
+			sink_puts(out, prefix);
+			sink_puts(out, f->name);
+			if (f->count > 1) {
+				sink_putc(out, '[');
+				sink_dec(out, i);
+				sink_putc(out, ']');
+			}
+			sink_puts(out, ": ");
+			put_value(out, f, va);
+			sink_puts(out, " -> ");
+			put_value(out, f, vb);
+			if (f->type == FT_HEX) {
+				sink_puts(out, " (^");
+				for (int k = f->size - 1; k >= 0; --k)
+					sink_hex02(out, (va ^ vb) >> (8 * k));
+				sink_putc(out, ')');
+			}
+			sink_putc(out, '\n');
+			++lines;
+		}
+	}
+
+	return lines;
+}
+
+/* The "section[i]." or "section[i>j]." line prefix */
+static void record_prefix(char *prefix, size_t size, const char *section, int i, int j)
+{
+	if (i < 0)
+		snprintf(prefix, size, "%s.", section);
+	else if (i == j)
+		snprintf(prefix, size, "%s[%d].", section, i);
+	else
+		snprintf(prefix, size, "%s[%d>%d].", section, i, j);
+}
+
+/* Diffs count records of type T pairwise, field by field */
+template <typename T>
+static int diff_records(struct sink *out, const T *a, const T *b, int count)
+{
+	const struct field_table &t = fields_of<T>::table;
+	const size_t size = sizeof (T);
+	char prefix[64];
+	int lines = 0;
+
+	if (memcmp(a, b, size * count) == 0)
+		return 0;
+
+	for (int i = 0; i < count; ++i) {
+		const uint8_t *ra = (const uint8_t *) a + i * size;
+		const uint8_t *rb = (const uint8_t *) b + i * size;
+		if (memcmp(ra, rb, size) == 0)
+			continue;
+		record_prefix(prefix, sizeof (prefix), t.name, (count > 1) ? i : -1, i);
+		lines += diff_fields(out, prefix, t.field, t.count, ra, rb);
+	}
+
+	return lines;
+}
+
+static int diff_routes(struct sink *out, const struct savegame::trade_route *a, const struct savegame::trade_route *b)
+{
+	char prefix[64];
+	int lines = 0;
+
+	if (memcmp(a, b, sizeof (*a) * 12) == 0)
+		return 0;
+
+	for (int i = 0; i < 12; ++i) {
+		if (memcmp(&a[i], &b[i], sizeof (a[i])) == 0)
+			continue;
+
+		snprintf(prefix, sizeof (prefix), "trade_route[%d].", i);
+		lines += diff_fields(out, prefix, route_fields.field, route_fields.count,
+		                     (const uint8_t *) &a[i], (const uint8_t *) &b[i]);
+
+		for (int j = 0; j < 4; ++j) {
+			snprintf(prefix, sizeof (prefix), "trade_route[%d].entry[%d].", i, j);
+			lines += diff_fields(out, prefix, entry_fields.field, entry_fields.count,
+			                     (const uint8_t *) &a[i].entry[j], (const uint8_t *) &b[i].entry[j]);
+		}
+	}
+
+	return lines;
+}
+
+/* One line per changed tile: "map[l](x,y): tile 2 -> 3, forest 1 -> 0" */
+static int diff_map(struct sink *out, const struct savegame::map *a, const struct savegame::map *b)
+{
+	static const char *bit_names[] = { "tile", "forest", "water", "phys" };
+	static const uint8_t bit_shift[] = { 0, 3, 4, 5 };
+	static const uint8_t bit_mask[]  = { 7, 1, 1, 7 };
+	int lines = 0;
+
+	if (memcmp(a, b, sizeof (*a)) == 0)
+		return 0;
+
+	for (int l = 0; l < MAP_LAYERS; ++l) {
+		const uint8_t *la = (const uint8_t *) a->layer[l];
+		const uint8_t *lb = (const uint8_t *) b->layer[l];
+
+		for (int i = 0; i < MAP_TILES; ) {
+			/* Skip ahead a word at a time over identical tiles */
+			if (i + 8 <= MAP_TILES && memcmp(la + i, lb + i, 8) == 0) {
+				i += 8;
+				continue;
+			}
+			if (la[i] == lb[i]) {
+				++i;
+				continue;
+			}
+
+			sink_puts(out, "map[");
+			sink_dec(out, l);
+			sink_puts(out, "](");
+			sink_dec(out, i % MAP_WIDTH);
+			sink_putc(out, ',');
+			sink_dec(out, i / MAP_WIDTH);
+			sink_puts(out, "):");
+
+			const char *sep = " ";
+			for (int k = 0; k < 4; ++k) {
+				int va = (la[i] >> bit_shift[k]) & bit_mask[k];
+				int vb = (lb[i] >> bit_shift[k]) & bit_mask[k];
+				if (va == vb)
+					continue;
+				sink_puts(out, sep);
+				sink_puts(out, bit_names[k]);
+				sink_putc(out, ' ');
+				sink_dec(out, va);
+				sink_puts(out, " -> ");
+				sink_dec(out, vb);
+				sep = ", ";
+			}
+			sink_putc(out, '\n');
+			++lines;
+			++i;
+		}
+	}
+
+	return lines;
+}
+
+/*
+ * Record alignment
+ */
+
+/*
+ * Pairs up the a and b records, so that match[i] is the b index of a[i], or
+ * -1 if a[i] was removed, with matches in increasing order. Records with
+ * the same key are considered the same record; the pairing is the longest
+ * common subsequence of the keys, found with Myers' O(ND) algorithm after
+ * trimming the common ends. Beyond DIFF_MAX_EDITS edits the records are
+ * paired by index instead.
+ */
+static void align_sequence(const uint32_t *a, int n, const uint32_t *b, int m, int *match)
+{
+	int pre = 0, post = 0;
+
+	while (pre < n && pre < m && a[pre] == b[pre]) {
+		match[pre] = pre;
+		++pre;
+	}
+	while (post < n - pre && post < m - pre && a[n - 1 - post] == b[m - 1 - post]) {
+		match[n - 1 - post] = m - 1 - post;
+		++post;
+	}
+
+	a += pre; b += pre; match += pre;
+	n -= pre + post; m -= pre + post;
+
+	for (int i = 0; i < n; ++i)
+		match[i] = -1;
+	if (n == 0 || m == 0)
+		return;
+
+	int limit = MIN(n + m, DIFF_MAX_EDITS);
+
+	/* trace holds V after every step d, at (d * d + 2 * d) + k + d + 1 */
+	int *trace = (int *) malloc(sizeof (int) * ((size_t) (limit + 1) * (limit + 1) + 2 * (limit + 1)));
+	int *v = (int *) calloc(2 * limit + 3, sizeof (int));
+	int *vk = v + limit + 1;
+	int d, found = 0;
+
+	for (d = 0; d <= limit && !found; ++d) {
+		for (int k = -d; k <= d; k += 2) {
+			int x;
+			if (k == -d || (k != d && vk[k - 1] < vk[k + 1]))
+				x = vk[k + 1];
+			else
+				x = vk[k - 1] + 1;
+			int y = x - k;
+			while (x < n && y < m && a[x] == b[y])
+				++x, ++y;
+			vk[k] = x;
+			if (x >= n && y >= m)
+				found = 1;
+		}
+		memcpy(trace + d * d + 2 * d, vk - d - 1, sizeof (int) * (2 * d + 3));
+	}
+
+	if (!found) {
+		for (int i = 0; i < MIN(n, m); ++i)
+			match[i] = i;
+		free(trace);
+		free(v);
+		return;
+	}
+
+	int x = n, y = m;
+	for (--d; d > 0; --d) {
+		const int *pv = trace + (d - 1) * (d - 1) + 2 * (d - 1) + d;  // V after step d-1, at k = 0
+		int k = x - y;
+		int pk = (k == -d || (k != d && pv[k - 1] < pv[k + 1])) ? k + 1 : k - 1;
+		int px = pv[pk], py = px - pk;
+
+		while (x > px && y > py) {
+			--x, --y;
+			match[x] = y;
+		}
+		x = px;
+		y = py;
+	}
+	while (x > 0 && y > 0) {
+		--x, --y;
+		match[x] = y;
+	}
+
+	for (int i = 0; i < n; ++i)
+		if (match[i] >= 0)
+			match[i] += pre;
+
+	free(trace);
+	free(v);
+}
+
+/*
+ * Pairs up records by map position, for colonies and tribes which never
+ * move. Same contract as align_sequence().
+ */
+static void align_position(const uint16_t *a, int n, const uint16_t *b, int m, int *match)
+{
+	static __thread int16_t where[256 * 256];
+	static __thread int ready;
+
+	if (!ready) {
+		memset(where, 0xff, sizeof (where));
+		ready = 1;
+	}
+
+	for (int j = 0; j < m; ++j)
+		if (where[b[j]] == -1)
+			where[b[j]] = j;
+
+	/* Taken once matched, so two records of a on one tile don't share a partner */
+	for (int i = 0; i < n; ++i) {
+		match[i] = where[a[i]];
+		where[a[i]] = -1;
+	}
+
+	for (int j = 0; j < m; ++j)
+		where[b[j]] = -1;
+}
+
+typedef void (*describe_fn)(struct sink *out, const struct savegame_view *sv, int i);
+
+static void describe_colony(struct sink *out, const struct savegame_view *sv, int i)
+{
+	const struct savegame::colony *c = &sv->colony[i];
+	sink_printf(out, " %.*s %s (%d,%d)", (int) sizeof (c->name), c->name,
+		c->nation < 12 ? nation_list[c->nation] : "?", c->x, c->y);
+}
+
+static void describe_unit(struct sink *out, const struct savegame_view *sv, int i)
+{
+	const struct savegame::unit *u = &sv->unit[i];
+	sink_printf(out, " %s %s (%d,%d)",
+		u->type < COUNT_OF(unit_type_list) ? unit_type_list[u->type] : "?",
+		u->owner < 12 ? nation_list[u->owner] : "?", u->x, u->y);
+}
+
+static void describe_tribe(struct sink *out, const struct savegame_view *sv, int i)
+{
+	const struct savegame::tribe *t = &sv->tribe[i];
+	sink_printf(out, " %s (%d,%d)", t->nation < 12 ? nation_list[t->nation] : "?", t->x, t->y);
+}
+
+/*
+ * Writes the matched records' field changes in a order, then the records
+ * only in b, and returns the number of lines.
+ */
+template <typename T>
+static int diff_aligned(struct sink *out, const struct savegame_view *sa, const T *a, int n,
+                        const struct savegame_view *sb, const T *b, int m,
+                        const int *match, describe_fn describe)
+{
+	const struct field_table &t = fields_of<T>::table;
+	const char *section = t.name;
+	const size_t size = sizeof (T);
+	char prefix[64];
+	int lines = 0;
+
+	char *matched = (char *) calloc(m + 1, 1);
+
+	for (int i = 0; i < n; ++i) {
+		const uint8_t *ra = (const uint8_t *) a + i * size;
+		int j = match[i];
+
+		if (j < 0) {
+			sink_printf(out, "- %s[%d]", section, i);
+			describe(out, sa, i);
+			sink_putc(out, '\n');
+			++lines;
+			continue;
+		}
+
+		matched[j] = 1;
+		const uint8_t *rb = (const uint8_t *) b + j * size;
+		if (memcmp(ra, rb, size) == 0)
+			continue;
+
+		record_prefix(prefix, sizeof (prefix), section, i, j);
+		lines += diff_fields(out, prefix, t.field, t.count, ra, rb);
+	}
+
+	for (int j = 0; j < m; ++j) {
+		if (matched[j])
+			continue;
+		sink_printf(out, "+ %s[%d]", section, j);
+		describe(out, sb, j);
+		sink_putc(out, '\n');
+		++lines;
+	}
+
+	free(matched);
+	return lines;
+}
+
+int savegame_diff(struct sink *out, const struct savegame_view *a, const struct savegame_view *b)
+{
+	int lines = 0;
+
+	lines += diff_records(out, a->head, b->head, 1);
+	lines += diff_records(out, a->player, b->player, 4);
+	lines += diff_records(out, a->other, b->other, 1);
+
+	int na, nb;
+	int *match;
+
+	/* Colonies, by position */
+	na = a->head->colony_count;
+	nb = b->head->colony_count;
+	if (na != nb || memcmp(a->colony, b->colony, sizeof (*a->colony) * na) != 0) {
+		uint16_t *ka = (uint16_t *) malloc(sizeof (uint16_t) * (na + nb + 1));
+		uint16_t *kb = ka + na;
+		match = (int *) malloc(sizeof (int) * (na + 1));
+		for (int i = 0; i < na; ++i)
+			ka[i] = a->colony[i].x | a->colony[i].y << 8;
+		for (int j = 0; j < nb; ++j)
+			kb[j] = b->colony[j].x | b->colony[j].y << 8;
+		align_position(ka, na, kb, nb, match);
+		lines += diff_aligned(out, a, a->colony, na, b, b->colony, nb, match, describe_colony);
+		free(match);
+		free(ka);
+	}
+
+	/* Units move and change type, so pair them up by owner and type */
+	na = a->head->unit_count;
+	nb = b->head->unit_count;
+	if (na != nb || memcmp(a->unit, b->unit, sizeof (*a->unit) * na) != 0) {
+		uint32_t *ka = (uint32_t *) malloc(sizeof (uint32_t) * (na + nb + 1));
+		uint32_t *kb = ka + na;
+		match = (int *) malloc(sizeof (int) * (na + 1));
+		for (int i = 0; i < na; ++i)
+			ka[i] = a->unit[i].owner << 8 | a->unit[i].type;
+		for (int j = 0; j < nb; ++j)
+			kb[j] = b->unit[j].owner << 8 | b->unit[j].type;
+		align_sequence(ka, na, kb, nb, match);
+		lines += diff_aligned(out, a, a->unit, na, b, b->unit, nb, match, describe_unit);
+		free(match);
+		free(ka);
+	}
+
+	lines += diff_records(out, a->nation, b->nation, 4);
+
+	/* Tribes, by position */
+	na = a->head->tribe_count;
+	nb = b->head->tribe_count;
+	if (na != nb || memcmp(a->tribe, b->tribe, sizeof (*a->tribe) * na) != 0) {
+		uint16_t *ka = (uint16_t *) malloc(sizeof (uint16_t) * (na + nb + 1));
+		uint16_t *kb = ka + na;
+		match = (int *) malloc(sizeof (int) * (na + 1));
+		for (int i = 0; i < na; ++i)
+			ka[i] = a->tribe[i].x | a->tribe[i].y << 8;
+		for (int j = 0; j < nb; ++j)
+			kb[j] = b->tribe[j].x | b->tribe[j].y << 8;
+		align_position(ka, na, kb, nb, match);
+		lines += diff_aligned(out, a, a->tribe, na, b, b->tribe, nb, match, describe_tribe);
+		free(match);
+		free(ka);
+	}
+
+	lines += diff_records(out, a->indian_relations, b->indian_relations, 8);
+	lines += diff_records(out, a->stuff, b->stuff, 1);
+	lines += diff_map(out, a->map, b->map);
+	lines += diff_records(out, a->tail, b->tail, 1);
+	lines += diff_routes(out, a->trade_route, b->trade_route);
+
+	return lines;
+}
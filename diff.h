@@ -0,0 +1,26 @@
+#ifndef DIFF_H
+#define DIFF_H
+
+#include "savegame.h"
+#include "sink.h"
+
+/*
+ * Writes what changed from savegame a to savegame b to out, one line per
+ * changed field:
+ *
+ *   head.year: 1600 -> 1601
+ *   nation[1].gold: 1000 -> 1250
+ *   head.tut1.nr13: 0 -> 1
+ *   stuff.unk_big[17]: 0x12 -> 0x16 (^04)
+ *   colony[3>2].population: 3 -> 4
+ *   + unit[40] Soldier England (12,30)
+ *   - tribe[7] Sioux (40,12)
+ *
+ * Identical sections and records are skipped with one memcmp. Colonies and
+ * tribes are matched up by position and units by edit distance, so a record
+ * removed in the middle of a list doesn't show up as every later record
+ * changing. Returns the number of lines written.
+ */
+int savegame_diff(struct sink *out, const struct savegame_view *a, const struct savegame_view *b);
+
+#endif
@@ -0,0 +1,572 @@
+#ifndef FIELDS_H
+#define FIELDS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "savegame.h"
+
+/*
+ * Field tables, one per savegame struct, listing every byte of it: the
+ * name, byte offset, size, bit offset and width, signedness and name list
+ * of each field. The diff, the NDJSON export and the columnar export all
+ * work from these, and they are constant expressions, so the checks at the
+ * bottom verify at compile time that each table covers its struct exactly.
+ */
+
+#define COUNT_OF(a) (sizeof (a) / sizeof ((a)[0]))
+
+enum field_type {
+	FT_UINT,  // little endian unsigned
+	FT_INT,   // little endian signed
+	FT_HEX,   // unknown, printed in hex with the bits that flipped
+	FT_CHAR,  // nul padded string
+	FT_BITS,  // width bits at shift of the little endian size byte word
+};
+
+struct field {
+	const char *name;
+	uint16_t offset;
+	uint8_t size;   // of one element
+	uint16_t count; // elements, 1 for scalars
+	uint8_t type;
+	uint8_t shift, width;
+	const char **names;
+	int name_count;
+};
+
+struct field_table {
+	const char *name; // of the section
+	const struct field *field;
+	int count;
+	size_t size;      // of one record
+};
+
+#define MEMBER_SIZE(S, m) sizeof (((S *) 0)->m)
+
+#define FIELD(S, m, t)   { #m, offsetof(S, m), MEMBER_SIZE(S, m), 1, t, 0, 0, NULL, 0 }
+#define ARRAY(S, m, t)   { #m, offsetof(S, m), MEMBER_SIZE(S, m[0]), MEMBER_SIZE(S, m) / MEMBER_SIZE(S, m[0]), t, 0, 0, NULL, 0 }
+#define STRING(S, m)     { #m, offsetof(S, m), MEMBER_SIZE(S, m), 1, FT_CHAR, 0, 0, NULL, 0 }
+#define NAMED(S, m, l)   { #m, offsetof(S, m), MEMBER_SIZE(S, m), 1, FT_UINT, 0, 0, l, COUNT_OF(l) }
+
+/* Bitfields can't be offsetof()'d, so these name the word they live in */
+#define BITS(name, off, size, shift, width) { name, (uint16_t) (off), size, 1, FT_BITS, shift, width, NULL, 0 }
+#define BIT(name, off, size, shift) BITS(name, off, size, shift, 1)
+
+typedef struct savegame::head             head_t;
+typedef struct savegame::player           player_t;
+typedef struct savegame::other            other_t;
+typedef struct savegame::colony           colony_t;
+typedef struct savegame::unit             unit_t;
+typedef struct savegame::nation           nation_t;
+typedef struct savegame::tribe            tribe_t;
+typedef struct savegame::indian_relations indian_t;
+typedef struct savegame::stuff            stuff_t;
+typedef struct savegame::tail             tail_t;
+typedef struct savegame::trade_route      route_t;
+typedef struct savegame::trade_route::entry entry_t;
+
+static constexpr struct field head_field[] = {
+	STRING(head_t, sig_colonize),
+	ARRAY(head_t, unk0, FT_HEX),
+	FIELD(head_t, map_size_x, FT_UINT),
+	FIELD(head_t, map_size_y, FT_UINT),
+	BIT("tut1.nr13", offsetof(head_t, tut1), 1, 0),
+	BIT("tut1.nr14", offsetof(head_t, tut1), 1, 1),
+	BIT("tut1.unk3", offsetof(head_t, tut1), 1, 2),
+	BIT("tut1.nr15", offsetof(head_t, tut1), 1, 3),
+	BIT("tut1.nr16", offsetof(head_t, tut1), 1, 4),
+	BIT("tut1.nr17", offsetof(head_t, tut1), 1, 5),
+	BIT("tut1.unk7", offsetof(head_t, tut1), 1, 6),
+	BIT("tut1.nr19", offsetof(head_t, tut1), 1, 7),
+	ARRAY(head_t, unk1, FT_HEX),
+	BITS("game_options.unknown7",            offsetof(head_t, game_options), 2, 0, 7),
+	BIT("game_options.tutorial_hints",       offsetof(head_t, game_options), 2, 7),
+	BIT("game_options.water_color_cycling",  offsetof(head_t, game_options), 2, 8),
+	BIT("game_options.combat_analysis",      offsetof(head_t, game_options), 2, 9),
+	BIT("game_options.autosave",             offsetof(head_t, game_options), 2, 10),
+	BIT("game_options.end_of_turn",          offsetof(head_t, game_options), 2, 11),
+	BIT("game_options.fast_piece_slide",     offsetof(head_t, game_options), 2, 12),
+	BIT("game_options.cheat",                offsetof(head_t, game_options), 2, 13),
+	BIT("game_options.show_foreign_moves",   offsetof(head_t, game_options), 2, 14),
+	BIT("game_options.show_indian_moves",    offsetof(head_t, game_options), 2, 15),
+	BIT("colony_report_options.labels_on_cargo_and_terrain",        offsetof(head_t, colony_report_options), 2, 0),
+	BIT("colony_report_options.labels_on_buildings",                offsetof(head_t, colony_report_options), 2, 1),
+	BIT("colony_report_options.report_new_cargos_available",        offsetof(head_t, colony_report_options), 2, 2),
+	BIT("colony_report_options.report_inefficient_government",      offsetof(head_t, colony_report_options), 2, 3),
+	BIT("colony_report_options.report_tools_needed_for_production", offsetof(head_t, colony_report_options), 2, 4),
+	BIT("colony_report_options.report_raw_materials_shortages",     offsetof(head_t, colony_report_options), 2, 5),
+	BIT("colony_report_options.report_food_shortages",              offsetof(head_t, colony_report_options), 2, 6),
+	BIT("colony_report_options.report_when_colonists_trained",      offsetof(head_t, colony_report_options), 2, 7),
+	BIT("colony_report_options.report_sons_of_liberty_membership",  offsetof(head_t, colony_report_options), 2, 8),
+	BIT("colony_report_options.report_rebel_majorities",            offsetof(head_t, colony_report_options), 2, 9),
+	BITS("colony_report_options.unused",                            offsetof(head_t, colony_report_options), 2, 10, 6),
+	BIT("tut2.howtowin",         offsetof(head_t, tut2), 1, 0),
+	BIT("tut2.background_music", offsetof(head_t, tut2), 1, 1),
+	BIT("tut2.event_music",      offsetof(head_t, tut2), 1, 2),
+	BIT("tut2.sound_effects",    offsetof(head_t, tut2), 1, 3),
+	BIT("tut2.nr1",              offsetof(head_t, tut2), 1, 4),
+	BIT("tut2.nr2",              offsetof(head_t, tut2), 1, 5),
+	BIT("tut2.nr3",              offsetof(head_t, tut2), 1, 6),
+	BIT("tut2.nr4",              offsetof(head_t, tut2), 1, 7),
+	BIT("tut3.nr5",  offsetof(head_t, tut3), 1, 0),
+	BIT("tut3.nr6",  offsetof(head_t, tut3), 1, 1),
+	BIT("tut3.nr7",  offsetof(head_t, tut3), 1, 2),
+	BIT("tut3.nr8",  offsetof(head_t, tut3), 1, 3),
+	BIT("tut3.nr9",  offsetof(head_t, tut3), 1, 4),
+	BIT("tut3.nr10", offsetof(head_t, tut3), 1, 5),
+	BIT("tut3.nr11", offsetof(head_t, tut3), 1, 6),
+	BIT("tut3.nr12", offsetof(head_t, tut3), 1, 7),
+	FIELD(head_t, numbers00, FT_INT),
+	FIELD(head_t, year, FT_UINT),
+	FIELD(head_t, autumn, FT_UINT),
+	FIELD(head_t, turn, FT_UINT),
+	FIELD(head_t, numbers01, FT_INT),
+	FIELD(head_t, active_unit, FT_UINT),
+	ARRAY(head_t, numbers02, FT_INT),
+	FIELD(head_t, tribe_count, FT_UINT),
+	FIELD(head_t, unit_count, FT_UINT),
+	FIELD(head_t, colony_count, FT_UINT),
+	FIELD(head_t, trade_route_count, FT_UINT),
+	ARRAY(head_t, numbers03, FT_INT),
+	NAMED(head_t, difficulty, difficulty_list),
+	FIELD(head_t, numbers04, FT_INT),
+	ARRAY(head_t, founding_father, FT_INT),
+	ARRAY(head_t, numbers05, FT_UINT),
+	ARRAY(head_t, nation_relation, FT_INT),
+	ARRAY(head_t, numbers06, FT_INT),
+	ARRAY(head_t, expeditionary_force, FT_UINT),
+	ARRAY(head_t, numbers07, FT_UINT),
+	ARRAY(head_t, count_down, FT_UINT),
+	BIT("event.discovery_of_the_new_world",     offsetof(head_t, event), 2, 0),
+	BIT("event.building_a_colony",              offsetof(head_t, event), 2, 1),
+	BIT("event.meeting_the_natives",            offsetof(head_t, event), 2, 2),
+	BIT("event.the_aztec_empire",               offsetof(head_t, event), 2, 3),
+	BIT("event.the_inca_nation",                offsetof(head_t, event), 2, 4),
+	BIT("event.discovery_of_the_pacific_ocean", offsetof(head_t, event), 2, 5),
+	BIT("event.entering_indian_village",        offsetof(head_t, event), 2, 6),
+	BIT("event.the_fountain_of_youth",          offsetof(head_t, event), 2, 7),
+	BIT("event.cargo_from_the_new_world",       offsetof(head_t, event), 2, 8),
+	BIT("event.meeting_fellow_europeans",       offsetof(head_t, event), 2, 9),
+	BIT("event.colony_burning",                 offsetof(head_t, event), 2, 10),
+	BIT("event.colony_destroyed",               offsetof(head_t, event), 2, 11),
+	BIT("event.indian_raid",                    offsetof(head_t, event), 2, 12),
+	BIT("event.woodcut14",                      offsetof(head_t, event), 2, 13),
+	BIT("event.woodcut15",                      offsetof(head_t, event), 2, 14),
+	BIT("event.woodcut16",                      offsetof(head_t, event), 2, 15),
+	ARRAY(head_t, unkb, FT_HEX),
+};
+
+static const char *control_list[] = { "Player", "AI", "Withdrawn" };
+
+static constexpr struct field player_field[] = {
+	STRING(player_t, name),
+	STRING(player_t, country),
+	FIELD(player_t, unk00, FT_HEX),
+	NAMED(player_t, control, control_list),
+	FIELD(player_t, founded_colonies, FT_UINT),
+	FIELD(player_t, diplomacy, FT_UINT),
+};
+
+static constexpr struct field other_field[] = {
+	ARRAY(other_t, unkXX_xx, FT_HEX),
+};
+
+#define COLONY_BUILDINGS   offsetof(colony_t, buildings)
+#define COLONY_CUSTOMHOUSE offsetof(colony_t, custom_house)
+
+static constexpr struct field colony_field[] = {
+	FIELD(colony_t, x, FT_UINT),
+	FIELD(colony_t, y, FT_UINT),
+	STRING(colony_t, name),
+	NAMED(colony_t, nation, nation_list),
+	ARRAY(colony_t, unk0, FT_HEX),
+	FIELD(colony_t, population, FT_UINT),
+	ARRAY(colony_t, occupation, FT_UINT),
+	ARRAY(colony_t, profession, FT_UINT),
+	ARRAY(colony_t, unk6, FT_HEX),
+	ARRAY(colony_t, tiles, FT_INT),
+	ARRAY(colony_t, unk8, FT_HEX),
+	BITS("buildings.stockade",             COLONY_BUILDINGS, 4, 0, 3),
+	BITS("buildings.armory",               COLONY_BUILDINGS, 4, 3, 3),
+	BITS("buildings.docks",                COLONY_BUILDINGS, 4, 6, 3),
+	BITS("buildings.town_hall",            COLONY_BUILDINGS, 4, 9, 3),
+	BITS("buildings.schoolhouse",          COLONY_BUILDINGS, 4, 12, 3),
+	BITS("buildings.warehouse",            COLONY_BUILDINGS, 4, 15, 2),
+	BIT("buildings.stables",               COLONY_BUILDINGS, 4, 17),
+	BIT("buildings.custom_house",          COLONY_BUILDINGS, 4, 18),
+	BITS("buildings.printing_press",       COLONY_BUILDINGS, 4, 19, 2),
+	BITS("buildings.weavers_house",        COLONY_BUILDINGS, 4, 21, 3),
+	BITS("buildings.tobacconists_house",   COLONY_BUILDINGS, 4, 24, 3),
+	BITS("buildings.rum_distillers_house", COLONY_BUILDINGS, 4, 27, 3),
+	BITS("buildings.capitol",              COLONY_BUILDINGS, 4, 30, 2),
+	BITS("buildings.fur_traders_house",    COLONY_BUILDINGS + 4, 2, 0, 3),
+	BITS("buildings.carpenters_shop",      COLONY_BUILDINGS + 4, 2, 3, 2),
+	BITS("buildings.church",               COLONY_BUILDINGS + 4, 2, 5, 2),
+	BITS("buildings.blacksmiths_house",    COLONY_BUILDINGS + 4, 2, 7, 3),
+	BITS("buildings.unused",               COLONY_BUILDINGS + 4, 2, 10, 6),
+	BIT("custom_house.food",        COLONY_CUSTOMHOUSE, 2, 0),
+	BIT("custom_house.sugar",       COLONY_CUSTOMHOUSE, 2, 1),
+	BIT("custom_house.tobacco",     COLONY_CUSTOMHOUSE, 2, 2),
+	BIT("custom_house.cotton",      COLONY_CUSTOMHOUSE, 2, 3),
+	BIT("custom_house.furs",        COLONY_CUSTOMHOUSE, 2, 4),
+	BIT("custom_house.lumber",      COLONY_CUSTOMHOUSE, 2, 5),
+	BIT("custom_house.ore",         COLONY_CUSTOMHOUSE, 2, 6),
+	BIT("custom_house.silver",      COLONY_CUSTOMHOUSE, 2, 7),
+	BIT("custom_house.horses",      COLONY_CUSTOMHOUSE, 2, 8),
+	BIT("custom_house.rum",         COLONY_CUSTOMHOUSE, 2, 9),
+	BIT("custom_house.cigars",      COLONY_CUSTOMHOUSE, 2, 10),
+	BIT("custom_house.cloth",       COLONY_CUSTOMHOUSE, 2, 11),
+	BIT("custom_house.coats",       COLONY_CUSTOMHOUSE, 2, 12),
+	BIT("custom_house.trade_goods", COLONY_CUSTOMHOUSE, 2, 13),
+	BIT("custom_house.tools",       COLONY_CUSTOMHOUSE, 2, 14),
+	BIT("custom_house.muskets",     COLONY_CUSTOMHOUSE, 2, 15),
+	ARRAY(colony_t, unka, FT_HEX),
+	FIELD(colony_t, hammers, FT_UINT),
+	FIELD(colony_t, building_in_production, FT_UINT),
+	ARRAY(colony_t, unkb, FT_HEX),
+	ARRAY(colony_t, stock, FT_INT),
+	ARRAY(colony_t, unkd, FT_HEX),
+	FIELD(colony_t, rebel_dividend, FT_UINT),
+	FIELD(colony_t, rebel_divisor, FT_UINT),
+};
+
+#define UNIT_OWNER offsetof(unit_t, type) + 1
+#define UNIT_CARGO offsetof(unit_t, holds_occupied) + 1
+
+static constexpr struct field unit_field[] = {
+	FIELD(unit_t, x, FT_UINT),
+	FIELD(unit_t, y, FT_UINT),
+	NAMED(unit_t, type, unit_type_list),
+	{ "owner", UNIT_OWNER, 1, 1, FT_BITS, 0, 4, nation_list, COUNT_OF(nation_list) },
+	BITS("unk04", UNIT_OWNER, 1, 4, 4),
+	FIELD(unit_t, unk05, FT_HEX),
+	FIELD(unit_t, moves, FT_UINT),
+	FIELD(unit_t, unk06, FT_HEX),
+	FIELD(unit_t, unk07, FT_HEX),
+	FIELD(unit_t, order, FT_UINT),
+	ARRAY(unit_t, unk08, FT_HEX),
+	FIELD(unit_t, holds_occupied, FT_UINT),
+	BITS("cargo_item_0", UNIT_CARGO,     1, 0, 4),
+	BITS("cargo_item_1", UNIT_CARGO,     1, 4, 4),
+	BITS("cargo_item_2", UNIT_CARGO + 1, 1, 0, 4),
+	BITS("cargo_item_3", UNIT_CARGO + 1, 1, 4, 4),
+	BITS("cargo_item_4", UNIT_CARGO + 2, 1, 0, 4),
+	BITS("cargo_item_5", UNIT_CARGO + 2, 1, 4, 4),
+	ARRAY(unit_t, cargo_hold, FT_UINT),
+	FIELD(unit_t, turns_worked, FT_UINT),
+	NAMED(unit_t, profession, profession_list),
+	FIELD(unit_t, transport_chain.next_unit_idx, FT_INT),
+	FIELD(unit_t, transport_chain.prev_unit_idx, FT_INT),
+};
+
+static constexpr struct field nation_field[] = {
+	FIELD(nation_t, unk0, FT_HEX),
+	FIELD(nation_t, tax_rate, FT_UINT),
+	ARRAY(nation_t, recruit, FT_UINT),
+	FIELD(nation_t, unk1, FT_HEX),
+	FIELD(nation_t, recruit_count, FT_UINT),
+	ARRAY(nation_t, unk2, FT_HEX),
+	FIELD(nation_t, liberty_bells_total, FT_UINT),
+	FIELD(nation_t, liberty_bells_last_turn, FT_UINT),
+	ARRAY(nation_t, unk3, FT_HEX),
+	FIELD(nation_t, next_founding_father, FT_INT),
+	FIELD(nation_t, founding_father_count, FT_UINT),
+	FIELD(nation_t, ffc_high, FT_UINT),
+	FIELD(nation_t, villages_burned, FT_UINT),
+	ARRAY(nation_t, unk4, FT_HEX),
+	FIELD(nation_t, artillery_count, FT_UINT),
+	FIELD(nation_t, boycott_bitmap, FT_HEX),
+	ARRAY(nation_t, unk5, FT_HEX),
+	FIELD(nation_t, gold, FT_UINT),
+	FIELD(nation_t, crosses, FT_UINT),
+	ARRAY(nation_t, unk6, FT_HEX),
+	ARRAY(nation_t, indian_relation, FT_HEX),
+	ARRAY(nation_t, unk7, FT_HEX),
+	ARRAY(nation_t, trade.euro_price, FT_UINT),
+	ARRAY(nation_t, trade.nr, FT_INT),
+	ARRAY(nation_t, trade.gold, FT_INT),
+	ARRAY(nation_t, trade.tons, FT_INT),
+	ARRAY(nation_t, trade.tons2, FT_INT),
+};
+
+static constexpr struct field tribe_field[] = {
+	FIELD(tribe_t, x, FT_UINT),
+	FIELD(tribe_t, y, FT_UINT),
+	NAMED(tribe_t, nation, nation_list),
+	BIT("state.artillery", offsetof(tribe_t, state), 1, 0),
+	BIT("state.learned",   offsetof(tribe_t, state), 1, 1),
+	BIT("state.capital",   offsetof(tribe_t, state), 1, 2),
+	BIT("state.scouted",   offsetof(tribe_t, state), 1, 3),
+	BIT("state.unk5",      offsetof(tribe_t, state), 1, 4),
+	BIT("state.unk6",      offsetof(tribe_t, state), 1, 5),
+	BIT("state.unk7",      offsetof(tribe_t, state), 1, 6),
+	BIT("state.unk8",      offsetof(tribe_t, state), 1, 7),
+	FIELD(tribe_t, population, FT_UINT),
+	FIELD(tribe_t, mission, FT_INT),
+	FIELD(tribe_t, unk1, FT_HEX),
+	FIELD(tribe_t, flag_0, FT_INT),
+	FIELD(tribe_t, last_cargo_bought, FT_INT),
+	FIELD(tribe_t, last_cargo_sold, FT_INT),
+	FIELD(tribe_t, panic, FT_UINT),
+	ARRAY(tribe_t, unk2, FT_HEX),
+	FIELD(tribe_t, population_loss_in_current_turn, FT_UINT),
+};
+
+static constexpr struct field indian_field[] = {
+	FIELD(indian_t, unk0, FT_HEX),
+	FIELD(indian_t, unk1, FT_HEX),
+	NAMED(indian_t, level, indian_level),
+	ARRAY(indian_t, unk2, FT_HEX),
+	FIELD(indian_t, armed_braves, FT_UINT),
+	FIELD(indian_t, horse_herds, FT_UINT),
+	ARRAY(indian_t, unk3, FT_HEX),
+	ARRAY(indian_t, stock, FT_INT),
+	ARRAY(indian_t, unk4, FT_HEX),
+	ARRAY(indian_t, meeting, FT_UINT),
+	ARRAY(indian_t, unk5, FT_HEX),
+	ARRAY(indian_t, aggr, FT_UINT),
+};
+
+static constexpr struct field stuff_field[] = {
+	ARRAY(stuff_t, unk15, FT_HEX),
+	FIELD(stuff_t, counter_decreasing_on_new_colony, FT_UINT),
+	FIELD(stuff_t, unk_short, FT_HEX),
+	FIELD(stuff_t, counter_increasing_on_new_colony, FT_UINT),
+	ARRAY(stuff_t, unk_big, FT_HEX),
+	FIELD(stuff_t, x, FT_UINT),
+	FIELD(stuff_t, y, FT_UINT),
+	FIELD(stuff_t, zoom_level, FT_UINT),
+	FIELD(stuff_t, unk7, FT_HEX),
+	FIELD(stuff_t, viewport_x, FT_UINT),
+	FIELD(stuff_t, viewport_y, FT_UINT),
+};
+
+static constexpr struct field tail_field[] = {
+	ARRAY(tail_t, unk, FT_HEX),
+};
+
+static constexpr struct field route_field[] = {
+	STRING(route_t, name),
+	FIELD(route_t, type, FT_UINT),
+	FIELD(route_t, entries, FT_UINT),
+};
+
+#define ENTRY_SIZES offsetof(entry_t, destination) + 2
+#define ENTRY_CARGO offsetof(entry_t, cargo)
+
+static constexpr struct field entry_field[] = {
+	FIELD(entry_t, destination, FT_UINT),
+	BITS("unloading_size", ENTRY_SIZES, 1, 0, 4),
+	BITS("loading_size",   ENTRY_SIZES, 1, 4, 4),
+	BITS("cargo[0].item_0", ENTRY_CARGO,     1, 0, 4),
+	BITS("cargo[0].item_1", ENTRY_CARGO,     1, 4, 4),
+	BITS("cargo[0].item_2", ENTRY_CARGO + 1, 1, 0, 4),
+	BITS("cargo[0].item_3", ENTRY_CARGO + 1, 1, 4, 4),
+	BITS("cargo[0].item_4", ENTRY_CARGO + 2, 1, 0, 4),
+	BITS("cargo[0].item_5", ENTRY_CARGO + 2, 1, 4, 4),
+	BITS("cargo[1].item_0", ENTRY_CARGO + 3, 1, 0, 4),
+	BITS("cargo[1].item_1", ENTRY_CARGO + 3, 1, 4, 4),
+	BITS("cargo[1].item_2", ENTRY_CARGO + 4, 1, 0, 4),
+	BITS("cargo[1].item_3", ENTRY_CARGO + 4, 1, 4, 4),
+	BITS("cargo[1].item_4", ENTRY_CARGO + 5, 1, 0, 4),
+	BITS("cargo[1].item_5", ENTRY_CARGO + 5, 1, 4, 4),
+	FIELD(entry_t, padding, FT_HEX),
+};
+
+#define TABLE(name, fields, type) { name, fields, (int) COUNT_OF(fields), sizeof (type) }
+
+static constexpr struct field_table head_fields   = TABLE("head",   head_field,   head_t);
+static constexpr struct field_table player_fields = TABLE("player", player_field, player_t);
+static constexpr struct field_table other_fields  = TABLE("other",  other_field,  other_t);
+static constexpr struct field_table colony_fields = TABLE("colony", colony_field, colony_t);
+static constexpr struct field_table unit_fields   = TABLE("unit",   unit_field,   unit_t);
+static constexpr struct field_table nation_fields = TABLE("nation", nation_field, nation_t);
+static constexpr struct field_table tribe_fields  = TABLE("tribe",  tribe_field,  tribe_t);
+static constexpr struct field_table indian_fields = TABLE("indian", indian_field, indian_t);
+static constexpr struct field_table stuff_fields  = TABLE("stuff",  stuff_field,  stuff_t);
+static constexpr struct field_table tail_fields   = TABLE("tail",   tail_field,   tail_t);
+static constexpr struct field_table route_fields  = TABLE("route",  route_field,  route_t);
+static constexpr struct field_table entry_fields  = TABLE("entry",  entry_field,  entry_t);
+
+/* The table of each struct, for code generic over record types */
+template <typename T> struct fields_of;
+
+#define FIELDS_OF(type, fields) \
+	template <> struct fields_of<type> { static constexpr const struct field_table &table = fields; }
+
+FIELDS_OF(head_t,   head_fields);
+FIELDS_OF(player_t, player_fields);
+FIELDS_OF(other_t,  other_fields);
+FIELDS_OF(colony_t, colony_fields);
+FIELDS_OF(unit_t,   unit_fields);
+FIELDS_OF(nation_t, nation_fields);
+FIELDS_OF(tribe_t,  tribe_fields);
+FIELDS_OF(indian_t, indian_fields);
+FIELDS_OF(stuff_t,  stuff_fields);
+FIELDS_OF(tail_t,   tail_fields);
+FIELDS_OF(route_t,  route_fields);
+FIELDS_OF(entry_t,  entry_fields);
+
+/*
+ * Compile time checks
+ */
+
+/*
+ * Fields follow each other with no gap or overlap up to size, and the bit fields of a word follow each other from bit 0 up to
+ * its last bit.
+ */
+constexpr bool fields_cover(const struct field_table &t, size_t size)
+{
+	size_t end = 0;
+	int bits = 0; // used so far of the open bit field word, 0 if none is open
+
+	for (int i = 0; i < t.count; ++i) {
+		const struct field &f = t.field[i];
+
+		if (f.size == 0 || f.count == 0 || (f.names && f.name_count == 0))
+			return false;
+
+		if (f.type == FT_BITS && bits != 0) {
+			if (f.offset != t.field[i - 1].offset || f.size != t.field[i - 1].size || f.shift != bits)
+				return false;
+		} else {
+			if (f.offset != end)
+				return false;
+			end += (size_t) f.size * f.count;
+			if (f.type == FT_BITS && f.shift != 0)
+				return false;
+		}
+
+		if (f.type == FT_BITS) {
+			if (f.width == 0 || f.count != 1)
+				return false;
+			bits += f.width;
+			if (bits > 8 * f.size)
+				return false;
+			if (bits == 8 * f.size)
+				bits = 0;
+		}
+	}
+
+	return end == size && bits == 0;
+}
+
+static_assert(fields_cover(head_fields, sizeof (head_t)), "head_field doesn't match struct savegame::head");
+static_assert(fields_cover(player_fields, sizeof (player_t)), "player_field doesn't match struct savegame::player");
+static_assert(fields_cover(other_fields, sizeof (other_t)), "other_field doesn't match struct savegame::other");
+static_assert(fields_cover(colony_fields, sizeof (colony_t)), "colony_field doesn't match struct savegame::colony");
+static_assert(fields_cover(unit_fields, sizeof (unit_t)), "unit_field doesn't match struct savegame::unit");
+static_assert(fields_cover(nation_fields, sizeof (nation_t)), "nation_field doesn't match struct savegame::nation");
+static_assert(fields_cover(tribe_fields, sizeof (tribe_t)), "tribe_field doesn't match struct savegame::tribe");
+static_assert(fields_cover(indian_fields, sizeof (indian_t)), "indian_field doesn't match struct savegame::indian_relations");
+static_assert(fields_cover(stuff_fields, sizeof (stuff_t)), "stuff_field doesn't match struct savegame::stuff");
+static_assert(fields_cover(tail_fields, sizeof (tail_t)), "tail_field doesn't match struct savegame::tail");
+static_assert(fields_cover(route_fields, offsetof(route_t, entry)), "route_field doesn't match struct savegame::trade_route");
+static_assert(sizeof (route_t) == offsetof(route_t, entry) + 4 * sizeof (entry_t), "route entries aren't last");
+static_assert(fields_cover(entry_fields, sizeof (entry_t)), "entry_field doesn't match struct savegame::trade_route::entry");
+
+constexpr bool name_equal(const char *a, const char *b)
+{
+	while (*a && *a == *b)
+		++a, ++b;
+	return *a == *b;
+}
+
+/* Index of the field called name in t, -1 if there is none */
+constexpr int field_index(const struct field_table &t, const char *name)
+{
+	for (int i = 0; i < t.count; ++i)
+		if (name_equal(t.field[i].name, name))
+			return i;
+	return -1;
+}
+
+/*
+ * Field and element packed into one int, field << 8 | element, or -1 if
+ * the table has no such field or element. Wrapped in FIELD_REF() it fails
+ * to compile instead.
+ */
+constexpr int field_ref(const struct field_table &t, const char *name, int element = 0)
+{
+	return (field_index(t, name) != -1 && element >= 0 && element < t.field[field_index(t, name)].count) ?
+		field_index(t, name) << 8 | element : -1;
+}
+
+template <int ref> struct field_constant {
+	static_assert(ref != -1, "no such field in the table");
+	static constexpr int value = ref;
+};
+
+#define FIELD_REF(table, name, ...) (field_constant<field_ref(table, name, ##__VA_ARGS__)>::value)
+
+/*
+ * Reading and writing
+ */
+
+static inline uint32_t load_le(const uint8_t *p, int size)
+{
+	uint32_t v = 0;
+	for (int i = size - 1; i >= 0; --i)
+		v = (v << 8) | p[i];
+	return v;
+}
+
+static inline void store_le(uint8_t *p, int size, uint32_t v)
+{
+	for (int i = 0; i < size; ++i, v >>= 8)
+		p[i] = v;
+}
+
+/* Value of the element of f at p, sign extended or bit extracted per its type */
+static inline int64_t field_value(const struct field *f, const uint8_t *p)
+{
+	uint32_t v = load_le(p, f->size);
+
+	switch (f->type) {
+		case FT_INT:
+			return (int32_t) (v << (32 - 8 * f->size)) >> (32 - 8 * f->size);
+		case FT_BITS:
+			return (v >> f->shift) & ((1u << f->width) - 1);
+		default:
+			return v;
+	}
+}
+
+/* Stores value into the element of f at p, truncated to its size or width */
+static inline void field_store(const struct field *f, uint8_t *p, int64_t value)
+{
+	if (f->type == FT_BITS) {
+		uint32_t mask = ((1u << f->width) - 1) << f->shift;
+		uint32_t v = load_le(p, f->size);
+		store_le(p, f->size, (v & ~mask) | (((uint32_t) value << f->shift) & mask));
+	} else {
+		store_le(p, f->size, (uint32_t) value);
+	}
+}
+
+/* Element ref (a FIELD_REF()) of records[i] */
+template <typename T>
+static inline int64_t field_get(const T *records, int i, int ref)
+{
+	const struct field *f = &fields_of<T>::table.field[ref >> 8];
+	return field_value(f, (const uint8_t *) &records[i] + f->offset + (ref & 0xff) * f->size);
+}
+
+#undef MEMBER_SIZE
+#undef FIELD
+#undef ARRAY
+#undef STRING
+#undef NAMED
+#undef BITS
+#undef BIT
+#undef TABLE
+#undef FIELDS_OF
+#undef COLONY_BUILDINGS
+#undef COLONY_CUSTOMHOUSE
+#undef UNIT_OWNER
+#undef UNIT_CARGO
+#undef ENTRY_SIZES
+#undef ENTRY_CARGO
+
+#endif
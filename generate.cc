@@ -0,0 +1,430 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/param.h>
+
+#include "generate.h"
+#include "mapplane.h"
+
+static const char *colony_names[] = {
+	"Jamestown", "Plymouth", "Roanoke", "Boston", "Charlestown", "Quebec", "Montreal",
+	"Trois-Rivieres", "St. Augustine", "Santa Fe", "Veracruz", "Havana", "Nieuw Amsterdam",
+	"Fort Oranje", "Beverwijck", "Wiltwyck",
+};
+
+static const char *leader_names[4] = { "Walter Raleigh", "Jacques Cartier", "Hernan Cortes", "Peter Minuit" };
+
+/* splitmix64, so a seed means the same thing everywhere */
+static uint64_t next(uint64_t *state)
+{
+	uint64_t z = (*state += 0x9e3779b97f4a7c15ull);
+	z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+	z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+	return z ^ (z >> 31);
+}
+
+/* [lo, hi] */
+static int range(uint64_t *state, int lo, int hi)
+{
+	return lo + (int) (next(state) % (uint64_t) (hi - lo + 1));
+}
+
+/* Layer 0 water bit, from the packed map byte */
+#define WATER 0x10
+
+struct land {
+	int count, water_count;
+	uint16_t *tile;  // land tiles, then water tiles
+	uint8_t island[MAP_TILES];
+};
+
+static void generate_map(uint64_t *rng, struct savegame::map *map, struct land *land)
+{
+	/* A few elliptic land masses on an ocean, the map's edge always water */
+	int islands = range(rng, 3, 7);
+	int cx[7], cy[7], rx[7], ry[7];
+	for (int k = 0; k < islands; ++k) {
+		cx[k] = range(rng, 6, MAP_WIDTH - 7);
+		cy[k] = range(rng, 6, MAP_HEIGHT - 7);
+		rx[k] = range(rng, 3, 12);
+		ry[k] = range(rng, 4, 18);
+	}
+
+	uint8_t *terrain = &map->layer[0][0].full;
+	for (int y = 0; y < MAP_HEIGHT; ++y) {
+		for (int x = 0; x < MAP_WIDTH; ++x) {
+			int is_land = 0;
+			if (x > 0 && y > 0 && x < MAP_WIDTH - 1 && y < MAP_HEIGHT - 1) {
+				for (int k = 0; k < islands && !is_land; ++k) {
+					int dx = x - cx[k], dy = y - cy[k];
+					is_land = dx * dx * ry[k] * ry[k] + dy * dy * rx[k] * rx[k] <= rx[k] * rx[k] * ry[k] * ry[k];
+				}
+			}
+
+			uint8_t *t = &terrain[x + y * MAP_WIDTH];
+			if (is_land)
+				*t = range(rng, 0, 7) | (range(rng, 0, 1) << 3) | (range(rng, 0, 7) << 5);
+			else
+				*t = range(rng, 0, 1) | WATER;
+		}
+	}
+
+	/* Land tiles first, then water, for placing things */
+	land->count = land->water_count = 0;
+	for (int i = 0; i < MAP_TILES; ++i)
+		if (!(terrain[i] & WATER))
+			land->tile[land->count++] = i;
+	for (int i = 0; i < MAP_TILES; ++i)
+		if (terrain[i] & WATER)
+			land->tile[land->count + land->water_count++] = i;
+
+	/* Islands numbered by flood fill, 1 to 7 */
+	static __thread uint16_t queue[MAP_TILES];
+	int number = 0;
+	memset(land->island, 0, sizeof (land->island));
+	for (int k = 0; k < land->count; ++k) {
+		int start = land->tile[k];
+		if (land->island[start])
+			continue;
+
+		number = MIN(number + 1, 7);
+		int head = 0, tail = 0;
+		queue[tail++] = start;
+		land->island[start] = number;
+		while (head < tail) {
+			int i = queue[head++], x = i % MAP_WIDTH, y = i / MAP_WIDTH;
+			static const int dx[4] = { 1, -1, 0, 0 }, dy[4] = { 0, 0, 1, -1 };
+			for (int d = 0; d < 4; ++d) {
+				int j = (x + dx[d]) + (y + dy[d]) * MAP_WIDTH; // the edge is water, so never off the map
+				if (!(terrain[j] & WATER) && !land->island[j]) {
+					land->island[j] = number;
+					queue[tail++] = j;
+				}
+			}
+		}
+	}
+
+	for (int i = 0; i < MAP_TILES; ++i) {
+		uint8_t water = terrain[i] & WATER;
+		map->layer[1][i].full = water;
+		map->layer[2][i].full = water | (land->island[i] << 5);
+		map->layer[3][i].full = water;
+	}
+}
+
+/* A random land tile, or water tile */
+static void place(uint64_t *rng, const struct land *land, int water, uint8_t *x, uint8_t *y)
+{
+	int i = water ? land->tile[land->count + range(rng, 0, land->water_count - 1)]
+	              : land->tile[range(rng, 0, land->count - 1)];
+	*x = i % MAP_WIDTH;
+	*y = i / MAP_WIDTH;
+}
+
+/* Layer 3: within two tiles of (x, y) is explored */
+static void explore(struct savegame::map *map, int x, int y)
+{
+	for (int j = MAX(y - 2, 0); j <= MIN(y + 2, MAP_HEIGHT - 1); ++j)
+		for (int i = MAX(x - 2, 0); i <= MIN(x + 2, MAP_WIDTH - 1); ++i)
+			map->layer[3][i + j * MAP_WIDTH].tile = 1;
+}
+
+size_t generate_savegame(uint64_t seed, const struct generate_options *go, struct savegame_view *sv, struct savegame_buffer *buf)
+{
+	uint64_t rng = seed;
+
+	struct savegame::head h;
+	memset(&h, 0, sizeof (h));
+	h.colony_count = MIN(go->colonies, GENERATE_MAX_COLONIES);
+	h.unit_count = MIN(go->units, GENERATE_MAX_UNITS);
+	h.tribe_count = MIN(go->tribes, GENERATE_MAX_TRIBES);
+	h.trade_route_count = MIN(go->routes, GENERATE_MAX_ROUTES);
+
+	int colonies = h.colony_count, units = h.unit_count, tribes = h.tribe_count;
+
+	struct section_table st;
+	section_table(&h, &st);
+	size_t size = st.offset[SECTION_COUNT];
+
+	if (buf->cap < size) {
+		buf->cap = MAX(buf->cap, 64 * 1024);
+		while (buf->cap < size)
+			buf->cap *= 2;
+		buf->data = (uint8_t *) realloc(buf->data, buf->cap);
+	}
+	memset(buf->data, 0, size);
+
+	savegame_view_init(sv, buf->data, &st);
+	sv->base = buf->data;
+	sv->size = size;
+	sv->mapped = 0;
+
+	static __thread uint16_t tiles[MAP_TILES];
+	static __thread struct land land;
+	land.tile = tiles;
+	generate_map(&rng, sv->map, &land);
+
+	struct savegame::head *head = sv->head;
+	*head = h;
+	memcpy(head->sig_colonize, "COLONIZE", 9);
+	head->map_size_x = MAP_WIDTH;
+	head->map_size_y = MAP_HEIGHT;
+	head->turn = range(&rng, 0, 600);
+	head->year = 1492 + (head->turn < 200 ? head->turn : 200 + (head->turn - 200) / 2);
+	head->autumn = head->turn >= 200 && (head->turn & 1);
+	head->difficulty = range(&rng, 0, 4);
+	head->active_unit = units ? range(&rng, 0, units - 1) : 0;
+	for (int i = 0; i < 25; ++i)
+		head->founding_father[i] = range(&rng, -1, 3);
+	for (int i = 0; i < 4; ++i)
+		head->nation_relation[i] = range(&rng, -100, 100);
+
+	int human = range(&rng, 0, 3);
+	for (int i = 0; i < 4; ++i) {
+		struct savegame::player *p = &sv->player[i];
+		strcpy(p->name, leader_names[i]);
+		strcpy(p->country, nation_list[i]);
+		p->control = (i == human) ? savegame::player::PLAYER : range(&rng, 0, 7) ? savegame::player::AI : savegame::player::WITHDRAWN;
+		p->founded_colonies = range(&rng, 0, 30);
+	}
+
+	for (int i = 0; i < colonies; ++i) {
+		struct savegame::colony *c = &sv->colony[i];
+		place(&rng, &land, 0, &c->x, &c->y);
+		sv->map->layer[1][c->x + c->y * MAP_WIDTH].tile = 1;
+		explore(sv->map, c->x, c->y);
+		const char *name = colony_names[i % (sizeof (colony_names) / sizeof (colony_names[0]))];
+		if (i < (int) (sizeof (colony_names) / sizeof (colony_names[0])))
+			snprintf(c->name, sizeof (c->name), "%s", name);
+		else
+			snprintf(c->name, sizeof (c->name), "%.16s %d", name, i);
+		c->nation = range(&rng, 0, 3);
+		c->population = range(&rng, 1, 32);
+		for (int j = 0; j < c->population; ++j) {
+			c->occupation[j] = range(&rng, 0, 28);
+			c->profession[j] = range(&rng, 0, 28);
+		}
+		for (int j = 0; j < 8; ++j)
+			c->tiles[j] = range(&rng, -1, c->population - 1);
+		c->buildings.stockade = range(&rng, 0, 3);
+		c->buildings.docks = range(&rng, 0, 3);
+		c->buildings.town_hall = range(&rng, 0, 3);
+		c->buildings.warehouse = range(&rng, 0, 2);
+		c->buildings.custom_house = range(&rng, 0, 1);
+		c->buildings.church = range(&rng, 0, 2);
+		c->hammers = range(&rng, 0, 500);
+		c->building_in_production = range(&rng, 0, 40);
+		for (int j = 0; j < 16; ++j)
+			c->stock[j] = range(&rng, 0, 300);
+		c->rebel_dividend = range(&rng, 0, 100);
+		c->rebel_divisor = range(&rng, 1, 100);
+	}
+
+	for (int i = 0; i < units; ++i) {
+		struct savegame::unit *u = &sv->unit[i];
+		u->type = range(&rng, 0, 22);
+		u->owner = (u->type >= 19) ? range(&rng, INDIAN_OFFSET, 11) : range(&rng, 0, 3);
+		place(&rng, &land, u->type >= 13 && u->type <= 18, &u->x, &u->y);
+		u->moves = range(&rng, 0, 12);
+		if (u->type < 13 || u->type > 18)
+			u->profession = (u->type == 10) ? range(&rng, 1, 200) : range(&rng, 0, 28);
+		u->transport_chain.next_unit_idx = -1;
+		u->transport_chain.prev_unit_idx = -1;
+	}
+
+	/*
+	 * Half the ships take on up to four European land units of their owner
+	 * that aren't aboard anything yet: ship <-> first <-> second ..., all on
+	 * the ship's tile. The rest of the holds may be goods.
+	 */
+	int from[4] = { 0, 0, 0, 0 }; // where to look on for an unlinked land unit, by owner
+	for (int s = 0; s < units; ++s) {
+		struct savegame::unit *ship = &sv->unit[s];
+		if (ship->type < 13 || ship->type > 18)
+			continue;
+
+		int aboard = 0, last = s;
+		if (range(&rng, 0, 1)) {
+			int want = range(&rng, 1, 4);
+			int *j = &from[ship->owner];
+			for (; *j < units && aboard < want; ++*j) {
+				struct savegame::unit *u = &sv->unit[*j];
+				if (u->type >= 13 || u->owner != ship->owner || u->transport_chain.prev_unit_idx != -1)
+					continue;
+				u->x = ship->x;
+				u->y = ship->y;
+				sv->unit[last].transport_chain.next_unit_idx = *j;
+				u->transport_chain.prev_unit_idx = last;
+				last = *j;
+				++aboard;
+			}
+		}
+
+		ship->holds_occupied = range(&rng, 0, 6 - aboard);
+		ship->cargo_item_0 = range(&rng, 0, 15); ship->cargo_item_1 = range(&rng, 0, 15);
+		ship->cargo_item_2 = range(&rng, 0, 15); ship->cargo_item_3 = range(&rng, 0, 15);
+		ship->cargo_item_4 = range(&rng, 0, 15); ship->cargo_item_5 = range(&rng, 0, 15);
+		for (int j = 0; j < ship->holds_occupied; ++j)
+			ship->cargo_hold[j] = range(&rng, 1, 100);
+	}
+
+	for (int i = 0; i < units; ++i)
+		explore(sv->map, sv->unit[i].x, sv->unit[i].y);
+
+	for (int i = 0; i < 4; ++i) {
+		struct savegame::nation *n = &sv->nation[i];
+		n->tax_rate = range(&rng, 0, 70);
+		for (int j = 0; j < 3; ++j)
+			n->recruit[j] = range(&rng, 0, 28);
+		n->recruit_count = range(&rng, 0, 180);
+		n->liberty_bells_total = range(&rng, 0, 5000);
+		n->liberty_bells_last_turn = range(&rng, 0, 100);
+		n->next_founding_father = range(&rng, -1, 24);
+		n->founding_father_count = range(&rng, 0, 25);
+		n->gold = range(&rng, 0, 100000);
+		n->crosses = range(&rng, 0, 3000);
+		for (int j = 0; j < 8; ++j) {
+			static const uint8_t relation[] = { savegame::nation::NOT_MET, savegame::nation::WAR, savegame::nation::PEACE };
+			n->indian_relation[j] = relation[range(&rng, 0, 2)];
+		}
+		for (int j = 0; j < 16; ++j) {
+			n->trade.euro_price[j] = range(&rng, 1, 20);
+			n->trade.tons[j] = n->trade.tons2[j] = range(&rng, 0, 99999);
+			n->trade.gold[j] = range(&rng, 0, 99999);
+		}
+	}
+
+	for (int i = 0; i < tribes; ++i) {
+		struct savegame::tribe *t = &sv->tribe[i];
+		place(&rng, &land, 0, &t->x, &t->y);
+		t->nation = range(&rng, INDIAN_OFFSET, 11);
+		t->population = range(&rng, 1, 20);
+		t->mission = range(&rng, -1, 3);
+		t->last_cargo_bought = range(&rng, -1, 15);
+		t->last_cargo_sold = range(&rng, -1, 15);
+		t->panic = range(&rng, 0, 100);
+	}
+
+	for (int i = 0; i < 8; ++i) {
+		struct savegame::indian_relations *ir = &sv->indian_relations[i];
+		ir->level = range(&rng, 0, 3);
+		ir->armed_braves = range(&rng, 0, 50);
+		ir->horse_herds = range(&rng, 0, 50);
+		for (int j = 0; j < 16; ++j)
+			ir->stock[j] = range(&rng, 0, 300);
+		for (int j = 0; j < 4; ++j) {
+			ir->meeting[j].met = range(&rng, 0, 1);
+			ir->aggr[j].aggr = range(&rng, 0, 255);
+		}
+	}
+
+	sv->stuff->x = range(&rng, 1, MAP_WIDTH - 2);
+	sv->stuff->y = range(&rng, 1, MAP_HEIGHT - 2);
+	sv->stuff->zoom_level = range(&rng, 0, 4);
+
+	for (int i = 0; i < head->trade_route_count; ++i) {
+		struct savegame::trade_route *r = &sv->trade_route[i];
+		snprintf(r->name, sizeof (r->name), "Route %d", i + 1);
+		r->type = range(&rng, 0, 1);
+		r->entries = colonies ? range(&rng, 1, 4) : 0;
+		for (int j = 0; j < r->entries; ++j) {
+			struct savegame::trade_route::entry *e = &r->entry[j];
+			e->destination = range(&rng, 0, colonies - 1);
+			e->loading_size = range(&rng, 0, 6);
+			e->unloading_size = range(&rng, 0, 6);
+			for (int k = 0; k < 2; ++k) {
+				e->cargo[k].item_0 = range(&rng, 0, 15); e->cargo[k].item_1 = range(&rng, 0, 15);
+				e->cargo[k].item_2 = range(&rng, 0, 15); e->cargo[k].item_3 = range(&rng, 0, 15);
+				e->cargo[k].item_4 = range(&rng, 0, 15); e->cargo[k].item_5 = range(&rng, 0, 15);
+			}
+		}
+	}
+
+	/* The head stays, so the file keeps its size */
+	for (int i = 0; i < go->flips; ++i)
+		buf->data[range(&rng, sizeof (struct savegame::head), size - 1)] = (uint8_t) next(&rng);
+
+	return size;
+}
+
+int generate_parse(const char *spec, struct generate_options *go, uint64_t *seed)
+{
+	char *copy = strdup(spec), *save = NULL;
+	int res = 0;
+
+	for (char *item = strtok_r(copy, ",", &save); item && res == 0; item = strtok_r(NULL, ",", &save)) {
+		if (strcmp(item, "max") == 0) {
+			go->colonies = GENERATE_MAX_COLONIES;
+			go->units = GENERATE_MAX_UNITS;
+			go->tribes = GENERATE_MAX_TRIBES;
+			go->routes = GENERATE_MAX_ROUTES;
+			continue;
+		}
+
+		char *eq = strchr(item, '='), *end;
+		if (!eq) {
+			fprintf(stderr, "--generate: expected name=value, not '%s'\n", item);
+			res = -1;
+			break;
+		}
+		*eq = '\0';
+		unsigned long long v = strtoull(eq + 1, &end, 0);
+		if (*end || end == eq + 1) {
+			fprintf(stderr, "--generate: '%s' is not a number\n", eq + 1);
+			res = -1;
+			break;
+		}
+
+		static const struct { const char *name; size_t offset; unsigned long long max; } counts[] = {
+			{ "colonies", offsetof(struct generate_options, colonies), GENERATE_MAX_COLONIES },
+			{ "units",    offsetof(struct generate_options, units),    GENERATE_MAX_UNITS },
+			{ "tribes",   offsetof(struct generate_options, tribes),   GENERATE_MAX_TRIBES },
+			{ "routes",   offsetof(struct generate_options, routes),   GENERATE_MAX_ROUTES },
+			{ "flips",    offsetof(struct generate_options, flips),    1u << 30 },
+		};
+
+		if (strcmp(item, "seed") == 0) {
+			*seed = v;
+			continue;
+		}
+
+		size_t k = 0;
+		while (k < sizeof (counts) / sizeof (counts[0]) && strcmp(item, counts[k].name) != 0)
+			++k;
+		if (k == sizeof (counts) / sizeof (counts[0])) {
+			fprintf(stderr, "--generate: unknown setting '%s'\n", item);
+			res = -1;
+		} else if (v > counts[k].max) {
+			fprintf(stderr, "--generate: %s can be at most %llu\n", item, counts[k].max);
+			res = -1;
+		} else {
+			*(int *) ((char *) go + counts[k].offset) = (int) v;
+		}
+	}
+
+	free(copy);
+	return res;
+}
+
+int generate_files(const struct generate_options *go, uint64_t seed, int count, char **files)
+{
+	struct savegame_buffer buf = { NULL, 0 };
+	struct savegame_view sv;
+	int res = 0;
+
+	for (int i = 0; i < count && res == 0; ++i) {
+		size_t n = generate_savegame(seed + i, go, &sv, &buf);
+
+		FILE *fp = fopen(files[i], "w");
+		int ok = fp && fwrite(buf.data, n, 1, fp) == 1;
+		if (fp && fclose(fp) != 0)
+			ok = 0;
+		if (!ok) {
+			fprintf(stderr, "Could not write file: %s\n", files[i]);
+			res = -1;
+		}
+	}
+
+	free(buf.data);
+	return res;
+}
@@ -0,0 +1,51 @@
+#ifndef GENERATE_H
+#define GENERATE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "loader.h"
+
+/*
+ * Synthetic savegames: the same seed gives the same bytes on any machine.
+ *
+ * Every record is filled in with values the print_* functions accept:
+ * indices into the name lists, zero wherever the format is not understood,
+ * colonies, tribes and land units on land and ships at sea. Some ships
+ * carry units of their owner, linked into transport chains both ways, and
+ * trade routes stop at existing colonies.
+ *
+ * Layer 0 of the map is a few islands on an ocean. The other layers follow
+ * its coastline: layer 1 marks the colony tiles, layer 2 numbers the
+ * islands in phys, and layer 3 marks what is within two tiles of a colony
+ * or unit as explored.
+ */
+
+/* The most the file format can hold; the game itself stops far sooner */
+#define GENERATE_MAX_COLONIES 65535 // uint16_t counts and route destinations
+#define GENERATE_MAX_UNITS    32767 // int16_t transport links
+#define GENERATE_MAX_TRIBES   65535
+#define GENERATE_MAX_ROUTES   12    // fixed size section
+
+struct generate_options {
+	int colonies;
+	int units;
+	int tribes;
+	int routes;
+	int flips; // bytes past the head overwritten at random afterwards, for fuzzing
+};
+
+/* Writes the savegame for seed into buf and points sv at it. Returns its size */
+size_t generate_savegame(uint64_t seed, const struct generate_options *go, struct savegame_view *sv, struct savegame_buffer *buf);
+
+/*
+ * Parses "seed=N,colonies=N,units=N,tribes=N,routes=N,flips=N", any of
+ * them, on top of what go and seed hold. "max" sets every count to the
+ * format's limit. Returns 0, or -1 after printing an error.
+ */
+int generate_parse(const char *spec, struct generate_options *go, uint64_t *seed);
+
+/* Writes count files, the i-th from seed + i. Returns 0, or -1 after printing an error */
+int generate_files(const struct generate_options *go, uint64_t seed, int count, char **files);
+
+#endif
@@ -0,0 +1,362 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/param.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "loader.h"
+#include "stats.h"
+
+/* Neighbouring reads closer than this are merged into one pread */
+#define READ_GAP 1024
+
+const char *section_name[SECTION_COUNT] = {
+	"head",
+	"player",
+	"other",
+	"colony",
+	"unit",
+	"nation",
+	"tribe",
+	"indian",
+	"stuff",
+	"map",
+	"tail",
+	"route",
+};
+
+void section_table(const struct savegame::head *head, struct section_table *st)
+{
+	st->record[SECTION_HEAD]   = sizeof (struct savegame::head);   st->count[SECTION_HEAD]   = 1;
+	st->record[SECTION_PLAYER] = sizeof (struct savegame::player); st->count[SECTION_PLAYER] = 4;
+	st->record[SECTION_OTHER]  = sizeof (struct savegame::other);  st->count[SECTION_OTHER]  = 1;
+	st->record[SECTION_COLONY] = sizeof (struct savegame::colony); st->count[SECTION_COLONY] = head->colony_count;
+	st->record[SECTION_UNIT]   = sizeof (struct savegame::unit);   st->count[SECTION_UNIT]   = head->unit_count;
+	st->record[SECTION_NATION] = sizeof (struct savegame::nation); st->count[SECTION_NATION] = 4;
+	st->record[SECTION_TRIBE]  = sizeof (struct savegame::tribe);  st->count[SECTION_TRIBE]  = head->tribe_count;
+	st->record[SECTION_INDIAN] = sizeof (struct savegame::indian_relations); st->count[SECTION_INDIAN] = 8;
+	st->record[SECTION_STUFF]  = sizeof (struct savegame::stuff);  st->count[SECTION_STUFF]  = 1;
+	st->record[SECTION_MAP]    = sizeof (struct savegame::map);    st->count[SECTION_MAP]    = 1;
+	st->record[SECTION_TAIL]   = sizeof (struct savegame::tail);   st->count[SECTION_TAIL]   = 1;
+	st->record[SECTION_ROUTE]  = sizeof (struct savegame::trade_route); st->count[SECTION_ROUTE] = 12;
+
+	st->offset[0] = 0;
+	for (int s = 0; s < SECTION_COUNT; ++s)
+		st->offset[s + 1] = st->offset[s] + st->record[s] * st->count[s];
+}
+
+size_t savegame_size(const struct savegame::head *head)
+{
+	struct section_table st;
+	section_table(head, &st);
+	return st.offset[SECTION_COUNT];
+}
+
+void savegame_view_init(struct savegame_view *sv, void *base, const struct section_table *st)
+{
+	uint8_t *p = (uint8_t *) base;
+
+	sv->head             = (struct savegame::head *)   (p + st->offset[SECTION_HEAD]);
+	sv->player           = (struct savegame::player *) (p + st->offset[SECTION_PLAYER]);
+	sv->other            = (struct savegame::other *)  (p + st->offset[SECTION_OTHER]);
+	sv->colony           = (struct savegame::colony *) (p + st->offset[SECTION_COLONY]);
+	sv->unit             = (struct savegame::unit *)   (p + st->offset[SECTION_UNIT]);
+	sv->nation           = (struct savegame::nation *) (p + st->offset[SECTION_NATION]);
+	sv->tribe            = (struct savegame::tribe *)  (p + st->offset[SECTION_TRIBE]);
+	sv->indian_relations = (struct savegame::indian_relations *) (p + st->offset[SECTION_INDIAN]);
+	sv->stuff            = (struct savegame::stuff *)  (p + st->offset[SECTION_STUFF]);
+	sv->map              = (struct savegame::map *)    (p + st->offset[SECTION_MAP]);
+	sv->tail             = (struct savegame::tail *)   (p + st->offset[SECTION_TAIL]);
+	sv->trade_route      = (struct savegame::trade_route *) (p + st->offset[SECTION_ROUTE]);
+}
+
+int savegame_open(const char *filename, struct savegame_view *sv, int flags)
+{
+	memset(sv, 0, sizeof (*sv));
+
+	uint64_t t = stats_start();
+	int fd = open(filename, O_RDONLY);
+	if (fd == -1)
+		return -1;
+
+	struct stat st;
+	if (fstat(fd, &st) == -1) {
+		close(fd);
+		return -1;
+	}
+	stats_stop(STATS_OPEN, t);
+	stats_syscalls(4); // with mmap() and close()
+
+	if (st.st_size < (off_t) sizeof (struct savegame::head)) {
+		close(fd);
+		errno = EINVAL;
+		return -1;
+	}
+
+	int prot = PROT_READ;
+	int mapflags = MAP_SHARED;
+	if (flags & SAVEGAME_PRIVATE) {
+		prot |= PROT_WRITE;
+		mapflags = MAP_PRIVATE;
+	}
+
+	t = stats_start();
+	void *base = mmap(NULL, st.st_size, prot, mapflags, fd, 0);
+	int saved_errno = errno;
+	close(fd);
+	stats_stop(STATS_READ, t);
+
+	if (base == MAP_FAILED) {
+		errno = saved_errno;
+		return -1;
+	}
+
+	t = stats_start();
+	struct section_table table;
+	section_table((struct savegame::head *) base, &table);
+
+	if (table.offset[SECTION_COUNT] > (size_t) st.st_size) {
+		munmap(base, st.st_size);
+		errno = EINVAL;
+		return -1;
+	}
+
+	savegame_view_init(sv, base, &table);
+	stats_stop(STATS_PARSE, t);
+	stats_bytes(&table, 0, table.offset[SECTION_COUNT]);
+	sv->base = base;
+	sv->size = st.st_size;
+	sv->mapped = 1;
+
+	return 0;
+}
+
+void savegame_close(struct savegame_view *sv)
+{
+	if (sv->base && sv->mapped) {
+		munmap(sv->base, sv->size);
+		stats_syscalls(1);
+	}
+
+	memset(sv, 0, sizeof (*sv));
+}
+
+void savegame_select_all(struct savegame_select *sel)
+{
+	sel->sections = SECTION_ALL;
+	for (int s = 0; s < SECTION_COUNT; ++s)
+		sel->record[s] = -1;
+}
+
+void savegame_select_none(struct savegame_select *sel)
+{
+	sel->sections = SECTION_BIT(SECTION_HEAD);
+	for (int s = 0; s < SECTION_COUNT; ++s)
+		sel->record[s] = -1;
+}
+
+static int pread_full(int fd, void *buf, size_t len, off_t off)
+{
+	uint8_t *p = (uint8_t *) buf;
+
+	while (len > 0) {
+		ssize_t n = pread(fd, p, len, off);
+		stats_syscalls(1);
+		if (n == -1) {
+			if (errno == EINTR)
+				continue;
+			return -1;
+		}
+		if (n == 0) {
+			errno = EINVAL;
+			return -1;
+		}
+		p += n;
+		off += n;
+		len -= n;
+	}
+	return 0;
+}
+
+int savegame_read(const char *filename, struct savegame_view *sv, const struct savegame_select *sel, struct savegame_buffer *buf)
+{
+	int whole = (sel->sections == SECTION_ALL);
+	for (int s = 0; s < SECTION_COUNT; ++s)
+		if (sel->record[s] != -1)
+			whole = 0;
+
+	if (whole)
+		return savegame_open(filename, sv);
+
+	memset(sv, 0, sizeof (*sv));
+
+	uint64_t t = stats_start();
+	int fd = open(filename, O_RDONLY);
+	if (fd == -1)
+		return -1;
+
+	struct stat st;
+	if (fstat(fd, &st) == -1)
+		goto fail;
+	stats_stop(STATS_OPEN, t);
+	stats_syscalls(3); // with close()
+
+	if (st.st_size < (off_t) sizeof (struct savegame::head)) {
+		errno = EINVAL;
+		goto fail;
+	}
+
+	if (buf->cap < sizeof (struct savegame::head)) {
+		buf->cap = 64 * 1024;
+		buf->data = (uint8_t *) realloc(buf->data, buf->cap);
+		stats_allocs(1);
+	}
+
+	t = stats_start();
+	if (pread_full(fd, buf->data, sizeof (struct savegame::head), 0) == -1)
+		goto fail;
+	stats_stop(STATS_READ, t);
+
+	t = stats_start();
+	struct section_table table;
+	section_table((struct savegame::head *) buf->data, &table);
+	stats_stop(STATS_PARSE, t);
+	stats_bytes(&table, 0, sizeof (struct savegame::head));
+
+	if (table.offset[SECTION_COUNT] > (size_t) st.st_size) {
+		errno = EINVAL;
+		goto fail;
+	}
+
+	if (buf->cap < table.offset[SECTION_COUNT]) {
+		while (buf->cap < table.offset[SECTION_COUNT])
+			buf->cap *= 2;
+		buf->data = (uint8_t *) realloc(buf->data, buf->cap);
+		stats_allocs(1);
+	}
+
+	/* Collect the byte ranges in file order, merging neighbours */
+	t = stats_start();
+	{
+		size_t start = table.offset[SECTION_HEAD + 1], end = start;
+
+		for (int s = SECTION_HEAD + 1; s < SECTION_COUNT; ++s) {
+			if (!(sel->sections & SECTION_BIT(s)))
+				continue;
+
+			size_t from = table.offset[s], to = table.offset[s + 1];
+			if (sel->record[s] != -1) {
+				if ((size_t) sel->record[s] >= table.count[s])
+					continue;
+				from += table.record[s] * sel->record[s];
+				to = from + table.record[s];
+			}
+			if (from == to)
+				continue;
+
+			if (from > end + READ_GAP) {
+				if (end > start && pread_full(fd, buf->data + start, end - start, start) == -1)
+					goto fail;
+				stats_bytes(&table, start, end);
+				start = from;
+			}
+			end = to;
+		}
+
+		if (end > start && pread_full(fd, buf->data + start, end - start, start) == -1)
+			goto fail;
+		stats_bytes(&table, start, end);
+	}
+	stats_stop(STATS_READ, t);
+
+	close(fd);
+
+	savegame_view_init(sv, buf->data, &table);
+	sv->base = buf->data;
+	sv->size = table.offset[SECTION_COUNT];
+	sv->mapped = 0;
+
+	return 0;
+
+fail:
+	int saved_errno = errno;
+	close(fd);
+	errno = saved_errno;
+	return -1;
+}
+
+int savegame_copy(const char *filename, struct savegame_view *sv, struct savegame_buffer *buf)
+{
+	memset(sv, 0, sizeof (*sv));
+
+	int fd = open(filename, O_RDONLY);
+	if (fd == -1)
+		return -1;
+
+	struct stat st;
+	if (fstat(fd, &st) == -1)
+		goto fail;
+
+	if (st.st_size < (off_t) sizeof (struct savegame::head)) {
+		errno = EINVAL;
+		goto fail;
+	}
+
+	if (buf->cap < (size_t) st.st_size) {
+		buf->cap = MAX(buf->cap, 64 * 1024);
+		while (buf->cap < (size_t) st.st_size)
+			buf->cap *= 2;
+		buf->data = (uint8_t *) realloc(buf->data, buf->cap);
+		stats_allocs(1);
+	}
+
+	if (pread_full(fd, buf->data, st.st_size, 0) == -1)
+		goto fail;
+
+	close(fd);
+
+	struct section_table table;
+	section_table((struct savegame::head *) buf->data, &table);
+
+	if (table.offset[SECTION_COUNT] > (size_t) st.st_size) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	savegame_view_init(sv, buf->data, &table);
+	sv->base = buf->data;
+	sv->size = table.offset[SECTION_COUNT];
+	sv->mapped = 0;
+
+	return 0;
+
+fail:
+	int saved_errno = errno;
+	close(fd);
+	errno = saved_errno;
+	return -1;
+}
+
+uint64_t content_hash(const void *data, size_t n)
+{
+	const uint8_t *p = (const uint8_t *) data;
+	uint64_t h = 0x9e3779b97f4a7c15ull ^ (n * 0xff51afd7ed558ccdull);
+
+	for (; n >= 8; p += 8, n -= 8) {
+		uint64_t w;
+		memcpy(&w, p, 8);
+		h = (h ^ w) * 0xff51afd7ed558ccdull;
+		h ^= h >> 32;
+	}
+	for (; n > 0; ++p, --n)
+		h = (h ^ *p) * 0xc4ceb9fe1a85ec53ull;
+
+	h ^= h >> 33;
+	h *= 0xff51afd7ed558ccdull;
+	h ^= h >> 33;
+	return h;
+}
@@ -0,0 +1,102 @@
+#ifndef LOADER_H
+#define LOADER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "savegame.h"
+
+/* savegame_open() flags */
+#define SAVEGAME_RDONLY  0
+#define SAVEGAME_PRIVATE 1 /* writable copy-on-write mapping, file is left untouched */
+
+/* Sections of a savegame, in file order */
+enum section {
+	SECTION_HEAD,
+	SECTION_PLAYER,
+	SECTION_OTHER,
+	SECTION_COLONY,
+	SECTION_UNIT,
+	SECTION_NATION,
+	SECTION_TRIBE,
+	SECTION_INDIAN,
+	SECTION_STUFF,
+	SECTION_MAP,
+	SECTION_TAIL,
+	SECTION_ROUTE,
+	SECTION_COUNT
+};
+
+#define SECTION_BIT(s) (1u << (s))
+#define SECTION_ALL    ((1u << SECTION_COUNT) - 1)
+
+extern const char *section_name[SECTION_COUNT];
+
+/*
+ * Where every section lives in the file, computed from the counts in the
+ * 158 byte head. offset[SECTION_COUNT] is the total size.
+ */
+struct section_table {
+	size_t offset[SECTION_COUNT + 1];
+	size_t record[SECTION_COUNT]; // size of one record
+	size_t count[SECTION_COUNT];  // number of records
+};
+
+void section_table(const struct savegame::head *head, struct section_table *st);
+
+/* Total file size implied by the counts in head */
+size_t savegame_size(const struct savegame::head *head);
+
+/* Points the sections of sv at their file offsets from base */
+void savegame_view_init(struct savegame_view *sv, void *base, const struct section_table *st);
+
+/*
+ * Memory-maps filename and points the sections of sv into the mapping.
+ * Section offsets follow from the counts in head, and are checked against
+ * the file size.
+ *
+ * Returns 0 on success, -1 on failure with errno set (EINVAL for a file
+ * that is too short for the counts in its head).
+ */
+int savegame_open(const char *filename, struct savegame_view *sv, int flags = SAVEGAME_RDONLY);
+void savegame_close(struct savegame_view *sv);
+
+/*
+ * Which parts of a savegame a caller needs. record[s] is -1 for the whole
+ * section, or the index of the one record needed from it.
+ */
+struct savegame_select {
+	uint32_t sections; // SECTION_BIT mask, head is always read
+	int record[SECTION_COUNT];
+};
+
+void savegame_select_all(struct savegame_select *sel);
+void savegame_select_none(struct savegame_select *sel);
+
+/* Scratch memory for savegame_read(), reused from file to file */
+struct savegame_buffer {
+	uint8_t *data;
+	size_t   cap;
+};
+
+/*
+ * Reads only the selected sections and records of filename with pread(2),
+ * into buf at their file offsets, so the view looks like a full load but
+ * only the selected parts are valid. A selection of everything memory-maps
+ * the file instead, like savegame_open().
+ *
+ * Errors as for savegame_open(). Close with savegame_close().
+ */
+int savegame_read(const char *filename, struct savegame_view *sv, const struct savegame_select *sel, struct savegame_buffer *buf);
+
+/*
+ * Reads all of filename into buf, for a view that outlives changes to the
+ * file. Errors as for savegame_open(); the view needs no closing, buf is
+ * the caller's to free.
+ */
+int savegame_copy(const char *filename, struct savegame_view *sv, struct savegame_buffer *buf);
+
+/* 64 bit hash of n bytes, for telling apart contents rather than security */
+uint64_t content_hash(const void *data, size_t n);
+
+#endif
@@ -0,0 +1,138 @@
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define MAP_X86 1
+#endif
+
+#include "mapplane.h"
+
+/*
+ * Bit positions of the savegame::map bitfields:
+ *   tile 0-2, forest 3, water 4, phys 5-7
+ */
+#define TILE_MASK    0x07
+#define FOREST_SHIFT 3
+#define WATER_SHIFT  4
+#define PHYS_SHIFT   5
+
+static void decode_scalar(const uint8_t *in, uint8_t *tile, uint8_t *phys, uint64_t *forest, uint64_t *water, int from)
+{
+	for (int i = from; i < MAP_TILES; ++i) {
+		uint8_t b = in[i];
+		tile[i] = b & TILE_MASK;
+		phys[i] = b >> PHYS_SHIFT;
+		forest[i >> 6] |= (uint64_t) ((b >> FOREST_SHIFT) & 1) << (i & 63);
+		water[i >> 6]  |= (uint64_t) ((b >> WATER_SHIFT)  & 1) << (i & 63);
+	}
+}
+
+#ifdef MAP_X86
+
+/* MAP_TILES is a multiple of 16, so SSE2 needs no tail */
+__attribute__ ((target ("sse2")))
+static void decode_sse2(const uint8_t *in, uint8_t *tile, uint8_t *phys, uint64_t *forest, uint64_t *water)
+{
+	const __m128i tmask = _mm_set1_epi8(TILE_MASK);
+	const __m128i pmask = _mm_set1_epi8(0x07);
+
+	for (int i = 0; i < MAP_TILES; i += 16) {
+		__m128i v = _mm_loadu_si128((const __m128i *) (in + i));
+
+		_mm_storeu_si128((__m128i *) (tile + i), _mm_and_si128(v, tmask));
+		_mm_storeu_si128((__m128i *) (phys + i), _mm_and_si128(_mm_srli_epi16(v, PHYS_SHIFT), pmask));
+
+		/* Move the flag bit to the top of each byte, and collect the tops */
+		uint64_t f = (uint16_t) _mm_movemask_epi8(_mm_slli_epi16(v, 7 - FOREST_SHIFT));
+		uint64_t w = (uint16_t) _mm_movemask_epi8(_mm_slli_epi16(v, 7 - WATER_SHIFT));
+		forest[i >> 6] |= f << (i & 63);
+		water[i >> 6]  |= w << (i & 63);
+	}
+}
+
+__attribute__ ((target ("avx2")))
+static void decode_avx2(const uint8_t *in, uint8_t *tile, uint8_t *phys, uint64_t *forest, uint64_t *water)
+{
+	const __m256i tmask = _mm256_set1_epi8(TILE_MASK);
+	const __m256i pmask = _mm256_set1_epi8(0x07);
+
+	int i = 0;
+	for (; i + 32 <= MAP_TILES; i += 32) {
+		__m256i v = _mm256_loadu_si256((const __m256i *) (in + i));
+
+		_mm256_storeu_si256((__m256i *) (tile + i), _mm256_and_si256(v, tmask));
+		_mm256_storeu_si256((__m256i *) (phys + i), _mm256_and_si256(_mm256_srli_epi16(v, PHYS_SHIFT), pmask));
+
+		uint64_t f = (uint32_t) _mm256_movemask_epi8(_mm256_slli_epi16(v, 7 - FOREST_SHIFT));
+		uint64_t w = (uint32_t) _mm256_movemask_epi8(_mm256_slli_epi16(v, 7 - WATER_SHIFT));
+		forest[i >> 6] |= f << (i & 63);
+		water[i >> 6]  |= w << (i & 63);
+	}
+
+	decode_scalar(in, tile, phys, forest, water, i);
+}
+
+#endif
+
+typedef void (*decode_fn)(const uint8_t *, uint8_t *, uint8_t *, uint64_t *, uint64_t *);
+
+static void decode_c(const uint8_t *in, uint8_t *tile, uint8_t *phys, uint64_t *forest, uint64_t *water)
+{
+	decode_scalar(in, tile, phys, forest, water, 0);
+}
+
+static decode_fn decode;
+static const char *decode_name;
+
+static void pick_decoder(void)
+{
+	decode = decode_c;
+	decode_name = "scalar";
+
+#ifdef MAP_X86
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2")) {
+		decode = decode_avx2;
+		decode_name = "avx2";
+	} else if (__builtin_cpu_supports("sse2")) {
+		decode = decode_sse2;
+		decode_name = "sse2";
+	}
+#endif
+}
+
+/* Resolved before main(), so workers never race on it */
+__attribute__ ((constructor))
+static void map_decode_init(void)
+{
+	pick_decoder();
+}
+
+void map_decode(const struct savegame::map *map, struct map_planes *mp)
+{
+	memset(mp->forest, 0, sizeof (mp->forest));
+	memset(mp->water,  0, sizeof (mp->water));
+
+	for (int l = 0; l < MAP_LAYERS; ++l)
+		decode((const uint8_t *) map->layer[l], mp->tile[l], mp->phys[l], mp->forest[l], mp->water[l]);
+}
+
+const char *map_decoder(void)
+{
+	return decode_name;
+}
+
+void map_stats(const struct map_planes *mp, int layer, struct map_stats *ms)
+{
+	memset(ms, 0, sizeof (*ms));
+
+	for (int w = 0; w < MAP_WORDS; ++w) {
+		ms->water  += __builtin_popcountll(mp->water[layer][w]);
+		ms->forest += __builtin_popcountll(mp->forest[layer][w]);
+	}
+	ms->land = MAP_TILES - ms->water;
+
+	const uint8_t *tile = mp->tile[layer];
+	for (int i = 0; i < MAP_TILES; ++i)
+		ms->tile[map_test(mp->water[layer], i)][tile[i]]++;
+}
@@ -0,0 +1,50 @@
+#ifndef MAPPLANE_H
+#define MAPPLANE_H
+
+#include <stdint.h>
+
+#include "savegame.h"
+
+#define MAP_WIDTH  58
+#define MAP_HEIGHT 72
+#define MAP_TILES  (MAP_WIDTH * MAP_HEIGHT)
+#define MAP_LAYERS 4
+#define MAP_WORDS  ((MAP_TILES + 63) / 64)
+
+/*
+ * savegame::map with the packed tile:3 / forest:1 / water:1 / phys:3
+ * bytes split into planes: one byte per tile for tile and phys, and
+ * bitboards (bit i of word i / 64 is tile i) for forest and water.
+ */
+struct map_planes {
+	uint8_t  tile[MAP_LAYERS][MAP_TILES];
+	uint8_t  phys[MAP_LAYERS][MAP_TILES];
+	uint64_t forest[MAP_LAYERS][MAP_WORDS];
+	uint64_t water[MAP_LAYERS][MAP_WORDS];
+};
+
+static inline int map_test(const uint64_t *board, int i)
+{
+	return (board[i >> 6] >> (i & 63)) & 1;
+}
+
+/*
+ * Splits all four layers into planes. Uses AVX2 or SSE2 where the CPU has
+ * them, picked once at runtime, and plain C otherwise.
+ */
+void map_decode(const struct savegame::map *map, struct map_planes *mp);
+
+/* Name of the decoder map_decode() uses on this CPU */
+const char *map_decoder(void);
+
+/* Per layer terrain counts */
+struct map_stats {
+	int land;
+	int water;
+	int forest;
+	int tile[2][8]; // [water][tile]
+};
+
+void map_stats(const struct map_planes *mp, int layer, struct map_stats *ms);
+
+#endif
@@ -0,0 +1,158 @@
+#include <stdint.h>
+#include <string.h>
+
+#include "ndjson.h"
+
+/* Unicode for bytes 0x80 to 0xff of code page 437 */
+static const uint16_t cp437[128] = {
+	0x00c7, 0x00fc, 0x00e9, 0x00e2, 0x00e4, 0x00e0, 0x00e5, 0x00e7, 0x00ea, 0x00eb, 0x00e8, 0x00ef, 0x00ee, 0x00ec, 0x00c4, 0x00c5,
+	0x00c9, 0x00e6, 0x00c6, 0x00f4, 0x00f6, 0x00f2, 0x00fb, 0x00f9, 0x00ff, 0x00d6, 0x00dc, 0x00a2, 0x00a3, 0x00a5, 0x20a7, 0x0192,
+	0x00e1, 0x00ed, 0x00f3, 0x00fa, 0x00f1, 0x00d1, 0x00aa, 0x00ba, 0x00bf, 0x2310, 0x00ac, 0x00bd, 0x00bc, 0x00a1, 0x00ab, 0x00bb,
+	0x2591, 0x2592, 0x2593, 0x2502, 0x2524, 0x2561, 0x2562, 0x2556, 0x2555, 0x2563, 0x2551, 0x2557, 0x255d, 0x255c, 0x255b, 0x2510,
+	0x2514, 0x2534, 0x252c, 0x251c, 0x2500, 0x253c, 0x255e, 0x255f, 0x255a, 0x2554, 0x2569, 0x2566, 0x2560, 0x2550, 0x256c, 0x2567,
+	0x2568, 0x2564, 0x2565, 0x2559, 0x2558, 0x2552, 0x2553, 0x256b, 0x256a, 0x2518, 0x250c, 0x2588, 0x2584, 0x258c, 0x2590, 0x2580,
+	0x03b1, 0x00df, 0x0393, 0x03c0, 0x03a3, 0x03c3, 0x00b5, 0x03c4, 0x03a6, 0x0398, 0x03a9, 0x03b4, 0x221e, 0x03c6, 0x03b5, 0x2229,
+	0x2261, 0x00b1, 0x2265, 0x2264, 0x2320, 0x2321, 0x00f7, 0x2248, 0x00b0, 0x2219, 0x00b7, 0x221a, 0x207f, 0x00b2, 0x25a0, 0x00a0,
+};
+
+static const char hex_digits[] = "0123456789abcdef";
+
+/*
+ * A JSON string of the n bytes at p, up to the first nul. With dos set the
+ * bytes are code page 437, otherwise they are copied as they are (for file
+ * names, which are whatever the file system holds).
+ */
+static void put_string(struct sink *out, const uint8_t *p, size_t n, int dos)
+{
+	char *d = sink_reserve(out, 6 * n + 2); // "\u00xx" is the longest a byte gets
+	char *start = d;
+
+	*d++ = '"';
+	for (size_t i = 0; i < n && p[i]; ++i) {
+		uint8_t c = p[i];
+
+		if (c == '"' || c == '\\') {
+			*d++ = '\\';
+			*d++ = c;
+		} else if (c < 0x20) {
+			memcpy(d, "\\u00", 4);
+			d[4] = hex_digits[c >> 4];
+			d[5] = hex_digits[c & 0xf];
+			d += 6;
+		} else if (c < 0x80 || !dos) {
+			*d++ = c;
+		} else {
+			uint16_t u = cp437[c - 0x80];
+			if (u < 0x800) {
+				*d++ = 0xc0 | (u >> 6);
+				*d++ = 0x80 | (u & 0x3f);
+			} else {
+				*d++ = 0xe0 | (u >> 12);
+				*d++ = 0x80 | ((u >> 6) & 0x3f);
+				*d++ = 0x80 | (u & 0x3f);
+			}
+		}
+	}
+	*d++ = '"';
+
+	out->len += d - start;
+}
+
+/* ,"name": */
+static void put_key(struct sink *out, const char *name, const char *suffix = "")
+{
+	size_t n = strlen(name), m = strlen(suffix);
+	char *d = sink_reserve(out, n + m + 4);
+
+	d[0] = ',';
+	d[1] = '"';
+	memcpy(d + 2, name, n);
+	memcpy(d + 2 + n, suffix, m);
+	d[2 + n + m] = '"';
+	d[3 + n + m] = ':';
+	out->len += n + m + 4;
+}
+
+static void put_fields(struct sink *out, const struct field_table *table, const uint8_t *data)
+{
+	for (const struct field *f = table->field; f < table->field + table->count; ++f) {
+		const uint8_t *p = data + f->offset;
+
+		put_key(out, f->name);
+
+		switch (f->type) {
+			case FT_CHAR:
+				put_string(out, p, f->size, 1);
+				continue;
+
+			case FT_HEX: {
+				size_t n = (size_t) f->size * f->count;
+				char *d = sink_reserve(out, 2 * n + 2);
+				*d++ = '"';
+				for (size_t i = 0; i < n; ++i) {
+					*d++ = hex_digits[p[i] >> 4];
+					*d++ = hex_digits[p[i] & 0xf];
+				}
+				*d = '"';
+				out->len += 2 * n + 2;
+				continue;
+			}
+		}
+
+		if (f->count > 1) {
+			sink_putc(out, '[');
+			for (int i = 0; i < f->count; ++i) {
+				if (i)
+					sink_putc(out, ',');
+				sink_dec(out, field_value(f, p + i * f->size));
+			}
+			sink_putc(out, ']');
+			continue;
+		}
+
+		int64_t v = field_value(f, p);
+		sink_dec(out, v);
+		if (f->names && v >= 0 && v < f->name_count) {
+			put_key(out, f->name, "_name");
+			put_string(out, (const uint8_t *) f->names[v], strlen(f->names[v]), 0);
+		}
+	}
+}
+
+/* {"file":...,"section":...,"index":n */
+static void put_header(struct sink *out, const char *file, const char *section, int index)
+{
+	sink_puts(out, "{\"file\":");
+	put_string(out, (const uint8_t *) file, strlen(file), 0);
+	sink_puts(out, ",\"section\":\"");
+	sink_puts(out, section);
+	sink_puts(out, "\",\"index\":");
+	sink_dec(out, index);
+}
+
+void ndjson_record(struct sink *out, const char *file, const struct field_table *table, int index, const void *data)
+{
+	put_header(out, file, table->name, index);
+	put_fields(out, table, (const uint8_t *) data);
+	sink_puts(out, "}\n");
+}
+
+void ndjson_route(struct sink *out, const char *file, int index, const struct savegame::trade_route *route)
+{
+	put_header(out, file, route_fields.name, index);
+	put_fields(out, &route_fields, (const uint8_t *) route);
+
+	sink_puts(out, ",\"entry\":[");
+	for (int j = 0; j < 4; ++j) {
+		sink_puts(out, j ? ",{\"index\":" : "{\"index\":");
+		sink_dec(out, j);
+		put_fields(out, &entry_fields, (const uint8_t *) &route->entry[j]);
+		sink_putc(out, '}');
+	}
+	sink_puts(out, "]}\n");
+}
+
+void ndjson_file(struct sink *out, const char *file)
+{
+	put_string(out, (const uint8_t *) file, strlen(file), 0);
+}
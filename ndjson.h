@@ -0,0 +1,30 @@
+#ifndef NDJSON_H
+#define NDJSON_H
+
+#include "fields.h"
+#include "sink.h"
+
+/*
+ * Newline delimited JSON, one object per savegame record:
+ *
+ *   {"file":"COLONY00.SAV","section":"unit","index":3,"x":12,"y":30,
+ *    "type":1,"type_name":"Soldier",...,"unk08":"1a2b3c",...}
+ *
+ * Every field of the record's field table is written: numbers as numbers,
+ * arrays as arrays, unknown bytes as a hex string, and names as strings
+ * converted from the game's DOS code page (437) to UTF-8. Enumerated fields
+ * get their name alongside, as "<field>_name".
+ *
+ * Writes straight into the sink's buffer without allocating.
+ */
+
+/* The record at data, number index of its section */
+void ndjson_record(struct sink *out, const char *file, const struct field_table *table, int index, const void *data);
+
+/* A trade route, with its stops as an "entry" array of objects */
+void ndjson_route(struct sink *out, const char *file, int index, const struct savegame::trade_route *route);
+
+/* A file name as a JSON string, quotes included, for records written elsewhere */
+void ndjson_file(struct sink *out, const char *file);
+
+#endif
@@ -0,0 +1,911 @@
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/param.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "patch.h"
+#include "columns.h"
+#include "fields.h"
+#include "loader.h"
+#include "stats.h"
+#include "where.h"
+
+/* A selector is compiled for each nation as the player, and for no player */
+#define PATCH_PLAYERS (4 + 1)
+#define NO_PLAYER     255
+
+const char patch_colony10[] =
+	"# 4,000,000 gold and ten working colonists with docks and a custom house\n"
+	"# in each of the player's colonies, and no stockades in anyone else's\n"
+	"nation[nation == player].gold = 4000000\n"
+	"colony[nation == player].profession[0..2] = 17    # elder statesman\n"
+	"colony[nation == player].occupation[0..2] = 17\n"
+	"colony[nation == player].profession[3..4] = 13    # carpenter\n"
+	"colony[nation == player].occupation[3..4] = 13\n"
+	"colony[nation == player].profession[5..6] = 14    # blacksmith\n"
+	"colony[nation == player].occupation[5..6] = 14\n"
+	"colony[nation == player].profession[7] = 5        # lumberjack\n"
+	"colony[nation == player].occupation[7] = 5\n"
+	"colony[nation == player].tiles[0] = 7\n"
+	"colony[nation == player].profession[8] = 8        # fisherman\n"
+	"colony[nation == player].occupation[8] = 8\n"
+	"colony[nation == player].tiles[1] = 8\n"
+	"colony[nation == player].profession[9] = 6        # ore miner\n"
+	"colony[nation == player].occupation[9] = 6\n"
+	"colony[nation == player].tiles[4] = 9\n"
+	"colony[nation == player].population = 10\n"
+	"colony[nation == player].buildings.docks = 1\n"
+	"colony[nation == player].buildings.custom_house = 1\n"
+	"colony[nation != player].buildings.stockade = 0\n";
+
+/* The field table of each section, NULL for the map */
+static const struct field_table *section_fields[SECTION_COUNT] = {
+	&head_fields, &player_fields, &other_fields, &colony_fields, &unit_fields, &nation_fields,
+	&tribe_fields, &indian_fields, &stuff_fields, NULL, &tail_fields, &route_fields,
+};
+
+struct patch_selector {
+	const struct table *table;
+	char *text;
+	struct where *where[PATCH_PLAYERS]; // all the same one if text doesn't use player
+};
+
+struct patch_stmt {
+	int section;
+	const struct field *field;
+	int first, last; // elements
+	int record;      // -1 for all of them
+	int selector;    // into patch::selector, -1 for none
+	char op;         // '=', '+', '-', '*' or '/'
+	int64_t value;
+	char text[32];   // for strings
+};
+
+struct patch {
+	struct patch_stmt *stmt;
+	int stmt_count, stmt_cap;
+	struct patch_selector *selector;
+	int selector_count, selector_cap;
+};
+
+/*
+ * Compiler
+ */
+
+/* text with the word player replaced by the number value, outside quotes; NULL if it has none */
+static char *with_player(const char *text, int value)
+{
+	size_t n = strlen(text);
+	char *out = (char *) malloc(n * 2 + 1), *d = out;
+	int quoted = 0, found = 0;
+
+	for (const char *s = text; *s; ) {
+		if (*s == '"')
+			quoted = !quoted;
+		if (!quoted && strncmp(s, "player", 6) == 0 &&
+		    (s == text || !(isalnum((unsigned char) s[-1]) || s[-1] == '_' || s[-1] == '.')) &&
+		    !(isalnum((unsigned char) s[6]) || s[6] == '_' || s[6] == '.')) {
+			d += sprintf(d, "%d", value);
+			s += 6;
+			found = 1;
+			continue;
+		}
+		*d++ = *s++;
+	}
+	*d = '\0';
+
+	if (!found) {
+		free(out);
+		return NULL;
+	}
+	return out;
+}
+
+static int add_selector(struct patch *p, const struct table *table, const char *text)
+{
+	for (int i = 0; i < p->selector_count; ++i)
+		if (p->selector[i].table == table && strcmp(p->selector[i].text, text) == 0)
+			return i;
+
+	struct patch_selector sel;
+	memset(&sel, 0, sizeof (sel));
+	sel.table = table;
+	sel.text = strdup(text);
+
+	for (int k = 0; k < PATCH_PLAYERS; ++k) {
+		char *variant = with_player(text, k < 4 ? k : NO_PLAYER);
+		if (!variant) {
+			sel.where[0] = where_compile(text, table);
+			for (int j = 1; j < PATCH_PLAYERS; ++j)
+				sel.where[j] = sel.where[0];
+			break;
+		}
+		sel.where[k] = where_compile(variant, table);
+		free(variant);
+		if (!sel.where[k])
+			break;
+	}
+
+	if (!sel.where[PATCH_PLAYERS - 1]) {
+		for (int k = 0; k < PATCH_PLAYERS && sel.where[k]; ++k)
+			where_free(sel.where[k]);
+		free(sel.text);
+		return -1;
+	}
+
+	if (p->selector_count == p->selector_cap) {
+		p->selector_cap = p->selector_cap ? 2 * p->selector_cap : 8;
+		p->selector = (struct patch_selector *) realloc(p->selector, sizeof (struct patch_selector) * p->selector_cap);
+	}
+	p->selector[p->selector_count] = sel;
+	return p->selector_count++;
+}
+
+static void skip_space(const char **s)
+{
+	while (isspace((unsigned char) **s))
+		++*s;
+}
+
+/* Number of records of a section that doesn't depend on the head, 0 for those that do */
+static int fixed_records(int section)
+{
+	switch (section) {
+		case SECTION_PLAYER: case SECTION_NATION: return 4;
+		case SECTION_INDIAN: return 8;
+		case SECTION_ROUTE:  return 12;
+		case SECTION_COLONY: case SECTION_UNIT: case SECTION_TRIBE: return 0;
+		default: return 1;
+	}
+}
+
+/* A value name of f, ignoring case and the padding of the names */
+static int find_name(const struct field *f, const char *name, size_t n)
+{
+	for (int i = 0; i < f->name_count; ++i) {
+		size_t m = strlen(f->names[i]);
+		while (m > 0 && f->names[i][m - 1] == ' ')
+			--m;
+		if (m == n && strncasecmp(f->names[i], name, n) == 0)
+			return i;
+	}
+	return -1;
+}
+
+#define ERROR(...) do { fprintf(stderr, "%s:%d: ", name, line); fprintf(stderr, __VA_ARGS__); fputc('\n', stderr); return -1; } while (0)
+
+static int parse_stmt(struct patch *p, const char *s, const char *name, int line)
+{
+	struct patch_stmt st;
+	memset(&st, 0, sizeof (st));
+	st.record = st.selector = -1;
+
+	/* Section */
+	skip_space(&s);
+	const char *start = s;
+	while (isalpha((unsigned char) *s))
+		++s;
+	st.section = -1;
+	for (int i = 0; i < SECTION_COUNT; ++i)
+		if (section_fields[i] && strlen(section_name[i]) == (size_t) (s - start) && strncasecmp(section_name[i], start, s - start) == 0)
+			st.section = i;
+	if (st.section == -1)
+		ERROR("expected a section (head, player, other, colony, unit, nation, tribe, indian, stuff, tail or route)");
+	const struct field_table *fields = section_fields[st.section];
+
+	/* Records */
+	skip_space(&s);
+	if (*s == '[') {
+		const char *end = ++s;
+		int quoted = 0;
+		while (*end && (quoted || *end != ']'))
+			quoted ^= (*end++ == '"');
+		if (*end != ']')
+			ERROR("missing ]");
+
+		char text[256];
+		size_t n = MIN((size_t) (end - s), sizeof (text) - 1);
+		memcpy(text, s, n);
+		text[n] = '\0';
+		s = end + 1;
+
+		char *digits = text;
+		while (isspace((unsigned char) *digits))
+			++digits;
+		char *after;
+		long record = strtol(digits, &after, 10);
+		while (isspace((unsigned char) *after))
+			++after;
+
+		if (isdigit((unsigned char) *digits) && *after == '\0') {
+			if (fixed_records(st.section) && record >= fixed_records(st.section))
+				ERROR("%s has %d records", section_name[st.section], fixed_records(st.section));
+			st.record = record;
+		} else {
+			const struct table *table = NULL;
+			for (int t = 0; t < column_table_count; ++t)
+				if (column_tables[t].section == st.section)
+					table = &column_tables[t];
+			if (!table)
+				ERROR("only units, colonies, tribes and nations can be picked by an expression");
+			st.selector = add_selector(p, table, text);
+			if (st.selector == -1)
+				ERROR("in the records of %s", section_name[st.section]);
+		}
+	}
+
+	/* Field */
+	skip_space(&s);
+	if (*s++ != '.')
+		ERROR("expected .field after %s", section_name[st.section]);
+	start = s;
+	while (isalnum((unsigned char) *s) || *s == '_' || *s == '.')
+		++s;
+	char field[64];
+	size_t n = MIN((size_t) (s - start), sizeof (field) - 1);
+	memcpy(field, start, n);
+	field[n] = '\0';
+
+	int index = field_index(*fields, field);
+	if (index == -1)
+		ERROR("%s has no field '%s'", section_name[st.section], field);
+	st.field = &fields->field[index];
+
+	if (st.section == SECTION_HEAD && (strcmp(field, "colony_count") == 0 || strcmp(field, "unit_count") == 0 ||
+	                                   strcmp(field, "tribe_count") == 0))
+		ERROR("%s moves the sections after it, and can't be patched", field);
+
+	/* Elements */
+	st.first = 0;
+	st.last = st.field->count - 1;
+	skip_space(&s);
+	if (*s == '[') {
+		char *end;
+		st.first = st.last = strtol(s + 1, &end, 10);
+		if (strncmp(end, "..", 2) == 0)
+			st.last = strtol(end + 2, &end, 10);
+		if (*end != ']')
+			ERROR("expected [N] or [N..M] after %s", field);
+		if (st.first < 0 || st.first > st.last || st.last >= st.field->count)
+			ERROR("%s has elements 0..%d", field, st.field->count - 1);
+		s = end + 1;
+	}
+
+	/* Operator */
+	skip_space(&s);
+	if (*s == '=') {
+		st.op = '=';
+		s += 1;
+	} else if (strchr("+-*/", *s) && *s && s[1] == '=') {
+		st.op = *s;
+		s += 2;
+	} else {
+		ERROR("expected =, +=, -=, *= or /=");
+	}
+
+	/* Value */
+	skip_space(&s);
+	const char *end = s + strlen(s);
+	while (end > s && isspace((unsigned char) end[-1]))
+		--end;
+
+	if (st.field->type == FT_CHAR) {
+		if (st.op != '=' || end - s < 2 || *s != '"' || end[-1] != '"')
+			ERROR("%s takes = \"text\"", field);
+		n = end - s - 2;
+		if (n >= st.field->size)
+			ERROR("%s holds at most %d characters", field, st.field->size - 1);
+		memcpy(st.text, s + 1, n);
+	} else {
+		char *after;
+		st.value = strtoll(s, &after, 0);
+		if (after == s || after != end) {
+			if (*s == '"' && end - s >= 2 && end[-1] == '"')
+				++s, --end;
+			st.value = st.field->names ? find_name(st.field, s, end - s) : -1;
+			if (st.value == -1)
+				ERROR("'%.*s' is not a number%s", (int) (end - s), s, st.field->names ? " or name of a value" : "");
+		}
+		if (st.op == '/' && st.value == 0)
+			ERROR("division by zero");
+	}
+
+	if (p->stmt_count == p->stmt_cap) {
+		p->stmt_cap = p->stmt_cap ? 2 * p->stmt_cap : 16;
+		p->stmt = (struct patch_stmt *) realloc(p->stmt, sizeof (struct patch_stmt) * p->stmt_cap);
+	}
+	p->stmt[p->stmt_count++] = st;
+	return 0;
+}
+
+#undef ERROR
+
+struct patch *patch_compile(const char *script, const char *name)
+{
+	struct patch *p = (struct patch *) calloc(1, sizeof (struct patch));
+	char *copy = strdup(script);
+	int line = 1, res = 0;
+
+	/* Statements end at a newline or ';', comments at the end of the line */
+	for (char *s = copy; *s && res == 0; ) {
+		char *stmt = s;
+		int quoted = 0, comment = 0;
+
+		while (*s && *s != '\n' && (quoted || comment || *s != ';')) {
+			if (*s == '"' && !comment)
+				quoted = !quoted;
+			if (*s == '#' && !quoted)
+				comment = 1;
+			if (comment)
+				*s = '\0';
+			++s;
+		}
+
+		char end = *s;
+		*s = '\0';
+
+		const char *t = stmt;
+		skip_space(&t);
+		if (*t)
+			res = parse_stmt(p, t, name, line);
+
+		if (end == '\n')
+			++line;
+		if (end)
+			++s;
+	}
+
+	free(copy);
+
+	if (res) {
+		patch_free(p);
+		return NULL;
+	}
+	return p;
+}
+
+struct patch *patch_load(const char *path)
+{
+	FILE *fp = fopen(path, "r");
+	if (!fp) {
+		fprintf(stderr, "Could not open %s: %s\n", path, strerror(errno));
+		return NULL;
+	}
+
+	char *script = NULL;
+	size_t len = 0, cap = 0, n;
+	do {
+		if (len + 4096 + 1 > cap) {
+			cap = MAX(2 * cap, len + 4096 + 1);
+			script = (char *) realloc(script, cap);
+		}
+		n = fread(script + len, 1, 4096, fp);
+		len += n;
+	} while (n > 0);
+	fclose(fp);
+	script[len] = '\0';
+
+	struct patch *p = patch_compile(script, path);
+	free(script);
+	return p;
+}
+
+void patch_free(struct patch *p)
+{
+	if (!p)
+		return;
+
+	for (int i = 0; i < p->selector_count; ++i) {
+		struct patch_selector *sel = &p->selector[i];
+		for (int k = 0; k < PATCH_PLAYERS; ++k)
+			if (k == 0 || sel->where[k] != sel->where[0])
+				where_free(sel->where[k]);
+		free(sel->text);
+	}
+	free(p->selector);
+	free(p->stmt);
+	free(p);
+}
+
+/*
+ * Applying
+ */
+
+/* What values of f can hold */
+static void field_bounds(const struct field *f, int64_t *lo, int64_t *hi)
+{
+	if (f->type == FT_BITS) {
+		*lo = 0;
+		*hi = ((int64_t) 1 << f->width) - 1;
+	} else if (f->type == FT_INT) {
+		*lo = -((int64_t) 1 << (8 * f->size - 1));
+		*hi = ((int64_t) 1 << (8 * f->size - 1)) - 1;
+	} else {
+		*lo = 0;
+		*hi = ((int64_t) 1 << (8 * f->size)) - 1;
+	}
+}
+
+/* Notes that [begin, end) of section changed, merging it with what it touches */
+static void dirty_add(struct patch_dirty *d, int section, uint32_t begin, uint32_t end)
+{
+	struct patch_range *r = d->range[section];
+	int n = d->count[section];
+
+	/* Almost always at or past the last range, as records are walked in order */
+	int i = n;
+	if (n && begin < r[n - 1].begin) {
+		int lo = 0, hi = n - 1;
+		while (lo < hi) {
+			int mid = (lo + hi) / 2;
+			if (r[mid].begin < begin)
+				lo = mid + 1;
+			else
+				hi = mid;
+		}
+		i = lo;
+	}
+
+	/* Merge with the one before, or make room */
+	if (i > 0 && r[i - 1].end >= begin) {
+		--i;
+		r[i].end = MAX(r[i].end, end);
+	} else {
+		if (n == d->cap[section]) {
+			d->cap[section] = MAX(16, 2 * n);
+			d->range[section] = r = (struct patch_range *) realloc(r, sizeof (*r) * d->cap[section]);
+			stats_allocs(1);
+		}
+		memmove(r + i + 1, r + i, sizeof (*r) * (n - i));
+		r[i].begin = begin;
+		r[i].end = end;
+		++n;
+	}
+
+	/* and swallow the ones after it that it now reaches */
+	int j = i + 1;
+	while (j < n && r[j].begin <= r[i].end) {
+		r[i].end = MAX(r[i].end, r[j].end);
+		++j;
+	}
+	memmove(r + i + 1, r + j, sizeof (*r) * (n - j));
+	d->count[section] = n - (j - i - 1);
+}
+
+void patch_dirty_free(struct patch_dirty *d)
+{
+	for (int s = 0; s < SECTION_COUNT; ++s) {
+		free(d->range[s]);
+		d->range[s] = NULL;
+		d->count[s] = d->cap[s] = 0;
+	}
+}
+
+/* Applies st to one record at file offset at of file */
+static int apply_record(const struct patch_stmt *st, uint8_t *file, size_t at, struct patch_dirty *dirty)
+{
+	const struct field *f = st->field;
+	uint8_t *record = file + at;
+	int changed = 0;
+
+	if (f->type == FT_CHAR) {
+		char text[sizeof (st->text)];
+		memset(text, 0, sizeof (text));
+		memcpy(text, st->text, f->size);
+		if (memcmp(record + f->offset, text, f->size) != 0) {
+			memcpy(record + f->offset, text, f->size);
+			if (dirty)
+				dirty_add(dirty, st->section, at + f->offset, at + f->offset + f->size);
+			changed = 1;
+		}
+		return changed;
+	}
+
+	int64_t lo, hi;
+	field_bounds(f, &lo, &hi);
+
+	for (int e = st->first; e <= st->last; ++e) {
+		uint8_t *q = record + f->offset + e * f->size;
+		int64_t old = field_value(f, q), v;
+
+		switch (st->op) {
+			case '+': v = old + st->value; break;
+			case '-': v = old - st->value; break;
+			case '*': v = old * st->value; break;
+			case '/': v = old / st->value; break;
+			default:  v = st->value; break;
+		}
+		v = MAX(lo, MIN(hi, v));
+
+		if (v != old) {
+			field_store(f, q, v);
+			if (dirty)
+				dirty_add(dirty, st->section, q - file, q - file + f->size);
+			++changed;
+		}
+	}
+
+	return changed;
+}
+
+int patch_apply(const struct patch *p, struct savegame_view *sv, struct patch_dirty *dirty)
+{
+	/* Selector results, kept until a statement writes to their section */
+	static __thread uint8_t **mask;
+	static __thread size_t *mask_cap;
+	static __thread int *valid;
+	static __thread int cache_cap;
+
+	if (cache_cap < p->selector_count) {
+		mask = (uint8_t **) realloc(mask, sizeof (uint8_t *) * p->selector_count);
+		mask_cap = (size_t *) realloc(mask_cap, sizeof (size_t) * p->selector_count);
+		valid = (int *) realloc(valid, sizeof (int) * p->selector_count);
+		stats_allocs(3);
+		for (int i = cache_cap; i < p->selector_count; ++i) {
+			mask[i] = NULL;
+			mask_cap[i] = 0;
+		}
+		cache_cap = p->selector_count;
+	}
+	for (int i = 0; i < p->selector_count; ++i)
+		valid[i] = 0;
+
+	int player = NO_PLAYER;
+	for (int i = 0; i < 4 && player == NO_PLAYER; ++i)
+		if (sv->player[i].control == savegame::player::PLAYER)
+			player = i;
+	int variant = (player == NO_PLAYER) ? 4 : player;
+
+	struct section_table table;
+	section_table(sv->head, &table);
+	table.count[SECTION_ROUTE] = MIN(sv->head->trade_route_count, 12);
+
+	if (dirty)
+		for (int s = 0; s < SECTION_COUNT; ++s)
+			dirty->count[s] = 0;
+
+	uint8_t *file = (uint8_t *) sv->base;
+	int changed = 0;
+	for (int i = 0; i < p->stmt_count; ++i) {
+		const struct patch_stmt *st = &p->stmt[i];
+		size_t base = table.offset[st->section];
+		size_t size = table.record[st->section];
+		int count = table.count[st->section];
+		int n = 0;
+
+		if (st->selector != -1) {
+			const struct patch_selector *sel = &p->selector[st->selector];
+			int s = st->selector;
+			if (!valid[s]) {
+				if (mask_cap[s] < (size_t) count) {
+					mask_cap[s] = count;
+					mask[s] = (uint8_t *) realloc(mask[s], count);
+					stats_allocs(1);
+				}
+				where_eval(sel->where[variant], sv, mask[s]);
+				valid[s] = 1;
+			}
+			for (int r = 0; r < count; ++r)
+				if (mask[s][r])
+					n += apply_record(st, file, base + r * size, dirty);
+		} else if (st->record != -1) {
+			if (st->record < count)
+				n = apply_record(st, file, base + st->record * size, dirty);
+		} else {
+			for (int r = 0; r < count; ++r)
+				n += apply_record(st, file, base + r * size, dirty);
+		}
+
+		if (n) {
+			for (int s = 0; s < p->selector_count; ++s)
+				if (p->selector[s].table->section == st->section)
+					valid[s] = 0;
+			changed += n;
+		}
+	}
+
+	return changed;
+}
+
+/*
+ * Output
+ */
+
+/* Dirty ranges closer than this are written with one call, gap and all */
+#define PATCH_GAP 512
+
+/* A file written, waiting for its batch to be synced */
+struct patch_pending {
+	int fd;
+	char *tmp;  // NULL when written in place
+	char *path;
+};
+
+struct patch_writer {
+	pthread_mutex_t lock;
+	int sync;
+	struct patch_pending *pending;
+	int count, cap;
+	unsigned serial; // for temporary names
+};
+
+static int write_full(int fd, const void *buf, size_t len, off_t off)
+{
+	const uint8_t *p = (const uint8_t *) buf;
+
+	while (len > 0) {
+		ssize_t n = pwrite(fd, p, len, off);
+		stats_syscalls(1);
+		if (n == -1) {
+			if (errno == EINTR)
+				continue;
+			return -1;
+		}
+		stats_written(n);
+		p += n;
+		off += n;
+		len -= n;
+	}
+	return 0;
+}
+
+/* Writes the dirty ranges of sv to fd, which has the rest of it already */
+static int write_dirty(int fd, const struct savegame_view *sv, const struct patch_dirty *dirty)
+{
+	const uint8_t *file = (const uint8_t *) sv->base;
+	uint32_t begin = 0, end = 0;
+
+	/* The sections are in file order, so their ranges are too */
+	for (int s = 0; s < SECTION_COUNT; ++s) {
+		for (int i = 0; i < dirty->count[s]; ++i) {
+			const struct patch_range *r = &dirty->range[s][i];
+			if (end && r->begin <= end + PATCH_GAP) {
+				end = r->end;
+				continue;
+			}
+			if (end && write_full(fd, file + begin, end - begin, begin) == -1)
+				return -1;
+			begin = r->begin;
+			end = r->end;
+		}
+	}
+
+	if (end && write_full(fd, file + begin, end - begin, begin) == -1)
+		return -1;
+	return 0;
+}
+
+/* Copies size bytes of from to fd in the kernel; -1 if it can't, and nothing should be assumed copied */
+static int copy_file(int fd, const char *from, size_t size)
+{
+	int in = open(from, O_RDONLY);
+	stats_syscalls(2); // with close()
+	if (in == -1)
+		return -1;
+
+	loff_t off_in = 0, off_out = 0;
+	while ((size_t) off_in < size) {
+		ssize_t n = copy_file_range(in, &off_in, fd, &off_out, size - off_in, 0);
+		stats_syscalls(1);
+		if (n == -1 && errno == EINTR)
+			continue;
+		if (n <= 0) {
+			close(in);
+			return -1;
+		}
+	}
+
+	close(in);
+	return 0;
+}
+
+/* Syncs, renames and closes the files of one batch. Returns -1 if anything failed */
+static int flush_pending(struct patch_pending *p, int count, int sync)
+{
+	int res = 0;
+
+	if (sync && count) {
+		/* One syncfs() per file system */
+		dev_t *dev = (dev_t *) malloc(sizeof (dev_t) * count);
+		for (int i = 0; i < count; ++i) {
+			struct stat st;
+			dev[i] = (fstat(p[i].fd, &st) == 0) ? st.st_dev : 0;
+			int seen = 0;
+			for (int j = 0; j < i && !seen; ++j)
+				seen = (dev[j] == dev[i]);
+			if (!seen && syncfs(p[i].fd) == -1)
+				res = -1;
+		}
+		free(dev);
+	}
+
+	for (int i = 0; i < count; ++i) {
+		if (p[i].tmp && (res == -1 || rename(p[i].tmp, p[i].path) == -1)) {
+			unlink(p[i].tmp);
+			res = -1;
+		}
+		close(p[i].fd);
+	}
+
+	/* and one fsync() per directory, for the renames */
+	for (int i = 0; i < count && sync && res == 0; ++i) {
+		if (!p[i].tmp)
+			continue;
+		/* The directory with its slash, "" for the current one */
+		const char *slash = strrchr(p[i].path, '/');
+		int len = slash ? slash - p[i].path + 1 : 0;
+		int seen = 0;
+		for (int j = 0; j < i && !seen; ++j) {
+			const char *s = strrchr(p[j].path, '/');
+			seen = p[j].tmp && (s ? s - p[j].path + 1 : 0) == len && strncmp(p[j].path, p[i].path, len) == 0;
+		}
+		if (seen)
+			continue;
+
+		char dir[PATH_MAX];
+		snprintf(dir, sizeof (dir), "%.*s", len ? len : 1, len ? p[i].path : ".");
+		int fd = open(dir, O_RDONLY | O_DIRECTORY);
+		if (fd == -1 || fsync(fd) == -1)
+			res = -1;
+		if (fd != -1)
+			close(fd);
+	}
+
+	for (int i = 0; i < count; ++i) {
+		free(p[i].tmp);
+		free(p[i].path);
+	}
+
+	return res;
+}
+
+/* Queues a written file, and flushes the batch when it is full */
+static int add_pending(struct patch_writer *w, int fd, const char *tmp, const char *path)
+{
+	struct patch_pending p = { fd, tmp ? strdup(tmp) : NULL, strdup(path) };
+	stats_allocs(tmp ? 2 : 1);
+
+	if (!w->sync)
+		return flush_pending(&p, 1, 0);
+
+	pthread_mutex_lock(&w->lock);
+	if (w->count == w->cap) {
+		w->cap = MAX(16, 2 * w->cap);
+		w->pending = (struct patch_pending *) realloc(w->pending, sizeof (p) * w->cap);
+		stats_allocs(1);
+	}
+	w->pending[w->count++] = p;
+
+	struct patch_pending *batch = NULL;
+	int count = 0;
+	if (w->count >= w->sync) {
+		batch = w->pending;
+		count = w->count;
+		w->pending = NULL;
+		w->count = w->cap = 0;
+	}
+	pthread_mutex_unlock(&w->lock);
+
+	/* Outside the lock, so the other threads keep writing meanwhile */
+	int res = flush_pending(batch, count, w->sync);
+	free(batch);
+	return res;
+}
+
+struct patch_writer *patch_writer_new(int sync)
+{
+	struct patch_writer *w = (struct patch_writer *) calloc(1, sizeof (struct patch_writer));
+
+	pthread_mutex_init(&w->lock, NULL);
+	w->sync = sync;
+	return w;
+}
+
+int patch_writer_put(struct patch_writer *w, const struct savegame_view *sv, const struct patch_dirty *dirty,
+                     const char *from, const char *path)
+{
+	size_t size = savegame_size(sv->head);
+	struct stat a, b;
+	int fd;
+
+	/* In place, the file has everything but the changes already */
+	stats_syscalls(dirty ? 4 : 2); // the stat()s, and open() and close() of the output
+	if (dirty && stat(path, &b) == 0 && stat(from, &a) == 0 && a.st_dev == b.st_dev && a.st_ino == b.st_ino) {
+		int any = 0;
+		for (int s = 0; s < SECTION_COUNT; ++s)
+			any |= dirty->count[s];
+		if (!any)
+			return 0;
+
+		if ((fd = open(path, O_WRONLY)) == -1)
+			return -1;
+		if (write_dirty(fd, sv, dirty) == -1) {
+			close(fd);
+			return -1;
+		}
+		return add_pending(w, fd, NULL, path);
+	}
+
+	char tmp[PATH_MAX];
+	pthread_mutex_lock(&w->lock);
+	unsigned serial = w->serial++;
+	pthread_mutex_unlock(&w->lock);
+	if (snprintf(tmp, sizeof (tmp), "%s.%d-%u.tmp", path, (int) getpid(), serial) >= (int) sizeof (tmp)) {
+		errno = ENAMETOOLONG;
+		return -1;
+	}
+
+	if ((fd = open(tmp, O_WRONLY | O_CREAT | O_EXCL, 0666)) == -1)
+		return -1;
+
+	int res;
+	if (dirty && copy_file(fd, from, size) == 0)
+		res = write_dirty(fd, sv, dirty);
+	else
+		res = write_full(fd, sv->base, size, 0);
+
+	if (res == -1) {
+		close(fd);
+		unlink(tmp);
+		return -1;
+	}
+	return add_pending(w, fd, tmp, path);
+}
+
+int patch_writer_close(struct patch_writer *w)
+{
+	int res = flush_pending(w->pending, w->count, w->sync);
+
+	pthread_mutex_destroy(&w->lock);
+	free(w->pending);
+	free(w);
+	return res;
+}
+
+int patch_path(char *path, size_t size, const char *pattern, const char *filename, int index)
+{
+	const char *slash = strrchr(filename, '/');
+	const char *base = slash ? slash + 1 : filename;
+	const char *dot = strrchr(base, '.');
+	size_t n = 0;
+
+	for (const char *p = pattern; *p; ++p) {
+		char number[16];
+		const char *s = p;
+		size_t len = 1;
+
+		if (*p == '%' && p[1]) {
+			switch (*++p) {
+				case 'f': s = base; len = strlen(base); break;
+				case 'b': s = base; len = dot ? (size_t) (dot - base) : strlen(base); break;
+				case 'e': s = dot ? dot : ""; len = strlen(s); break;
+				case 'd': s = slash ? filename : "."; len = slash ? (size_t) (slash - filename) : 1; break;
+				case 'n': s = number; len = snprintf(number, sizeof (number), "%d", index); break;
+				default:  s = p; break; // %% and anything unknown stand for themselves
+			}
+		}
+
+		if (n + len >= size)
+			return -1;
+		memcpy(path + n, s, len);
+		n += len;
+	}
+	path[n] = '\0';
+
+	return 0;
+}
+
+int patch_path_varies(const char *pattern)
+{
+	for (const char *p = pattern; *p; ++p)
+		if (*p == '%' && p[1] && strchr("fbn", *++p))
+			return 1;
+	return 0;
+}
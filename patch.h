@@ -0,0 +1,99 @@
+#ifndef PATCH_H
+#define PATCH_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "savegame.h"
+#include "loader.h"
+
+/*
+ * Patch scripts: edits to savegames, compiled once and applied to any
+ * number of files. One statement per line (or separated by ';'), '#'
+ * starts a comment:
+ *
+ *   nation[nation == player].gold = 4000000
+ *   colony[nation != player].buildings.stockade = 0
+ *   colony[3].profession[0..2] = 17
+ *   unit[type == Treasure].profession *= 2
+ *   colony.name = "Nowhere"
+ *
+ * A statement is a section (head, player, other, colony, unit, nation,
+ * tribe, indian, stuff, tail or route), the records to change, a field of
+ * the section's field table (see fields.h) with an element or element
+ * range for arrays, and =, +=, -=, *= or /= with a number, a value name
+ * of the field, or for strings a quoted string. Results are clamped to
+ * what the field can hold.
+ *
+ * Records are all of them, [N] for record N, or for units, colonies,
+ * tribes and nations a --where expression (see where.h), in which player
+ * stands for the human player's nation. Each statement sees the edits of
+ * the ones before it.
+ */
+
+struct patch;
+
+/* name is for error messages. Returns NULL after printing an error */
+struct patch *patch_compile(const char *script, const char *name);
+struct patch *patch_load(const char *path);
+void patch_free(struct patch *p);
+
+/* The --colony10 edits */
+extern const char patch_colony10[];
+
+/*
+ * The bytes of a file patch_apply() changed, as file offsets per section,
+ * sorted and with touching ranges merged. Start zeroed; patch_apply()
+ * empties it each time.
+ */
+struct patch_range {
+	uint32_t begin, end;
+};
+
+struct patch_dirty {
+	struct patch_range *range[SECTION_COUNT];
+	int count[SECTION_COUNT], cap[SECTION_COUNT];
+};
+
+void patch_dirty_free(struct patch_dirty *d);
+
+/*
+ * Applies p to the writable view sv, noting what it changed in dirty if
+ * not NULL. Returns the number of values changed.
+ */
+int patch_apply(const struct patch *p, struct savegame_view *sv, struct patch_dirty *dirty);
+
+/*
+ * Writes patched files, from any number of threads. When path is the file
+ * sv was opened from only the dirty ranges are written back, in place.
+ * Anything else is written to a temporary file next to path, copied from
+ * the original in the kernel and then patched the same way, and renamed
+ * over path.
+ *
+ * With sync > 0 the files are made durable sync at a time: one syncfs()
+ * per file system, then the renames, then one fsync() per directory. With
+ * sync 0 nothing is synced and the renames happen right away.
+ */
+struct patch_writer;
+
+struct patch_writer *patch_writer_new(int sync);
+
+/* dirty NULL writes all of sv. Returns 0, or -1 with errno set */
+int patch_writer_put(struct patch_writer *w, const struct savegame_view *sv, const struct patch_dirty *dirty,
+                     const char *from, const char *path);
+
+/* Syncs and renames what is left, and frees w. Returns -1 if a sync failed */
+int patch_writer_close(struct patch_writer *w);
+
+/*
+ * Output path for the index-th input filename: pattern with %f the file
+ * name, %b the file name without its extension, %e the extension (with
+ * its dot), %d the directory ("." if none), %n the index and %% a %.
+ * Returns -1 if it doesn't fit in size.
+ */
+int patch_path(char *path, size_t size, const char *pattern, const char *filename, int index);
+
+/* The pattern gives every file its own path */
+int patch_path_varies(const char *pattern);
+
+#endif
@@ -0,0 +1,681 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "loader.h"
+#include "path.h"
+#include "stats.h"
+
+#define CLUSTERS_X ((MAP_WIDTH  + PATH_CLUSTER - 1) / PATH_CLUSTER)
+#define CLUSTERS_Y ((MAP_HEIGHT + PATH_CLUSTER - 1) / PATH_CLUSTER)
+#define CLUSTERS   (CLUSTERS_X * CLUSTERS_Y)
+
+#define FAR UINT32_MAX
+
+/* What a tile is, for the step costs */
+enum {
+	T_WATER    = 1 << 0,
+	T_ROUGH    = 1 << 1, // forest or hills
+	T_MOUNTAIN = 1 << 2,
+	T_RIVER    = 1 << 3,
+	T_ROAD     = 1 << 4, // or a colony
+	T_COLONY   = 1 << 5,
+};
+
+/* The phys bits of a layer 0 tile; mountains are hills with the major river bit */
+#define PHYS_HILLS       1
+#define PHYS_RIVER       2
+#define PHYS_MAJOR_RIVER 4
+#define PHYS_MOUNTAINS   (PHYS_HILLS | PHYS_MAJOR_RIVER)
+
+/* Tiles on the way a route is refined between at a time */
+#define REFINE 4
+
+/* A run of at least this many crossable border tiles gets an entrance at each end */
+#define WIDE_ENTRANCE 6
+
+/* Tiles at most this many clusters apart are searched tile by tile */
+#define PLAIN_NEAR 2
+
+struct edge {
+	uint16_t to;
+	uint16_t cost;
+};
+
+/* The abstraction of one domain: entrance tiles, and the cheapest costs between them */
+struct graph {
+	uint16_t component[MAP_TILES]; // area of each tile, 0 for impassable ones
+	int nodes;
+	int16_t node_of[MAP_TILES];    // -1 for tiles that aren't entrances
+	uint16_t *tile;                // [nodes]
+	uint32_t *first;               // [nodes + 1], into edge
+	struct edge *edge;
+	uint16_t cluster_first[CLUSTERS + 1];
+	uint16_t *cluster_node;        // nodes by cluster
+};
+
+struct path_map {
+	uint64_t fingerprint;
+	uint8_t terrain[MAP_TILES];
+	struct graph graph[PATH_DOMAINS];
+};
+
+/* Movement points by unit_type_list */
+static const uint8_t unit_movement[] = {
+	1, 1, 1, 1, 4, 4, 1, 4, 4, 1, 1, 1, 2, // Colonist .. Wagon train
+	4, 5, 6, 8, 6, 6,                      // Caravel .. Man-O-War
+	1, 1, 4, 4,                            // Brave .. Mounted warrior
+};
+
+static_assert(sizeof (unit_movement) == sizeof (unit_type_list) / sizeof (unit_type_list[0]), "unit_movement");
+
+enum path_domain path_unit_domain(int type)
+{
+	return (type >= 13 && type <= 18) ? PATH_SEA : PATH_LAND;
+}
+
+int path_unit_movement(int type)
+{
+	return (type >= 0 && type < (int) sizeof (unit_movement)) ? unit_movement[type] : 1;
+}
+
+/* The 8 neighbours */
+static const int dx[8] = { -1, 0, 1, -1, 1, -1, 0, 1 }, dy[8] = { -1, -1, -1, 0, 0, 1, 1, 1 };
+
+static inline int cluster_of(int tile)
+{
+	int x = tile % MAP_WIDTH, y = tile / MAP_WIDTH;
+	return (y / PATH_CLUSTER) * CLUSTERS_X + x / PATH_CLUSTER;
+}
+
+static inline int passable(const struct path_map *pm, int domain, int tile)
+{
+	uint8_t t = pm->terrain[tile];
+	return domain == PATH_LAND ? !(t & T_WATER) : (t & (T_WATER | T_COLONY)) != 0;
+}
+
+/* Moves for a step from a to b, which must be neighbours and b passable */
+static inline int step_cost(const struct path_map *pm, int domain, int a, int b)
+{
+	uint8_t s = pm->terrain[a], t = pm->terrain[b];
+
+	if (domain == PATH_SEA)
+		return 3;
+	if ((s & t & T_ROAD) || (s & t & T_RIVER))
+		return 1;
+	if (t & T_MOUNTAIN)
+		return 9;
+	return (t & T_ROUGH) ? 6 : 3;
+}
+
+/* At least the moves between two tiles: steps of 8 way moves, at 1 each over land and 3 at sea */
+static inline uint32_t estimate(int domain, int a, int b)
+{
+	int w = abs(a % MAP_WIDTH - b % MAP_WIDTH), h = abs(a / MAP_WIDTH - b / MAP_WIDTH);
+	return (w > h ? w : h) * (domain == PATH_SEA ? 3 : 1);
+}
+
+/*
+ * Searches
+ */
+
+/* Dijkstra or A* state over tiles, or over graph nodes, reset by bumping gen */
+struct search {
+	uint32_t gen;
+	uint32_t seen[MAP_TILES]; // gen when dist and parent are set
+	uint32_t dist[MAP_TILES];
+	int16_t parent[MAP_TILES];
+	uint64_t *heap;           // key << 16 | index
+	int len, cap;
+};
+
+static void search_reset(struct search *s)
+{
+	if (++s->gen == 0) {
+		memset(s->seen, 0, sizeof (s->seen));
+		s->gen = 1;
+	}
+	s->len = 0;
+}
+
+static inline uint32_t search_dist(const struct search *s, int i)
+{
+	return s->seen[i] == s->gen ? s->dist[i] : FAR;
+}
+
+static void heap_push(struct search *s, uint64_t key, int i)
+{
+	if (s->len == s->cap) {
+		s->cap = s->cap ? 2 * s->cap : 1024;
+		s->heap = (uint64_t *) realloc(s->heap, sizeof (uint64_t) * s->cap);
+		stats_allocs(1);
+	}
+
+	uint64_t v = key << 16 | i;
+	int k = s->len++;
+	for (; k > 0 && s->heap[(k - 1) / 2] > v; k = (k - 1) / 2)
+		s->heap[k] = s->heap[(k - 1) / 2];
+	s->heap[k] = v;
+}
+
+static uint64_t heap_pop(struct search *s)
+{
+	uint64_t top = s->heap[0], v = s->heap[--s->len];
+	int k = 0;
+
+	for (;;) {
+		int c = 2 * k + 1;
+		if (c >= s->len)
+			break;
+		if (c + 1 < s->len && s->heap[c + 1] < s->heap[c])
+			++c;
+		if (s->heap[c] >= v)
+			break;
+		s->heap[k] = s->heap[c];
+		k = c;
+	}
+	s->heap[k] = v;
+	return top;
+}
+
+static inline void relax(struct search *s, int i, uint32_t d, int parent, uint32_t h)
+{
+	if (d < search_dist(s, i)) {
+		s->seen[i] = s->gen;
+		s->dist[i] = d;
+		s->parent[i] = parent;
+		heap_push(s, d + h, i);
+	}
+}
+
+/* Just cluster c, for tile_search() */
+static const uint8_t *just(int c)
+{
+	static __thread uint8_t in[CLUSTERS];
+
+	memset(in, 0, sizeof (in));
+	in[c] = 1;
+	return in;
+}
+
+/*
+ * Cheapest moves from source to the tiles of the clusters in[] is set for
+ * (every tile for NULL), or with reverse from them to source. With a
+ * target, an A* search that stops once it is reached; otherwise it
+ * settles them all.
+ */
+static void tile_search(const struct path_map *pm, int domain, struct search *s, int source, const uint8_t *in, int reverse, int target)
+{
+	search_reset(s);
+	relax(s, source, 0, -1, target >= 0 ? estimate(domain, source, target) : 0);
+
+	while (s->len) {
+		uint64_t top = heap_pop(s);
+		int u = top & 0xffff;
+		uint32_t d = s->dist[u];
+
+		if (u == target)
+			break;
+		if ((top >> 16) != d + (target >= 0 ? estimate(domain, u, target) : 0))
+			continue; // stale
+
+		int x = u % MAP_WIDTH, y = u / MAP_WIDTH;
+		for (int k = 0; k < 8; ++k) {
+			int nx = x + dx[k], ny = y + dy[k];
+			if (nx < 0 || nx >= MAP_WIDTH || ny < 0 || ny >= MAP_HEIGHT)
+				continue;
+
+			int n = nx + ny * MAP_WIDTH;
+			if ((in && !in[cluster_of(n)]) || !passable(pm, domain, n))
+				continue;
+			if (reverse && u != source && !passable(pm, domain, u))
+				continue;
+
+			int cost = reverse ? step_cost(pm, domain, n, u) : step_cost(pm, domain, u, n);
+			relax(s, n, d + cost, u, target >= 0 ? estimate(domain, n, target) : 0);
+		}
+	}
+}
+
+/* Appends the steps of s from its source to tile to */
+static void route_append(const struct path_map *pm, int domain, const struct search *s, int to, struct path_route *route)
+{
+	int n = 0;
+	for (int i = to; s->parent[i] != -1; i = s->parent[i])
+		++n;
+
+	int at = route->steps + n;
+	for (int i = to; s->parent[i] != -1; i = s->parent[i])
+		route->step[--at] = step_cost(pm, domain, s->parent[i], i);
+
+	route->steps += n;
+	route->cost += s->dist[to];
+}
+
+/*
+ * Building
+ */
+
+struct builder {
+	const struct path_map *pm;
+	struct graph *g;
+	int domain;
+	uint32_t (*edge)[3]; // from, to, cost
+	size_t edges, cap;
+};
+
+static int node(struct builder *b, int tile)
+{
+	struct graph *g = b->g;
+
+	if (g->node_of[tile] < 0) {
+		g->tile[g->nodes] = tile;
+		g->node_of[tile] = g->nodes++;
+	}
+	return g->node_of[tile];
+}
+
+static void add_edge(struct builder *b, int from, int to, int cost)
+{
+	if (b->edges == b->cap) {
+		b->cap = b->cap ? 2 * b->cap : 4096;
+		b->edge = (uint32_t (*)[3]) realloc(b->edge, sizeof (b->edge[0]) * b->cap);
+		stats_allocs(1);
+	}
+	b->edge[b->edges][0] = from;
+	b->edge[b->edges][1] = to;
+	b->edge[b->edges][2] = cost;
+	++b->edges;
+}
+
+/* An entrance between neighbouring tiles a and b, both passable */
+static void cross(struct builder *b, int ta, int tb)
+{
+	int na = node(b, ta), nb = node(b, tb);
+
+	add_edge(b, na, nb, step_cost(b->pm, b->domain, ta, tb));
+	add_edge(b, nb, na, step_cost(b->pm, b->domain, tb, ta));
+}
+
+/*
+ * The entrances of a border: tile a[i] on one side is next to b[i] on the
+ * other. Each run of straight crossings gets one in its middle, or one at
+ * each end if it is wide; a diagonal crossing gets its own where neither
+ * of its ends has a straight one.
+ */
+static void border(struct builder *b, const int *a, const int *t, int n)
+{
+	const struct path_map *pm = b->pm;
+	int pa[PATH_CLUSTER], pb[PATH_CLUSTER];
+
+	for (int i = 0; i < n; ++i) {
+		pa[i] = passable(pm, b->domain, a[i]);
+		pb[i] = passable(pm, b->domain, t[i]);
+	}
+
+	for (int i = 0; i < n; ) {
+		if (!(pa[i] && pb[i])) {
+			++i;
+			continue;
+		}
+		int j = i;
+		while (j < n && pa[j] && pb[j])
+			++j;
+		if (j - i < WIDE_ENTRANCE) {
+			cross(b, a[(i + j - 1) / 2], t[(i + j - 1) / 2]);
+		} else {
+			cross(b, a[i], t[i]);
+			cross(b, a[j - 1], t[j - 1]);
+		}
+		i = j;
+	}
+
+	for (int i = 0; i < n; ++i) {
+		for (int k = i - 1; k <= i + 1; k += 2) {
+			if (k < 0 || k >= n || !pa[i] || !pb[k])
+				continue;
+			if (!(pa[i] && pb[i]) && !(pa[k] && pb[k]))
+				cross(b, a[i], t[k]);
+		}
+	}
+}
+
+/* Numbers the areas of passable tiles, so queries between two of them need no search */
+static void label(const struct path_map *pm, int domain, uint16_t *component)
+{
+	static __thread uint16_t stack[MAP_TILES];
+	int areas = 0;
+
+	memset(component, 0, sizeof (uint16_t) * MAP_TILES);
+	for (int i = 0; i < MAP_TILES; ++i) {
+		if (component[i] || !passable(pm, domain, i))
+			continue;
+
+		int top = 0;
+		component[i] = ++areas;
+		stack[top++] = i;
+		while (top) {
+			int u = stack[--top], x = u % MAP_WIDTH, y = u / MAP_WIDTH;
+			for (int k = 0; k < 8; ++k) {
+				int nx = x + dx[k], ny = y + dy[k], n = nx + ny * MAP_WIDTH;
+				if (nx < 0 || nx >= MAP_WIDTH || ny < 0 || ny >= MAP_HEIGHT || component[n] || !passable(pm, domain, n))
+					continue;
+				component[n] = areas;
+				stack[top++] = n;
+			}
+		}
+	}
+}
+
+static void graph_build(struct path_map *pm, int domain, struct search *s)
+{
+	struct graph *g = &pm->graph[domain];
+	struct builder b = { pm, g, domain, NULL, 0, 0 };
+	int a[PATH_CLUSTER], t[PATH_CLUSTER];
+
+	label(pm, domain, g->component);
+	g->nodes = 0;
+	memset(g->node_of, -1, sizeof (g->node_of));
+	g->tile = (uint16_t *) realloc(g->tile, sizeof (uint16_t) * MAP_TILES);
+	stats_allocs(1);
+
+	/* Between cluster columns, then between cluster rows, then across corners */
+	for (int cx = 1; cx < CLUSTERS_X; ++cx) {
+		for (int y0 = 0; y0 < MAP_HEIGHT; y0 += PATH_CLUSTER) {
+			int n = 0;
+			for (int y = y0; y < y0 + PATH_CLUSTER && y < MAP_HEIGHT; ++y, ++n) {
+				a[n] = cx * PATH_CLUSTER - 1 + y * MAP_WIDTH;
+				t[n] = a[n] + 1;
+			}
+			border(&b, a, t, n);
+		}
+	}
+	for (int cy = 1; cy < CLUSTERS_Y; ++cy) {
+		for (int x0 = 0; x0 < MAP_WIDTH; x0 += PATH_CLUSTER) {
+			int n = 0;
+			for (int x = x0; x < x0 + PATH_CLUSTER && x < MAP_WIDTH; ++x, ++n) {
+				a[n] = x + (cy * PATH_CLUSTER - 1) * MAP_WIDTH;
+				t[n] = a[n] + MAP_WIDTH;
+			}
+			border(&b, a, t, n);
+		}
+	}
+	for (int cy = 1; cy < CLUSTERS_Y; ++cy) {
+		for (int cx = 1; cx < CLUSTERS_X; ++cx) {
+			int nw = cx * PATH_CLUSTER - 1 + (cy * PATH_CLUSTER - 1) * MAP_WIDTH;
+			int ne = nw + 1, sw = nw + MAP_WIDTH, se = sw + 1;
+			if (passable(pm, domain, nw) && passable(pm, domain, se))
+				cross(&b, nw, se);
+			if (passable(pm, domain, ne) && passable(pm, domain, sw))
+				cross(&b, ne, sw);
+		}
+	}
+
+	/* Nodes by cluster */
+	memset(g->cluster_first, 0, sizeof (g->cluster_first));
+	for (int i = 0; i < g->nodes; ++i)
+		++g->cluster_first[cluster_of(g->tile[i]) + 1];
+	for (int c = 0; c < CLUSTERS; ++c)
+		g->cluster_first[c + 1] += g->cluster_first[c];
+	g->cluster_node = (uint16_t *) realloc(g->cluster_node, sizeof (uint16_t) * (g->nodes ? g->nodes : 1));
+	stats_allocs(1);
+	uint16_t fill[CLUSTERS];
+	memcpy(fill, g->cluster_first, sizeof (fill));
+	for (int i = 0; i < g->nodes; ++i)
+		g->cluster_node[fill[cluster_of(g->tile[i])]++] = i;
+
+	/* Within each cluster, from every entrance to the others */
+	for (int c = 0; c < CLUSTERS; ++c) {
+		for (int i = g->cluster_first[c]; i < g->cluster_first[c + 1]; ++i) {
+			int from = g->cluster_node[i];
+			tile_search(pm, domain, s, g->tile[from], just(c), 0, -1);
+			for (int j = g->cluster_first[c]; j < g->cluster_first[c + 1]; ++j) {
+				int to = g->cluster_node[j];
+				uint32_t d = search_dist(s, g->tile[to]);
+				if (to != from && d != FAR)
+					add_edge(&b, from, to, d);
+			}
+		}
+	}
+
+	/* Edges by node */
+	g->first = (uint32_t *) realloc(g->first, sizeof (uint32_t) * (g->nodes + 1));
+	g->edge = (struct edge *) realloc(g->edge, sizeof (struct edge) * (b.edges ? b.edges : 1));
+	stats_allocs(2);
+	memset(g->first, 0, sizeof (uint32_t) * (g->nodes + 1));
+	for (size_t e = 0; e < b.edges; ++e)
+		++g->first[b.edge[e][0] + 1];
+	for (int i = 0; i < g->nodes; ++i)
+		g->first[i + 1] += g->first[i];
+	uint32_t *next = (uint32_t *) malloc(sizeof (uint32_t) * (g->nodes ? g->nodes : 1));
+	stats_allocs(1);
+	memcpy(next, g->first, sizeof (uint32_t) * g->nodes);
+	for (size_t e = 0; e < b.edges; ++e) {
+		struct edge *out = &g->edge[next[b.edge[e][0]]++];
+		out->to = b.edge[e][1];
+		out->cost = b.edge[e][2];
+	}
+	free(next);
+	free(b.edge);
+}
+
+static __thread struct search local, abstract;
+
+/* What path_map_get() works out the fingerprint from */
+static void terrain_of(const struct savegame_view *sv, uint8_t *terrain)
+{
+	static __thread struct map_planes mp;
+
+	map_decode(sv->map, &mp);
+	for (int i = 0; i < MAP_TILES; ++i) {
+		int phys = mp.phys[0][i];
+		uint8_t t = 0;
+
+		if (map_test(mp.water[0], i))
+			t |= T_WATER;
+		if ((phys & PHYS_MOUNTAINS) == PHYS_MOUNTAINS)
+			t |= T_MOUNTAIN;
+		else if ((phys & PHYS_HILLS) || map_test(mp.forest[0], i))
+			t |= T_ROUGH;
+		if ((phys & PHYS_MOUNTAINS) != PHYS_MOUNTAINS && (phys & (PHYS_RIVER | PHYS_MAJOR_RIVER)))
+			t |= T_RIVER;
+		if (map_test(mp.forest[1], i))
+			t |= T_ROAD;
+		terrain[i] = t;
+	}
+
+	for (int i = 0; i < sv->head->colony_count; ++i) {
+		const struct savegame::colony *c = &sv->colony[i];
+		if (c->x < MAP_WIDTH && c->y < MAP_HEIGHT)
+			terrain[c->x + c->y * MAP_WIDTH] |= T_COLONY | T_ROAD;
+	}
+}
+
+const struct path_map *path_map_get(const struct savegame_view *sv)
+{
+	static __thread struct path_map *cache[PATH_CACHE];
+	static __thread int oldest;
+	uint8_t terrain[MAP_TILES];
+
+	terrain_of(sv, terrain);
+	uint64_t fingerprint = content_hash(terrain, sizeof (terrain));
+
+	for (int i = 0; i < PATH_CACHE; ++i)
+		if (cache[i] && cache[i]->fingerprint == fingerprint && memcmp(cache[i]->terrain, terrain, sizeof (terrain)) == 0)
+			return cache[i];
+
+	struct path_map *pm = cache[oldest];
+	if (!pm) {
+		pm = cache[oldest] = (struct path_map *) calloc(1, sizeof (struct path_map));
+		stats_allocs(1);
+	}
+	oldest = (oldest + 1) % PATH_CACHE;
+
+	pm->fingerprint = fingerprint;
+	memcpy(pm->terrain, terrain, sizeof (terrain));
+	for (int d = 0; d < PATH_DOMAINS; ++d)
+		graph_build(pm, d, &local);
+	return pm;
+}
+
+/*
+ * Queries
+ */
+
+int path_find_plain(const struct path_map *pm, enum path_domain domain, int from, int to, struct path_route *route)
+{
+	route->cost = route->steps = 0;
+	if (from == to)
+		return 0;
+	if (!passable(pm, domain, to))
+		return -1;
+
+	tile_search(pm, domain, &local, from, NULL, 0, to);
+	if (search_dist(&local, to) == FAR)
+		return -1;
+	route_append(pm, domain, &local, to, route);
+	return 0;
+}
+
+/* path_find() from a passable tile */
+static int find(const struct path_map *pm, enum path_domain domain, int from, int to, struct path_route *route)
+{
+	const struct graph *g = &pm->graph[domain];
+	int cf = cluster_of(from), ct = cluster_of(to);
+	uint32_t best = FAR;
+	int last = -1; // node the best route leaves the graph at
+
+	/*
+	 * Close by, the detour through the entrances can be most of the route
+	 * (several times the cheapest), and a search tile by tile is cheap.
+	 */
+	if (abs(cf % CLUSTERS_X - ct % CLUSTERS_X) <= PLAIN_NEAR && abs(cf / CLUSTERS_X - ct / CLUSTERS_X) <= PLAIN_NEAR)
+		return path_find_plain(pm, domain, from, to, route);
+
+	/* Onto the graph at the entrances of from's cluster, off it at those of to's */
+	static __thread uint32_t goal[MAP_TILES];
+	tile_search(pm, domain, &local, to, just(ct), 1, -1);
+	for (int i = g->cluster_first[ct]; i < g->cluster_first[ct + 1]; ++i) {
+		int n = g->cluster_node[i];
+		goal[n] = search_dist(&local, g->tile[n]);
+	}
+
+	search_reset(&abstract);
+	tile_search(pm, domain, &local, from, just(cf), 0, -1);
+	for (int i = g->cluster_first[cf]; i < g->cluster_first[cf + 1]; ++i) {
+		int n = g->cluster_node[i];
+		uint32_t d = search_dist(&local, g->tile[n]);
+		if (d != FAR)
+			relax(&abstract, n, d, -1, estimate(domain, g->tile[n], to));
+	}
+
+	while (abstract.len) {
+		uint64_t top = heap_pop(&abstract);
+		int u = top & 0xffff;
+		uint32_t d = abstract.dist[u];
+
+		if ((top >> 16) >= best)
+			break;
+		if ((top >> 16) != d + estimate(domain, g->tile[u], to))
+			continue; // stale
+
+		if (cluster_of(g->tile[u]) == ct && goal[u] != FAR && d + goal[u] < best) {
+			best = d + goal[u];
+			last = u;
+		}
+
+		for (uint32_t e = g->first[u]; e < g->first[u + 1]; ++e) {
+			int v = g->edge[e].to;
+			relax(&abstract, v, d + g->edge[e].cost, u, estimate(domain, g->tile[v], to));
+		}
+	}
+
+	if (best == FAR)
+		return -1;
+
+	/* The tiles on the way: from, the entrances in order, to */
+	static __thread uint16_t way[MAP_TILES + 2];
+	int n = 0;
+	for (int u = last; u != -1; u = abstract.parent[u])
+		way[n++] = g->tile[u];
+	for (int i = 0; i < n / 2; ++i) {
+		uint16_t t = way[i];
+		way[i] = way[n - 1 - i];
+		way[n - 1 - i] = t;
+	}
+	memmove(way + 1, way, sizeof (uint16_t) * n);
+	way[0] = from;
+	way[n + 1] = to;
+	n += 2;
+
+	/*
+	 * The steps: the cheapest route through the clusters of a few tiles
+	 * on the way at a time, which costs no more than going through them
+	 */
+	for (int i = 0; i < n - 1; ) {
+		int j = i + REFINE < n - 1 ? i + REFINE : n - 1;
+		uint8_t in[CLUSTERS] = { 0 };
+		for (int k = i; k <= j; ++k)
+			in[cluster_of(way[k])] = 1;
+
+		if (way[i] != way[j]) {
+			tile_search(pm, domain, &local, way[i], in, 0, way[j]);
+			route_append(pm, domain, &local, way[j], route);
+		}
+		i = j;
+	}
+	return 0;
+}
+
+/*
+ * A unit can be where it can't go, as a colonist aboard a ship: then its
+ * first step may leave its cluster without any entrance, so the route is
+ * the best of those from the tiles it can step to.
+ */
+int path_find(const struct path_map *pm, enum path_domain domain, int from, int to, struct path_route *route)
+{
+	static __thread struct path_route next;
+
+	route->cost = route->steps = 0;
+	if (from == to)
+		return 0;
+	const uint16_t *component = pm->graph[domain].component;
+	if (!component[to])
+		return -1;
+	if (component[from])
+		return component[from] == component[to] ? find(pm, domain, from, to, route) : -1;
+
+	int best = -1, x = from % MAP_WIDTH, y = from / MAP_WIDTH;
+	for (int k = 0; k < 8; ++k) {
+		int nx = x + dx[k], ny = y + dy[k], n = nx + ny * MAP_WIDTH;
+		if (nx < 0 || nx >= MAP_WIDTH || ny < 0 || ny >= MAP_HEIGHT || component[n] != component[to])
+			continue;
+
+		int step = step_cost(pm, domain, from, n);
+		next.cost = next.steps = 0;
+		if ((n == to || find(pm, domain, n, to, &next) == 0) && (best == -1 || step + next.cost < route->cost)) {
+			best = n;
+			route->cost = step + next.cost;
+			route->steps = next.steps + 1;
+			route->step[0] = step;
+			memcpy(route->step + 1, next.step, next.steps);
+		}
+	}
+	return best == -1 ? -1 : 0;
+}
+
+int path_turns(const struct path_route *route, int movement, int used)
+{
+	int full = movement * 3, left = full - used, turns = 0;
+
+	if (left < 0)
+		left = 0;
+	for (int i = 0; i < route->steps; ++i) {
+		int cost = route->step[i];
+		if (cost > left && left < full) {
+			++turns;
+			left = full;
+		}
+		left = cost > left ? 0 : left - cost;
+	}
+	return turns;
+}
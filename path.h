@@ -0,0 +1,76 @@
+#ifndef PATH_H
+#define PATH_H
+
+#include <stdint.h>
+
+#include "mapplane.h"
+#include "savegame.h"
+
+/*
+ * Routes and travel times over the map.
+ *
+ * Costs are in moves, as unit::moves counts them: 3 for a step onto open
+ * land or water, 6 onto forest or hills, 9 onto mountains, and 1 between
+ * two tiles with a road (colonies count as one) or along a river. Land
+ * units go over land; ships go over water and through colonies, which are
+ * ports. Steps go to any of the 8 neighbours. Other units and who owns
+ * the tiles are not taken into account.
+ *
+ * Terrain comes from map layer 0 (water, forest, and the hills and river
+ * bits of phys) and roads from layer 1, where the game keeps them in the
+ * bit that decodes as forest.
+ *
+ * Searches run on an abstraction of the map, built once per map: the map
+ * is cut into PATH_CLUSTER square clusters, each stretch of border two
+ * clusters can be crossed along gets an entrance, and the cheapest routes
+ * between the entrances of each cluster are worked out ahead. A query then
+ * searches a few hundred entrances instead of thousands of tiles, and
+ * fills in the steps a few clusters at a time. Routes found that way cost
+ * more than the cheapest one: 1 to 4% on average over random pairs of
+ * tiles, but one a few clusters long can cost up to about 2.6 times as
+ * much. Tiles at most two clusters apart are searched tile by tile, which
+ * finds the cheapest. The areas of connected tiles are numbered too, so a
+ * query with no route needs no search at all.
+ */
+
+#define PATH_CLUSTER 8
+
+enum path_domain { PATH_LAND, PATH_SEA, PATH_DOMAINS };
+
+struct path_map;
+
+/*
+ * The abstraction of sv's map (read with its map and colony sections).
+ * Each thread keeps the last PATH_CACHE it built by fingerprint of the
+ * terrain, roads and colonies, so queries against saves of the same map
+ * find it ready. Valid until the thread gets PATH_CACHE other maps.
+ */
+#define PATH_CACHE 8
+
+const struct path_map *path_map_get(const struct savegame_view *sv);
+
+/* The steps of a route, each one's cost in moves */
+struct path_route {
+	int cost;
+	int steps;
+	uint8_t step[MAP_TILES];
+};
+
+/* A route from tile from to tile to (x + y * MAP_WIDTH). Returns 0, or -1 if there is none */
+int path_find(const struct path_map *pm, enum path_domain domain, int from, int to, struct path_route *route);
+
+/* The same, searching tile by tile without the abstraction: the cheapest route, slower when far */
+int path_find_plain(const struct path_map *pm, enum path_domain domain, int from, int to, struct path_route *route);
+
+/*
+ * Turns a unit with movement points a turn (3 moves each) that has used
+ * up used moves of this one ends on the way. 0 if it gets there this turn.
+ * A unit that has not moved yet this turn can always make one step.
+ */
+int path_turns(const struct path_route *route, int movement, int used);
+
+/* The domain and movement points of a unit type */
+enum path_domain path_unit_domain(int type);
+int path_unit_movement(int type);
+
+#endif
@@ -0,0 +1,37 @@
+#ifndef PRINT_H
+#define PRINT_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "loader.h"
+#include "sink.h"
+#include "spatial.h"
+
+/*
+ * The text printers of savegame.cc, one per section or option. With
+ * just_this_one only that record (counting from 0), and with mask only
+ * the records it has set.
+ */
+
+void print_head(  struct sink *out, const struct savegame_view *sv);
+void print_player(struct sink *out, const struct savegame_view *sv, int just_this_one = -1);
+void print_other( struct sink *out, const struct savegame_view *sv);
+void print_colony(struct sink *out, const struct savegame_view *sv, int just_this_one = -1, const uint8_t *mask = NULL);
+void print_unit(  struct sink *out, const struct savegame_view *sv, int just_this_one = -1, const uint8_t *mask = NULL);
+void print_nation(struct sink *out, const struct savegame_view *sv, int just_this_one = -1, const uint8_t *mask = NULL);
+void print_tribe( struct sink *out, const struct savegame_view *sv, int just_this_one = -1, const uint8_t *mask = NULL);
+void print_indian(struct sink *out, const struct savegame_view *sv, int just_this_one = -1);
+void print_stuff( struct sink *out, const struct savegame_view *sv);
+void print_map(   struct sink *out, const struct savegame_view *sv);
+void print_tail(  struct sink *out, const struct savegame_view *sv);
+void print_terrain(struct sink *out, const struct savegame_view *sv, const char *filename);
+void print_route( struct sink *out, const struct savegame_view *sv, int just_this_one = -1);
+void print_at(    struct sink *out, const struct savegame_view *sv, const struct spatial_index *si, int x, int y, int r);
+void print_near(  struct sink *out, const struct savegame_view *sv, const struct spatial_index *si, int r);
+void print_manifest(struct sink *out, const struct savegame_view *sv);
+void print_totals(struct sink *out, const struct savegame_view *sv, const char *filename);
+void print_territory(struct sink *out, const struct savegame_view *sv, const char *filename);
+void print_path(  struct sink *out, const struct savegame_view *sv, const char *filename, const int *pairs = NULL, int count = 0);
+
+#endif
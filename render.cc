@@ -0,0 +1,412 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "mapplane.h"
+#include "render.h"
+#include "sink.h"
+#include "stats.h"
+
+void image_resize(struct image *img, int width, int height)
+{
+	size_t need = (size_t) width * height * 3;
+
+	if (img->cap < need) {
+		img->rgb = (uint8_t *) realloc(img->rgb, need);
+		stats_allocs(1);
+		img->cap = need;
+	}
+	img->width = width;
+	img->height = height;
+}
+
+void image_free(struct image *img)
+{
+	free(img->rgb);
+	memset(img, 0, sizeof (*img));
+}
+
+void image_tile(struct image *img, int scale, int x, int y, const uint8_t *rgb)
+{
+	for (int py = y * scale; py < (y + 1) * scale; ++py) {
+		uint8_t *p = img->rgb + ((size_t) py * img->width + x * scale) * 3;
+		for (int px = 0; px < scale; ++px, p += 3) {
+			p[0] = rgb[0];
+			p[1] = rgb[1];
+			p[2] = rgb[2];
+		}
+	}
+}
+
+/*
+ * Palette, indexed by the low five bits of a map byte: tile | forest << 3 | water << 4.
+ * What the tile numbers mean isn't known yet, so land runs from grassland
+ * greens to desert and mountain browns, forest darkens it, and water tiles
+ * are shades of blue.
+ */
+static const uint8_t palette[32][3] = {
+	/* land */
+	{ 120, 170,  80 }, { 150, 180,  90 }, { 190, 180, 100 }, { 170, 140,  90 },
+	{ 140, 120, 100 }, { 200, 190, 150 }, { 160, 160, 160 }, { 230, 230, 230 },
+	/* forest */
+	{  50, 110,  40 }, {  70, 120,  50 }, { 100, 120,  50 }, {  90, 100,  50 },
+	{  80,  90,  60 }, { 110, 120,  80 }, {  90, 100,  90 }, { 150, 170, 150 },
+	/* water */
+	{  30,  70, 150 }, {  40,  90, 170 }, {  50, 110, 190 }, {  60, 130, 200 },
+	{  20,  50, 120 }, {  70, 150, 210 }, {  80, 160, 220 }, {  10,  30,  90 },
+	/* water + forest bit */
+	{  30,  80, 130 }, {  40, 100, 150 }, {  50, 120, 170 }, {  60, 140, 180 },
+	{  20,  60, 100 }, {  70, 160, 190 }, {  80, 170, 200 }, {  10,  40,  80 },
+};
+
+const uint8_t nation_rgb[12][3] = {
+	{ 220,  30,  30 }, // England
+	{  40,  60, 230 }, // France
+	{ 250, 220,  30 }, // Spain
+	{ 250, 140,  20 }, // Netherlands
+	{ 180,  90,  40 }, // Inca
+	{ 140,  60, 140 }, // Aztec
+	{ 200, 120, 160 }, // Awarak
+	{ 100,  60,  30 }, // Iroquoi
+	{ 120, 200, 120 }, // Cherokee
+	{ 200, 160, 120 }, // Apache
+	{ 160, 120, 200 }, // Sioux
+	{ 100, 200, 200 }, // Tupi
+};
+
+static const uint8_t black[3] = { 0, 0, 0 };
+static const uint8_t unknown_rgb[3] = { 255, 0, 255 };
+
+static const uint8_t *owner_rgb(int nation)
+{
+	return (nation >= 0 && nation < 12) ? nation_rgb[nation] : unknown_rgb;
+}
+
+static int on_map(int x, int y)
+{
+	return x >= 0 && x < MAP_WIDTH && y >= 0 && y < MAP_HEIGHT;
+}
+
+/* A size x size square centred in tile (x, y) */
+static void mark(struct image *img, int scale, int x, int y, int size, int hollow, const uint8_t *rgb)
+{
+	int off = (scale - size) / 2;
+
+	for (int dy = 0; dy < size; ++dy) {
+		for (int dx = 0; dx < size; ++dx) {
+			if (hollow && dy > 0 && dy < size - 1 && dx > 0 && dx < size - 1)
+				continue;
+			uint8_t *p = img->rgb + ((size_t) (y * scale + off + dy) * img->width + x * scale + off + dx) * 3;
+			memcpy(p, rgb, 3);
+		}
+	}
+}
+
+void render_map(const struct savegame_view *sv, const struct render_options *ro, struct image *img)
+{
+	const int s = ro->scale;
+	const uint8_t *layer = (const uint8_t *) sv->map->layer[ro->layer];
+
+	image_resize(img, MAP_WIDTH * s, MAP_HEIGHT * s);
+
+	if (s == 1) {
+		uint8_t *p = img->rgb;
+		for (int i = 0; i < MAP_TILES; ++i, p += 3)
+			memcpy(p, palette[layer[i] & 0x1f], 3);
+	} else {
+		for (int y = 0; y < MAP_HEIGHT; ++y) {
+			/* Draw the first pixel row of the tile row, then copy it down */
+			uint8_t *row = img->rgb + (size_t) y * s * img->width * 3;
+			uint8_t *p = row;
+			for (int x = 0; x < MAP_WIDTH; ++x) {
+				const uint8_t *c = palette[layer[x + y * MAP_WIDTH] & 0x1f];
+				for (int k = 0; k < s; ++k, p += 3)
+					memcpy(p, c, 3);
+			}
+			for (int k = 1; k < s; ++k)
+				memcpy(row + (size_t) k * img->width * 3, row, (size_t) img->width * 3);
+		}
+	}
+
+	if (!ro->overlay)
+		return;
+
+	for (int i = 0; i < sv->head->tribe_count; ++i) {
+		const struct savegame::tribe *t = &sv->tribe[i];
+		if (!on_map(t->x, t->y))
+			continue;
+		if (s >= 3)
+			mark(img, s, t->x, t->y, s, 1, owner_rgb(t->nation));
+		else
+			image_tile(img, s, t->x, t->y, owner_rgb(t->nation));
+	}
+
+	for (int i = 0; i < sv->head->unit_count; ++i) {
+		const struct savegame::unit *u = &sv->unit[i];
+		if (!on_map(u->x, u->y))
+			continue;
+		mark(img, s, u->x, u->y, (s >= 2) ? s / 2 : 1, 0, owner_rgb(u->owner));
+	}
+
+	/* Colonies last, they matter most */
+	for (int i = 0; i < sv->head->colony_count; ++i) {
+		const struct savegame::colony *c = &sv->colony[i];
+		if (!on_map(c->x, c->y))
+			continue;
+		image_tile(img, s, c->x, c->y, owner_rgb(c->nation));
+		if (s >= 3)
+			mark(img, s, c->x, c->y, s, 1, black);
+	}
+}
+
+void render_path(char *path, size_t size, const char *dir, const char *filename, enum image_format format)
+{
+	while (filename[0] == '.' && filename[1] == '/')
+		filename += 2;
+	while (filename[0] == '/')
+		++filename;
+
+	int n = snprintf(path, size, "%s/", dir);
+	for (const char *p = filename; *p && n + 1 < (int) size; ++p)
+		path[n++] = (*p == '/') ? '_' : *p;
+	path[n] = '\0';
+
+	char *dot = strrchr(path + strlen(dir) + 1, '.');
+	if (dot)
+		*dot = '\0';
+
+	strncat(path, (format == IMAGE_PNG) ? ".png" : ".ppm", size - strlen(path) - 1);
+}
+
+/*
+ * PNG writer: filtered scanlines in a zlib stream compressed with the
+ * fixed deflate codes. Rows are filtered with Up when they repeat the row
+ * above and Sub otherwise, so upscaled tiles become runs of zeros, which
+ * are coded as distance 1 matches.
+ */
+
+static uint32_t crc_table[256];
+
+__attribute__ ((constructor))
+static void crc_init(void)
+{
+	for (uint32_t n = 0; n < 256; ++n) {
+		uint32_t c = n;
+		for (int k = 0; k < 8; ++k)
+			c = (c & 1) ? 0xedb88320u ^ (c >> 1) : c >> 1;
+		crc_table[n] = c;
+	}
+}
+
+static uint32_t crc32(uint32_t crc, const uint8_t *p, size_t n)
+{
+	crc = ~crc;
+	while (n--)
+		crc = crc_table[(crc ^ *p++) & 0xff] ^ (crc >> 8);
+	return ~crc;
+}
+
+struct bits {
+	struct sink *out;
+	uint32_t acc;
+	int n;
+};
+
+static inline void put_bits(struct bits *b, uint32_t value, int count)
+{
+	b->acc |= value << b->n;
+	b->n += count;
+	while (b->n >= 8) {
+		sink_putc(b->out, b->acc & 0xff);
+		b->acc >>= 8;
+		b->n -= 8;
+	}
+}
+
+/* Huffman codes go out most significant bit first */
+static inline void put_code(struct bits *b, uint32_t code, int count)
+{
+	uint32_t rev = 0;
+	for (int i = 0; i < count; ++i)
+		rev |= ((code >> i) & 1) << (count - 1 - i);
+	put_bits(b, rev, count);
+}
+
+static void put_literal(struct bits *b, int lit)
+{
+	if (lit < 144)
+		put_code(b, 0x30 + lit, 8);
+	else if (lit < 256)
+		put_code(b, 0x190 + lit - 144, 9);
+	else if (lit < 280)
+		put_code(b, lit - 256, 7);
+	else
+		put_code(b, 0xc0 + lit - 280, 8);
+}
+
+static void put_match(struct bits *b, int len)
+{
+	static const uint16_t base[29] = {
+		3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+		35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+	static const uint8_t extra[29] = {
+		0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+		3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+
+	int code = 28;
+	while (base[code] > len)
+		--code;
+
+	put_literal(b, 257 + code);
+	if (extra[code])
+		put_bits(b, len - base[code], extra[code]);
+	put_code(b, 0, 5); // distance code 0: distance 1
+}
+
+static void deflate_fixed(struct sink *out, const uint8_t *data, size_t n)
+{
+	struct bits b = { out, 0, 0 };
+
+	put_bits(&b, 1, 1); // final block
+	put_bits(&b, 1, 2); // fixed codes
+
+	size_t i = 0;
+	while (i < n) {
+		put_literal(&b, data[i]);
+
+		size_t run = 0;
+		while (i + 1 + run < n && data[i + 1 + run] == data[i] && run < 258)
+			++run;
+
+		if (run >= 3) {
+			put_match(&b, run);
+			i += run + 1;
+		} else {
+			++i;
+		}
+	}
+
+	put_literal(&b, 256);
+	if (b.n)
+		put_bits(&b, 0, 8 - b.n);
+}
+
+static void put_be32(struct sink *out, uint32_t v)
+{
+	uint8_t be[4] = { (uint8_t) (v >> 24), (uint8_t) (v >> 16), (uint8_t) (v >> 8), (uint8_t) v };
+	sink_write(out, be, 4);
+}
+
+static void put_chunk(struct sink *out, const char *type, const uint8_t *data, size_t n)
+{
+	put_be32(out, n);
+	size_t start = out->len;
+	sink_write(out, type, 4);
+	sink_write(out, data, n);
+	put_be32(out, crc32(0, (const uint8_t *) out->buf + start, n + 4));
+}
+
+static void write_png(struct sink *out, const struct image *img, struct sink *tmp)
+{
+	static const uint8_t signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n' };
+	sink_write(out, signature, 8);
+
+	uint8_t ihdr[13];
+	ihdr[0] = img->width >> 24;  ihdr[1] = img->width >> 16;  ihdr[2]  = img->width >> 8;  ihdr[3]  = img->width;
+	ihdr[4] = img->height >> 24; ihdr[5] = img->height >> 16; ihdr[6]  = img->height >> 8; ihdr[7]  = img->height;
+	ihdr[8] = 8;  // bit depth
+	ihdr[9] = 2;  // RGB
+	ihdr[10] = 0; // deflate
+	ihdr[11] = 0; // adaptive filtering
+	ihdr[12] = 0; // no interlace
+	put_chunk(out, "IHDR", ihdr, sizeof (ihdr));
+
+	/* Filtered scanlines, in tmp */
+	size_t stride = (size_t) img->width * 3;
+	tmp->len = 0;
+	for (int y = 0; y < img->height; ++y) {
+		const uint8_t *row = img->rgb + y * stride;
+		char *p = sink_reserve(tmp, stride + 1);
+
+		if (y > 0 && memcmp(row, row - stride, stride) == 0) {
+			*p++ = 2; // Up: all zeros
+			memset(p, 0, stride);
+		} else {
+			*p++ = 1; // Sub
+			memcpy(p, row, 3);
+			for (size_t i = 3; i < stride; ++i)
+				p[i] = row[i] - row[i - 3];
+		}
+		tmp->len += stride + 1;
+	}
+
+	uint32_t a = 1, b = 0;
+	for (size_t i = 0; i < tmp->len; ++i) {
+		a = (a + (uint8_t) tmp->buf[i]) % 65521;
+		b = (b + a) % 65521;
+	}
+
+	/*
+	 * zlib stream, compressed after the scanlines in tmp. Fixed codes are
+	 * at most 9 bits a byte, so reserving up front keeps the scanlines
+	 * from moving while they're read.
+	 */
+	size_t raw = tmp->len;
+	sink_reserve(tmp, raw + raw / 4 + 64);
+	sink_putc(tmp, 0x78);
+	sink_putc(tmp, 0x01);
+	deflate_fixed(tmp, (const uint8_t *) tmp->buf, raw);
+	put_be32(tmp, (b << 16) | a);
+
+	put_chunk(out, "IDAT", (const uint8_t *) tmp->buf + raw, tmp->len - raw);
+	put_chunk(out, "IEND", NULL, 0);
+}
+
+static int write_full(int fd, const void *buf, size_t len)
+{
+	const uint8_t *p = (const uint8_t *) buf;
+
+	while (len > 0) {
+		ssize_t n = write(fd, p, len);
+		stats_syscalls(1);
+		if (n == -1) {
+			if (errno == EINTR)
+				continue;
+			return -1;
+		}
+		stats_written(n);
+		p += n;
+		len -= n;
+	}
+	return 0;
+}
+
+int image_write(const struct image *img, enum image_format format, const char *path)
+{
+	static __thread struct sink out, tmp;
+
+	if (out.buf == NULL) {
+		sink_init(&out, -1);
+		sink_init(&tmp, -1);
+	}
+
+	out.len = 0;
+	if (format == IMAGE_PNG) {
+		write_png(&out, img, &tmp);
+	} else {
+		sink_printf(&out, "P6\n%d %d\n255\n", img->width, img->height);
+		sink_write(&out, img->rgb, (size_t) img->width * img->height * 3);
+	}
+
+	int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+	if (fd == -1)
+		return -1;
+
+	int res = write_full(fd, out.buf, out.len);
+	if (close(fd) == -1)
+		res = -1;
+	return res;
+}
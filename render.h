@@ -0,0 +1,47 @@
+#ifndef RENDER_H
+#define RENDER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "savegame.h"
+
+/* 24 bit RGB image, the pixel memory is kept and reused between images */
+struct image {
+	int width, height;
+	uint8_t *rgb;
+	size_t cap;
+};
+
+void image_resize(struct image *img, int width, int height);
+void image_free(struct image *img);
+
+/* Fills the scale x scale block of map tile (x, y) */
+void image_tile(struct image *img, int scale, int x, int y, const uint8_t *rgb);
+
+enum image_format { IMAGE_PPM, IMAGE_PNG };
+
+/* Returns 0 on success, -1 with errno set */
+int image_write(const struct image *img, enum image_format format, const char *path);
+
+/* Colour of each nation_list entry */
+extern const uint8_t nation_rgb[12][3];
+
+struct render_options {
+	int scale;    // pixels per tile
+	int overlay;  // draw colonies, units and tribes
+	int layer;    // map layer
+	enum image_format format;
+};
+
+/* Draws sv's map (and overlays) into img */
+void render_map(const struct savegame_view *sv, const struct render_options *ro, struct image *img);
+
+/*
+ * Output path for savegame filename in dir: the path with '/' turned into
+ * '_' and the extension swapped for the format's, so saves with the same
+ * name in different campaign directories don't collide.
+ */
+void render_path(char *path, size_t size, const char *dir, const char *filename, enum image_format format);
+
+#endif
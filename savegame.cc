@@ -1,28 +1,216 @@
 #include <assert.h>
 #include <ctype.h>
+#include <errno.h>
 #include <getopt.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/param.h>
+#include <unistd.h>
 
 #include "savegame.h"
-
-void print_head(  const struct savegame::head   *head);
-void print_player(const struct savegame::player *player,                        int just_this_one = -1);
-void print_other( const struct savegame::other  *other);
-void print_colony(const struct savegame *sg, const struct savegame::colony *colony, uint16_t colony_count, int just_this_one = -1);
-void print_unit(  const struct savegame::unit   *unit,   uint16_t unit_count,   int just_this_one = -1);
-void print_nation(const struct savegame::nation *nation,                        int just_this_one = -1);
-void print_tribe( const struct savegame::tribe  *tribe,  uint16_t tribe_count,  int just_this_one = -1);
-void print_indian(const struct savegame::indian_relations *ir,                  int just_this_one = -1);
-void print_stuff( const struct savegame::stuff  *stuff);
-void print_map(   const struct savegame::map    *map);
-void print_tail(  const struct savegame::tail   *tail);
-void print_route(const struct savegame *sg, const struct savegame::trade_route *route, int just_this_one = -1);
+#include "archive.h"
+#include "batch.h"
+#include "catalog.h"
+#include "columns.h"
+#include "daemon.h"
+#include "diff.h"
+#include "generate.h"
+#include "loader.h"
+#include "mapplane.h"
+#include "ndjson.h"
+#include "patch.h"
+#include "path.h"
+#include "print.h"
+#include "render.h"
+#include "series.h"
+#include "sink.h"
+#include "spatial.h"
+#include "stats.h"
+#include "territory.h"
+#include "totals.h"
+#include "transport.h"
+#include "where.h"
+
+struct print_options;
+
+void print_ndjson(struct sink *out, const struct print_options *o, const struct savegame_view *sv, const char *filename, uint8_t *const *mask);
+void print_selected(struct sink *out, const struct print_options *o, const struct savegame_view *sv, const char *filename, uint8_t *const *mask);
 
 void dump(void *address, size_t bytes, const char *filename);
 
+void select_sections(const struct print_options *o, struct savegame_select *sel);
+int process_file(int index, struct sink *out, void *arg);
+int process_file_stats(int index, struct sink *out, void *arg);
+int diff_files(int index, struct sink *out, void *arg);
+int archive_add(const char *path, int count, char **files);
+int archive_list(const char *path);
+int archive_get(const char *path, int count, char **turns);
+int daemon_query(struct sink *out, const struct savegame_view *sv, const char *filename, const char *query, uint32_t *sections);
+
+enum format { FORMAT_TEXT, FORMAT_NDJSON };
+
+/*
+ * What to print and draw for each file, from the command line or from a
+ * daemon query. Flags
+ *  -1 print all
+ *  0 don't print any
+ *  n print specific entry
+ */
+struct print_options {
+	int head, player, other, colony, unit, nation, tribe, stuff, indian, map,
+	    tail, route, terrain, manifest, totals, territory;
+
+	/* --at=X,Y[,R] and --near=R, -1 when not given */
+	int at_x, at_y, at_r, near;
+
+	struct where *where[4];  // by column_tables index
+	enum format format;
+
+	/* --path, and its unit, colony index pairs, or NULL for all of them */
+	const char *path;
+	int *path_pairs, path_pair_count;
+
+	/* --render-map and --territory-map directories */
+	const char *render, *territory_map;
+};
+
+#define PRINT_OPTIONS_INIT { 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, \
+                             -1, -1, 0, -1, { NULL }, FORMAT_TEXT, NULL, NULL, 0, NULL, NULL }
+
+static struct print_options opt = PRINT_OPTIONS_INIT;
+
+static int opt_help = 0, opt_colony10 = 0, opt_diff = 0;
+
+static int opt_jobs = 1, opt_patch_sync = 64;
+static int opt_stats = 0; // --stats given
+static enum stats_format opt_stats_format = STATS_TEXT;
+static const char *opt_export = NULL, *opt_query = NULL;
+static const char *opt_archive_add = NULL, *opt_archive_list = NULL, *opt_archive_extract = NULL;
+static const char *opt_daemon = NULL, *opt_ask = NULL;
+static const char *opt_catalog = NULL, *opt_catalog_query = NULL, *opt_catalog_find = NULL;
+static const char *opt_generate = NULL;
+static const char *opt_series = NULL, *opt_series_print = NULL;
+static const char *opt_patch = NULL, *opt_patch_output = "%d/%b.patched%e";
+static struct render_options opt_render_options = { 4, 0, 0, IMAGE_PNG };
+
+/* Long options without a short one */
+enum {
+	OPT_EXPORT = 0x100,
+	OPT_QUERY,
+	OPT_RENDER_MAP,
+	OPT_RENDER_SCALE,
+	OPT_RENDER_FORMAT,
+	OPT_RENDER_LAYER,
+	OPT_RENDER_OVERLAY,
+	OPT_ARCHIVE_ADD,
+	OPT_ARCHIVE_LIST,
+	OPT_ARCHIVE_EXTRACT,
+	OPT_WHERE,
+	OPT_AT,
+	OPT_NEAR,
+	OPT_FORMAT,
+	OPT_DAEMON,
+	OPT_ASK,
+	OPT_CATALOG,
+	OPT_CATALOG_QUERY,
+	OPT_CATALOG_FIND,
+	OPT_GENERATE,
+	OPT_PATCH,
+	OPT_PATCH_OUTPUT,
+	OPT_PATCH_SYNC,
+	OPT_STATS,
+	OPT_SERIES,
+	OPT_SERIES_PRINT,
+	OPT_TERRITORY_MAP,
+	OPT_PATH,
+};
+
+/* What the opt_ flags need read from each file */
+static struct savegame_select opt_select;
+
+/* --patch or --colony10 compiled, and where its results go */
+static struct patch *patch;
+static const char *patch_output;
+static struct patch_writer *patch_writer;
+
+/* -pN and friends: -1 for all of the section, N + 1 for entry N */
+static int section_flag(const char *arg)
+{
+	return (arg && isdigit(arg[0])) ? atoi(arg) + 1 : -1;
+}
+
+/* --path=all, U:C pairs separated by commas or spaces, or @FILE of them */
+static int path_parse(const char *spec)
+{
+	char *text = NULL;
+
+	free(opt.path_pairs);
+	opt.path_pairs = NULL;
+	opt.path_pair_count = 0;
+	if (strcmp(spec, "all") == 0)
+		return 0;
+
+	if (spec[0] == '@') {
+		FILE *fp = fopen(spec + 1, "r");
+		if (!fp) {
+			fprintf(stderr, "%s: %s\n", spec + 1, strerror(errno));
+			return -1;
+		}
+		size_t len = 0, cap = 4096, n;
+		text = (char *) malloc(cap);
+		while ((n = fread(text + len, 1, cap - len - 1, fp)) > 0) {
+			len += n;
+			if (len + 1 == cap)
+				text = (char *) realloc(text, cap *= 2);
+		}
+		text[len] = '\0';
+		fclose(fp);
+		spec = text;
+	}
+
+	int cap = 0;
+	for (const char *p = spec; ; ) {
+		int unit, colony, n;
+
+		p += strspn(p, ", \t\r\n");
+		if (!*p)
+			break;
+		if (sscanf(p, "%d:%d%n", &unit, &colony, &n) != 2 || unit < 0 || colony < 0 ||
+		    (p[n] && !strchr(", \t\r\n", p[n]))) {
+			fprintf(stderr, "--path: expected all, U:C,... or @FILE at '%.20s'\n", p);
+			free(text);
+			return -1;
+		}
+		if (opt.path_pair_count == cap) {
+			cap = cap ? 2 * cap : 64;
+			opt.path_pairs = (int *) realloc(opt.path_pairs, sizeof (int) * 2 * cap);
+		}
+		opt.path_pairs[2 * opt.path_pair_count] = unit;
+		opt.path_pairs[2 * opt.path_pair_count + 1] = colony;
+		++opt.path_pair_count;
+		p += n;
+	}
+	free(text);
+
+	if (!opt.path_pair_count) {
+		fprintf(stderr, "--path: no unit and colony pairs\n");
+		return -1;
+	}
+	return 0;
+}
+
+/* NDJSON of everything there is a field table for, unless told otherwise */
+static void ndjson_defaults(struct print_options *o)
+{
+	if (o->format == FORMAT_NDJSON &&
+	    !(o->head || o->player || o->other || o->colony || o->unit || o->nation ||
+	      o->tribe || o->indian || o->stuff || o->tail || o->route || o->totals ||
+	      o->territory || o->path))
+		o->head = o->player = o->colony = o->unit = o->nation = o->tribe = o->indian = o->route = -1;
+}
+
 void print_help(const char *prog){
 	fprintf(stderr, "Usage: %s [options] <COLONY0*.SAV> ...\n", prog);
 	fprintf(stderr, "OPTIONs:\n");
@@ -33,6 +221,7 @@ void print_help(const char *prog){
 	fprintf(stderr, "-o, --other      displays other section of savegame  \n");
 	fprintf(stderr, "-s, --stuff      displays stuff section of savegame  \n");
 	fprintf(stderr, "-m, --map        displays map section of savegame    \n");
+	fprintf(stderr, "--terrain        one line of terrain counts per layer\n");
 	fprintf(stderr, "                                                     \n");
 	fprintf(stderr, "If N is given, displays a single entry in the section\n");
 	fprintf(stderr, "-pN, --player=N  displays player section of savegame \n");
@@ -41,33 +230,112 @@ void print_help(const char *prog){
 	fprintf(stderr, "-tN, --tribe=N   displays tribe section of savegame  \n");
 	fprintf(stderr, "-iN, --indian=N  displays indian section of savegame \n");
 	fprintf(stderr, "-rN, --route=N   displays trade route section        \n");
+	fprintf(stderr, "--where=F        only units, colonies, tribes or     \n");
+	fprintf(stderr, "                 nations matching F, e.g.            \n");
+	fprintf(stderr, "                 'unit: owner==England && x in 1..9' \n");
+	fprintf(stderr, "                                                     \n");
+	fprintf(stderr, "--manifest       what each nation's ships carry, and \n");
+	fprintf(stderr, "                 broken unit transport links         \n");
+	fprintf(stderr, "--totals         one line per file of each nation's  \n");
+	fprintf(stderr, "                 goods in colonies+holds, population,\n");
+	fprintf(stderr, "                 hammers and rebels                  \n");
+	fprintf(stderr, "--territory      each nation's and tribe's tiles, by \n");
+	fprintf(stderr, "                 distance to its colonies, villages  \n");
+	fprintf(stderr, "--path=U:C,...   turns for unit U to reach colony C, \n");
+	fprintf(stderr, "                 over land or by sea; all for every  \n");
+	fprintf(stderr, "                 unit to its nation's colonies, or   \n");
+	fprintf(stderr, "                 @FILE for pairs read from FILE      \n");
+	fprintf(stderr, "--at=X,Y[,R]     units, colonies and tribes on tile  \n");
+	fprintf(stderr, "                 X,Y, or within R tiles of it        \n");
+	fprintf(stderr, "--near=R         units within R tiles of each colony,\n");
+	fprintf(stderr, "                 and its nearest tribe and colony    \n");
+	fprintf(stderr, "                                                     \n");
+	fprintf(stderr, "--format=ndjson  one JSON object per record instead, \n");
+	fprintf(stderr, "                 of every section when none is given\n");
 	fprintf(stderr, "                                                     \n");
 	fprintf(stderr, "--colony10  writes modificaions to COLONY10.SAV      \n");
+	fprintf(stderr, "--patch=FILE     applies the edits in FILE to each   \n");
+	fprintf(stderr, "                 file, e.g. 'unit[type == Treasure]  \n");
+	fprintf(stderr, "                 .profession *= 2' (see patch.h)     \n");
+	fprintf(stderr, "--patch-output=P where --patch writes to, with %%f, %%b,\n");
+	fprintf(stderr, "                 %%e, %%d and %%n for the file's name,  \n");
+	fprintf(stderr, "                 base, extension, dir and number     \n");
+	fprintf(stderr, "                 (default %%d/%%b.patched%%e), %%d/%%f    \n");
+	fprintf(stderr, "                 writes just the changes in place    \n");
+	fprintf(stderr, "--patch-sync=N   syncs written files N at a time     \n");
+	fprintf(stderr, "                 (default 64), 0 not at all          \n");
+	fprintf(stderr, "                                                     \n");
+	fprintf(stderr, "-jN, --jobs=N    process files on N worker threads   \n");
+	fprintf(stderr, "--stats[=json]   where the time went, per phase and  \n");
+	fprintf(stderr, "                 file, to stderr at the end          \n");
+	fprintf(stderr, "--diff A B ...   what changed from each file to the  \n");
+	fprintf(stderr, "                 next, field by field                \n");
+	fprintf(stderr, "                                                     \n");
+	fprintf(stderr, "--export=DIR     writes a columnar store of units,   \n");
+	fprintf(stderr, "                 colonies, tribes and nations to DIR \n");
+	fprintf(stderr, "--query=Q <DIR>  runs Q over the columnar store DIR, \n");
+	fprintf(stderr, "                 e.g. 'sum(gold) by nation,year'     \n");
+	fprintf(stderr, "                                                     \n");
+	fprintf(stderr, "--render-map=DIR writes each map as an image to DIR  \n");
+	fprintf(stderr, "--render-scale=N pixels per tile (default 4)         \n");
+	fprintf(stderr, "--render-format=png|ppm                              \n");
+	fprintf(stderr, "--render-layer=N map layer to draw (default 0)       \n");
+	fprintf(stderr, "--render-overlay draws colonies, units and tribes    \n");
+	fprintf(stderr, "--territory-map=DIR                                  \n");
+	fprintf(stderr, "                 writes each map's --territory as an \n");
+	fprintf(stderr, "                 image to DIR, as for --render-map   \n");
+	fprintf(stderr, "                                                     \n");
+	fprintf(stderr, "--archive-add=LOG <SAV> ...                          \n");
+	fprintf(stderr, "                 appends savegames to the archive LOG\n");
+	fprintf(stderr, "--archive-list=LOG                                   \n");
+	fprintf(stderr, "                 lists the turns in the archive LOG  \n");
+	fprintf(stderr, "--archive-extract=LOG <N> ...                        \n");
+	fprintf(stderr, "                 restores turn N as NNNN-<name>      \n");
+	fprintf(stderr, "                                                     \n");
+	fprintf(stderr, "--catalog=IDX <SAV> ...                              \n");
+	fprintf(stderr, "                 indexes the heads, players, colony  \n");
+	fprintf(stderr, "                 and trade route names of savegames  \n");
+	fprintf(stderr, "--catalog-query=IDX <F>                              \n");
+	fprintf(stderr, "                 the indexed saves matching F, e.g.  \n");
+	fprintf(stderr, "                 'year > 1700 && difficulty==Viceroy'\n");
+	fprintf(stderr, "--catalog-find=IDX <NAME> ...                        \n");
+	fprintf(stderr, "                 the indexed saves with a colony,    \n");
+	fprintf(stderr, "                 player or route NAME, or NAME*      \n");
+	fprintf(stderr, "                                                     \n");
+	fprintf(stderr, "--series=SER <SAV> ...                               \n");
+	fprintf(stderr, "                 adds the dates, gold, taxes and     \n");
+	fprintf(stderr, "                 trade of savegames of one campaign  \n");
+	fprintf(stderr, "                 to the time series SER              \n");
+	fprintf(stderr, "--series-print=SER [nations|goods|<GOOD>] ...        \n");
+	fprintf(stderr, "                 each nation's or good's values by   \n");
+	fprintf(stderr, "                 date, with the change since the     \n");
+	fprintf(stderr, "                 turn before (--format=ndjson too)   \n");
+	fprintf(stderr, "                                                     \n");
+	fprintf(stderr, "--generate=S <SAV> ...                               \n");
+	fprintf(stderr, "                 writes synthetic savegames, each one\n");
+	fprintf(stderr, "                 seeded one higher; S sets seed=N,   \n");
+	fprintf(stderr, "                 colonies=N, units=N, tribes=N,      \n");
+	fprintf(stderr, "                 routes=N, flips=N (random bytes), or\n");
+	fprintf(stderr, "                 max for the largest the format holds\n");
+	fprintf(stderr, "                                                     \n");
+	fprintf(stderr, "--daemon=SOCK <DIR> ...                              \n");
+	fprintf(stderr, "                 keeps the savegames in DIRs loaded, \n");
+	fprintf(stderr, "                 reloading them as they change, and  \n");
+	fprintf(stderr, "                 answers queries on the socket SOCK  \n");
+	fprintf(stderr, "--ask=SOCK -- <Q>                                    \n");
+	fprintf(stderr, "                 asks the daemon at SOCK, e.g.       \n");
+	fprintf(stderr, "                 -- -H -u3 COLONY00.SAV, list, stats \n");
 }
 
-int main(int argc, char *argv[])
-{
-	assert(sizeof (struct savegame::head)   == 158);
-	assert(sizeof (struct savegame::player) ==  52);
-	assert(sizeof (struct savegame::colony) == 202);
-	assert(sizeof (struct savegame::unit)   ==  28);
-	assert(sizeof (struct savegame::nation) == 316);
-	assert(sizeof (struct savegame::tribe)  ==  18);
-	assert(sizeof (struct savegame::stuff)  == 727);
-	assert(sizeof (struct savegame::map)    == 58*72*4);
-	assert(sizeof (struct savegame::trade_route) == 74);
+/* The benchmark (bench.cc) links this file with a main of its own */
+#ifndef SAVEGAME_MAIN
+#define SAVEGAME_MAIN main
+#endif
 
+int SAVEGAME_MAIN(int argc, char *argv[])
+{
 	int c, optindex = 0;
 
-	/* Flags
-	 *  -1 print all
-	 *  0 don't print any
-	 *  n print specific entry
-	 */
-	int opt_head = 0, opt_player = 0, opt_other = 0, opt_colony = 0, opt_unit = 0,
-	    opt_nation = 0, opt_tribe = 0, opt_stuff = 0, opt_indian = 0, opt_map = 0,
-	    opt_tail = 0, opt_route = 0, opt_help = 0, opt_colony10 = 0;
-
 	static struct option long_options[] = {
 		{ "head",     no_argument,       NULL,          'H' },
 		{ "player",   optional_argument, NULL,          'p' },
@@ -82,11 +350,45 @@ int main(int argc, char *argv[])
 		{ "tail",     no_argument,       NULL,          'T' },
 		{ "route",    optional_argument, NULL,          'r' },
 		{ "colony10", no_argument,       &opt_colony10, -1  },
+		{ "terrain",  no_argument,       &opt.terrain,  -1  },
+		{ "diff",     no_argument,       &opt_diff,     -1  },
+		{ "manifest", no_argument,       &opt.manifest, -1  },
+		{ "totals",   no_argument,       &opt.totals,   -1  },
+		{ "territory", no_argument,      &opt.territory, -1 },
+		{ "jobs",     required_argument, NULL,          'j' },
+		{ "export",   required_argument, NULL,          OPT_EXPORT },
+		{ "query",    required_argument, NULL,          OPT_QUERY },
+		{ "render-map",     required_argument, NULL,    OPT_RENDER_MAP },
+		{ "render-scale",   required_argument, NULL,    OPT_RENDER_SCALE },
+		{ "render-format",  required_argument, NULL,    OPT_RENDER_FORMAT },
+		{ "render-layer",   required_argument, NULL,    OPT_RENDER_LAYER },
+		{ "render-overlay", no_argument,       NULL,    OPT_RENDER_OVERLAY },
+		{ "territory-map",  required_argument, NULL,    OPT_TERRITORY_MAP },
+		{ "path",     required_argument, NULL,          OPT_PATH },
+		{ "archive-add",     required_argument, NULL,   OPT_ARCHIVE_ADD },
+		{ "archive-list",    required_argument, NULL,   OPT_ARCHIVE_LIST },
+		{ "archive-extract", required_argument, NULL,   OPT_ARCHIVE_EXTRACT },
+		{ "where",    required_argument, NULL,          OPT_WHERE },
+		{ "at",       required_argument, NULL,          OPT_AT },
+		{ "near",     required_argument, NULL,          OPT_NEAR },
+		{ "format",   required_argument, NULL,          OPT_FORMAT },
+		{ "daemon",   required_argument, NULL,          OPT_DAEMON },
+		{ "ask",      required_argument, NULL,          OPT_ASK },
+		{ "catalog",         required_argument, NULL,   OPT_CATALOG },
+		{ "catalog-query",   required_argument, NULL,   OPT_CATALOG_QUERY },
+		{ "catalog-find",    required_argument, NULL,   OPT_CATALOG_FIND },
+		{ "generate", required_argument, NULL,          OPT_GENERATE },
+		{ "patch",    required_argument, NULL,          OPT_PATCH },
+		{ "patch-output", required_argument, NULL,      OPT_PATCH_OUTPUT },
+		{ "patch-sync",   required_argument, NULL,      OPT_PATCH_SYNC },
+		{ "stats",    optional_argument, NULL,          OPT_STATS },
+		{ "series",       required_argument, NULL,      OPT_SERIES },
+		{ "series-print", required_argument, NULL,      OPT_SERIES_PRINT },
 		{ "help",     no_argument,       NULL,          'h' },
 		{ NULL,       no_argument, NULL,  0  }
 	};
 
-	while ((c = getopt_long(argc, argv, ":Hp::oc::u::n::t::i::r::smTh", long_options, &optindex)) != -1) {
+	while ((c = getopt_long(argc, argv, ":Hp::oc::u::n::t::i::r::smTj:h", long_options, &optindex)) != -1) {
 		switch (c) {
 
 			case 0:
@@ -98,39 +400,129 @@ int main(int argc, char *argv[])
 					printf(" with arg %s", optarg);
 				printf("\n");
 
-			case 'H': opt_head   = -1; break;
-			case 'p': opt_player = -1;
-				if (optarg && isdigit(optarg[0]) )
-					opt_player = atoi(optarg) + 1;
+			case 'H': opt.head   = -1; break;
+			case 'p': opt.player = section_flag(optarg); break;
+			case 'o': opt.other  = -1; break;
+			case 'c': opt.colony = section_flag(optarg); break;
+			case 'u': opt.unit   = section_flag(optarg); break;
+			case 'n': opt.nation = section_flag(optarg); break;
+			case 't': opt.tribe  = section_flag(optarg); break;
+			case 'i': opt.indian = section_flag(optarg); break;
+			case 'r': opt.route  = section_flag(optarg); break;
+			case 's': opt.stuff  = -1; break;
+			case 'm': opt.map    = -1; break;
+			case 'T': opt.tail   = -1; break;
+			case 'j': opt_jobs   = atoi(optarg); break;
+
+			case OPT_EXPORT: opt_export = optarg; break;
+			case OPT_QUERY:  opt_query  = optarg; break;
+
+			case OPT_WHERE: {
+				struct where *w = where_compile(optarg);
+				if (!w)
+					exit(EXIT_FAILURE);
+				int t = where_table(w) - column_tables;
+				where_free(opt.where[t]);
+				opt.where[t] = w;
 				break;
-			case 'o': opt_other  = -1; break;
-			case 'c': opt_colony = -1;
-				if (optarg && isdigit(optarg[0]) )
-					opt_colony = atoi(optarg) + 1;
+			}
+
+			case OPT_AT:
+				if (sscanf(optarg, "%d,%d,%d", &opt.at_x, &opt.at_y, &opt.at_r) < 2 ||
+				    opt.at_x < 0 || opt.at_x >= MAP_WIDTH || opt.at_y < 0 || opt.at_y >= MAP_HEIGHT || opt.at_r < 0) {
+					fprintf(stderr, "--at: expected X,Y[,R] on the %dx%d map\n", MAP_WIDTH, MAP_HEIGHT);
+					exit(EXIT_FAILURE);
+				}
 				break;
-			case 'u': opt_unit   = -1;
-				if (optarg && isdigit(optarg[0]) )
-					opt_unit = atoi(optarg) + 1;
+			case OPT_PATH:
+				opt.path = optarg;
+				if (path_parse(optarg) == -1)
+					exit(EXIT_FAILURE);
 				break;
-			case 'n': opt_nation = -1;
-				if (optarg && isdigit(optarg[0]) )
-					opt_nation = atoi(optarg) + 1;
+			case OPT_NEAR:
+				opt.near = atoi(optarg);
+				if (opt.near < 0) {
+					fprintf(stderr, "--near: expected a distance in tiles\n");
+					exit(EXIT_FAILURE);
+				}
 				break;
-			case 't': opt_tribe  = -1;
-				if (optarg && isdigit(optarg[0]) )
-					opt_tribe = atoi(optarg) + 1;
+
+			case OPT_FORMAT:
+				if (strcmp(optarg, "text") == 0)
+					opt.format = FORMAT_TEXT;
+				else if (strcmp(optarg, "ndjson") == 0)
+					opt.format = FORMAT_NDJSON;
+				else {
+					fprintf(stderr, "Unknown format: %s\n", optarg);
+					exit(EXIT_FAILURE);
+				}
 				break;
-			case 'i': opt_indian = -1;
-				if (optarg && isdigit(optarg[0]) )
-					opt_indian = atoi(optarg) + 1;
+
+			case OPT_DAEMON: opt_daemon = optarg; break;
+			case OPT_ASK:    opt_ask    = optarg; break;
+
+			case OPT_CATALOG:       opt_catalog       = optarg; break;
+			case OPT_CATALOG_QUERY: opt_catalog_query = optarg; break;
+			case OPT_CATALOG_FIND:  opt_catalog_find  = optarg; break;
+
+			case OPT_GENERATE: opt_generate = optarg; break;
+
+			case OPT_SERIES:       opt_series       = optarg; break;
+			case OPT_SERIES_PRINT: opt_series_print = optarg; break;
+
+			case OPT_PATCH:        opt_patch        = optarg; break;
+			case OPT_PATCH_OUTPUT: opt_patch_output = optarg; break;
+			case OPT_STATS:
+				opt_stats = 1;
+				if (!optarg || strcmp(optarg, "text") == 0)
+					opt_stats_format = STATS_TEXT;
+				else if (strcmp(optarg, "json") == 0)
+					opt_stats_format = STATS_JSON;
+				else {
+					fprintf(stderr, "Unknown stats format: %s\n", optarg);
+					exit(EXIT_FAILURE);
+				}
 				break;
-			case 'r': opt_route = -1;
-				if (optarg && isdigit(optarg[0]) )
-					opt_route = atoi(optarg) + 1;
+
+			case OPT_PATCH_SYNC:
+				opt_patch_sync = atoi(optarg);
+				if (opt_patch_sync < 0) {
+					fprintf(stderr, "--patch-sync: expected a number of files\n");
+					exit(EXIT_FAILURE);
+				}
+				break;
+
+			case OPT_ARCHIVE_ADD:     opt_archive_add     = optarg; break;
+			case OPT_ARCHIVE_LIST:    opt_archive_list    = optarg; break;
+			case OPT_ARCHIVE_EXTRACT: opt_archive_extract = optarg; break;
+
+			case OPT_RENDER_MAP:     opt.render = optarg; break;
+			case OPT_RENDER_OVERLAY: opt_render_options.overlay = 1; break;
+			case OPT_TERRITORY_MAP:  opt.territory_map = optarg; break;
+			case OPT_RENDER_SCALE:
+				opt_render_options.scale = atoi(optarg);
+				if (opt_render_options.scale < 1 || opt_render_options.scale > 64) {
+					fprintf(stderr, "Render scale must be 1..64\n");
+					exit(EXIT_FAILURE);
+				}
+				break;
+			case OPT_RENDER_LAYER:
+				opt_render_options.layer = atoi(optarg);
+				if (opt_render_options.layer < 0 || opt_render_options.layer >= MAP_LAYERS) {
+					fprintf(stderr, "Render layer must be 0..%d\n", MAP_LAYERS - 1);
+					exit(EXIT_FAILURE);
+				}
+				break;
+			case OPT_RENDER_FORMAT:
+				if (strcasecmp(optarg, "png") == 0)
+					opt_render_options.format = IMAGE_PNG;
+				else if (strcasecmp(optarg, "ppm") == 0)
+					opt_render_options.format = IMAGE_PPM;
+				else {
+					fprintf(stderr, "Unknown render format '%s'\n", optarg);
+					exit(EXIT_FAILURE);
+				}
 				break;
-			case 's': opt_stuff  = -1; break;
-			case 'm': opt_map    = -1; break;
-			case 'T': opt_tail   = -1; break;
 
 			case '?': /* fall through to 'h'*/
 				fprintf(stderr, "Unknown option '%s'\n", argv[optind-1]);
@@ -147,186 +539,813 @@ int main(int argc, char *argv[])
 		}
 	}
 
+	if (opt_archive_list)
+		exit(archive_list(opt_archive_list) ? EXIT_FAILURE : EXIT_SUCCESS);
+
+	if (opt_series_print) {
+		struct sink out;
+		int res = 0;
+
+		sink_init(&out, STDOUT_FILENO);
+		if (optind >= argc)
+			res = series_print(opt_series_print, "nations", opt.format == FORMAT_NDJSON, &out);
+		for (int i = optind; i < argc && res == 0; ++i)
+			res = series_print(opt_series_print, argv[i], opt.format == FORMAT_NDJSON, &out);
+		sink_flush(&out);
+		sink_free(&out);
+
+		exit(res ? EXIT_FAILURE : EXIT_SUCCESS);
+	}
+
 	if (optind >= argc) {
 		print_help(argv[0]);
 		exit(EXIT_FAILURE);
 	}
 
-	for (int fi = optind; fi < argc; ++fi) {
-		struct savegame sg;
+	if (opt_query) {
+		struct sink out;
+		int res = 0;
+
+		sink_init(&out, STDOUT_FILENO);
+		for (int i = optind; i < argc && res == 0; ++i)
+			res = columns_query(argv[i], opt_query, &out);
+		sink_flush(&out);
+		sink_free(&out);
 
-		FILE *fp = fopen(argv[fi], "r");	
+		exit(res ? EXIT_FAILURE : EXIT_SUCCESS);
+	}
 
-		if (fp == NULL) {
-			printf("Could not open file: %s\n", argv[fi]);
+	if (opt_generate) {
+		struct generate_options go = { 20, 150, 40, 4, 0 };
+		uint64_t seed = 1;
+
+		if (generate_parse(opt_generate, &go, &seed) == -1)
 			exit(EXIT_FAILURE);
+		exit(generate_files(&go, seed, argc - optind, argv + optind) ? EXIT_FAILURE : EXIT_SUCCESS);
+	}
+
+	if (opt_series)
+		exit(series_add(opt_series, argc - optind, argv + optind) ? EXIT_FAILURE : EXIT_SUCCESS);
+
+	if (opt_catalog)
+		exit(catalog_build(opt_catalog, argc - optind, argv + optind) ? EXIT_FAILURE : EXIT_SUCCESS);
+
+	if (opt_catalog_query || opt_catalog_find) {
+		struct sink out;
+		int res = 0;
+
+		sink_init(&out, STDOUT_FILENO);
+		for (int i = optind; i < argc && res == 0; ++i) {
+			if (opt_catalog_query)
+				res = catalog_query(opt_catalog_query, argv[i], &out);
+			else
+				res = catalog_find(opt_catalog_find, argv[i], &out);
 		}
-	
-		size_t res = 0;
-		res = fread(&sg.head, sizeof (struct savegame::head), 1, fp);
-		res = fread(&sg.player, sizeof (struct savegame::player), 4, fp);
-		res = fread(&sg.other, sizeof (struct savegame::other), 1, fp);
-
-		sg.colony = (struct savegame::colony *) malloc(sizeof (struct savegame::colony) * sg.head.colony_count);
-		res = fread(sg.colony, sizeof (struct savegame::colony), sg.head.colony_count, fp);
-	
-		sg.unit   = (struct savegame::unit *)   malloc(sizeof (struct savegame::unit)   * sg.head.unit_count);
-		res = fread(sg.unit, sizeof (struct savegame::unit), sg.head.unit_count, fp);
-	
-		res = fread(sg.nation, sizeof (struct savegame::nation), 4, fp);
-	
-		sg.tribe  = (struct savegame::tribe *)  malloc(sizeof (struct savegame::tribe)  * sg.head.tribe_count);
-		res = fread(sg.tribe, sizeof (struct savegame::tribe), sg.head.tribe_count, fp);
-	
-		res = fread(&sg.indian_relations, sizeof (struct savegame::indian_relations), 8, fp);
-		res = fread(&sg.stuff, sizeof (struct savegame::stuff), 1, fp);
-		res = fread(&sg.map, sizeof (struct savegame::map), 1, fp);
-		res = fread(&sg.tail, sizeof (struct savegame::tail), 1, fp);
-		res = fread(&sg.trade_route, sizeof (struct savegame::trade_route), 12, fp);
-	
-		fclose(fp);
-	
-		if (opt_head)
-			print_head(&(sg.head));
-	
-		if (opt_player)
-			print_player(sg.player, (opt_player == -1) ? opt_player: opt_player - 1);
-	
-		if (opt_other)
-			print_other(&(sg.other));
-	
-		if (opt_colony)
-			print_colony(&sg, sg.colony, sg.head.colony_count, (opt_colony == -1) ? opt_colony : opt_colony - 1);
-	
-		if (opt_unit)
-			print_unit(sg.unit, sg.head.unit_count, (opt_unit == -1) ? opt_unit : opt_unit - 1);
-	
-		if (opt_nation)
-			print_nation(sg.nation, (opt_nation == -1) ? opt_nation : opt_nation - 1);
-	
-		if (opt_tribe)
-			print_tribe(sg.tribe, sg.head.tribe_count, (opt_tribe == -1) ? opt_tribe : opt_tribe - 1);
-	
-		if (opt_indian)
-			print_indian(sg.indian_relations, (opt_indian == -1) ? opt_indian : opt_indian - 1);
-	
-		if (opt_stuff)
-			print_stuff(&(sg.stuff));
-	
-		if (opt_map)
-			print_map(&(sg.map));
-	
-		if (opt_tail)
-			print_tail(&(sg.tail));
-	
-		if (opt_route)
-			print_route(&sg, sg.trade_route, (opt_route == -1) ? opt_route : opt_route - 1);
-
-		if (opt_colony10) {
-
-			/* Find our player */
-			int player_nation = -1;
-			for (int i = 0; i < 4; ++i) {
-				if (sg.player[i].control == 0) {
-					player_nation = i;
-					break;
-				}
-			}
+		sink_flush(&out);
+		sink_free(&out);
 
-			sg.nation[player_nation].gold = 4000000;
-
-			for (int i = 0; i < sg.head.colony_count; ++i) {
-				if (sg.colony[i].nation == player_nation) {
-
-					for (int j = 0; j < 32; ++j) {
-						switch (j) {
-							case 0:
-							case 1:
-							case 2:
-								sg.colony[i].profession[j] = 0x11; // elder statesman
-								sg.colony[i].occupation[j] = 0x11;
-								break;
-							case 3:
-							case 4:
-								sg.colony[i].profession[j] = 0x0d; // carpenter
-								sg.colony[i].occupation[j] = 0x0d;
-								break;
-							case 5:
-							case 6:
-								sg.colony[i].profession[j] = 0x0e; // blacksmith
-								sg.colony[i].occupation[j] = 0x0e;
-								break;
-							case 7:
-								sg.colony[i].profession[j] = 0x05; // lumberjack
-								sg.colony[i].occupation[j] = 0x05;
-								sg.colony[i].tiles[0] = j;
-								break;
-							case 8:
-								sg.colony[i].profession[j] = 0x08; // fisherman
-								sg.colony[i].occupation[j] = 0x08;
-								sg.colony[i].tiles[1] = j;
-								break;
-							case 9:
-								sg.colony[i].profession[j] = 0x06; // oreminer
-								sg.colony[i].occupation[j] = 0x06;
-								sg.colony[i].tiles[4] = j;
-								break;
-
-							default:
-								continue;
-						}
-					}
-
-					sg.colony[i].population = 10;
-
-					sg.colony[i].buildings.docks = 1;
-					sg.colony[i].buildings.custom_house = 1;
-					continue;
-				}
+		exit(res ? EXIT_FAILURE : EXIT_SUCCESS);
+	}
 
-				// Opposing nations, remove pesky stockades
-				sg.colony[i].buildings.stockade = 0;
-			}
+	if (opt_daemon)
+		exit(daemon_run(opt_daemon, argc - optind, argv + optind, daemon_query) ? EXIT_FAILURE : EXIT_SUCCESS);
+
+	if (opt_ask) {
+		struct sink out, request;
+		int res;
 
-			FILE *fop = fopen("COLONY10.SAV", "w");
-			fwrite(&sg.head, sizeof (struct savegame::head), 1, fop);
-			fwrite(&sg.player, sizeof (struct savegame::player), 4, fop);
-			fwrite(&sg.other, sizeof (struct savegame::other), 1, fop);
-			fwrite(sg.colony, sizeof (struct savegame::colony), sg.head.colony_count, fop);
-			fwrite(sg.unit, sizeof (struct savegame::unit), sg.head.unit_count, fop);
-			fwrite(sg.nation, sizeof (struct savegame::nation), 4, fop);
-			fwrite(sg.tribe, sizeof (struct savegame::tribe), sg.head.tribe_count, fop);
-			fwrite(sg.indian_relations, sizeof (struct savegame::indian_relations), 8, fop);
-			fwrite(&sg.stuff, sizeof (struct savegame::stuff), 1, fop);
-			fwrite(&sg.map, sizeof (struct savegame::map), 1, fop);
-			fwrite(&sg.tail, sizeof(struct savegame::tail), 1, fop);
-			fwrite(&sg.trade_route, sizeof(struct savegame::trade_route), 12, fop);
-			fclose(fop);
+		sink_init(&request, -1);
+		for (int i = optind; i < argc; ++i) {
+			if (i > optind)
+				sink_putc(&request, ' ');
+			sink_puts(&request, argv[i]);
 		}
+		sink_putc(&request, '\0');
+
+		sink_init(&out, STDOUT_FILENO);
+		res = daemon_ask(opt_ask, request.buf, &out);
+		sink_flush(&out);
+		sink_free(&out);
+		sink_free(&request);
+
+		exit(res ? EXIT_FAILURE : EXIT_SUCCESS);
+	}
+
+	if (opt_archive_add)
+		exit(archive_add(opt_archive_add, argc - optind, argv + optind) ? EXIT_FAILURE : EXIT_SUCCESS);
+
+	if (opt_archive_extract)
+		exit(archive_get(opt_archive_extract, argc - optind, argv + optind) ? EXIT_FAILURE : EXIT_SUCCESS);
+
+	if (opt_export)
+		exit(columns_export(opt_export, argc - optind, argv + optind, opt.where) ? EXIT_FAILURE : EXIT_SUCCESS);
+
+	/* A filter on a section prints it */
+	int *where_opt[4] = { &opt.unit, &opt.colony, &opt.tribe, &opt.nation };
+	for (int t = 0; t < 4; ++t)
+		if (opt.where[t] && !*where_opt[t])
+			*where_opt[t] = -1;
+
+	if (opt_diff) {
+		if (argc - optind < 2) {
+			print_help(argv[0]);
+			exit(EXIT_FAILURE);
+		}
+		exit(batch_run(opt_jobs, argc - optind - 1, diff_files, argv + optind) ? EXIT_FAILURE : EXIT_SUCCESS);
+	}
+
+	if (opt_patch) {
+		patch = patch_load(opt_patch);
+		patch_output = opt_patch_output;
+	} else if (opt_colony10) {
+		patch = patch_compile(patch_colony10, "--colony10");
+		patch_output = "COLONY10.SAV";
+	}
+	if (patch == NULL && (opt_patch || opt_colony10))
+		exit(EXIT_FAILURE);
+
+	/* Every file would write the same output */
+	if (patch && !patch_path_varies(patch_output))
+		opt_jobs = 1;
+	if (patch)
+		patch_writer = patch_writer_new(opt_patch_sync);
 
-		free(sg.colony);
-		free(sg.unit);
-		free(sg.tribe);
+	ndjson_defaults(&opt);
+
+	select_sections(&opt, &opt_select);
+
+	if (opt_stats)
+		stats_init(argc - optind);
+
+	int res = batch_run(opt_jobs, argc - optind, opt_stats ? process_file_stats : process_file, argv + optind);
+
+	/* The last batch of patched files */
+	if (patch_writer && patch_writer_close(patch_writer) == -1) {
+		fprintf(stderr, "Could not write patched files: %s\n", strerror(errno));
+		res = -1;
 	}
-	
+
+	if (opt_stats) {
+		struct sink out;
+
+		sink_init(&out, STDERR_FILENO);
+		stats_report(&out, opt_stats_format, argv + optind, MAX(opt_jobs, 1));
+		sink_flush(&out);
+		sink_free(&out);
+	}
+
+	if (res)
+		exit(EXIT_FAILURE);
+
 	return EXIT_SUCCESS;
 }
 
-void print_head(  const struct savegame::head   *head)
+/* Translates an opt_ flag to the record it needs, -1 for all of them */
+static int select_record(int opt)
 {
-	printf("-- head --\n");
+	return (opt == -1) ? -1 : opt - 1;
+}
+
+/* Works out which sections and records the opt_ flags need read */
+void select_sections(const struct print_options *o, struct savegame_select *sel)
+{
+	savegame_select_none(sel);
+
+	if (patch) {
+		savegame_select_all(sel);
+		return;
+	}
+
+	if (o->player) {
+		sel->sections |= SECTION_BIT(SECTION_PLAYER);
+		sel->record[SECTION_PLAYER] = select_record(o->player);
+	}
+
+	if (o->other)
+		sel->sections |= SECTION_BIT(SECTION_OTHER);
+
+	/* print_colony() skips ahead to the next player colony, and needs
+	 * the players to find out which one that is */
+	if (o->colony) {
+		sel->sections |= SECTION_BIT(SECTION_COLONY) | SECTION_BIT(SECTION_PLAYER);
+		sel->record[SECTION_PLAYER] = -1;
+	}
+
+	if (o->unit) {
+		sel->sections |= SECTION_BIT(SECTION_UNIT);
+		sel->record[SECTION_UNIT] = select_record(o->unit);
+	}
+
+	if (o->nation) {
+		sel->sections |= SECTION_BIT(SECTION_NATION);
+		sel->record[SECTION_NATION] = select_record(o->nation);
+	}
+
+	if (o->tribe) {
+		sel->sections |= SECTION_BIT(SECTION_TRIBE);
+		sel->record[SECTION_TRIBE] = select_record(o->tribe);
+	}
+
+	/* print_indian() always starts at the first tribe */
+	if (o->indian)
+		sel->sections |= SECTION_BIT(SECTION_INDIAN);
+
+	if (o->stuff)
+		sel->sections |= SECTION_BIT(SECTION_STUFF);
+
+	if (o->map || o->terrain || o->render)
+		sel->sections |= SECTION_BIT(SECTION_MAP);
 
-	printf("Signature: %s: %s\n",
+	if (o->render && opt_render_options.overlay) {
+		sel->sections |= SECTION_BIT(SECTION_COLONY) | SECTION_BIT(SECTION_UNIT) | SECTION_BIT(SECTION_TRIBE);
+		sel->record[SECTION_COLONY] = -1;
+		sel->record[SECTION_UNIT] = -1;
+		sel->record[SECTION_TRIBE] = -1;
+	}
+
+	if (o->tail)
+		sel->sections |= SECTION_BIT(SECTION_TAIL);
+
+	if (o->manifest) {
+		sel->sections |= SECTION_BIT(SECTION_UNIT);
+		sel->record[SECTION_UNIT] = -1;
+	}
+
+	if (o->totals) {
+		sel->sections |= SECTION_BIT(SECTION_COLONY) | SECTION_BIT(SECTION_UNIT);
+		sel->record[SECTION_COLONY] = -1;
+		sel->record[SECTION_UNIT] = -1;
+	}
+
+	if (o->territory || o->territory_map) {
+		sel->sections |= SECTION_BIT(SECTION_MAP) | SECTION_BIT(SECTION_COLONY) | SECTION_BIT(SECTION_TRIBE);
+		sel->record[SECTION_COLONY] = -1;
+		sel->record[SECTION_TRIBE] = -1;
+	}
+
+	if (o->path) {
+		sel->sections |= SECTION_BIT(SECTION_MAP) | SECTION_BIT(SECTION_UNIT) | SECTION_BIT(SECTION_COLONY);
+		sel->record[SECTION_UNIT] = -1;
+		sel->record[SECTION_COLONY] = -1;
+	}
+
+	if (o->at_x != -1 || o->near != -1) {
+		sel->sections |= SECTION_BIT(SECTION_UNIT) | SECTION_BIT(SECTION_COLONY) | SECTION_BIT(SECTION_TRIBE);
+		sel->record[SECTION_UNIT] = -1;
+		sel->record[SECTION_COLONY] = -1;
+		sel->record[SECTION_TRIBE] = -1;
+	}
+
+	/* Filters run over every record */
+	for (int t = 0; t < column_table_count; ++t)
+		if (o->where[t])
+			sel->record[column_tables[t].section] = -1;
+
+	/* Route destinations are printed by colony name */
+	if (o->route) {
+		sel->sections |= SECTION_BIT(SECTION_ROUTE) | SECTION_BIT(SECTION_COLONY);
+		sel->record[SECTION_ROUTE] = select_record(o->route);
+		sel->record[SECTION_COLONY] = -1;
+	}
+}
+
+/* Appends files to the archive at path, in order */
+int archive_add(const char *path, int count, char **files)
+{
+	struct archive ar;
+	size_t bytes_in = 0;
+	int res = 0;
+
+	if (archive_open(&ar, path, 1) == -1) {
+		fprintf(stderr, "Could not open archive %s: %s\n", path, strerror(errno));
+		return -1;
+	}
+	size_t start = ar.end;
+
+	for (int i = 0; i < count && res == 0; ++i) {
+		struct savegame_view sv;
+		if (savegame_open(files[i], &sv) == -1) {
+			fprintf(stderr, "Skipping %s: %s\n", files[i], (errno == EINVAL) ? "truncated savegame" : strerror(errno));
+			continue;
+		}
+
+		res = archive_append(&ar, files[i], (const uint8_t *) sv.base, sv.size);
+		if (res == -1)
+			fprintf(stderr, "Could not append %s: %s\n", files[i], strerror(errno));
+		bytes_in += sv.size;
+		savegame_close(&sv);
+	}
+
+	printf("%d turns, %zu bytes added as %zu\n", ar.turn_count, bytes_in, ar.end - start);
+
+	archive_close(&ar);
+	return res;
+}
+
+int archive_list(const char *path)
+{
+	static struct savegame_buffer buf;
+	struct archive ar;
+	struct sink out;
+	int res = 0;
+
+	if (archive_open(&ar, path, 0) == -1) {
+		fprintf(stderr, "Could not open archive %s: %s\n", path, strerror(errno));
+		return -1;
+	}
+
+	sink_init(&out, STDOUT_FILENO);
+	for (int i = 0; i < ar.turn_count; ++i) {
+		const char *name;
+		size_t size;
+
+		if (archive_extract(&ar, i, &buf, &size, &name) == -1) {
+			fprintf(stderr, "Could not read turn %d: %s\n", i, strerror(errno));
+			res = -1;
+			break;
+		}
+
+		const struct savegame::head *head = (const struct savegame::head *) buf.data;
+		sink_dec(&out, i, 5);
+		sink_putc(&out, ' ');
+		sink_dec(&out, head->year, 5);
+		sink_str(&out, head->autumn ? " Autumn" : " Spring");
+		sink_str(&out, "  turn ");
+		sink_dec(&out, head->turn, 4);
+		sink_dec(&out, size, 8);
+		sink_str(&out, "  ");
+		sink_str(&out, name);
+		sink_putc(&out, '\n');
+	}
+	sink_flush(&out);
+	sink_free(&out);
+
+	archive_close(&ar);
+	return res;
+}
+
+/* Restores the listed turns to NNNN-<basename> in the current directory */
+int archive_get(const char *path, int count, char **turns)
+{
+	static struct savegame_buffer buf;
+	struct archive ar;
+
+	if (archive_open(&ar, path, 0) == -1) {
+		fprintf(stderr, "Could not open archive %s: %s\n", path, strerror(errno));
+		return -1;
+	}
+
+	for (int i = 0; i < count; ++i) {
+		char *end;
+		long n = strtol(turns[i], &end, 10);
+		const char *name;
+		size_t size;
+
+		if (*end || n < 0 || n >= ar.turn_count) {
+			fprintf(stderr, "No turn %s in %s\n", turns[i], path);
+			archive_close(&ar);
+			return -1;
+		}
+
+		if (archive_extract(&ar, n, &buf, &size, &name) == -1) {
+			fprintf(stderr, "Could not read turn %ld: %s\n", n, strerror(errno));
+			archive_close(&ar);
+			return -1;
+		}
+
+		const char *base = strrchr(name, '/');
+		char filename[PATH_MAX];
+		snprintf(filename, sizeof (filename), "%04ld-%s", n, base ? base + 1 : name);
+
+		FILE *fp = fopen(filename, "wb");
+		int ok = fp != NULL && fwrite(buf.data, size, 1, fp) == 1;
+		if (fp != NULL && fclose(fp) != 0)
+			ok = 0;
+		if (!ok) {
+			fprintf(stderr, "Could not write %s\n", filename);
+			archive_close(&ar);
+			return -1;
+		}
+	}
+
+	archive_close(&ar);
+	return 0;
+}
+
+/* process_file() as one file of --stats */
+int process_file_stats(int index, struct sink *out, void *arg)
+{
+	struct stats_file *prev = stats_begin(index);
+	int res = process_file(index, out, arg);
+	stats_end(prev, res);
+	return res;
+}
+
+/* Diffs argv-file number index against the one after it */
+int diff_files(int index, struct sink *out, void *arg)
+{
+	const char *a = ((char **) arg)[index];
+	const char *b = ((char **) arg)[index + 1];
+	struct savegame_view sa, sb;
+
+	if (savegame_open(a, &sa) == -1) {
+		sink_printf(out, "%s: %s\n", (errno == EINVAL) ? "Truncated savegame" : "Could not open file", a);
+		return -1;
+	}
+	if (savegame_open(b, &sb) == -1) {
+		sink_printf(out, "%s: %s\n", (errno == EINVAL) ? "Truncated savegame" : "Could not open file", b);
+		savegame_close(&sa);
+		return -1;
+	}
+
+	sink_printf(out, "--- %s\n+++ %s\n", a, b);
+	savegame_diff(out, &sa, &sb);
+
+	savegame_close(&sa);
+	savegame_close(&sb);
+	return 0;
+}
+
+/* Loads and prints argv-file number index, as selected by the opt_ flags */
+int process_file(int index, struct sink *out, void *arg)
+{
+	static __thread struct savegame_buffer buf;
+
+	const char *filename = ((char **) arg)[index];
+	struct savegame_view sv;
+	int res;
+
+	if (patch)
+		res = savegame_open(filename, &sv, SAVEGAME_PRIVATE);
+	else
+		res = savegame_read(filename, &sv, &opt_select, &buf);
+
+	if (res == -1) {
+		if (errno == EINVAL)
+			sink_printf(out, "Truncated savegame: %s\n", filename);
+		else
+			sink_printf(out, "Could not open file: %s\n", filename);
+		return -1;
+	}
+
+	/* Patched first, so what is printed is what gets written */
+	if (patch) {
+		static __thread struct patch_dirty dirty;
+		char path[PATH_MAX];
+
+		uint64_t t0 = stats_start();
+		patch_apply(patch, &sv, &dirty);
+		stats_stop(STATS_PARSE, t0);
+
+		t0 = stats_start();
+		res = patch_path(path, sizeof (path), patch_output, filename, index);
+		if (res == 0)
+			res = patch_writer_put(patch_writer, &sv, &dirty, filename, path);
+		stats_stop(STATS_WRITE, t0);
+		if (res == -1) {
+			sink_printf(out, "Could not write file: %s\n", path);
+			savegame_close(&sv);
+			return -1;
+		}
+	}
+
+	/* Rows of each filtered table to print */
+	static __thread uint8_t *mask[4];
+	static __thread size_t mask_cap[4];
+	uint64_t t0 = stats_start();
+	for (int t = 0; t < 4; ++t) {
+		if (!opt.where[t])
+			continue;
+		size_t n = column_tables[t].rows(&sv);
+		if (mask_cap[t] < n) {
+			mask_cap[t] = n;
+			mask[t] = (uint8_t *) realloc(mask[t], n);
+			stats_allocs(1);
+		}
+		where_eval(opt.where[t], &sv, mask[t]);
+	}
+	stats_stop(STATS_PARSE, t0);
+
+	t0 = stats_start();
+	if (opt.format == FORMAT_NDJSON)
+		print_ndjson(out, &opt, &sv, filename, mask);
+	else
+		print_selected(out, &opt, &sv, filename, mask);
+
+	if (opt.render) {
+		static __thread struct image img;
+		char path[PATH_MAX];
+
+		render_map(&sv, &opt_render_options, &img);
+		stats_stop(STATS_FORMAT, t0);
+		t0 = stats_start();
+		render_path(path, sizeof (path), opt.render, filename, opt_render_options.format);
+		res = image_write(&img, opt_render_options.format, path);
+		stats_stop(STATS_WRITE, t0);
+		t0 = stats_start();
+		if (res == -1) {
+			sink_printf(out, "Could not write image: %s\n", path);
+			savegame_close(&sv);
+			return -1;
+		}
+	}
+
+	if (opt.territory_map) {
+		static __thread struct territory t;
+		static __thread struct image img;
+		char path[PATH_MAX];
+
+		territory_compute(&sv, &t);
+		territory_render(&sv, &t, &opt_render_options, &img);
+		stats_stop(STATS_FORMAT, t0);
+		t0 = stats_start();
+		render_path(path, sizeof (path), opt.territory_map, filename, opt_render_options.format);
+		res = image_write(&img, opt_render_options.format, path);
+		stats_stop(STATS_WRITE, t0);
+		t0 = stats_start();
+		if (res == -1) {
+			sink_printf(out, "Could not write image: %s\n", path);
+			savegame_close(&sv);
+			return -1;
+		}
+	}
+
+	stats_stop(STATS_FORMAT, t0);
+
+	savegame_close(&sv);
+
+	return 0;
+}
+
+/* Prints the sections the opt_ flags select as text, filtered by mask if given */
+void print_selected(struct sink *out, const struct print_options *o, const struct savegame_view *sv, const char *filename, uint8_t *const *mask)
+{
+	if (o->head)
+		print_head(out, sv);
+
+	if (o->player)
+		print_player(out, sv, (o->player == -1) ? o->player: o->player - 1);
+
+	if (o->other)
+		print_other(out, sv);
+
+	if (o->colony)
+		print_colony(out, sv, (o->colony == -1) ? o->colony : o->colony - 1, mask && o->where[1] ? mask[1] : NULL);
+
+	if (o->unit)
+		print_unit(out, sv, (o->unit == -1) ? o->unit : o->unit - 1, mask && o->where[0] ? mask[0] : NULL);
+
+	if (o->nation)
+		print_nation(out, sv, (o->nation == -1) ? o->nation : o->nation - 1, mask && o->where[3] ? mask[3] : NULL);
+
+	if (o->tribe)
+		print_tribe(out, sv, (o->tribe == -1) ? o->tribe : o->tribe - 1, mask && o->where[2] ? mask[2] : NULL);
+
+	if (o->indian)
+		print_indian(out, sv, (o->indian == -1) ? o->indian : o->indian - 1);
+
+	if (o->stuff)
+		print_stuff(out, sv);
+
+	if (o->map)
+		print_map(out, sv);
+
+	if (o->terrain)
+		print_terrain(out, sv, filename);
+
+	if (o->tail)
+		print_tail(out, sv);
+
+	if (o->route)
+		print_route(out, sv, (o->route == -1) ? o->route : o->route - 1);
+
+	if (o->manifest)
+		print_manifest(out, sv);
+
+	if (o->totals)
+		print_totals(out, sv, filename);
+
+	if (o->territory)
+		print_territory(out, sv, filename);
+
+	if (o->path)
+		print_path(out, sv, filename, o->path_pairs, o->path_pair_count);
+
+	if (o->at_x != -1 || o->near != -1) {
+		static __thread struct spatial_index si;
+
+		spatial_build(&si, sv);
+		if (o->at_x != -1)
+			print_at(out, sv, &si, o->at_x, o->at_y, o->at_r);
+		if (o->near != -1)
+			print_near(out, sv, &si, o->near);
+	}
+}
+
+/*
+ * What print_selected() asserts on or looks up in its name lists, checked
+ * up front for the sections a daemon query reads. A save that changes
+ * under the daemon can hold anything, and one bad file must not take the
+ * daemon down for everyone. Returns -1 after saying what is wrong.
+ */
+static int check_records(struct sink *out, const struct savegame_view *sv, const char *filename, uint32_t sections)
+{
+	const struct savegame::head *head = sv->head;
+	const char *what = NULL;
+	int i = 0;
+
+#define CHECK(section, cond) do { if ((sections & SECTION_BIT(section)) && !(cond)) { what = #cond; goto bad; } } while (0)
+
+	CHECK(SECTION_HEAD, head->colony_report_options.unused == 0);
+	CHECK(SECTION_HEAD, head->game_options.unknown7 == 0);
+	CHECK(SECTION_HEAD, head->tut2.nr2 == 0);
+	CHECK(SECTION_HEAD, head->difficulty < COUNT_OF(difficulty_list));
+
+	for (i = 0; i < head->colony_count; ++i) {
+		const struct savegame::colony *colony = &sv->colony[i];
+		CHECK(SECTION_COLONY, colony->nation < COUNT_OF(nation_list));
+		CHECK(SECTION_COLONY, colony->buildings.unused == 0);
+		for (int j = 0; j < 32; ++j) {
+			CHECK(SECTION_COLONY, colony->profession[j] < COUNT_OF(profession_list));
+			CHECK(SECTION_COLONY, colony->occupation[j] < COUNT_OF(profession_list));
+		}
+	}
+
+	for (i = 0; i < head->unit_count; ++i) {
+		const struct savegame::unit *unit = &sv->unit[i];
+		CHECK(SECTION_UNIT, unit->type < COUNT_OF(unit_type_list));
+		CHECK(SECTION_UNIT, unit->owner < COUNT_OF(nation_list));
+		switch (unit->type) {
+			case 0: case 1: case 2: case 3: case 4: case 5: case 7: case 9: case 19:
+				CHECK(SECTION_UNIT, unit->profession < COUNT_OF(profession_list));
+				break;
+			case 13: case 14: case 15:
+				CHECK(SECTION_UNIT, unit->profession == 0);
+				break;
+		}
+		CHECK(SECTION_UNIT, unit->holds_occupied < 7);
+	}
+
+	for (i = 0; i < 4; ++i) {
+		const struct savegame::nation *nation = &sv->nation[i];
+		CHECK(SECTION_NATION, nation->recruit_count <= 180);
+		CHECK(SECTION_NATION, nation->unk1 == 0);
+		CHECK(SECTION_NATION, nation->ffc_high == 0);
+		for (int j = 0; j < 3; ++j)
+			CHECK(SECTION_NATION, nation->recruit[j] < COUNT_OF(profession_list));
+		CHECK(SECTION_NATION, nation->next_founding_father >= -1 &&
+		                      nation->next_founding_father < (int) COUNT_OF(founding_father_list));
+	}
+
+	for (i = 0; i < head->tribe_count; ++i) {
+		const struct savegame::tribe *tribe = &sv->tribe[i];
+		CHECK(SECTION_TRIBE, tribe->nation < COUNT_OF(nation_list));
+		CHECK(SECTION_TRIBE, tribe->last_cargo_bought >= -1 && tribe->last_cargo_bought < (int) COUNT_OF(cargo_list));
+		CHECK(SECTION_TRIBE, tribe->last_cargo_sold >= -1 && tribe->last_cargo_sold < (int) COUNT_OF(cargo_list));
+	}
+
+	for (i = 0; i < 8; ++i) {
+		const struct savegame::indian_relations *ir = &sv->indian_relations[i];
+		CHECK(SECTION_INDIAN, ir->level < COUNT_OF(indian_level));
+		for (int j = 0; j < 4; ++j)
+			CHECK(SECTION_INDIAN, ir->aggr[j].aggr_high == 0);
+	}
+
+	for (i = 0; i < 12; ++i)
+		for (int j = 0; j < 4; ++j)
+			CHECK(SECTION_ROUTE, sv->trade_route[i].entry[j].padding == 0);
+
+#undef CHECK
+	return 0;
+
+bad:
+	sink_printf(out, "Unexpected contents in %s, record %d: %s\n", filename, i, what);
+	return -1;
+}
+
+/*
+ * Answers a query of the daemon: the section flags of the command line,
+ * and --manifest, --terrain and --format, e.g. "-H -u3" or "-c --format=ndjson".
+ */
+int daemon_query(struct sink *out, const struct savegame_view *sv, const char *filename, const char *query, uint32_t *sections)
+{
+	struct print_options q = PRINT_OPTIONS_INIT;
+	struct option query_options[] = {
+		{ "head",     no_argument,       NULL,          'H' },
+		{ "player",   optional_argument, NULL,          'p' },
+		{ "other",    no_argument,       NULL,          'o' },
+		{ "colony",   optional_argument, NULL,          'c' },
+		{ "unit",     optional_argument, NULL,          'u' },
+		{ "nation",   optional_argument, NULL,          'n' },
+		{ "tribe",    optional_argument, NULL,          't' },
+		{ "indian",   optional_argument, NULL,          'i' },
+		{ "stuff",    no_argument,       NULL,          's' },
+		{ "map",      no_argument,       NULL,          'm' },
+		{ "tail",     no_argument,       NULL,          'T' },
+		{ "route",    optional_argument, NULL,          'r' },
+		{ "terrain",  no_argument,       &q.terrain,    -1  },
+		{ "manifest", no_argument,       &q.manifest,   -1  },
+		{ "format",   required_argument, NULL,          OPT_FORMAT },
+		{ NULL,       no_argument, NULL,  0  }
+	};
+
+	char words[4096]; // as long as a daemon request line
+	char *argv[64], *save;
+	int argc = 0, c;
+	size_t len = strlen(query);
+
+	if (len >= sizeof (words)) {
+		sink_printf(out, "Query too long, at most %zu characters\n", sizeof (words) - 1);
+		return -1;
+	}
+	memcpy(words, query, len + 1);
+
+	argv[argc++] = (char *) "query";
+	for (char *w = strtok_r(words, " ", &save); w; w = strtok_r(NULL, " ", &save)) {
+		if (argc == 63) {
+			sink_printf(out, "Too many words in query, at most %d\n", argc - 1);
+			return -1;
+		}
+		argv[argc++] = w;
+	}
+	argv[argc] = NULL;
+
+	optind = 0; // start over
+	opterr = 0;
+	while ((c = getopt_long(argc, argv, ":Hp::oc::u::n::t::i::r::smT", query_options, NULL)) != -1) {
+		switch (c) {
+			case 0: break;
+
+			case 'H': q.head   = -1; break;
+			case 'p': q.player = section_flag(optarg); break;
+			case 'o': q.other  = -1; break;
+			case 'c': q.colony = section_flag(optarg); break;
+			case 'u': q.unit   = section_flag(optarg); break;
+			case 'n': q.nation = section_flag(optarg); break;
+			case 't': q.tribe  = section_flag(optarg); break;
+			case 'i': q.indian = section_flag(optarg); break;
+			case 'r': q.route  = section_flag(optarg); break;
+			case 's': q.stuff  = -1; break;
+			case 'm': q.map    = -1; break;
+			case 'T': q.tail   = -1; break;
+
+			case OPT_FORMAT:
+				if (strcmp(optarg, "text") == 0)
+					q.format = FORMAT_TEXT;
+				else if (strcmp(optarg, "ndjson") == 0)
+					q.format = FORMAT_NDJSON;
+				else {
+					sink_printf(out, "Unknown format: %s\n", optarg);
+					return -1;
+				}
+				break;
+
+			default:
+				sink_printf(out, "Unknown option '%s'\n", argv[optind - 1]);
+				return -1;
+		}
+	}
+
+	if (optind < argc) {
+		sink_printf(out, "Unexpected '%s'\n", argv[optind]);
+		return -1;
+	}
+
+	ndjson_defaults(&q);
+
+	struct savegame_select sel;
+	select_sections(&q, &sel);
+	*sections = sel.sections | SECTION_BIT(SECTION_HEAD);
+
+	if (check_records(out, sv, filename, *sections) == -1)
+		return -1;
+
+	if (q.format == FORMAT_NDJSON)
+		print_ndjson(out, &q, sv, filename, NULL);
+	else
+		print_selected(out, &q, sv, filename, NULL);
+
+	return 0;
+}
+
+void print_head(  struct sink *out, const struct savegame_view *sv)
+{
+	const struct savegame::head *head = sv->head;
+
+	sink_puts(out, "-- head --\n");
+	stats_record(STATS_PRINT_HEAD);
+
+	sink_printf(out, "Signature: %s: %s\n",
 		head->sig_colonize,
 		strncmp(head->sig_colonize, "COLONIZE", 9) ? "INVALID" : "OK");
 
-	printf("Map size: %2d x %2d\n",
+	sink_printf(out, "Map size: %2d x %2d\n",
 		head->map_size_x, head->map_size_y);
 
-	printf("Difficulty: %s\n",
+	sink_printf(out, "Difficulty: %s\n",
 		difficulty_list[head->difficulty]);
 
-	printf("%s %4d, Turn: %2d, Tribes: %d, Units: %d, Colonies: %d, Trade Routes: %d\n",
+	sink_printf(out, "%s %4d, Turn: %2d, Tribes: %d, Units: %d, Colonies: %d, Trade Routes: %d\n",
 		head->autumn ? "Autumn" : "Spring",
 		head->year,
 		head->turn,
@@ -335,199 +1354,207 @@ void print_head(  const struct savegame::head   *head)
 		head->colony_count,
 		head->trade_route_count);
 
-//	printf("Active unit: "); print_unit(sg.unit, sg.head.unit_count, head->active_unit);
-
-	assert(head->unit_count <= 300);
-
-	for (int i = 0; i < sizeof (head->unk0); ++i)
-		printf("%02x ", head->unk0[i]);
-	printf("\n\n");
-
-	printf("Colony report options\n");
-	printf("%d - Labels on buildings\n",                head->colony_report_options.labels_on_buildings);
-	printf("%d - Labels on cargo and terrain\n",        head->colony_report_options.labels_on_cargo_and_terrain);
-	printf("%d - report_when_colonists_trained\n",      head->colony_report_options.report_when_colonists_trained);
-	printf("%d - report_food_shortages\n",              head->colony_report_options.report_food_shortages);
-	printf("%d - report_raw_materials_shortages\n",     head->colony_report_options.report_raw_materials_shortages);
-	printf("%d - report_tools_needed_for_production\n", head->colony_report_options.report_tools_needed_for_production);
-	printf("%d - report_inefficient_government\n",      head->colony_report_options.report_inefficient_government);
-	printf("%d - report_new_cargos_available\n",        head->colony_report_options.report_new_cargos_available);
-	printf("%d - report_sons_of_liberty_membership\n",  head->colony_report_options.report_sons_of_liberty_membership);
-	printf("%d - report_rebel_majorities\n",            head->colony_report_options.report_rebel_majorities);
-	printf("%d - unused\n",                             head->colony_report_options.unused);
-	printf("\n");
+//	sink_puts(out, "Active unit: "); print_unit(out, sv, head->active_unit);
+
+	/* The game stops at 300, the file format doesn't (see generate.h) */
+	if (head->unit_count > 300)
+		sink_puts(out, "More units than the game allows\n");
+
+	sink_hexdump(out, head->unk0, sizeof (head->unk0));
+	sink_puts(out, "\n\n");
+
+	sink_puts(out, "Colony report options\n");
+	sink_printf(out, "%d - Labels on buildings\n",                head->colony_report_options.labels_on_buildings);
+	sink_printf(out, "%d - Labels on cargo and terrain\n",        head->colony_report_options.labels_on_cargo_and_terrain);
+	sink_printf(out, "%d - report_when_colonists_trained\n",      head->colony_report_options.report_when_colonists_trained);
+	sink_printf(out, "%d - report_food_shortages\n",              head->colony_report_options.report_food_shortages);
+	sink_printf(out, "%d - report_raw_materials_shortages\n",     head->colony_report_options.report_raw_materials_shortages);
+	sink_printf(out, "%d - report_tools_needed_for_production\n", head->colony_report_options.report_tools_needed_for_production);
+	sink_printf(out, "%d - report_inefficient_government\n",      head->colony_report_options.report_inefficient_government);
+	sink_printf(out, "%d - report_new_cargos_available\n",        head->colony_report_options.report_new_cargos_available);
+	sink_printf(out, "%d - report_sons_of_liberty_membership\n",  head->colony_report_options.report_sons_of_liberty_membership);
+	sink_printf(out, "%d - report_rebel_majorities\n",            head->colony_report_options.report_rebel_majorities);
+	sink_printf(out, "%d - unused\n",                             head->colony_report_options.unused);
+	sink_putc(out, '\n');
 	assert(head->colony_report_options.unused == 0);
 
-	printf("Tutorial 13: %5s\n", head->tut1.nr13 ? "true" : "false");
-	printf("Tutorial 14: %5s\n", head->tut1.nr14 ? "true" : "false");
-	printf("tut1.x3    : %5s\n", head->tut1.unk3 ? "true" : "false");
-	printf("Tutorial 15: %5s\n", head->tut1.nr15 ? "true" : "false");
-	printf("Tutorial 16: %5s\n", head->tut1.nr16 ? "true" : "false");
-	printf("Tutorial 17: %5s\n", head->tut1.nr17 ? "true" : "false");
-	printf("tut1.x7    : %5s\n", head->tut1.unk7 ? "true" : "false");
-	printf("Tutorial 19: %5s\n", head->tut1.nr19 ? "true" : "false");
-	printf("\n");
-
-	for (int i = 0; i < sizeof (head->unk1); ++i)
-		printf("%02x ", head->unk1[i]);
-	printf("\n\n");
-
-	printf("Set Game Options:\n");
-	printf("  %c Show Indian Moves\n",   head->game_options.show_indian_moves   ? '*' : ' ');
-	printf("  %c Show Foreign Moves\n",  head->game_options.show_foreign_moves  ? '*' : ' ');
-	printf("  %c Fast Piece Slide\n",    head->game_options.fast_piece_slide    ? '*' : ' ');
-	printf("  %c End of Turn\n",         head->game_options.end_of_turn         ? '*' : ' ');
-	printf("  %c Autosave\n",            head->game_options.autosave            ? '*' : ' ');
-	printf("  %c Combat Analysis\n",     head->game_options.combat_analysis     ? '*' : ' ');
-	printf("  %c Water Color Cycling\n", head->game_options.water_color_cycling ? ' ' : '*'); // I don't know why it's inverted
-	printf("  %c Tutorial Hints\n",      head->game_options.tutorial_hints      ? '*' : ' ');
+	sink_printf(out, "Tutorial 13: %5s\n", head->tut1.nr13 ? "true" : "false");
+	sink_printf(out, "Tutorial 14: %5s\n", head->tut1.nr14 ? "true" : "false");
+	sink_printf(out, "tut1.x3    : %5s\n", head->tut1.unk3 ? "true" : "false");
+	sink_printf(out, "Tutorial 15: %5s\n", head->tut1.nr15 ? "true" : "false");
+	sink_printf(out, "Tutorial 16: %5s\n", head->tut1.nr16 ? "true" : "false");
+	sink_printf(out, "Tutorial 17: %5s\n", head->tut1.nr17 ? "true" : "false");
+	sink_printf(out, "tut1.x7    : %5s\n", head->tut1.unk7 ? "true" : "false");
+	sink_printf(out, "Tutorial 19: %5s\n", head->tut1.nr19 ? "true" : "false");
+	sink_putc(out, '\n');
+
+	sink_hexdump(out, head->unk1, sizeof (head->unk1));
+	sink_puts(out, "\n\n");
+
+	sink_puts(out, "Set Game Options:\n");
+	sink_printf(out, "  %c Show Indian Moves\n",   head->game_options.show_indian_moves   ? '*' : ' ');
+	sink_printf(out, "  %c Show Foreign Moves\n",  head->game_options.show_foreign_moves  ? '*' : ' ');
+	sink_printf(out, "  %c Fast Piece Slide\n",    head->game_options.fast_piece_slide    ? '*' : ' ');
+	sink_printf(out, "  %c End of Turn\n",         head->game_options.end_of_turn         ? '*' : ' ');
+	sink_printf(out, "  %c Autosave\n",            head->game_options.autosave            ? '*' : ' ');
+	sink_printf(out, "  %c Combat Analysis\n",     head->game_options.combat_analysis     ? '*' : ' ');
+	sink_printf(out, "  %c Water Color Cycling\n", head->game_options.water_color_cycling ? ' ' : '*'); // I don't know why it's inverted
+	sink_printf(out, "  %c Tutorial Hints\n",      head->game_options.tutorial_hints      ? '*' : ' ');
 
 	assert(head->game_options.unknown7 == 0);
 
-	printf("HowToWin        : %5s\n", head->tut2.howtowin ? "true" : "false");
-
-	printf("Set Sound Options:\n");
-	printf("  %c Background Music\n", head->tut2.background_music ? '*' : ' ');
-	printf("  %c Event Music\n",      head->tut2.event_music      ? '*' : ' ');
-	printf("  %c Sound Effects\n",    head->tut2.sound_effects    ? '*' : ' ');
-
-	printf("Tutorial  1: %5s\n", head->tut2.nr1  ? "true" : "false");
-	printf("Tutorial  2: %5s\n", head->tut2.nr2  ? "true" : "false");
-	printf("Tutorial  3: %5s\n", head->tut2.nr3  ? "true" : "false");
-	printf("Tutorial  4: %5s\n", head->tut2.nr4  ? "true" : "false");
-	printf("Tutorial  5: %5s\n", head->tut3.nr5  ? "true" : "false");
-	printf("Tutorial  6: %5s\n", head->tut3.nr6  ? "true" : "false");
-	printf("Tutorial  7: %5s\n", head->tut3.nr7  ? "true" : "false");
-	printf("Tutorial  8: %5s\n", head->tut3.nr8  ? "true" : "false");
-	printf("Tutorial  9: %5s\n", head->tut3.nr9  ? "true" : "false");
-	printf("Tutorial 10: %5s\n", head->tut3.nr10 ? "true" : "false");
-	printf("Tutorial 11: %5s\n", head->tut3.nr11 ? "true" : "false");
-	printf("Tutorial 12: %5s\n", head->tut3.nr12 ? "true" : "false");
-	printf("\n");
+	sink_printf(out, "HowToWin        : %5s\n", head->tut2.howtowin ? "true" : "false");
+
+	sink_puts(out, "Set Sound Options:\n");
+	sink_printf(out, "  %c Background Music\n", head->tut2.background_music ? '*' : ' ');
+	sink_printf(out, "  %c Event Music\n",      head->tut2.event_music      ? '*' : ' ');
+	sink_printf(out, "  %c Sound Effects\n",    head->tut2.sound_effects    ? '*' : ' ');
+
+	sink_printf(out, "Tutorial  1: %5s\n", head->tut2.nr1  ? "true" : "false");
+	sink_printf(out, "Tutorial  2: %5s\n", head->tut2.nr2  ? "true" : "false");
+	sink_printf(out, "Tutorial  3: %5s\n", head->tut2.nr3  ? "true" : "false");
+	sink_printf(out, "Tutorial  4: %5s\n", head->tut2.nr4  ? "true" : "false");
+	sink_printf(out, "Tutorial  5: %5s\n", head->tut3.nr5  ? "true" : "false");
+	sink_printf(out, "Tutorial  6: %5s\n", head->tut3.nr6  ? "true" : "false");
+	sink_printf(out, "Tutorial  7: %5s\n", head->tut3.nr7  ? "true" : "false");
+	sink_printf(out, "Tutorial  8: %5s\n", head->tut3.nr8  ? "true" : "false");
+	sink_printf(out, "Tutorial  9: %5s\n", head->tut3.nr9  ? "true" : "false");
+	sink_printf(out, "Tutorial 10: %5s\n", head->tut3.nr10 ? "true" : "false");
+	sink_printf(out, "Tutorial 11: %5s\n", head->tut3.nr11 ? "true" : "false");
+	sink_printf(out, "Tutorial 12: %5s\n", head->tut3.nr12 ? "true" : "false");
+	sink_putc(out, '\n');
 
 	assert(head->tut2.nr2 == 0); // I don't think this is used
 
-	printf("numbers00: %3d(%04x)\n", head->numbers00, head->numbers00);
-	printf("numbers01: %3d(%04x)\n", head->numbers01, head->numbers01);
+	sink_printf(out, "numbers00: %3d(%04x)\n", head->numbers00, head->numbers00);
+	sink_printf(out, "numbers01: %3d(%04x)\n", head->numbers01, head->numbers01);
 
 	for (int i = 0; i < 3; ++i)
-		printf("numbers02.%d: %3d(%04x)\n", i, head->numbers02[i], head->numbers02[i]);
+		sink_printf(out, "numbers02.%d: %3d(%04x)\n", i, head->numbers02[i], head->numbers02[i]);
 
 	for (int i = 0; i < 2; ++i)
-		printf("numbers03.%d: %3d(%04x)\n", i, head->numbers03[i], head->numbers03[i]);
+		sink_printf(out, "numbers03.%d: %3d(%04x)\n", i, head->numbers03[i], head->numbers03[i]);
 
-	printf("numbers04: %3d(%04x)\n", head->numbers04, head->numbers04);
-	printf("\n");
+	sink_printf(out, "numbers04: %3d(%04x)\n", head->numbers04, head->numbers04);
+	sink_putc(out, '\n');
 
-	printf("Founding fathers:\n");
+	sink_puts(out, "Founding fathers:\n");
 	for (int i = 0; i < 25; ++i) {
 		switch (head->founding_father[i]) {
-			case -1: printf("( -1)"); break;
-			case  0: printf("(Eng)"); break;
-			case  1: printf("(Fra)"); break;
-			case  2: printf("(Spa)"); break;
-			case  3: printf("(Dut)"); break;
-			default: printf("(Unk)"); break;
+			case -1: sink_puts(out, "( -1)"); break;
+			case  0: sink_puts(out, "(Eng)"); break;
+			case  1: sink_puts(out, "(Fra)"); break;
+			case  2: sink_puts(out, "(Spa)"); break;
+			case  3: sink_puts(out, "(Dut)"); break;
+			default: sink_puts(out, "(Unk)"); break;
 		}
-		printf(", %s\n", founding_father_list[i]);
+		sink_printf(out, ", %s\n", founding_father_list[i]);
 	}
-	printf("\n");
+	sink_putc(out, '\n');
 
 	for (int i = 0; i < 3; ++i)
-		printf("numbers05.%d: %3d(%04x)\n", i, head->numbers05[i], head->numbers05[i]);
-	printf("\n");
+		sink_printf(out, "numbers05.%d: %3d(%04x)\n", i, head->numbers05[i], head->numbers05[i]);
+	sink_putc(out, '\n');
 
 	for (int i = 0; i < 4; ++i)
-		printf("National relation: %3d %s\n", head->nation_relation[i], nation_list[i]);
-	printf("\n");
+		sink_printf(out, "National relation: %3d %s\n", head->nation_relation[i], nation_list[i]);
+	sink_putc(out, '\n');
 
 	for (int i = 0; i < 5; ++i)
-		printf("numbers06.%d: %3d(%04x)\n", i, head->numbers06[i], head->numbers06[i]);
-	printf("\n");
+		sink_printf(out, "numbers06.%d: %3d(%04x)\n", i, head->numbers06[i], head->numbers06[i]);
+	sink_putc(out, '\n');
 
 	for (int i = 0; i < 4; ++i) {
 		switch (i) {
-			case 0: printf("%d Regulars, ",  head->expeditionary_force[i]); break;
-			case 1: printf("%d Cavalry,  ",  head->expeditionary_force[i]); break;
-			case 2: printf("%d Man-O-War, ", head->expeditionary_force[i]); break;
-			case 3: printf("%d Artillery\n", head->expeditionary_force[i]); break;
+			case 0: sink_printf(out, "%d Regulars, ",  head->expeditionary_force[i]); break;
+			case 1: sink_printf(out, "%d Cavalry,  ",  head->expeditionary_force[i]); break;
+			case 2: sink_printf(out, "%d Man-O-War, ", head->expeditionary_force[i]); break;
+			case 3: sink_printf(out, "%d Artillery\n", head->expeditionary_force[i]); break;
 		}
 	}
 
 	for (int i = 0; i < 4; ++i)
-		printf("numbers07.%d: %3d(%04x)\n", i, head->numbers07[i], head->numbers07[i]);
-	printf("\n");
+		sink_printf(out, "numbers07.%d: %3d(%04x)\n", i, head->numbers07[i], head->numbers07[i]);
+	sink_putc(out, '\n');
 
 	for (int i = 0; i < 16; ++i)
-		printf("count down[%2d]: %3d\n", i, head->count_down[i]);
-	printf("\n");
-
-	printf("event_discovery_of_the_new_world     : %5s\n", head->event.discovery_of_the_new_world     ? "true" : "false");
-	printf("event_building_a_colony              : %5s\n", head->event.building_a_colony              ? "true" : "false");
-	printf("event_meeting_the_natives            : %5s\n", head->event.meeting_the_natives            ? "true" : "false");
-	printf("event_the_aztec_empire               : %5s\n", head->event.the_aztec_empire               ? "true" : "false");
-	printf("event_the_inca_nation                : %5s\n", head->event.the_inca_nation                ? "true" : "false");
-	printf("event_discovery_of_the_pacific_ocean : %5s\n", head->event.discovery_of_the_pacific_ocean ? "true" : "false");
-	printf("event_entering_indian_village        : %5s\n", head->event.entering_indian_village        ? "true" : "false");
-	printf("event_the_fountain_of_youth          : %5s\n", head->event.the_fountain_of_youth          ? "true" : "false");
-	printf("event_cargo_from_the_new_world       : %5s\n", head->event.cargo_from_the_new_world       ? "true" : "false");
-	printf("event_meeting_fellow_europeans       : %5s\n", head->event.meeting_fellow_europeans       ? "true" : "false");
-	printf("event_colony_burning                 : %5s\n", head->event.colony_burning                 ? "true" : "false");
-	printf("event_colony_destroyed               : %5s\n", head->event.colony_destroyed               ? "true" : "false");
-	printf("event_indian_raid                    : %5s\n", head->event.indian_raid                    ? "true" : "false");
-	printf("event_woodcut14                      : %5s\n", head->event.woodcut14                      ? "true" : "false");
-	printf("event_woodcut15                      : %5s\n", head->event.woodcut15                      ? "true" : "false");
-	printf("event_woodcut16                      : %5s\n", head->event.woodcut16                      ? "true" : "false");
+		sink_printf(out, "count down[%2d]: %3d\n", i, head->count_down[i]);
+	sink_putc(out, '\n');
+
+	sink_printf(out, "event_discovery_of_the_new_world     : %5s\n", head->event.discovery_of_the_new_world     ? "true" : "false");
+	sink_printf(out, "event_building_a_colony              : %5s\n", head->event.building_a_colony              ? "true" : "false");
+	sink_printf(out, "event_meeting_the_natives            : %5s\n", head->event.meeting_the_natives            ? "true" : "false");
+	sink_printf(out, "event_the_aztec_empire               : %5s\n", head->event.the_aztec_empire               ? "true" : "false");
+	sink_printf(out, "event_the_inca_nation                : %5s\n", head->event.the_inca_nation                ? "true" : "false");
+	sink_printf(out, "event_discovery_of_the_pacific_ocean : %5s\n", head->event.discovery_of_the_pacific_ocean ? "true" : "false");
+	sink_printf(out, "event_entering_indian_village        : %5s\n", head->event.entering_indian_village        ? "true" : "false");
+	sink_printf(out, "event_the_fountain_of_youth          : %5s\n", head->event.the_fountain_of_youth          ? "true" : "false");
+	sink_printf(out, "event_cargo_from_the_new_world       : %5s\n", head->event.cargo_from_the_new_world       ? "true" : "false");
+	sink_printf(out, "event_meeting_fellow_europeans       : %5s\n", head->event.meeting_fellow_europeans       ? "true" : "false");
+	sink_printf(out, "event_colony_burning                 : %5s\n", head->event.colony_burning                 ? "true" : "false");
+	sink_printf(out, "event_colony_destroyed               : %5s\n", head->event.colony_destroyed               ? "true" : "false");
+	sink_printf(out, "event_indian_raid                    : %5s\n", head->event.indian_raid                    ? "true" : "false");
+	sink_printf(out, "event_woodcut14                      : %5s\n", head->event.woodcut14                      ? "true" : "false");
+	sink_printf(out, "event_woodcut15                      : %5s\n", head->event.woodcut15                      ? "true" : "false");
+	sink_printf(out, "event_woodcut16                      : %5s\n", head->event.woodcut16                      ? "true" : "false");
 
 	for (int i = 0; i < 2; ++i)
-		printf("%02x ", head->unkb[i]);
-	printf("\n");
+		sink_printf(out, "%02x ", head->unkb[i]);
+	sink_putc(out, '\n');
 
-	printf("\n");
+	sink_putc(out, '\n');
 }
 
-void print_player(const struct savegame::player *player, int just_this_one)
+void print_player(struct sink *out, const struct savegame_view *sv, int just_this_one)
 {
-	printf("-- player --\n");
+	const struct savegame::player *player = sv->player;
+
+	sink_puts(out, "-- player --\n");
 
 	int start = (just_this_one == -1) ? 0 : just_this_one;
 
 	for (int i = start; i < 4; ++i) {
-		printf("%-11s: %23s / %23s : ", nation_list[i], player[i].name, player[i].country);
+		stats_record(STATS_PRINT_PLAYER);
+		sink_printf(out, "%-11s: %23s / %23s : ", nation_list[i], player[i].name, player[i].country);
 		switch (player[i].control) {
-			case savegame::player::PLAYER:    printf("Player    "); break;
-			case savegame::player::AI:        printf("AI        "); break;
-			case savegame::player::WITHDRAWN: printf("Withdrawn "); break;
-			default: printf("UNKNOWN (%02x)", player[i].control);
+			case savegame::player::PLAYER:    sink_puts(out, "Player    "); break;
+			case savegame::player::AI:        sink_puts(out, "AI        "); break;
+			case savegame::player::WITHDRAWN: sink_puts(out, "Withdrawn "); break;
+			default: sink_printf(out, "UNKNOWN (%02x)", player[i].control);
 		}
-		printf("diplomacy: %02x ", player[i].diplomacy);
+		sink_printf(out, "diplomacy: %02x ", player[i].diplomacy);
 
-		printf("unknown: %02x ", player[i].unk00);
-		printf("colonies: %2d\n", player[i].founded_colonies);
+		sink_printf(out, "unknown: %02x ", player[i].unk00);
+		sink_printf(out, "colonies: %2d\n", player[i].founded_colonies);
 
 		if (just_this_one != -1)
 			break;
 	}
-	printf("\n");
+	sink_putc(out, '\n');
 }
 
-void print_other( const struct savegame::other  *other)
+void print_other( struct sink *out, const struct savegame_view *sv)
 {
-	printf("-- other --\n");
+	const struct savegame::other *other = sv->other;
+
+	sink_puts(out, "-- other --\n");
+	stats_record(STATS_PRINT_OTHER);
 
-	for (int i = 0; i < sizeof (other->unkXX_xx); ++i)
-		printf("%02x ", other->unkXX_xx[i]);
-	printf("\n\n");
+	sink_hexdump(out, other->unkXX_xx, sizeof (other->unkXX_xx));
+	sink_puts(out, "\n\n");
 }
 
-void print_colony(const struct savegame *sg, const struct savegame::colony *colony, uint16_t colony_count, int just_this_one)
+void print_colony(struct sink *out, const struct savegame_view *sv, int just_this_one, const uint8_t *mask)
 {
-	printf("-- colonies --\n");
+	const struct savegame::colony *colony = sv->colony;
+	uint16_t colony_count = sv->head->colony_count;
+
+	sink_puts(out, "-- colonies --\n");
 
 	/* Find our player */
 	int player_nation = -1;
 	for (int i = 0; i < 4; ++i) {
-		if (sg->player[i].control == 0) {
+		if (sv->player[i].control == 0) {
 			player_nation = i;
 			break;
 		}
@@ -538,277 +1565,296 @@ void print_colony(const struct savegame *sg, const struct savegame::colony *colo
 		if ( colony[i].nation != player_nation) /* Skip printing colonies not under player control */
 			continue;
 
-		printf("[%3d] (%3d, %3d): %2d %s\n", i, colony[i].x, colony[i].y, colony[i].population, colony[i].name);
+		if (mask && !mask[i])
+			continue;
+
+		stats_record(STATS_PRINT_COLONY);
+		sink_printf(out, "[%3d] (%3d, %3d): %2d %s\n", i, colony[i].x, colony[i].y, colony[i].population, colony[i].name);
 
 		for (int j = 0; j < sizeof (colony[i].unk0) ; ++j)
-			printf("%02x ", colony[i].unk0[j]);
-		printf("\n");
+			sink_printf(out, "%02x ", colony[i].unk0[j]);
+		sink_putc(out, '\n');
 
-		printf("Colonists;\n");
+		sink_puts(out, "Colonists;\n");
 		for (int j = 0; j < colony[i].population; ++j)
-			printf("[%2d]  %s working as %s\n",
+			sink_printf(out, "[%2d]  %s working as %s\n",
 				j, profession_list[ colony[i].profession[j] ] ,
 				   profession_list[ colony[i].occupation[j] ] );
-		printf("\n");
+		sink_putc(out, '\n');
 
-		for (int j = 0; j < sizeof (colony[i].unk6); ++j)
-			printf("%02x ", colony[i].unk6[j]);
-		printf("\n\n");
+		sink_hexdump(out, colony[i].unk6, sizeof (colony[i].unk6));
+		sink_puts(out, "\n\n");
 
-		printf("%2d | %2d | %2d\n", colony[i].tiles[4], colony[i].tiles[0], colony[i].tiles[5]);
-		printf("-------------\n");
-		printf("%2d |    | %2d\n",  colony[i].tiles[3],                     colony[i].tiles[1]);
-		printf("-------------\n");
-		printf("%2d | %2d | %2d\n", colony[i].tiles[7], colony[i].tiles[2], colony[i].tiles[6]);
-		printf("\n");
+		sink_printf(out, "%2d | %2d | %2d\n", colony[i].tiles[4], colony[i].tiles[0], colony[i].tiles[5]);
+		sink_puts(out, "-------------\n");
+		sink_printf(out, "%2d |    | %2d\n",  colony[i].tiles[3],                     colony[i].tiles[1]);
+		sink_puts(out, "-------------\n");
+		sink_printf(out, "%2d | %2d | %2d\n", colony[i].tiles[7], colony[i].tiles[2], colony[i].tiles[6]);
+		sink_putc(out, '\n');
 
-		for (int j = 0; j < sizeof (colony[i].unk8); ++j)
-			printf("%02x ", colony[i].unk8[j]);
-		printf("\n");
+		sink_hexdump(out, colony[i].unk8, sizeof (colony[i].unk8));
+		sink_putc(out, '\n');
 
-		printf("Colony buildings:\n");
+		sink_puts(out, "Colony buildings:\n");
 			switch( colony[i].buildings.stockade ) {
 				case 0: break;
-				case 1: printf(" stockade\n"); break;
-				case 3: printf(" fort    \n"); break;
-				case 7: printf(" fortress\n"); break;
-				default: printf("a0: %d\n", colony[i].buildings.stockade); break;
+				case 1: sink_puts(out, " stockade\n"); break;
+				case 3: sink_puts(out, " fort    \n"); break;
+				case 7: sink_puts(out, " fortress\n"); break;
+				default: sink_printf(out, "a0: %d\n", colony[i].buildings.stockade); break;
 			}
 
 			switch ( colony[i].buildings.armory ) {
 				case 0: break;
-				case 1: printf(" armory  \n"); break;
-				case 3: printf(" magazine\n"); break;
-				case 7: printf(" arsenal \n"); break;
-				default: printf("a1: %d\n", colony[i].buildings.armory); break;
+				case 1: sink_puts(out, " armory  \n"); break;
+				case 3: sink_puts(out, " magazine\n"); break;
+				case 7: sink_puts(out, " arsenal \n"); break;
+				default: sink_printf(out, "a1: %d\n", colony[i].buildings.armory); break;
 			}
 
 			switch ( colony[i].buildings.docks ) {
 				case 0: break;
-				case 1: printf(" docks   \n"); break;
-				case 3: printf(" dry dock\n"); break;
-				case 7: printf(" shipyard\n"); break;
-				default: printf("a2: %d\n", colony[i].buildings.docks); break;
+				case 1: sink_puts(out, " docks   \n"); break;
+				case 3: sink_puts(out, " dry dock\n"); break;
+				case 7: sink_puts(out, " shipyard\n"); break;
+				default: sink_printf(out, "a2: %d\n", colony[i].buildings.docks); break;
 			}
 
 			switch ( colony[i].buildings.town_hall ) {
 				case 0: break;
-				case 1: printf(" town hall\n"); break;
-				case 3: printf("a3: 3\n"); break;
-				case 7: printf("a3: 7\n"); break;
-				default: printf("a3: %d\n", colony[i].buildings.town_hall); break;
+				case 1: sink_puts(out, " town hall\n"); break;
+				case 3: sink_puts(out, "a3: 3\n"); break;
+				case 7: sink_puts(out, "a3: 7\n"); break;
+				default: sink_printf(out, "a3: %d\n", colony[i].buildings.town_hall); break;
 			}
 
 			switch ( colony[i].buildings.schoolhouse ) {
 				case 0: break;
-				case 1: printf(" schoolhouse\n"); break;
-				case 3: printf(" college    \n"); break;
-				case 7: printf(" university \n"); break;
-				default: printf("a4: %d\n", colony[i].buildings.schoolhouse); break;
+				case 1: sink_puts(out, " schoolhouse\n"); break;
+				case 3: sink_puts(out, " college    \n"); break;
+				case 7: sink_puts(out, " university \n"); break;
+				default: sink_printf(out, "a4: %d\n", colony[i].buildings.schoolhouse); break;
 			}
 
 			switch ( colony[i].buildings.warehouse ) {
 				case 0: break;
-				case 1: printf("warehouse\n"); break;
-				case 3: printf("warehouse (expansion)\n"); break;
-				default: printf("a5: %d\n", colony[i].buildings.warehouse); break;
+				case 1: sink_puts(out, "warehouse\n"); break;
+				case 3: sink_puts(out, "warehouse (expansion)\n"); break;
+				default: sink_printf(out, "a5: %d\n", colony[i].buildings.warehouse); break;
 			}
 
 			switch ( colony[i].buildings.stables ) {
 				case 0: break;
-				case 1: printf("stables\n"); break;
-				default: printf("b1: %d\n", colony[i].buildings.stables); break;
+				case 1: sink_puts(out, "stables\n"); break;
+				default: sink_printf(out, "b1: %d\n", colony[i].buildings.stables); break;
 			}
 
 			switch ( colony[i].buildings.custom_house ) {
 				case 0: break;
-				case 1: printf("custom house\n"); break;
-				default: printf("b2: %d\n", colony[i].buildings.custom_house); break;
+				case 1: sink_puts(out, "custom house\n"); break;
+				default: sink_printf(out, "b2: %d\n", colony[i].buildings.custom_house); break;
 			}
 
 			switch ( colony[i].buildings.printing_press ) {
 				case 0: break;
-				case 1: printf("printing press\n"); break;
-				case 3: printf("newspaper     \n"); break;
-				default: printf("b3: %d\n", colony[i].buildings.printing_press); break;
+				case 1: sink_puts(out, "printing press\n"); break;
+				case 3: sink_puts(out, "newspaper     \n"); break;
+				default: sink_printf(out, "b3: %d\n", colony[i].buildings.printing_press); break;
 			}
 
 			switch ( colony[i].buildings.weavers_house ) {
 				case 0: break;
-				case 1: printf("weaver's house\n"); break;
-				case 3: printf("weaver's shop \n"); break;
-				case 7: printf("textile mill  \n"); break;
-				default: printf("b4: %d\n", colony[i].buildings.weavers_house); break;
+				case 1: sink_puts(out, "weaver's house\n"); break;
+				case 3: sink_puts(out, "weaver's shop \n"); break;
+				case 7: sink_puts(out, "textile mill  \n"); break;
+				default: sink_printf(out, "b4: %d\n", colony[i].buildings.weavers_house); break;
 			}
 
 			switch ( colony[i].buildings.tobacconists_house ) {
 				case 0: break;
-				case 1: printf("tobacconist's house\n"); break;
-				case 3: printf("tobacconist's shop \n"); break;
-				case 7: printf("cigar factory      \n"); break;
-				default: printf("b5: %d\n", colony[i].buildings.tobacconists_house); break;
+				case 1: sink_puts(out, "tobacconist's house\n"); break;
+				case 3: sink_puts(out, "tobacconist's shop \n"); break;
+				case 7: sink_puts(out, "cigar factory      \n"); break;
+				default: sink_printf(out, "b5: %d\n", colony[i].buildings.tobacconists_house); break;
 			}
 
 			switch ( colony[i].buildings.rum_distillers_house ) {
 				case 0: break;
-				case 1: printf("rum distiller's house\n"); break;
-				case 3: printf("rum distillery\n"); break;
-				case 7: printf("rum factory\n"); break;
-				default: printf("b6: %d\n", colony[i].buildings.rum_distillers_house); break;
+				case 1: sink_puts(out, "rum distiller's house\n"); break;
+				case 3: sink_puts(out, "rum distillery\n"); break;
+				case 7: sink_puts(out, "rum factory\n"); break;
+				default: sink_printf(out, "b6: %d\n", colony[i].buildings.rum_distillers_house); break;
 			}
 
 			switch ( colony[i].buildings.capitol ) {
 				case 0: break;
-				case 1: printf("capitol\n"); break;
-				case 3: printf("capitol (expansion)\n"); break;
-				default: printf("b7: %d\n", colony[i].buildings.capitol); break;
+				case 1: sink_puts(out, "capitol\n"); break;
+				case 3: sink_puts(out, "capitol (expansion)\n"); break;
+				default: sink_printf(out, "b7: %d\n", colony[i].buildings.capitol); break;
 			}
 
 			switch ( colony[i].buildings.fur_traders_house ) {
 				case 0: break;
-				case 1: printf("fur trader's house\n"); break;
-				case 3: printf("fur trading post  \n"); break;
-				case 7: printf("fur factory       \n"); break;
-				default: printf("c0: %d\n", colony[i].buildings.fur_traders_house);
+				case 1: sink_puts(out, "fur trader's house\n"); break;
+				case 3: sink_puts(out, "fur trading post  \n"); break;
+				case 7: sink_puts(out, "fur factory       \n"); break;
+				default: sink_printf(out, "c0: %d\n", colony[i].buildings.fur_traders_house);
 			}
 
 			switch ( colony[i].buildings.carpenters_shop ) {
 				case 0: break;
-				case 1: printf("carpenter's shop\n"); break;
-				case 3: printf("lumber mill\n"); break;
-				default: printf("c1: %d\n", colony[i].buildings.carpenters_shop);
+				case 1: sink_puts(out, "carpenter's shop\n"); break;
+				case 3: sink_puts(out, "lumber mill\n"); break;
+				default: sink_printf(out, "c1: %d\n", colony[i].buildings.carpenters_shop);
 			}
 
 			switch ( colony[i].buildings.church ) {
 				case 0: break;
-				case 1: printf("church\n"); break;
-				case 3: printf("cathedral: 3\n"); break;
-				default: printf("c2: %d\n", colony[i].buildings.church);
+				case 1: sink_puts(out, "church\n"); break;
+				case 3: sink_puts(out, "cathedral: 3\n"); break;
+				default: sink_printf(out, "c2: %d\n", colony[i].buildings.church);
 			}
 
 			switch ( colony[i].buildings.blacksmiths_house ) {
 				case 0: break;
-				case 1: printf("blacksmith's house\n"); break;
-				case 3: printf("blacksmith's shop \n"); break;
-				case 7: printf("iron works        \n"); break;
-				default: printf("c3: %d\n", colony[i].buildings.blacksmiths_house);
+				case 1: sink_puts(out, "blacksmith's house\n"); break;
+				case 3: sink_puts(out, "blacksmith's shop \n"); break;
+				case 7: sink_puts(out, "iron works        \n"); break;
+				default: sink_printf(out, "c3: %d\n", colony[i].buildings.blacksmiths_house);
 			}
 
 			assert(colony[i].buildings.unused == 0);
 
-		printf("Custom house:\n");
-		printf("  %c food       \n", colony[i].custom_house.food        ? '*' : ' ');
-		printf("  %c sugar      \n", colony[i].custom_house.sugar       ? '*' : ' ');
-		printf("  %c tobacco    \n", colony[i].custom_house.tobacco     ? '*' : ' ');
-		printf("  %c cotton     \n", colony[i].custom_house.cotton      ? '*' : ' ');
-		printf("  %c furs       \n", colony[i].custom_house.furs        ? '*' : ' ');
-		printf("  %c lumber     \n", colony[i].custom_house.lumber      ? '*' : ' ');
-		printf("  %c ore        \n", colony[i].custom_house.ore         ? '*' : ' ');
-		printf("  %c silver     \n", colony[i].custom_house.silver      ? '*' : ' ');
-		printf("  %c horses     \n", colony[i].custom_house.horses      ? '*' : ' ');
-		printf("  %c rum        \n", colony[i].custom_house.rum         ? '*' : ' ');
-		printf("  %c cigars     \n", colony[i].custom_house.cigars      ? '*' : ' ');
-		printf("  %c cloth      \n", colony[i].custom_house.cloth       ? '*' : ' ');
-		printf("  %c coats      \n", colony[i].custom_house.coats       ? '*' : ' ');
-		printf("  %c trade_goods\n", colony[i].custom_house.trade_goods ? '*' : ' ');
-		printf("  %c tools      \n", colony[i].custom_house.tools       ? '*' : ' ');
-		printf("  %c muskets    \n", colony[i].custom_house.muskets     ? '*' : ' ');
-		printf("\n");
-
-		for (int j = 0; j < sizeof (colony[i].unka); ++j)
-			printf("%02x ", colony[i].unka[j]);
-		printf("\n");
-
-		printf("%3d hammers ", colony[i].hammers);
-		printf("producing: ");
+		sink_puts(out, "Custom house:\n");
+		sink_puts(out, colony[i].custom_house.food       ? "  * food       \n" : "    food       \n");
+		sink_puts(out, colony[i].custom_house.sugar      ? "  * sugar      \n" : "    sugar      \n");
+		sink_puts(out, colony[i].custom_house.tobacco    ? "  * tobacco    \n" : "    tobacco    \n");
+		sink_puts(out, colony[i].custom_house.cotton     ? "  * cotton     \n" : "    cotton     \n");
+		sink_puts(out, colony[i].custom_house.furs       ? "  * furs       \n" : "    furs       \n");
+		sink_puts(out, colony[i].custom_house.lumber     ? "  * lumber     \n" : "    lumber     \n");
+		sink_puts(out, colony[i].custom_house.ore        ? "  * ore        \n" : "    ore        \n");
+		sink_puts(out, colony[i].custom_house.silver     ? "  * silver     \n" : "    silver     \n");
+		sink_puts(out, colony[i].custom_house.horses     ? "  * horses     \n" : "    horses     \n");
+		sink_puts(out, colony[i].custom_house.rum        ? "  * rum        \n" : "    rum        \n");
+		sink_puts(out, colony[i].custom_house.cigars     ? "  * cigars     \n" : "    cigars     \n");
+		sink_puts(out, colony[i].custom_house.cloth      ? "  * cloth      \n" : "    cloth      \n");
+		sink_puts(out, colony[i].custom_house.coats      ? "  * coats      \n" : "    coats      \n");
+		sink_puts(out, colony[i].custom_house.trade_goods? "  * trade_goods\n" : "    trade_goods\n");
+		sink_puts(out, colony[i].custom_house.tools      ? "  * tools      \n" : "    tools      \n");
+		sink_puts(out, colony[i].custom_house.muskets    ? "  * muskets    \n" : "    muskets    \n");
+		sink_putc(out, '\n');
+
+		sink_hexdump(out, colony[i].unka, sizeof (colony[i].unka));
+		sink_putc(out, '\n');
+
+		sink_printf(out, "%3d hammers ", colony[i].hammers);
+		sink_puts(out, "producing: ");
 		switch (colony[i].building_in_production) {
-			case 255: printf("Nothing              \n"); break;
-			case   0: printf("Stockade             \n"); break;
-			case   1: printf("Fort                 \n"); break;
-			case   2: printf("Fortress             \n"); break;
-			case   3: printf("Armory               \n"); break;
-			case   4: printf("Magazine             \n"); break;
-			case   5: printf("Arsenal              \n"); break;
-			case   6: printf("Docks                \n"); break;
-			case   7: printf("Drydock              \n"); break;
-			case   8: printf("Shipyard             \n"); break;
-			case   9: printf("Town Hall            \n"); break;
-			case  10: printf("Town Hall            \n"); break;
-			case  11: printf("Town Hall            \n"); break;
-			case  12: printf("Schoolhouse          \n"); break;
-			case  13: printf("College              \n"); break;
-			case  14: printf("University           \n"); break;
-			case  15: printf("Warehouse            \n"); break;
-			case  16: printf("Warehouse Expansion  \n"); break;
-			case  17: printf("Stable               \n"); break;
-			case  18: printf("Custom House         \n"); break;
-			case  19: printf("Printing Press       \n"); break;
-			case  20: printf("Newspaper            \n"); break;
-			case  21: printf("Weaver's House       \n"); break;
-			case  22: printf("Weaver's Shop        \n"); break;
-			case  23: printf("Textile Mill         \n"); break;
-			case  24: printf("Tobacconist's House  \n"); break;
-			case  25: printf("Tobacconist's Shop   \n"); break;
-			case  26: printf("Cigar Factory        \n"); break;
-			case  27: printf("Rum Distiller's House\n"); break;
-			case  28: printf("Rum Distillery       \n"); break;
-			case  29: printf("Rum Factory          \n"); break;
-			case  30: printf("Capitol              \n"); break;
-			case  31: printf("Capitol Expansion    \n"); break;
-			case  32: printf("Fur Trader's House   \n"); break;
-			case  33: printf("Fur Trading Post     \n"); break;
-			case  34: printf("Fur Factory          \n"); break;
-			case  35: printf("Carpenter's Shop     \n"); break;
-			case  36: printf("Lumber Mill          \n"); break;
-			case  37: printf("Church               \n"); break;
-			case  38: printf("Cathedral            \n"); break;
-			case  39: printf("Blacksmith's House   \n"); break;
-			case  40: printf("Blacksmith's Shop    \n"); break;
-			case  41: printf("Iron Works           \n"); break;
-			case  42: printf("Artillery            \n"); break;
-			case  43: printf("Wagon Train          \n"); break;
-
-			default:  printf("(%3d) unknown\n", colony[i].building_in_production); break;
+			case 255: sink_puts(out, "Nothing              \n"); break;
+			case   0: sink_puts(out, "Stockade             \n"); break;
+			case   1: sink_puts(out, "Fort                 \n"); break;
+			case   2: sink_puts(out, "Fortress             \n"); break;
+			case   3: sink_puts(out, "Armory               \n"); break;
+			case   4: sink_puts(out, "Magazine             \n"); break;
+			case   5: sink_puts(out, "Arsenal              \n"); break;
+			case   6: sink_puts(out, "Docks                \n"); break;
+			case   7: sink_puts(out, "Drydock              \n"); break;
+			case   8: sink_puts(out, "Shipyard             \n"); break;
+			case   9: sink_puts(out, "Town Hall            \n"); break;
+			case  10: sink_puts(out, "Town Hall            \n"); break;
+			case  11: sink_puts(out, "Town Hall            \n"); break;
+			case  12: sink_puts(out, "Schoolhouse          \n"); break;
+			case  13: sink_puts(out, "College              \n"); break;
+			case  14: sink_puts(out, "University           \n"); break;
+			case  15: sink_puts(out, "Warehouse            \n"); break;
+			case  16: sink_puts(out, "Warehouse Expansion  \n"); break;
+			case  17: sink_puts(out, "Stable               \n"); break;
+			case  18: sink_puts(out, "Custom House         \n"); break;
+			case  19: sink_puts(out, "Printing Press       \n"); break;
+			case  20: sink_puts(out, "Newspaper            \n"); break;
+			case  21: sink_puts(out, "Weaver's House       \n"); break;
+			case  22: sink_puts(out, "Weaver's Shop        \n"); break;
+			case  23: sink_puts(out, "Textile Mill         \n"); break;
+			case  24: sink_puts(out, "Tobacconist's House  \n"); break;
+			case  25: sink_puts(out, "Tobacconist's Shop   \n"); break;
+			case  26: sink_puts(out, "Cigar Factory        \n"); break;
+			case  27: sink_puts(out, "Rum Distiller's House\n"); break;
+			case  28: sink_puts(out, "Rum Distillery       \n"); break;
+			case  29: sink_puts(out, "Rum Factory          \n"); break;
+			case  30: sink_puts(out, "Capitol              \n"); break;
+			case  31: sink_puts(out, "Capitol Expansion    \n"); break;
+			case  32: sink_puts(out, "Fur Trader's House   \n"); break;
+			case  33: sink_puts(out, "Fur Trading Post     \n"); break;
+			case  34: sink_puts(out, "Fur Factory          \n"); break;
+			case  35: sink_puts(out, "Carpenter's Shop     \n"); break;
+			case  36: sink_puts(out, "Lumber Mill          \n"); break;
+			case  37: sink_puts(out, "Church               \n"); break;
+			case  38: sink_puts(out, "Cathedral            \n"); break;
+			case  39: sink_puts(out, "Blacksmith's House   \n"); break;
+			case  40: sink_puts(out, "Blacksmith's Shop    \n"); break;
+			case  41: sink_puts(out, "Iron Works           \n"); break;
+			case  42: sink_puts(out, "Artillery            \n"); break;
+			case  43: sink_puts(out, "Wagon Train          \n"); break;
+
+			default:  sink_printf(out, "(%3d) unknown\n", colony[i].building_in_production); break;
 		}
 
-		for (int j = 0; j < sizeof (colony[i].unkb); ++j)
-			printf("%02x ", colony[i].unkb[j]);
-		printf("\n");
+		sink_hexdump(out, colony[i].unkb, sizeof (colony[i].unkb));
+		sink_putc(out, '\n');
 
-		printf("Stock;\n");
-		for (int j = 0; j < 16; ++j)
-			printf("  %11s: %3d\n", cargo_list[j], colony[i].stock[j]);
-		printf("\n");
+		sink_puts(out, "Stock;\n");
+		for (int j = 0; j < 16; ++j) {
+			sink_puts(out, "  ");
+			sink_str(out, cargo_list[j], 11);
+			sink_puts(out, ": ");
+			sink_dec(out, colony[i].stock[j], 3);
+			sink_putc(out, '\n');
+		}
+		sink_putc(out, '\n');
 
-		for (int j = 0; j < sizeof (colony[i].unkd); ++j)
-			printf("%02x ", colony[i].unkd[j]);
-		printf("\n");
+		sink_hexdump(out, colony[i].unkd, sizeof (colony[i].unkd));
+		sink_putc(out, '\n');
 
-		printf("rebel ratio: %d/%d = %d\n",
+		sink_printf(out, "rebel ratio: %d/%d = %d\n",
 			colony[i].rebel_dividend, colony[i].rebel_divisor,
 			(colony[i].rebel_dividend * 100) / colony[i].rebel_divisor);
-		printf("\n");
+		sink_putc(out, '\n');
 
 		if (just_this_one != -1)
 			break;
 	}
 
-	printf("\n");
+	sink_putc(out, '\n');
 }
 
-void print_unit(  const struct savegame::unit   *unit,   uint16_t unit_count, int just_this_one)
+void print_unit(  struct sink *out, const struct savegame_view *sv, int just_this_one, const uint8_t *mask)
 {
-	printf("-- units --\n");
+	const struct savegame::unit *unit = sv->unit;
+	uint16_t unit_count = sv->head->unit_count;
+
+	sink_puts(out, "-- units --\n");
 
 	int start = (just_this_one == -1) ? 0 : just_this_one;
 
 	for (int i = start; i < unit_count; ++i) {
-		printf("[%3d] (%3d, %3d): %-19s ", i, unit[i].x, unit[i].y, unit_type_list[unit[i].type]);
+		if (mask && !mask[i]) {
+			if (just_this_one != -1)
+				break;
+			continue;
+		}
 
-		printf("%-11s ", nation_list[unit[i].owner] );
-		printf("m:%02x ", unit[i].moves);
+		stats_record(STATS_PRINT_UNIT);
+		sink_putc(out, '[');  sink_dec(out, i, 3);
+		sink_puts(out, "] ("); sink_dec(out, unit[i].x, 3);
+		sink_puts(out, ", ");  sink_dec(out, unit[i].y, 3);
+		sink_puts(out, "): "); sink_str(out, unit_type_list[unit[i].type], -19);
+		sink_putc(out, ' ');
 
-		printf("tw:%d ", unit[i].turns_worked);
+		sink_str(out, nation_list[unit[i].owner], -11);
+		sink_puts(out, " m:"); sink_hex02(out, unit[i].moves);
+
+		sink_puts(out, " tw:"); sink_dec(out, unit[i].turns_worked);
+		sink_putc(out, ' ');
 
 		switch (unit[i].type) {
 			case  0: //savegame::unit::COLONIST:
@@ -820,128 +1866,136 @@ void print_unit(  const struct savegame::unit   *unit,   uint16_t unit_count, in
 			case  7: //savegame::unit::CONTINENTAL_CAVALRY:
 			case  9: //savegame::unit::CONTINENTAL_ARMY:
 			case 19: //savegame::unit::BRAVE:
-				printf("%-22s", profession_list[unit[i].profession]);
+				sink_str(out, profession_list[unit[i].profession], -22);
 				break;
 			case 10: //savegame::unit::TREASURE:
-				printf("%3d00 gold            ", unit[i].profession);
+				sink_printf(out, "%3d00 gold            ", unit[i].profession);
 				break;
 			case 13: //savegame::unit::CARAVEL:
 			case 14: //savegame::uniT::MERCHANTMAN:
 			case 15: //savegame::unit::GALEON:
-				printf("%-22s", unit_type_list[unit[i].type]);
+				sink_str(out, unit_type_list[unit[i].type], -22);
 				assert(0 == unit[i].profession);
 				break;
 			default:
-				printf("TYPE: %2d PROF: %2d     ", unit[i].type, unit[i].profession);
+				sink_printf(out, "TYPE: %2d PROF: %2d     ", unit[i].type, unit[i].profession);
 		}
 
 		assert(unit[i].holds_occupied >= 0 &&
 			unit[i].holds_occupied < 7 );
 
-		printf("cargo_holds (%d) : [ %s:%3d, %s:%3d, %s:%3d, %s:%3d, %s:%3d, %s:%3d ]",
-			unit[i].holds_occupied,
-			(unit[i].holds_occupied > 0) ? cargo_list[unit[i].cargo_item_0] : "", (unit[i].holds_occupied > 0) ? unit[i].cargo_hold[0] : -1,
-			(unit[i].holds_occupied > 1) ? cargo_list[unit[i].cargo_item_1] : "", (unit[i].holds_occupied > 1) ? unit[i].cargo_hold[1] : -1,
-			(unit[i].holds_occupied > 2) ? cargo_list[unit[i].cargo_item_2] : "", (unit[i].holds_occupied > 2) ? unit[i].cargo_hold[2] : -1,
-			(unit[i].holds_occupied > 3) ? cargo_list[unit[i].cargo_item_3] : "", (unit[i].holds_occupied > 3) ? unit[i].cargo_hold[3] : -1,
-			(unit[i].holds_occupied > 4) ? cargo_list[unit[i].cargo_item_4] : "", (unit[i].holds_occupied > 4) ? unit[i].cargo_hold[4] : -1,
-			(unit[i].holds_occupied > 5) ? cargo_list[unit[i].cargo_item_5] : "", (unit[i].holds_occupied > 5) ? unit[i].cargo_hold[5] : -1);
+		const uint8_t cargo_item[6] = {
+			unit[i].cargo_item_0, unit[i].cargo_item_1, unit[i].cargo_item_2,
+			unit[i].cargo_item_3, unit[i].cargo_item_4, unit[i].cargo_item_5 };
+
+		sink_puts(out, "cargo_holds ("); sink_dec(out, unit[i].holds_occupied);
+		sink_puts(out, ") : [ ");
+		for (int j = 0; j < 6; ++j) {
+			sink_puts(out, (unit[i].holds_occupied > j) ? cargo_list[cargo_item[j]] : "");
+			sink_putc(out, ':');
+			sink_dec(out, (unit[i].holds_occupied > j) ? unit[i].cargo_hold[j] : -1, 3);
+			sink_puts(out, (j < 5) ? ", " : " ]");
+		}
 
-		printf("(%x) %02x %02x %02x ",
-			unit[i].unk04,
-			unit[i].unk05,
-			unit[i].unk06,
-			unit[i].unk07);
+		sink_putc(out, '('); sink_putc(out, "0123456789abcdef"[unit[i].unk04]);
+		sink_puts(out, ") "); sink_hex02(out, unit[i].unk05);
+		sink_putc(out, ' ');  sink_hex02(out, unit[i].unk06);
+		sink_putc(out, ' ');  sink_hex02(out, unit[i].unk07);
+		sink_putc(out, ' ');
 
-		for (int j = 0; j < sizeof (unit[i].unk08); ++j)
-			printf("%02x ", unit[i].unk08[j]);
+		sink_hexdump(out, unit[i].unk08, sizeof (unit[i].unk08));
 
-		printf("%3d %3d\n",
-			unit[i].transport_chain.next_unit_idx,
-			unit[i].transport_chain.prev_unit_idx);
+		sink_dec(out, unit[i].transport_chain.next_unit_idx, 3);
+		sink_putc(out, ' ');
+		sink_dec(out, unit[i].transport_chain.prev_unit_idx, 3);
+		sink_putc(out, '\n');
 
 		if (just_this_one != -1)
 			break;
 	}
 
-	printf("\n");
+	sink_putc(out, '\n');
 }
 
-void print_nation(const struct savegame::nation *nation, int just_this_one)
+void print_nation(struct sink *out, const struct savegame_view *sv, int just_this_one, const uint8_t *mask)
 {
-	printf("-- nations --\n");
+	const struct savegame::nation *nation = sv->nation;
+
+	sink_puts(out, "-- nations --\n");
 
 	int start = (just_this_one == -1) ? 0 : just_this_one;
 
 	for (int i = start; i < 4; ++i) {
-		printf("%-11s, tax_rate: %2d\n", nation_list[i], nation[i].tax_rate);
+		if (mask && !mask[i]) {
+			if (just_this_one != -1)
+				break;
+			continue;
+		}
+
+		stats_record(STATS_PRINT_NATION);
+		sink_printf(out, "%-11s, tax_rate: %2d\n", nation_list[i], nation[i].tax_rate);
 
 		assert(nation[i].recruit_count <= 180); //does not go above 180
 
-		printf("Recruit: (%3d)\n", nation[i].recruit_count);
+		sink_printf(out, "Recruit: (%3d)\n", nation[i].recruit_count);
 		for (int j = 0; j < 3; ++j)
-			printf("  %s\n", profession_list[ nation[i].recruit[j] ]);
+			sink_printf(out, "  %s\n", profession_list[ nation[i].recruit[j] ]);
 
-		printf("%02x / %02x\n", nation[i].unk0, nation[i].unk1);
+		sink_printf(out, "%02x / %02x\n", nation[i].unk0, nation[i].unk1);
 		assert(nation[i].unk1 == 0);
 
-		for (int j = 0; j < sizeof (nation[i].unk2); ++j)
-			printf("%02x ", nation[i].unk2[j]);
-		printf("\n");
+		sink_hexdump(out, nation[i].unk2, sizeof (nation[i].unk2));
+		sink_putc(out, '\n');
 
-		printf("Liberty bell production: %3d (%4d)\n",
+		sink_printf(out, "Liberty bell production: %3d (%4d)\n",
 			nation[i].liberty_bells_last_turn,
 			nation[i].liberty_bells_total);
 
-		for (int j = 0; j < sizeof (nation[i].unk3); ++j)
-			printf("%02x ", nation[i].unk3[j]);
-		printf("\n");
+		sink_hexdump(out, nation[i].unk3, sizeof (nation[i].unk3));
+		sink_putc(out, '\n');
 
 		assert(nation[i].ffc_high == 0);
-		printf("Founding fathers: %2d", nation[i].founding_father_count);
+		sink_printf(out, "Founding fathers: %2d", nation[i].founding_father_count);
 		if (nation[i].next_founding_father != -1)
-			printf(", Next founding father: %s", founding_father_list[nation[i].next_founding_father] );
-		printf("\n");
+			sink_printf(out, ", Next founding father: %s", founding_father_list[nation[i].next_founding_father] );
+		sink_putc(out, '\n');
 
 
-		printf("Villages burned: %d\n", nation[i].villages_burned);
+		sink_printf(out, "Villages burned: %d\n", nation[i].villages_burned);
 
-		for (int j = 0; j < sizeof (nation[i].unk4); ++j)
-			printf("%02x ", nation[i].unk4[j]);
-		printf("\n");
+		sink_hexdump(out, nation[i].unk4, sizeof (nation[i].unk4));
+		sink_putc(out, '\n');
 
-		printf("Artillery count: %d\n", nation[i].artillery_count);
+		sink_printf(out, "Artillery count: %d\n", nation[i].artillery_count);
 		
 		
-		for (int j = 0; j < sizeof (nation[i].unk5); ++j)
-			printf("%02x ", nation[i].unk5[j]);
-		printf("\n");
+		sink_hexdump(out, nation[i].unk5, sizeof (nation[i].unk5));
+		sink_putc(out, '\n');
 
-		printf("Gold: %5d, Crosses: %4d\n",
+		sink_printf(out, "Gold: %5d, Crosses: %4d\n",
 			nation[i].gold, nation[i].crosses);
 
 		for (int j = 0; j < 4; ++j)
-			printf("%d ", nation[i].unk6[j] );
-		printf("\n");
+			sink_printf(out, "%d ", nation[i].unk6[j] );
+		sink_putc(out, '\n');
 
 		for (int j = 0; j < 8; ++j) {
-			printf("Indian status - %-8s:", nation_list[INDIAN_OFFSET + j]);
+			sink_printf(out, "Indian status - %-8s:", nation_list[INDIAN_OFFSET + j]);
 			switch (nation[i].indian_relation[j]) {
-				case savegame::nation::WAR:     printf("war\n");     break;
-				case savegame::nation::PEACE:   printf("peace\n");   break;
-				case savegame::nation::NOT_MET: printf("not met\n"); break;
-				default: printf("unknown (%02x)\n", nation[i].indian_relation[j]);
+				case savegame::nation::WAR:     sink_puts(out, "war\n");     break;
+				case savegame::nation::PEACE:   sink_puts(out, "peace\n");   break;
+				case savegame::nation::NOT_MET: sink_puts(out, "not met\n"); break;
+				default: sink_printf(out, "unknown (%02x)\n", nation[i].indian_relation[j]);
 			}
 		}
 
-		for (int j = 0; j < sizeof (nation[i].unk7); ++j)
-			printf("%02x ", nation[i].unk7[j]);
-		printf("\n");
+		sink_hexdump(out, nation[i].unk7, sizeof (nation[i].unk7));
+		sink_putc(out, '\n');
 
 
 		for (int j = 0; j < 16; ++j) {
-			printf("%11s: %7s, ", cargo_list[j], nation[i].boycott_bitmap & (1 << j) ? "boycott" : "");
-			printf("euro: %2d, %4d(%04x) nr, %5d gold, %4d tons, %4d tons2\n",
+			sink_printf(out, "%11s: %7s, ", cargo_list[j], nation[i].boycott_bitmap & (1 << j) ? "boycott" : "");
+			sink_printf(out, "euro: %2d, %4d(%04x) nr, %5d gold, %4d tons, %4d tons2\n",
 				nation[i].trade.euro_price[j],
 				nation[i].trade.nr[j], nation[i].trade.nr[j],
 				nation[i].trade.gold[j],
@@ -950,190 +2004,245 @@ void print_nation(const struct savegame::nation *nation, int just_this_one)
 			//assert(nation[i].trade.tons[j] == nation[i].trade.tons2[j]); //under which circumstances are these two not equal?
 		}
 
-		printf("\n");
+		sink_putc(out, '\n');
 
 		if (just_this_one != -1)
 			break;
 	}
-	printf("\n");
+	sink_putc(out, '\n');
 }
 
-void print_tribe(const struct savegame::tribe  *tribe,  uint16_t tribe_count, int just_this_one)
+void print_tribe( struct sink *out, const struct savegame_view *sv, int just_this_one, const uint8_t *mask)
 {
-	printf("-- tribes --\n");
+	const struct savegame::tribe *tribe = sv->tribe;
+	uint16_t tribe_count = sv->head->tribe_count;
+
+	sink_puts(out, "-- tribes --\n");
 
 	int start = (just_this_one == -1) ? 0 : just_this_one;
 
 	for (int i = start; i < tribe_count; ++i) {
-		printf("[%3d] (%3d, %3d): %2d %-11s :", i, tribe[i].x, tribe[i].y, tribe[i].population, nation_list[tribe[i].nation]);
-		printf(" state: artillery(%d) learned(%d) capital(%d) scouted(%d) %d %d %d %d,",
+		if (mask && !mask[i]) {
+			if (just_this_one != -1)
+				break;
+			continue;
+		}
+
+		stats_record(STATS_PRINT_TRIBE);
+		sink_printf(out, "[%3d] (%3d, %3d): %2d %-11s :", i, tribe[i].x, tribe[i].y, tribe[i].population, nation_list[tribe[i].nation]);
+		sink_printf(out, " state: artillery(%d) learned(%d) capital(%d) scouted(%d) %d %d %d %d,",
 			tribe[i].state.artillery, tribe[i].state.learned, tribe[i].state.capital, tribe[i].state.scouted,
 			tribe[i].state.unk5, tribe[i].state.unk6, tribe[i].state.unk7, tribe[i].state.unk8);
 
-		printf(" mission(%2d)", tribe[i].mission);
-		printf(" unk1: %02x", tribe[i].unk1);
-		printf(" f0: %d", tribe[i].flag_0);
-		printf(" cargo_bought: %s", (tribe[i].last_cargo_bought != -1) ? cargo_list[ tribe[i].last_cargo_bought ] : "-1");
-		printf(" cargo_sold: %s", (tribe[i].last_cargo_sold != -1) ? cargo_list[ tribe[i].last_cargo_sold ] : "-1");
-		printf(" panic(%2d) ", tribe[i].panic);
+		sink_printf(out, " mission(%2d)", tribe[i].mission);
+		sink_printf(out, " unk1: %02x", tribe[i].unk1);
+		sink_printf(out, " f0: %d", tribe[i].flag_0);
+		sink_printf(out, " cargo_bought: %s", (tribe[i].last_cargo_bought != -1) ? cargo_list[ tribe[i].last_cargo_bought ] : "-1");
+		sink_printf(out, " cargo_sold: %s", (tribe[i].last_cargo_sold != -1) ? cargo_list[ tribe[i].last_cargo_sold ] : "-1");
+		sink_printf(out, " panic(%2d) ", tribe[i].panic);
 
-		for (int j = 0; j < sizeof (tribe[i].unk2); ++j)
-			printf("%02x ", tribe[i].unk2[j]);
+		sink_hexdump(out, tribe[i].unk2, sizeof (tribe[i].unk2));
 
-		printf("%02x\n", tribe[i].population_loss_in_current_turn);
+		sink_printf(out, "%02x\n", tribe[i].population_loss_in_current_turn);
 
 		if (just_this_one != -1)
 			break;
 	}
-	printf("\n");
+	sink_putc(out, '\n');
 }
 
-void print_indian(const struct savegame::indian_relations *ir, int just_this_one)
+void print_indian(struct sink *out, const struct savegame_view *sv, int just_this_one)
 {
-	printf("-- indian --\n");
+	const struct savegame::indian_relations *ir = sv->indian_relations;
+
+	sink_puts(out, "-- indian --\n");
 
 	int start = (just_this_one == -1) ? 0 : just_this_one;
 
 	for (int i = 0; i < 8; ++i) {
-		printf("%-8s:", nation_list[INDIAN_OFFSET + i]);
+		stats_record(STATS_PRINT_INDIAN);
+		sink_printf(out, "%-8s:", nation_list[INDIAN_OFFSET + i]);
 
-		printf(" %02x %02x", ir[i].unk0, ir[i].unk1);
-		printf(" %-12s", indian_level[ ir[i].level ]);
+		sink_printf(out, " %02x %02x", ir[i].unk0, ir[i].unk1);
+		sink_printf(out, " %-12s", indian_level[ ir[i].level ]);
 
-		for (int j = 0; j < sizeof (ir[i].unk2); ++j) {
-			printf(" %02x", ir[i].unk2[j]);
-		}
+		sink_hexdump(out, ir[i].unk2, sizeof (ir[i].unk2), ' ', 1);
 
-		printf(" %2d armed_braves?", ir[i].armed_braves);
-		printf(" %2d horse_herds", ir[i].horse_herds);
+		sink_printf(out, " %2d armed_braves?", ir[i].armed_braves);
+		sink_printf(out, " %2d horse_herds", ir[i].horse_herds);
 
-		for (int j = 0; j < sizeof (ir[i].unk3); ++j) {
-			printf(" %02x", ir[i].unk3[j]);
-		}
+		sink_hexdump(out, ir[i].unk3, sizeof (ir[i].unk3), ' ', 1);
 
-		for (int j = 0; j < sizeof (ir[i].unk4); ++j) {
-			printf(" %02x", ir[i].unk4[j]);
-		}
+		sink_hexdump(out, ir[i].unk4, sizeof (ir[i].unk4), ' ', 1);
 
 		for (int j = 0; j < 4; ++j) {
 			switch (j) {
-				case 0: printf(" eng_met(%02x)", ir[i].meeting[j].met); break;
-				case 1: printf(" fra_met(%02x)", ir[i].meeting[j].met); break;
-				case 2: printf(" spa_met(%02x)", ir[i].meeting[j].met); break;
-				case 3: printf(" dut_met(%02x)", ir[i].meeting[j].met); break;
-				default: printf("ERROR"); break;
+				case 0: sink_printf(out, " eng_met(%02x)", ir[i].meeting[j].met); break;
+				case 1: sink_printf(out, " fra_met(%02x)", ir[i].meeting[j].met); break;
+				case 2: sink_printf(out, " spa_met(%02x)", ir[i].meeting[j].met); break;
+				case 3: sink_printf(out, " dut_met(%02x)", ir[i].meeting[j].met); break;
+				default: sink_puts(out, "ERROR"); break;
 			}
 		}
 
-		for (int j = 0; j < sizeof (ir[i].unk5); ++j) {
-			printf(" %02x", ir[i].unk5[j]);
-		}
+		sink_hexdump(out, ir[i].unk5, sizeof (ir[i].unk5), ' ', 1);
 
 		for (int j = 0; j < 4; ++j) {
 			switch (j) {
-				case 0: printf(" eng_aggr(%3d)", ir[i].aggr[j].aggr); break;
-				case 1: printf(" fra_aggr(%3d)", ir[i].aggr[j].aggr); break;
-				case 2: printf(" spa_aggr(%3d)", ir[i].aggr[j].aggr); break;
-				case 3: printf(" dut_aggr(%3d)", ir[i].aggr[j].aggr); break;
-				default: printf("ERROR"); break;
+				case 0: sink_printf(out, " eng_aggr(%3d)", ir[i].aggr[j].aggr); break;
+				case 1: sink_printf(out, " fra_aggr(%3d)", ir[i].aggr[j].aggr); break;
+				case 2: sink_printf(out, " spa_aggr(%3d)", ir[i].aggr[j].aggr); break;
+				case 3: sink_printf(out, " dut_aggr(%3d)", ir[i].aggr[j].aggr); break;
+				default: sink_puts(out, "ERROR"); break;
 			}
 			assert(ir[i].aggr[j].aggr_high == 0);
 		}
-		printf("\n");
+		sink_putc(out, '\n');
 
-		printf("Stock;\n");
-		for (int j = 0; j < 16; ++j)
-			printf("  %11s: %3d\n", cargo_list[j], ir[i].stock[j]);
-		printf("\n");
+		sink_puts(out, "Stock;\n");
+		for (int j = 0; j < 16; ++j) {
+			sink_puts(out, "  ");
+			sink_str(out, cargo_list[j], 11);
+			sink_puts(out, ": ");
+			sink_dec(out, ir[i].stock[j], 3);
+			sink_putc(out, '\n');
+		}
+		sink_putc(out, '\n');
 
 		if (just_this_one != -1)
 			break;
 	}
 }
 
-void print_stuff(const struct savegame::stuff *stuff)
+void print_stuff( struct sink *out, const struct savegame_view *sv)
 {
-	printf("-- stuff --\n");
+	const struct savegame::stuff *stuff = sv->stuff;
 
-	for (int i = 0; i < sizeof (stuff->unk15); ++i) {
-		printf("%02x ", stuff->unk15[i]);
-	}
-	printf("\n");
+	sink_puts(out, "-- stuff --\n");
+	stats_record(STATS_PRINT_STUFF);
 
-	printf("decreasing_counter: %d\n", stuff->counter_decreasing_on_new_colony);
-	printf("unk_short: %d\n", stuff->unk_short);
-	printf("increasing_counter: %d\n", stuff->counter_increasing_on_new_colony);
+	sink_hexdump(out, stuff->unk15, sizeof (stuff->unk15));
+	sink_putc(out, '\n');
 
-	for (int i = 0; i < sizeof (stuff->unk_big); ++i) {
-		if (i % 16 == 0)
-			printf("\n[0x%03x]", i);
-		printf(" %02x", stuff->unk_big[i]);
+	sink_printf(out, "decreasing_counter: %d\n", stuff->counter_decreasing_on_new_colony);
+	sink_printf(out, "unk_short: %d\n", stuff->unk_short);
+	sink_printf(out, "increasing_counter: %d\n", stuff->counter_increasing_on_new_colony);
+
+	for (int i = 0; i < sizeof (stuff->unk_big); i += 16) {
+		sink_printf(out, "\n[0x%03x]", i);
+		sink_hexdump(out, stuff->unk_big + i, MIN(16, sizeof (stuff->unk_big) - i), ' ', 1);
 	}
-	printf("\n");
+	sink_putc(out, '\n');
 
-	printf("Active unit: (%3d, %3d)\n", stuff->x, stuff->y);
+	sink_printf(out, "Active unit: (%3d, %3d)\n", stuff->x, stuff->y);
 
-	printf("Zoom level: ");
+	sink_puts(out, "Zoom level: ");
 	switch (stuff->zoom_level) {
-		case 0: printf(" 15 x 12"); break;
-		case 1: printf(" 30 x 24"); break;
-		case 2: printf(" 60 x 48"); break;
-		case 3: printf("120 x 96"); break;
+		case 0: sink_puts(out, " 15 x 12"); break;
+		case 1: sink_puts(out, " 30 x 24"); break;
+		case 2: sink_puts(out, " 60 x 48"); break;
+		case 3: sink_puts(out, "120 x 96"); break;
 		default:
-			printf("UNKNOWN: (%02x)", stuff->zoom_level);
+			sink_printf(out, "UNKNOWN: (%02x)", stuff->zoom_level);
 			break;
 	}
-	printf("\n");
+	sink_putc(out, '\n');
 
-	printf("%02x\n", stuff->unk7);
+	sink_printf(out, "%02x\n", stuff->unk7);
 
-	printf("Viewport: (%3d, %3d)\n", stuff->viewport_x, stuff->viewport_y);
+	sink_printf(out, "Viewport: (%3d, %3d)\n", stuff->viewport_x, stuff->viewport_y);
 }
 
-void print_map(const struct savegame::map *map)
+void print_map(   struct sink *out, const struct savegame_view *sv)
 {
-	printf("-- map --\n");
+	struct map_planes mp;
+	map_decode(sv->map, &mp);
+
+	sink_puts(out, "-- map --\n");
+
+	/* "%x" of tile, or tile + 9 for water; water tile 7 prints as "10" */
+	static const char *hex[17] = {
+		"0", "1", "2", "3", "4", "5", "6", "7",
+		"8", "9", "a", "b", "c", "d", "e", "f", "10" };
 
 	for (int i = 0; i < 4; ++i) {
+		stats_record(STATS_PRINT_MAP);
+		char *start = sink_reserve(out, 72 * (58 * 2 + 1) + 1);
+		char *p = start;
 		for (int y = 0; y < 72; ++y) {
-			for (int x = 0; x < 58; ++x)
-				printf("%x", map->layer[i][x + (y * 58)].water ? map->layer[i][x + (y * 58)].tile + 9 : map->layer[i][x + (y * 58)].tile);
-//				printf("%02x(%d)", map->layer[i][x + (y * 58)].full, map->layer[i][x + (y * 58)].tile);
-			printf("\n");
+			for (int x = 0; x < 58; ++x) {
+				const char *h = hex[mp.tile[i][x + (y * 58)] + (map_test(mp.water[i], x + (y * 58)) ? 9 : 0)];
+				*p++ = h[0];
+				if (h[1])
+					*p++ = h[1];
+			}
+//				sink_printf(out, "%02x(%d)", sv->map->layer[i][x + (y * 58)].full, mp.tile[i][x + (y * 58)]);
+			*p++ = '\n';
 		}
-		printf("\n");
+		*p++ = '\n';
+		out->len += p - start;
 	}
 }
 
-void print_tail(const struct savegame::tail *tail)
+void print_terrain(struct sink *out, const struct savegame_view *sv, const char *filename)
 {
-	printf("-- tail --\n");
+	struct map_planes mp;
+	map_decode(sv->map, &mp);
 
-	for (int i = 0; i < sizeof (tail->unk); ++i) {
-		if (i % 20 == 0)
-			printf("\n");
-		printf("%02x ", tail->unk[i]);
+	for (int i = 0; i < 4; ++i) {
+		struct map_stats ms;
+		map_stats(&mp, i, &ms);
+		stats_record(STATS_PRINT_TERRAIN);
+
+		sink_printf(out, "%s: layer %d: land %4d, water %4d, forest %4d, land tiles [",
+			filename, i, ms.land, ms.water, ms.forest);
+		for (int t = 0; t < 8; ++t) {
+			sink_dec(out, ms.tile[0][t], 4);
+			sink_putc(out, (t < 7) ? ' ' : ']');
+		}
+		sink_puts(out, ", water tiles [");
+		for (int t = 0; t < 8; ++t) {
+			sink_dec(out, ms.tile[1][t], 4);
+			sink_putc(out, (t < 7) ? ' ' : ']');
+		}
+		sink_putc(out, '\n');
 	}
-	printf("\n");
 }
 
-void print_route(const struct savegame *sg, const struct savegame::trade_route *route, int just_this_one)
+void print_tail(  struct sink *out, const struct savegame_view *sv)
 {
-	printf("-- trade routes --\n");
+	const struct savegame::tail *tail = sv->tail;
+
+	sink_puts(out, "-- tail --\n");
+	stats_record(STATS_PRINT_TAIL);
+
+	for (int i = 0; i < sizeof (tail->unk); i += 20) {
+		sink_putc(out, '\n');
+		sink_hexdump(out, tail->unk + i, MIN(20, sizeof (tail->unk) - i));
+	}
+	sink_putc(out, '\n');
+}
+
+void print_route( struct sink *out, const struct savegame_view *sv, int just_this_one)
+{
+	const struct savegame::trade_route *route = sv->trade_route;
+
+	sink_puts(out, "-- trade routes --\n");
 
 	int start = (just_this_one == -1) ? 0 : just_this_one;
 
-	for (int i = start; i < sg->head.trade_route_count; ++i) {
-		printf("%-31s, type: %4s, entries: %d\n",
+	for (int i = start; i < sv->head->trade_route_count; ++i) {
+		stats_record(STATS_PRINT_ROUTE);
+		sink_printf(out, "%-31s, type: %4s, entries: %d\n",
 			route[i].name, route[i].type ? "sea" : "land",
 			route[i].entries);
 
 		for (int j = 0; j < route[i].entries; ++j) {
-			printf("%d. %-24s",
-				j, sg->colony[ route[i].entry[j].destination ].name);
+			sink_printf(out, "%d. %-24s",
+				j, sv->colony[ route[i].entry[j].destination ].name);
 
 			/* stupid string concatenation "trick" */
-			printf(" | unloading: %d, [%s%s%s%s%s%s%s%s%s%s%s]",
+			sink_printf(out, " | unloading: %d, [%s%s%s%s%s%s%s%s%s%s%s]",
 				route[i].entry[j].unloading_size,
 				(route[i].entry[j].unloading_size > 0) ? cargo_list[ route[i].entry[j].cargo[1].item_0 ] : "",
 				(route[i].entry[j].unloading_size > 1) ? ", " : "",
@@ -1147,7 +2256,7 @@ void print_route(const struct savegame *sg, const struct savegame::trade_route *
 				(route[i].entry[j].unloading_size > 5) ? ", " : "",
 				(route[i].entry[j].unloading_size > 5) ? cargo_list[ route[i].entry[j].cargo[1].item_5 ] : "");
 
-			printf(" | loading: %d, [%s%s%s%s%s%s%s%s%s%s%s]",
+			sink_printf(out, " | loading: %d, [%s%s%s%s%s%s%s%s%s%s%s]",
 				route[i].entry[j].loading_size,
 				(route[i].entry[j].loading_size > 0) ? cargo_list[ route[i].entry[j].cargo[0].item_0 ] : "",
 				(route[i].entry[j].loading_size > 1) ? ", " : "",
@@ -1160,17 +2269,543 @@ void print_route(const struct savegame *sg, const struct savegame::trade_route *
 				(route[i].entry[j].loading_size > 4) ? cargo_list[ route[i].entry[j].cargo[0].item_4 ] : "",
 				(route[i].entry[j].loading_size > 5) ? ", " : "",
 				(route[i].entry[j].loading_size > 5) ? cargo_list[ route[i].entry[j].cargo[0].item_5 ] : "");
-			printf("\n");
+			sink_putc(out, '\n');
 
 			/* If this doesn't go unused, I'd like to know about it. */
 			assert(route[i].entry[j].padding == 0);
 		}
-		printf("\n");
+		sink_putc(out, '\n');
 
 		if (just_this_one != -1)
 			break;
 	}
-	printf("\n");
+	sink_putc(out, '\n');
+}
+
+/* One line naming record i of kind */
+static void print_occupant(struct sink *out, const struct savegame_view *sv, enum spatial_kind kind, int i)
+{
+	const uint8_t *xy;
+	const char *name, *owner;
+
+	switch (kind) {
+		case SPATIAL_UNIT:
+			xy = &sv->unit[i].x;
+			name = sv->unit[i].type < COUNT_OF(unit_type_list) ? unit_type_list[sv->unit[i].type] : "?";
+			owner = sv->unit[i].owner < COUNT_OF(nation_list) ? nation_list[sv->unit[i].owner] : "?";
+			break;
+		case SPATIAL_COLONY:
+			xy = &sv->colony[i].x;
+			name = sv->colony[i].name;
+			owner = sv->colony[i].nation < COUNT_OF(nation_list) ? nation_list[sv->colony[i].nation] : "?";
+			break;
+		default:
+			xy = &sv->tribe[i].x;
+			name = "Village";
+			owner = sv->tribe[i].nation < COUNT_OF(nation_list) ? nation_list[sv->tribe[i].nation] : "?";
+			break;
+	}
+
+	sink_str(out, spatial_kind_name[kind], -6);
+	sink_puts(out, " ["); sink_dec(out, i, 3);
+	sink_puts(out, "] ("); sink_dec(out, xy[0], 3);
+	sink_puts(out, ", ");  sink_dec(out, xy[1], 3);
+	sink_puts(out, "): "); sink_str(out, name, -24);
+	sink_putc(out, ' ');   sink_puts(out, owner);
+	sink_putc(out, '\n');
+}
+
+void print_at(struct sink *out, const struct savegame_view *sv, const struct spatial_index *si, int x, int y, int r)
+{
+	static __thread uint16_t *found;
+	static __thread int found_cap;
+
+	sink_printf(out, "-- at (%d, %d) within %d --\n", x, y, r);
+
+	for (int k = 0; k < SPATIAL_KINDS; ++k) {
+		if (found_cap < si->count[k]) {
+			found_cap = si->count[k];
+			found = (uint16_t *) realloc(found, sizeof (uint16_t) * found_cap);
+			stats_allocs(1);
+		}
+		int n = spatial_near(si, (enum spatial_kind) k, x, y, r, found);
+		for (int j = 0; j < n; ++j) {
+			stats_record(STATS_PRINT_AT);
+			print_occupant(out, sv, (enum spatial_kind) k, found[j]);
+		}
+	}
+	sink_putc(out, '\n');
+}
+
+void print_near(struct sink *out, const struct savegame_view *sv, const struct spatial_index *si, int r)
+{
+	static __thread uint16_t *found;
+	static __thread int found_cap;
+
+	if (found_cap < si->count[SPATIAL_UNIT]) {
+		found_cap = si->count[SPATIAL_UNIT];
+		found = (uint16_t *) realloc(found, sizeof (uint16_t) * found_cap);
+		stats_allocs(1);
+	}
+
+	sink_printf(out, "-- near %d --\n", r);
+
+	for (int i = 0; i < sv->head->colony_count; ++i) {
+		const struct savegame::colony *colony = &sv->colony[i];
+		int n = spatial_near(si, SPATIAL_UNIT, colony->x, colony->y, r, found);
+
+		stats_record(STATS_PRINT_NEAR);
+		print_occupant(out, sv, SPATIAL_COLONY, i);
+		sink_puts(out, "\tunits: "); sink_dec(out, n);
+
+		int d, t = spatial_nearest(si, SPATIAL_TRIBE, colony->x, colony->y, -1, &d);
+		if (t != -1) {
+			sink_puts(out, ", nearest tribe: ["); sink_dec(out, t, 3);
+			sink_puts(out, "] ");
+			sink_puts(out, sv->tribe[t].nation < COUNT_OF(nation_list) ? nation_list[sv->tribe[t].nation] : "?");
+			sink_puts(out, " at "); sink_dec(out, d);
+		}
+
+		int c = spatial_nearest(si, SPATIAL_COLONY, colony->x, colony->y, i, &d);
+		if (c != -1) {
+			sink_puts(out, ", nearest colony: ["); sink_dec(out, c, 3);
+			sink_puts(out, "] "); sink_puts(out, sv->colony[c].name);
+			sink_puts(out, " at "); sink_dec(out, d);
+		}
+		sink_putc(out, '\n');
+
+		for (int j = 0; j < n; ++j) {
+			sink_putc(out, '\t');
+			print_occupant(out, sv, SPATIAL_UNIT, found[j]);
+		}
+	}
+	sink_putc(out, '\n');
+}
+
+static void print_goods(struct sink *out, const struct savegame::unit *u)
+{
+	const uint8_t cargo_item[6] = {
+		u->cargo_item_0, u->cargo_item_1, u->cargo_item_2,
+		u->cargo_item_3, u->cargo_item_4, u->cargo_item_5 };
+
+	for (int j = 0; j < u->holds_occupied && j < 6; ++j) {
+		sink_puts(out, ", ");
+		sink_puts(out, cargo_list[cargo_item[j]]);
+		sink_putc(out, ':');
+		sink_dec(out, u->cargo_hold[j]);
+	}
+}
+
+void print_manifest(struct sink *out, const struct savegame_view *sv)
+{
+	static __thread struct transport tr;
+	const struct savegame::unit *unit = sv->unit;
+
+	transport_resolve(&tr, sv);
+
+	sink_puts(out, "-- manifest --\n");
+
+	for (int nation = 0; nation < 12; ++nation) {
+		int printed = 0;
+
+		for (int s = 0; s < tr.count; ++s) {
+			if (!(tr.flags[s] & TRANSPORT_SHIP) || unit[s].owner != nation)
+				continue;
+
+			if (!printed++) {
+				sink_puts(out, nation_list[nation]);
+				sink_putc(out, '\n');
+			}
+
+			stats_record(STATS_PRINT_MANIFEST);
+			sink_putc(out, '[');   sink_dec(out, s, 3);
+			sink_puts(out, "] ("); sink_dec(out, unit[s].x, 3);
+			sink_puts(out, ", ");  sink_dec(out, unit[s].y, 3);
+			sink_puts(out, "): "); sink_str(out, unit_type_list[unit[s].type], -12);
+			sink_puts(out, " units: "); sink_dec(out, tr.cargo_start[s + 1] - tr.cargo_start[s]);
+			print_goods(out, &unit[s]);
+			sink_putc(out, '\n');
+
+			for (int k = tr.cargo_start[s]; k < tr.cargo_start[s + 1]; ++k) {
+				int j = tr.cargo[k];
+				sink_puts(out, "\t[");  sink_dec(out, j, 3);
+				sink_puts(out, "] ");
+				if (unit[j].type == 10) { // savegame::unit::TREASURE
+					sink_puts(out, "Treasure "); sink_dec(out, unit[j].profession);
+					sink_puts(out, "00 gold");
+				} else {
+					sink_puts(out, unit_type_list[unit[j].type]);
+				}
+				print_goods(out, &unit[j]);
+				sink_putc(out, '\n');
+			}
+		}
+	}
+
+	sink_printf(out, "chains: %d, longest: %d, dangling links: %d, one-way links: %d, cycles: %d\n",
+		tr.chain_count, tr.longest, tr.dangling, tr.one_way, tr.cycles);
+
+	for (int i = 0; i < tr.count; ++i) {
+		if (!(tr.flags[i] & (TRANSPORT_DANGLING | TRANSPORT_ONE_WAY | TRANSPORT_CYCLE)))
+			continue;
+		sink_putc(out, '[');  sink_dec(out, i, 3);
+		sink_puts(out, "] next "); sink_dec(out, unit[i].transport_chain.next_unit_idx, 3);
+		sink_puts(out, " prev ");  sink_dec(out, unit[i].transport_chain.prev_unit_idx, 3);
+		sink_puts(out, (tr.flags[i] & TRANSPORT_DANGLING) ? " dangling" : "");
+		sink_puts(out, (tr.flags[i] & TRANSPORT_ONE_WAY)  ? " one-way"  : "");
+		sink_puts(out, (tr.flags[i] & TRANSPORT_CYCLE)    ? " cycle"    : "");
+		sink_putc(out, '\n');
+	}
+	sink_putc(out, '\n');
+}
+
+/*
+ * One line for the whole save: per nation its colonies, population,
+ * hammers and rebels, then each cargo it has as warehouses+holds
+ */
+void print_totals(struct sink *out, const struct savegame_view *sv, const char *filename)
+{
+	struct totals t;
+	int printed = 0;
+
+	totals_compute(sv, &t);
+
+	sink_puts(out, filename);
+	sink_putc(out, ':');
+
+	for (int nation = 0; nation < TOTALS_NATIONS; ++nation) {
+		int goods = 0;
+		for (int k = 0; k < TOTALS_CARGO; ++k)
+			goods |= t.stock[nation][k] | t.hold[nation][k];
+		if (!t.colonies[nation] && !goods)
+			continue;
+
+		stats_record(STATS_PRINT_TOTALS);
+		sink_puts(out, printed++ ? "; " : " ");
+		sink_puts(out, nation_list[nation]);
+		sink_puts(out, " colonies ");   sink_dec(out, t.colonies[nation]);
+		sink_puts(out, ", population "); sink_dec(out, t.population[nation]);
+		sink_puts(out, ", hammers ");   sink_dec(out, t.hammers[nation]);
+		sink_puts(out, ", rebels ");    sink_dec(out, totals_rebel_percent(&t, nation));
+		sink_putc(out, '%');
+
+		for (int k = 0; k < TOTALS_CARGO; ++k) {
+			if (!t.stock[nation][k] && !t.hold[nation][k])
+				continue;
+			sink_puts(out, ", ");
+			sink_puts(out, cargo_list[k]);
+			sink_putc(out, ' ');
+			sink_dec(out, t.stock[nation][k]);
+			if (t.hold[nation][k]) {
+				sink_putc(out, '+');
+				sink_dec(out, t.hold[nation][k]);
+			}
+		}
+	}
+
+	sink_puts(out, printed ? "\n" : " no colonies or goods\n");
+}
+
+/* --totals as one object per nation with colonies or goods */
+static void ndjson_totals(struct sink *out, const struct savegame_view *sv, const char *filename)
+{
+	struct totals t;
+
+	totals_compute(sv, &t);
+
+	for (int nation = 0; nation < TOTALS_NATIONS; ++nation) {
+		int goods = 0;
+		for (int k = 0; k < TOTALS_CARGO; ++k)
+			goods |= t.stock[nation][k] | t.hold[nation][k];
+		if (!t.colonies[nation] && !goods)
+			continue;
+
+		stats_record(STATS_PRINT_NDJSON);
+		sink_puts(out, "{\"file\":"); ndjson_file(out, filename);
+		sink_puts(out, ",\"section\":\"totals\",\"nation\":"); sink_dec(out, nation);
+		sink_puts(out, ",\"nation_name\":\""); sink_puts(out, nation_list[nation]);
+		sink_puts(out, "\",\"colonies\":");   sink_dec(out, t.colonies[nation]);
+		sink_puts(out, ",\"population\":"); sink_dec(out, t.population[nation]);
+		sink_puts(out, ",\"hammers\":");    sink_dec(out, t.hammers[nation]);
+		sink_puts(out, ",\"rebels\":");     sink_dec(out, totals_rebel_percent(&t, nation));
+		sink_puts(out, ",\"stock\":[");
+		for (int k = 0; k < TOTALS_CARGO; ++k) {
+			if (k)
+				sink_putc(out, ',');
+			sink_dec(out, t.stock[nation][k]);
+		}
+		sink_puts(out, "],\"hold\":[");
+		for (int k = 0; k < TOTALS_CARGO; ++k) {
+			if (k)
+				sink_putc(out, ',');
+			sink_dec(out, t.hold[nation][k]);
+		}
+		sink_puts(out, "]}\n");
+	}
+}
+
+/*
+ * A line per nation and tribe with colonies or villages on the map: the
+ * tiles nearest to them, over land and over water, how many of those
+ * border someone else's, and the farthest; then the ties and the rest
+ */
+void print_territory(struct sink *out, const struct savegame_view *sv, const char *filename)
+{
+	static __thread struct territory t;
+
+	territory_compute(sv, &t);
+
+	for (int o = 0; o < TERRITORY_OWNERS; ++o) {
+		if (!t.sources[o])
+			continue;
+
+		stats_record(STATS_PRINT_TERRITORY);
+		sink_puts(out, filename);
+		sink_puts(out, ": ");
+		sink_str(out, nation_list[o], -12);
+		sink_puts(out, o < TERRITORY_EUROPEANS ? " colonies " : " villages ");
+		sink_dec(out, t.sources[o], 3);
+		sink_puts(out, ", land ");     sink_dec(out, t.land[o], 4);
+		sink_puts(out, ", sea ");      sink_dec(out, t.sea[o], 4);
+		sink_puts(out, ", frontier "); sink_dec(out, t.frontier_tiles[o], 4);
+		sink_puts(out, ", farthest "); sink_dec(out, t.farthest[o], 3);
+		sink_putc(out, '\n');
+	}
+
+	sink_puts(out, filename);
+	sink_puts(out, ": contested ");
+	sink_dec(out, t.contested_tiles);
+	sink_puts(out, ", unreached ");
+	sink_dec(out, t.unreached);
+	sink_putc(out, '\n');
+}
+
+/*
+ * --territory as an object per owner with colonies or villages, with each
+ * tile's distance to the nearest of them (-1 for none), and one for the
+ * contested and unreached tiles
+ */
+static void ndjson_territory(struct sink *out, const struct savegame_view *sv, const char *filename)
+{
+	static __thread struct territory t;
+
+	territory_compute(sv, &t);
+
+	for (int o = 0; o < TERRITORY_OWNERS; ++o) {
+		if (!t.sources[o])
+			continue;
+
+		stats_record(STATS_PRINT_NDJSON);
+		sink_puts(out, "{\"file\":"); ndjson_file(out, filename);
+		sink_puts(out, ",\"section\":\"territory\",\"nation\":"); sink_dec(out, o);
+		sink_puts(out, ",\"nation_name\":\""); sink_puts(out, nation_list[o]);
+		sink_puts(out, "\",\"sources\":");  sink_dec(out, t.sources[o]);
+		sink_puts(out, ",\"land\":");       sink_dec(out, t.land[o]);
+		sink_puts(out, ",\"sea\":");        sink_dec(out, t.sea[o]);
+		sink_puts(out, ",\"frontier\":");   sink_dec(out, t.frontier_tiles[o]);
+		sink_puts(out, ",\"farthest\":");   sink_dec(out, t.farthest[o]);
+		sink_puts(out, ",\"width\":");      sink_dec(out, MAP_WIDTH);
+		sink_puts(out, ",\"distance\":[");
+		for (int i = 0; i < MAP_TILES; ++i) {
+			if (i)
+				sink_putc(out, ',');
+			sink_dec(out, t.dist[o][i] == TERRITORY_FAR ? -1 : t.dist[o][i]);
+		}
+		sink_puts(out, "]}\n");
+	}
+
+	stats_record(STATS_PRINT_NDJSON);
+	sink_puts(out, "{\"file\":"); ndjson_file(out, filename);
+	sink_puts(out, ",\"section\":\"territory\",\"contested\":"); sink_dec(out, t.contested_tiles);
+	sink_puts(out, ",\"unreached\":"); sink_dec(out, t.unreached);
+	sink_puts(out, "}\n");
+}
+
+/* How a --path query came out */
+enum path_outcome { PATH_FOUND, PATH_NO_UNIT, PATH_NO_COLONY, PATH_OFF_MAP, PATH_NO_PATH };
+
+static const char *path_outcome_name[] = { "found", "no such unit", "no such colony", "not on the map", "no path" };
+
+/*
+ * The k-th --path pair: pairs[2 k], pairs[2 k + 1], or with no pairs the
+ * k-th unit and colony of the same European nation. Returns 0 when past
+ * the last one, -1 for one to skip.
+ */
+static int path_pair(const struct savegame_view *sv, const int *pairs, int count, int k, int *unit, int *colony)
+{
+	if (pairs) {
+		if (k >= count)
+			return 0;
+		*unit = pairs[2 * k];
+		*colony = pairs[2 * k + 1];
+		return 1;
+	}
+
+	int colonies = sv->head->colony_count;
+	if (!colonies || k >= sv->head->unit_count * colonies)
+		return 0;
+	*unit = k / colonies;
+	*colony = k % colonies;
+	return (sv->unit[*unit].owner < 4 && sv->unit[*unit].owner == sv->colony[*colony].nation) ? 1 : -1;
+}
+
+static enum path_outcome path_query(const struct savegame_view *sv, const struct path_map *pm, int unit, int colony,
+                                    struct path_route *route, int *turns)
+{
+	if (unit >= sv->head->unit_count)
+		return PATH_NO_UNIT;
+	if (colony >= sv->head->colony_count)
+		return PATH_NO_COLONY;
+
+	const struct savegame::unit *u = &sv->unit[unit];
+	const struct savegame::colony *c = &sv->colony[colony];
+	if (u->x >= MAP_WIDTH || u->y >= MAP_HEIGHT || c->x >= MAP_WIDTH || c->y >= MAP_HEIGHT)
+		return PATH_OFF_MAP;
+
+	if (path_find(pm, path_unit_domain(u->type), u->x + u->y * MAP_WIDTH, c->x + c->y * MAP_WIDTH, route) == -1)
+		return PATH_NO_PATH;
+	*turns = path_turns(route, path_unit_movement(u->type), u->moves);
+	return PATH_FOUND;
+}
+
+/*
+ * A line per --path pair: the turns the unit needs to reach the colony,
+ * counting the moves it has used this turn, and the moves and tiles of
+ * the way there
+ */
+void print_path(struct sink *out, const struct savegame_view *sv, const char *filename, const int *pairs, int count)
+{
+	static __thread struct path_route route;
+	const struct path_map *pm = path_map_get(sv);
+	int unit, colony, turns, res;
+
+	for (int k = 0; (res = path_pair(sv, pairs, count, k, &unit, &colony)); ++k) {
+		if (res == -1)
+			continue;
+
+		enum path_outcome o = path_query(sv, pm, unit, colony, &route, &turns);
+
+		stats_record(STATS_PRINT_PATH);
+		sink_puts(out, filename);
+		sink_puts(out, ": unit ");
+		sink_dec(out, unit, 3);
+		if (o != PATH_NO_UNIT) {
+			const struct savegame::unit *u = &sv->unit[unit];
+			sink_putc(out, ' ');
+			sink_str(out, u->type < COUNT_OF(unit_type_list) ? unit_type_list[u->type] : "?", -19);
+			sink_puts(out, " ("); sink_dec(out, u->x, 3);
+			sink_puts(out, ", "); sink_dec(out, u->y, 3);
+			sink_putc(out, ')');
+		}
+		sink_puts(out, " to colony ");
+		sink_dec(out, colony, 3);
+		if (o != PATH_NO_UNIT && o != PATH_NO_COLONY) {
+			const struct savegame::colony *c = &sv->colony[colony];
+			sink_putc(out, ' ');
+			sink_str(out, c->name, -24);
+			sink_puts(out, " ("); sink_dec(out, c->x, 3);
+			sink_puts(out, ", "); sink_dec(out, c->y, 3);
+			sink_putc(out, ')');
+		}
+		sink_puts(out, ": ");
+		if (o == PATH_FOUND) {
+			sink_dec(out, turns);
+			sink_puts(out, turns == 1 ? " turn, " : " turns, ");
+			sink_dec(out, route.cost);
+			sink_puts(out, " moves, ");
+			sink_dec(out, route.steps);
+			sink_puts(out, " tiles");
+		} else {
+			sink_puts(out, path_outcome_name[o]);
+		}
+		sink_putc(out, '\n');
+	}
+}
+
+/* --path as an object per pair, with "turns", "moves" and "tiles" or "error" */
+static void ndjson_path(struct sink *out, const struct savegame_view *sv, const char *filename, const int *pairs, int count)
+{
+	static __thread struct path_route route;
+	const struct path_map *pm = path_map_get(sv);
+	int unit, colony, turns, res;
+
+	for (int k = 0; (res = path_pair(sv, pairs, count, k, &unit, &colony)); ++k) {
+		if (res == -1)
+			continue;
+
+		enum path_outcome o = path_query(sv, pm, unit, colony, &route, &turns);
+
+		stats_record(STATS_PRINT_NDJSON);
+		sink_puts(out, "{\"file\":"); ndjson_file(out, filename);
+		sink_puts(out, ",\"section\":\"path\",\"unit\":"); sink_dec(out, unit);
+		sink_puts(out, ",\"colony\":"); sink_dec(out, colony);
+		if (o == PATH_FOUND) {
+			sink_puts(out, ",\"domain\":\"");
+			sink_puts(out, path_unit_domain(sv->unit[unit].type) == PATH_SEA ? "sea" : "land");
+			sink_puts(out, "\",\"turns\":"); sink_dec(out, turns);
+			sink_puts(out, ",\"moves\":");   sink_dec(out, route.cost);
+			sink_puts(out, ",\"tiles\":");   sink_dec(out, route.steps);
+		} else {
+			sink_puts(out, ",\"error\":\""); sink_puts(out, path_outcome_name[o]);
+			sink_putc(out, '"');
+		}
+		sink_puts(out, "}\n");
+	}
+}
+
+/* Records of a section as NDJSON, as selected by its opt_ flag and --where mask */
+template <typename T>
+static void ndjson_section(struct sink *out, const char *filename, const T *records, int count, int opt, const uint8_t *mask = NULL)
+{
+	int first = (opt == -1) ? 0 : opt - 1;
+	int last  = (opt == -1) ? count : MIN(opt, count);
+
+	for (int i = first; i < last; ++i) {
+		if (!mask || mask[i]) {
+			stats_record(STATS_PRINT_NDJSON);
+			ndjson_record(out, filename, &fields_of<T>::table, i, &records[i]);
+		}
+	}
+}
+
+void print_ndjson(struct sink *out, const struct print_options *o, const struct savegame_view *sv, const char *filename, uint8_t *const *mask)
+{
+	const struct savegame::head *head = sv->head;
+
+	if (o->head)
+		ndjson_section(out, filename, head, 1, -1);
+	if (o->player)
+		ndjson_section(out, filename, sv->player, 4, o->player);
+	if (o->other)
+		ndjson_section(out, filename, sv->other, 1, -1);
+	if (o->colony)
+		ndjson_section(out, filename, sv->colony, head->colony_count, o->colony, mask && o->where[1] ? mask[1] : NULL);
+	if (o->unit)
+		ndjson_section(out, filename, sv->unit, head->unit_count, o->unit, mask && o->where[0] ? mask[0] : NULL);
+	if (o->nation)
+		ndjson_section(out, filename, sv->nation, 4, o->nation, mask && o->where[3] ? mask[3] : NULL);
+	if (o->tribe)
+		ndjson_section(out, filename, sv->tribe, head->tribe_count, o->tribe, mask && o->where[2] ? mask[2] : NULL);
+	if (o->indian)
+		ndjson_section(out, filename, sv->indian_relations, 8, o->indian);
+	if (o->stuff)
+		ndjson_section(out, filename, sv->stuff, 1, -1);
+	if (o->tail)
+		ndjson_section(out, filename, sv->tail, 1, -1);
+	if (o->route) {
+		int first = (o->route == -1) ? 0 : o->route - 1;
+		int last  = (o->route == -1) ? head->trade_route_count : MIN(o->route, 12);
+		for (int i = first; i < last && i < 12; ++i) {
+			stats_record(STATS_PRINT_NDJSON);
+			ndjson_route(out, filename, i, &sv->trade_route[i]);
+		}
+	}
+	if (o->totals)
+		ndjson_totals(out, sv, filename);
+	if (o->territory)
+		ndjson_territory(out, sv, filename);
+	if (o->path)
+		ndjson_path(out, sv, filename, o->path_pairs, o->path_pair_count);
 }
 
 void dump(void *address, size_t bytes, const char *filename)
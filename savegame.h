@@ -1,3 +1,6 @@
+#ifndef SAVEGAME_H
+#define SAVEGAME_H
+
 #include <stdint.h>
 
 static const char *unit_type_list[] {
@@ -483,3 +486,40 @@ struct savegame {
 		} __attribute__ ((packed)) entry[4];
 	} __attribute__ ((packed)) trade_route[12];
 } __attribute__ ((packed));
+
+/* The sizes of the records in the file */
+static_assert(sizeof (struct savegame::head)        == 158, "savegame::head");
+static_assert(sizeof (struct savegame::player)      ==  52, "savegame::player");
+static_assert(sizeof (struct savegame::colony)      == 202, "savegame::colony");
+static_assert(sizeof (struct savegame::unit)        ==  28, "savegame::unit");
+static_assert(sizeof (struct savegame::nation)      == 316, "savegame::nation");
+static_assert(sizeof (struct savegame::tribe)       ==  18, "savegame::tribe");
+static_assert(sizeof (struct savegame::stuff)       == 727, "savegame::stuff");
+static_assert(sizeof (struct savegame::map)         == 58*72*4, "savegame::map");
+static_assert(sizeof (struct savegame::trade_route) ==  74, "savegame::trade_route");
+
+/*
+ * Read-only view of a savegame file. The section pointers point straight
+ * into the file mapping, or into a buffer holding just the sections that
+ * were asked for. See loader.h.
+ */
+struct savegame_view {
+	struct savegame::head             *head;
+	struct savegame::player           *player;           // [4]
+	struct savegame::other            *other;
+	struct savegame::colony           *colony;           // [head->colony_count]
+	struct savegame::unit             *unit;             // [head->unit_count]
+	struct savegame::nation           *nation;           // [4]
+	struct savegame::tribe            *tribe;            // [head->tribe_count]
+	struct savegame::indian_relations *indian_relations; // [8]
+	struct savegame::stuff            *stuff;
+	struct savegame::map              *map;
+	struct savegame::tail             *tail;
+	struct savegame::trade_route      *trade_route;      // [12]
+
+	void  *base;
+	size_t size;
+	int    mapped; // base is a file mapping, rather than a read buffer
+};
+
+#endif
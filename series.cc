@@ -0,0 +1,407 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "loader.h"
+#include "savegame.h"
+#include "series.h"
+
+/*
+ * File layout, native byte order: struct series_header, then the points
+ * back to back in the order they were added. A point cut short by a crash
+ * during an append is dropped by the next one.
+ */
+
+#define SERIES_MAGIC "viceroy-series 1\n"
+
+#define SERIES_NATIONS 4
+#define SERIES_GOODS   16
+
+struct series_header {
+	char magic[24];
+	uint32_t point_size; // sizeof (struct series_point), for telling versions apart
+	uint32_t unused;
+};
+
+struct series_good {
+	int32_t gold;
+	int32_t tons;
+	int32_t tons2;
+	uint8_t price;
+} __attribute__ ((packed));
+
+struct series_nation {
+	uint32_t gold;
+	uint16_t crosses;
+	uint16_t liberty_bells;
+	uint8_t tax_rate;
+	struct series_good good[SERIES_GOODS];
+} __attribute__ ((packed));
+
+struct series_point {
+	uint16_t year;
+	uint16_t turn;
+	uint8_t autumn;
+	struct series_nation nation[SERIES_NATIONS];
+} __attribute__ ((packed));
+
+static void series_point_from(struct series_point *p, const struct savegame_view *sv)
+{
+	memset(p, 0, sizeof (*p));
+	p->year = sv->head->year;
+	p->turn = sv->head->turn;
+	p->autumn = sv->head->autumn != 0;
+
+	for (int i = 0; i < SERIES_NATIONS; ++i) {
+		const struct savegame::nation *n = &sv->nation[i];
+		struct series_nation *sn = &p->nation[i];
+
+		sn->gold = n->gold;
+		sn->crosses = n->crosses;
+		sn->liberty_bells = n->liberty_bells_total;
+		sn->tax_rate = n->tax_rate;
+		for (int k = 0; k < SERIES_GOODS; ++k) {
+			sn->good[k].price = n->trade.euro_price[k];
+			sn->good[k].gold = n->trade.gold[k];
+			sn->good[k].tons = n->trade.tons[k];
+			sn->good[k].tons2 = n->trade.tons2[k];
+		}
+	}
+}
+
+/* By date, then by the order they were added in */
+static const struct series_point *sort_points;
+
+static int compare_points(const void *a, const void *b)
+{
+	uint32_t i = *(const uint32_t *) a, j = *(const uint32_t *) b;
+	const struct series_point *x = &sort_points[i], *y = &sort_points[j];
+
+	if (x->year != y->year)
+		return x->year < y->year ? -1 : 1;
+	if (x->autumn != y->autumn)
+		return x->autumn < y->autumn ? -1 : 1;
+	if (x->turn != y->turn)
+		return x->turn < y->turn ? -1 : 1;
+	return (i > j) - (i < j);
+}
+
+static int same_date(const struct series_point *x, const struct series_point *y)
+{
+	return x->year == y->year && x->autumn == y->autumn && x->turn == y->turn;
+}
+
+/* Checks the header of the series open as fd, size bytes long. Returns the number of whole points, or -1 */
+static long series_check(int fd, size_t size)
+{
+	struct series_header h;
+
+	if (size < sizeof (h) || pread(fd, &h, sizeof (h), 0) != (ssize_t) sizeof (h) ||
+	    memcmp(h.magic, SERIES_MAGIC, sizeof (SERIES_MAGIC) - 1) != 0 || h.point_size != sizeof (struct series_point))
+		return -1;
+	return (size - sizeof (h)) / sizeof (struct series_point);
+}
+
+/*
+ * Adding
+ */
+
+/* Open addressing over point indexes + 1, by content */
+struct point_set {
+	uint32_t *slot;
+	size_t mask;
+};
+
+/* Returns 1 if points[i] was already in the set, after adding it if not */
+static int point_set_add(struct point_set *set, const struct series_point *points, uint32_t i)
+{
+	size_t h = content_hash(&points[i], sizeof (struct series_point)) & set->mask;
+
+	for (; set->slot[h]; h = (h + 1) & set->mask)
+		if (memcmp(&points[set->slot[h] - 1], &points[i], sizeof (struct series_point)) == 0)
+			return 1;
+	set->slot[h] = i + 1;
+	return 0;
+}
+
+int series_add(const char *path, int count, char **files)
+{
+	int fd = open(path, O_RDWR | O_CREAT, 0666);
+	if (fd == -1) {
+		fprintf(stderr, "Could not open series %s: %s\n", path, strerror(errno));
+		return -1;
+	}
+
+	struct stat st;
+	if (fstat(fd, &st) == -1) {
+		fprintf(stderr, "Could not open series %s: %s\n", path, strerror(errno));
+		close(fd);
+		return -1;
+	}
+
+	long have = 0;
+	if (st.st_size == 0) {
+		struct series_header h;
+		memset(&h, 0, sizeof (h));
+		memcpy(h.magic, SERIES_MAGIC, sizeof (SERIES_MAGIC) - 1);
+		h.point_size = sizeof (struct series_point);
+		if (pwrite(fd, &h, sizeof (h), 0) != (ssize_t) sizeof (h)) {
+			fprintf(stderr, "Could not write %s: %s\n", path, strerror(errno));
+			close(fd);
+			return -1;
+		}
+	} else if ((have = series_check(fd, st.st_size)) == -1) {
+		fprintf(stderr, "Not a series, or a different version: %s\n", path);
+		close(fd);
+		return -1;
+	}
+	off_t end = sizeof (struct series_header) + have * sizeof (struct series_point);
+
+	/* The points already there, then the new ones */
+	size_t cap = have + count;
+	struct series_point *point = (struct series_point *) malloc(sizeof (struct series_point) * (cap ? cap : 1));
+	if (have && pread(fd, point, have * sizeof (struct series_point), sizeof (struct series_header)) != (ssize_t) (have * sizeof (struct series_point))) {
+		fprintf(stderr, "Could not read %s: %s\n", path, strerror(errno));
+		free(point);
+		close(fd);
+		return -1;
+	}
+
+	struct savegame_select sel;
+	savegame_select_none(&sel);
+	sel.sections = SECTION_BIT(SECTION_NATION);
+	struct savegame_buffer buf = { NULL, 0 };
+
+	uint32_t n = have;
+	for (int i = 0; i < count; ++i) {
+		struct savegame_view sv;
+		if (savegame_read(files[i], &sv, &sel, &buf) == -1) {
+			fprintf(stderr, "Skipping %s: %s\n", files[i], (errno == EINVAL) ? "truncated savegame" : strerror(errno));
+			continue;
+		}
+		series_point_from(&point[n++], &sv);
+		savegame_close(&sv);
+	}
+	free(buf.data);
+
+	/* The new points by date, less any the series (or an earlier file) already has */
+	uint32_t *order = (uint32_t *) malloc(sizeof (uint32_t) * (n - have ? n - have : 1));
+	for (uint32_t i = have; i < n; ++i)
+		order[i - have] = i;
+	sort_points = point;
+	qsort(order, n - have, sizeof (uint32_t), compare_points);
+
+	struct point_set set;
+	for (set.mask = 1023; set.mask < 2 * (size_t) n; set.mask = 2 * set.mask + 1)
+		;
+	set.slot = (uint32_t *) calloc(set.mask + 1, sizeof (uint32_t));
+	for (uint32_t i = 0; i < have; ++i)
+		point_set_add(&set, point, i);
+
+	struct sink out;
+	sink_init(&out, -1);
+	int added = 0;
+	for (uint32_t i = 0; i < n - have; ++i) {
+		if (point_set_add(&set, point, order[i]))
+			continue;
+		sink_write(&out, &point[order[i]], sizeof (struct series_point));
+		++added;
+	}
+
+	/* One write, over a torn point if there was one */
+	int res = 0;
+	if (ftruncate(fd, end) == -1 || pwrite(fd, out.buf, out.len, end) != (ssize_t) out.len) {
+		fprintf(stderr, "Could not write %s: %s\n", path, strerror(errno));
+		res = -1;
+	} else {
+		printf("%d points added, %ld in all, %zu bytes\n", added, have + added, (size_t) end + out.len);
+	}
+
+	sink_free(&out);
+	free(set.slot);
+	free(order);
+	free(point);
+	close(fd);
+	return res;
+}
+
+/*
+ * Printing
+ */
+
+typedef int64_t (*metric_fn)(const struct series_nation *n, int good);
+
+struct metric {
+	const char *name;
+	metric_fn get;
+};
+
+#define METRIC(name, expr) \
+	static int64_t name##_get(const struct series_nation *n, int good) { (void) good; return (expr); }
+
+METRIC(tax_rate,      n->tax_rate)
+METRIC(nation_gold,   n->gold)
+METRIC(crosses,       n->crosses)
+METRIC(liberty_bells, n->liberty_bells)
+METRIC(price,         n->good[good].price)
+METRIC(good_gold,     n->good[good].gold)
+METRIC(tons,          n->good[good].tons)
+METRIC(tons2,         n->good[good].tons2)
+
+static const struct metric nation_metric[] = {
+	{ "tax_rate", tax_rate_get }, { "gold", nation_gold_get }, { "crosses", crosses_get }, { "liberty_bells", liberty_bells_get },
+};
+
+static const struct metric good_metric[] = {
+	{ "price", price_get }, { "gold", good_gold_get }, { "tons", tons_get }, { "tons2", tons2_get },
+};
+
+#define METRICS 4
+
+/* One row: the date, nation and good (if any), and each metric with its change since prev */
+static void print_row(struct sink *out, int ndjson, const struct series_point *p, const struct series_point *prev,
+                      int nation, int good, const struct metric *metric)
+{
+	const char *season = p->autumn ? "Autumn" : "Spring";
+
+	if (ndjson) {
+		sink_puts(out, "{\"year\":");      sink_dec(out, p->year);
+		sink_puts(out, ",\"season\":\"");  sink_puts(out, season);
+		sink_puts(out, "\",\"turn\":");    sink_dec(out, p->turn);
+		sink_puts(out, ",\"nation\":\"");  sink_puts(out, nation_list[nation]);
+		sink_putc(out, '"');
+		if (good >= 0) {
+			sink_puts(out, ",\"good\":\"");
+			sink_puts(out, cargo_list[good]);
+			sink_putc(out, '"');
+		}
+	} else {
+		sink_dec(out, p->year);
+		sink_putc(out, '\t');
+		sink_puts(out, season);
+		sink_putc(out, '\t');
+		sink_dec(out, p->turn);
+		sink_putc(out, '\t');
+		sink_puts(out, nation_list[nation]);
+		if (good >= 0) {
+			sink_putc(out, '\t');
+			sink_puts(out, cargo_list[good]);
+		}
+	}
+
+	for (int m = 0; m < METRICS; ++m) {
+		int64_t v = metric[m].get(&p->nation[nation], good);
+		int64_t d = prev ? v - metric[m].get(&prev->nation[nation], good) : 0;
+
+		if (ndjson) {
+			sink_puts(out, ",\"");   sink_puts(out, metric[m].name);
+			sink_puts(out, "\":");   sink_dec(out, v);
+			sink_puts(out, ",\"");   sink_puts(out, metric[m].name);
+			sink_puts(out, "_delta\":"); sink_dec(out, d);
+		} else {
+			sink_putc(out, '\t');
+			sink_dec(out, v);
+			sink_putc(out, '\t');
+			sink_dec(out, d);
+		}
+	}
+
+	sink_puts(out, ndjson ? "}\n" : "\n");
+}
+
+int series_print(const char *path, const char *what, int ndjson, struct sink *out)
+{
+	int good = -2; // -2 for the nations, -1 for every good
+	if (strcasecmp(what, "nations") == 0) {
+		good = -2;
+	} else if (strcasecmp(what, "goods") == 0) {
+		good = -1;
+	} else {
+		for (int k = 0; k < SERIES_GOODS; ++k)
+			if (strcasecmp(what, cargo_list[k]) == 0)
+				good = k;
+		if (good == -2) {
+			fprintf(stderr, "No series \"%s\": nations, goods or a good's name\n", what);
+			return -1;
+		}
+	}
+
+	int fd = open(path, O_RDONLY);
+	if (fd == -1) {
+		fprintf(stderr, "Could not open series %s: %s\n", path, strerror(errno));
+		return -1;
+	}
+
+	struct stat st;
+	long count;
+	if (fstat(fd, &st) == -1 || (count = series_check(fd, st.st_size)) == -1) {
+		fprintf(stderr, "Not a series, or a different version: %s\n", path);
+		close(fd);
+		return -1;
+	}
+
+	void *base = MAP_FAILED;
+	if (count) {
+		base = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+		if (base == MAP_FAILED) {
+			fprintf(stderr, "Could not map series %s: %s\n", path, strerror(errno));
+			close(fd);
+			return -1;
+		}
+	}
+	close(fd);
+
+	const struct series_point *point = (const struct series_point *) ((const uint8_t *) base + sizeof (struct series_header));
+	uint32_t *order = (uint32_t *) malloc(sizeof (uint32_t) * (count ? count : 1));
+	for (long i = 0; i < count; ++i)
+		order[i] = i;
+	sort_points = point;
+	qsort(order, count, sizeof (uint32_t), compare_points);
+
+	/* The last added of each date */
+	long dates = 0;
+	for (long i = 0; i < count; ++i) {
+		if (dates && same_date(&point[order[dates - 1]], &point[order[i]]))
+			--dates;
+		order[dates++] = order[i];
+	}
+
+	const struct metric *metric = good == -2 ? nation_metric : good_metric;
+	if (!ndjson) {
+		sink_puts(out, good == -2 ? "year\tseason\tturn\tnation" : "year\tseason\tturn\tnation\tgood");
+		for (int m = 0; m < METRICS; ++m) {
+			sink_putc(out, '\t');
+			sink_puts(out, metric[m].name);
+			sink_putc(out, '\t');
+			sink_puts(out, metric[m].name);
+			sink_puts(out, "_delta");
+		}
+		sink_putc(out, '\n');
+	}
+
+	for (long i = 0; i < dates; ++i) {
+		const struct series_point *p = &point[order[i]];
+		const struct series_point *prev = i ? &point[order[i - 1]] : NULL;
+
+		for (int nation = 0; nation < SERIES_NATIONS; ++nation) {
+			if (good == -2) {
+				print_row(out, ndjson, p, prev, nation, -1, metric);
+				continue;
+			}
+			for (int k = 0; k < SERIES_GOODS; ++k)
+				if (good == -1 || good == k)
+					print_row(out, ndjson, p, prev, nation, k, metric);
+		}
+	}
+
+	free(order);
+	if (base != MAP_FAILED)
+		munmap(base, st.st_size);
+	return 0;
+}
@@ -0,0 +1,33 @@
+#ifndef SERIES_H
+#define SERIES_H
+
+#include "sink.h"
+
+/*
+ * Economic time series of one campaign, kept in a file that grows as its
+ * saves come in, so charting a campaign never reparses them.
+ *
+ * Each save adds a point: its date and, per European nation, the tax rate,
+ * gold, crosses and liberty bells, and the price, gold, tons and tons2 of
+ * each of the 16 goods from its trade records. Points are fixed size; the
+ * ones a run adds are sorted by date (keeping the order of the files for
+ * the same date) and appended after those already in the file, which stay
+ * as they are. A point equal to one already in the file is left out, and
+ * of two for the same date (a turn played again) the one added last counts.
+ *
+ * Printing sorts the points by year, season and turn and gives every
+ * nation, or nation and good, a row at every point, with each value's
+ * change since the point before (0 at the first).
+ */
+
+/* Adds the saves among files to the series at path, creating it. Returns 0, or -1 after printing an error */
+int series_add(const char *path, int count, char **files);
+
+/*
+ * Prints what of the series at path, as tab separated columns under a
+ * header or with ndjson one JSON object per row: "nations", "goods", or
+ * one good by name (e.g. "furs").
+ */
+int series_print(const char *path, const char *what, int ndjson, struct sink *out);
+
+#endif
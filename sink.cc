@@ -0,0 +1,148 @@
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "sink.h"
+#include "stats.h"
+
+void sink_init(struct sink *s, int fd, size_t cap)
+{
+	s->buf = (char *) malloc(cap);
+	stats_allocs(1);
+	s->len = 0;
+	s->cap = cap;
+	s->fd  = fd;
+
+	if (s->buf == NULL) {
+		perror("malloc");
+		exit(EXIT_FAILURE);
+	}
+}
+
+void sink_free(struct sink *s)
+{
+	free(s->buf);
+	s->buf = NULL;
+	s->len = s->cap = 0;
+}
+
+void sink_flush(struct sink *s)
+{
+	if (s->fd == -1)
+		return;
+
+	uint64_t t = stats_start();
+	const char *p = s->buf;
+	size_t left = s->len;
+	while (left > 0) {
+		ssize_t n = write(s->fd, p, left);
+		if (n == -1) {
+			perror("write");
+			exit(EXIT_FAILURE);
+		}
+		p += n;
+		left -= n;
+		stats_syscalls(1);
+	}
+	stats_written(s->len);
+	stats_stop(STATS_WRITE, t);
+	s->len = 0;
+}
+
+void sink_grow(struct sink *s, size_t n)
+{
+	if (s->fd != -1) {
+		sink_flush(s);
+		if (n <= s->cap)
+			return;
+	}
+
+	size_t cap = s->cap ? s->cap : SINK_DEFAULT_CAP;
+	while (s->len + n > cap)
+		cap *= 2;
+
+	s->buf = (char *) realloc(s->buf, cap);
+	stats_allocs(1);
+	s->cap = cap;
+
+	if (s->buf == NULL) {
+		perror("realloc");
+		exit(EXIT_FAILURE);
+	}
+}
+
+void sink_printf(struct sink *s, const char *fmt, ...)
+{
+	va_list ap;
+
+	va_start(ap, fmt);
+	int n = vsnprintf(s->buf + s->len, s->cap - s->len, fmt, ap);
+	va_end(ap);
+
+	if (s->len + n >= s->cap) {
+		sink_grow(s, n + 1);
+
+		va_start(ap, fmt);
+		vsnprintf(s->buf + s->len, s->cap - s->len, fmt, ap);
+		va_end(ap);
+	}
+
+	s->len += n;
+}
+
+void sink_dec(struct sink *s, int64_t value, int width)
+{
+	char tmp[24];
+	char *p = tmp + sizeof (tmp);
+	uint64_t v = (value < 0) ? -(uint64_t) value : value;
+
+	do {
+		*--p = '0' + v % 10;
+		v /= 10;
+	} while (v);
+
+	if (value < 0)
+		*--p = '-';
+
+	size_t digits = tmp + sizeof (tmp) - p;
+	size_t pad = (width > 0 && (size_t) width > digits) ? width - digits : 0;
+
+	char *dst = sink_reserve(s, pad + digits);
+	memset(dst, ' ', pad);
+	memcpy(dst + pad, p, digits);
+	s->len += pad + digits;
+}
+
+void sink_str(struct sink *s, const char *str, int width)
+{
+	size_t n = strlen(str);
+	size_t w = (width < 0) ? -width : width;
+	size_t pad = (w > n) ? w - n : 0;
+
+	char *dst = sink_reserve(s, n + pad);
+	if (width < 0) {
+		memcpy(dst, str, n);
+		memset(dst + n, ' ', pad);
+	} else {
+		memset(dst, ' ', pad);
+		memcpy(dst + pad, str, n);
+	}
+	s->len += n + pad;
+}
+
+void sink_hexdump(struct sink *s, const uint8_t *data, size_t n, char sep, int lead)
+{
+	static const char digits[] = "0123456789abcdef";
+	char *p = sink_reserve(s, n * 3);
+
+	for (size_t i = 0; i < n; ++i) {
+		if (lead)
+			*p++ = sep;
+		*p++ = digits[data[i] >> 4];
+		*p++ = digits[data[i] & 0xf];
+		if (!lead)
+			*p++ = sep;
+	}
+	s->len += n * 3;
+}
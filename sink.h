@@ -0,0 +1,74 @@
+#ifndef SINK_H
+#define SINK_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+/*
+ * Append buffer all print_* output goes through. A sink with an fd is
+ * written out with one write(2) whenever it fills up or is flushed; a sink
+ * without one (fd == -1) just grows, and is emitted by its owner.
+ *
+ * The formatters follow printf conventions: a positive width right-aligns
+ * ("%5d", "%11s"), a negative width left-aligns ("%-11s"), and the output
+ * is byte-for-byte what printf would have produced.
+ */
+struct sink {
+	char  *buf;
+	size_t len;
+	size_t cap;
+	int    fd;
+};
+
+#define SINK_DEFAULT_CAP (64 * 1024)
+
+void sink_init(struct sink *s, int fd, size_t cap = SINK_DEFAULT_CAP);
+void sink_free(struct sink *s);
+void sink_flush(struct sink *s);
+
+/* Makes room for n more bytes, flushing or growing as needed */
+void sink_grow(struct sink *s, size_t n);
+
+void sink_printf(struct sink *s, const char *fmt, ...) __attribute__ ((format (printf, 2, 3)));
+void sink_dec(struct sink *s, int64_t value, int width = 0);
+void sink_str(struct sink *s, const char *str, int width = 0);
+
+static inline char *sink_reserve(struct sink *s, size_t n)
+{
+	if (s->len + n > s->cap)
+		sink_grow(s, n);
+	return s->buf + s->len;
+}
+
+static inline void sink_write(struct sink *s, const void *data, size_t n)
+{
+	memcpy(sink_reserve(s, n), data, n);
+	s->len += n;
+}
+
+static inline void sink_putc(struct sink *s, char c)
+{
+	*sink_reserve(s, 1) = c;
+	s->len += 1;
+}
+
+static inline void sink_puts(struct sink *s, const char *str)
+{
+	sink_write(s, str, strlen(str));
+}
+
+/* "%02x" */
+static inline void sink_hex02(struct sink *s, uint8_t value)
+{
+	static const char digits[] = "0123456789abcdef";
+	char *p = sink_reserve(s, 2);
+	p[0] = digits[value >> 4];
+	p[1] = digits[value & 0xf];
+	s->len += 2;
+}
+
+/* n times "%02x" followed by sep (or sep followed by "%02x" if lead) */
+void sink_hexdump(struct sink *s, const uint8_t *data, size_t n, char sep = ' ', int lead = 0);
+
+#endif
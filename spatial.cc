@@ -0,0 +1,144 @@
+#include <stdlib.h>
+#include <string.h>
+#include <sys/param.h>
+
+#include "spatial.h"
+#include "stats.h"
+
+const char *spatial_kind_name[SPATIAL_KINDS] = { "unit", "colony", "tribe" };
+
+static inline int tile_of(int x, int y)
+{
+	return (x < MAP_WIDTH && y < MAP_HEIGHT) ? x + y * MAP_WIDTH : SPATIAL_OFF_MAP;
+}
+
+/* Counting sort of count records, stride bytes apart, by the x, y bytes they start with */
+static void bucket(struct spatial_index *si, enum spatial_kind kind, const uint8_t *xy, size_t stride, int count)
+{
+	uint32_t *start = si->start[kind];
+
+	if (si->cap[kind] < count) {
+		si->cap[kind] = count;
+		si->item[kind] = (uint16_t *) realloc(si->item[kind], sizeof (uint16_t) * count);
+		stats_allocs(1);
+	}
+	si->count[kind] = count;
+
+	memset(start, 0, sizeof (si->start[kind]));
+	memset(si->chunk[kind], 0, sizeof (si->chunk[kind]));
+
+	for (int i = 0; i < count; ++i) {
+		const uint8_t *p = xy + i * stride;
+		++start[tile_of(p[0], p[1]) + 1];
+		if (p[0] < MAP_WIDTH && p[1] < MAP_HEIGHT)
+			++si->chunk[kind][p[1] / SPATIAL_CHUNK][p[0] / SPATIAL_CHUNK];
+	}
+
+	for (int t = 0; t <= SPATIAL_OFF_MAP; ++t)
+		start[t + 1] += start[t];
+
+	/* Scatter, using start[t] as the fill position and shifting it back after */
+	uint16_t *item = si->item[kind];
+	for (int i = 0; i < count; ++i) {
+		const uint8_t *p = xy + i * stride;
+		item[start[tile_of(p[0], p[1])]++] = i;
+	}
+	memmove(start + 1, start, sizeof (uint32_t) * (SPATIAL_OFF_MAP + 1));
+	start[0] = 0;
+}
+
+void spatial_build(struct spatial_index *si, const struct savegame_view *sv)
+{
+	bucket(si, SPATIAL_UNIT,   &sv->unit->x,   sizeof (struct savegame::unit),   sv->head->unit_count);
+	bucket(si, SPATIAL_COLONY, &sv->colony->x, sizeof (struct savegame::colony), sv->head->colony_count);
+	bucket(si, SPATIAL_TRIBE,  &sv->tribe->x,  sizeof (struct savegame::tribe),  sv->head->tribe_count);
+}
+
+void spatial_free(struct spatial_index *si)
+{
+	for (int k = 0; k < SPATIAL_KINDS; ++k) {
+		free(si->item[k]);
+		si->item[k] = NULL;
+		si->cap[k] = si->count[k] = 0;
+	}
+}
+
+int spatial_at(const struct spatial_index *si, enum spatial_kind kind, int x, int y, const uint16_t **items)
+{
+	if (x < 0 || y < 0 || x >= MAP_WIDTH || y >= MAP_HEIGHT)
+		return 0;
+
+	int t = tile_of(x, y);
+	*items = si->item[kind] + si->start[kind][t];
+	return si->start[kind][t + 1] - si->start[kind][t];
+}
+
+int spatial_rect(const struct spatial_index *si, enum spatial_kind kind, int x0, int y0, int x1, int y1, uint16_t *out)
+{
+	x0 = MAX(x0, 0); x1 = MIN(x1, MAP_WIDTH - 1);
+	y0 = MAX(y0, 0); y1 = MIN(y1, MAP_HEIGHT - 1);
+
+	const uint32_t *start = si->start[kind];
+	const uint16_t *item = si->item[kind];
+	int n = 0;
+
+	for (int y = y0; y <= y1; ++y) {
+		const uint16_t *chunk = si->chunk[kind][y / SPATIAL_CHUNK];
+		for (int x = x0; x <= x1; ++x) {
+			if (chunk[x / SPATIAL_CHUNK] == 0) {
+				x |= SPATIAL_CHUNK - 1; // on to the next chunk
+				continue;
+			}
+			int t = tile_of(x, y);
+			for (uint32_t j = start[t]; j < start[t + 1]; ++j)
+				out[n++] = item[j];
+		}
+	}
+	return n;
+}
+
+int spatial_near(const struct spatial_index *si, enum spatial_kind kind, int x, int y, int r, uint16_t *out)
+{
+	return spatial_rect(si, kind, x - r, y - r, x + r, y + r, out);
+}
+
+/* Lowest record on tile (x, y) other than self, or best if that is lower */
+static int lowest(const struct spatial_index *si, enum spatial_kind kind, int x, int y, int self, int best)
+{
+	if (x < 0 || y < 0 || x >= MAP_WIDTH || y >= MAP_HEIGHT)
+		return best;
+
+	int t = tile_of(x, y);
+	for (uint32_t j = si->start[kind][t]; j < si->start[kind][t + 1]; ++j) {
+		int i = si->item[kind][j];
+		if (i != self) // items on a tile are in record order
+			return (best == -1 || i < best) ? i : best;
+	}
+	return best;
+}
+
+int spatial_nearest(const struct spatial_index *si, enum spatial_kind kind, int x, int y, int self, int *distance)
+{
+	if (si->start[kind][SPATIAL_OFF_MAP] == 0)
+		return -1;
+
+	int max_r = MAX(MAX(x, MAP_WIDTH - 1 - x), MAX(y, MAP_HEIGHT - 1 - y));
+
+	for (int r = 0; r <= max_r; ++r) {
+		int best = -1;
+		for (int dy = -r; dy <= r; ++dy) {
+			if (dy == -r || dy == r) {
+				for (int dx = -r; dx <= r; ++dx)
+					best = lowest(si, kind, x + dx, y + dy, self, best);
+			} else {
+				best = lowest(si, kind, x - r, y + dy, self, best);
+				best = lowest(si, kind, x + r, y + dy, self, best);
+			}
+		}
+		if (best != -1) {
+			*distance = r;
+			return best;
+		}
+	}
+	return -1;
+}
@@ -0,0 +1,64 @@
+#ifndef SPATIAL_H
+#define SPATIAL_H
+
+#include <stdint.h>
+
+#include "loader.h"
+#include "mapplane.h"
+
+/*
+ * Units, colonies and tribes bucketed by the tile they stand on.
+ *
+ * Each kind is sorted by tile with one counting sort pass, so the records
+ * on tile t are item[k][start[k][t]] up to item[k][start[k][t + 1]], in
+ * record order. Records outside the map (units in Europe, or on a ship at
+ * sea with odd coordinates) go to the SPATIAL_OFF_MAP bucket after the
+ * last tile. Occupancy counts per 8x8 chunk let area queries skip empty
+ * stretches of ocean.
+ *
+ * Distances are in tiles with diagonal steps counting as one, as units
+ * move, so "within r" is the (2r + 1) square around a tile.
+ */
+
+#define SPATIAL_OFF_MAP  MAP_TILES
+#define SPATIAL_CHUNK    8
+#define SPATIAL_CHUNKS_X ((MAP_WIDTH  + SPATIAL_CHUNK - 1) / SPATIAL_CHUNK)
+#define SPATIAL_CHUNKS_Y ((MAP_HEIGHT + SPATIAL_CHUNK - 1) / SPATIAL_CHUNK)
+
+enum spatial_kind { SPATIAL_UNIT, SPATIAL_COLONY, SPATIAL_TRIBE, SPATIAL_KINDS };
+
+extern const char *spatial_kind_name[SPATIAL_KINDS];
+
+struct spatial_index {
+	uint32_t start[SPATIAL_KINDS][MAP_TILES + 2];
+	uint16_t chunk[SPATIAL_KINDS][SPATIAL_CHUNKS_Y][SPATIAL_CHUNKS_X];
+	uint16_t *item[SPATIAL_KINDS];
+	int count[SPATIAL_KINDS];
+	int cap[SPATIAL_KINDS];
+};
+
+/* (Re)builds si from the unit, colony and tribe sections of sv, reusing its memory */
+void spatial_build(struct spatial_index *si, const struct savegame_view *sv);
+void spatial_free(struct spatial_index *si);
+
+/* Records of kind on tile (x, y), returns how many and points *items at them */
+int spatial_at(const struct spatial_index *si, enum spatial_kind kind, int x, int y, const uint16_t **items);
+
+/*
+ * Records of kind in the rectangle x0..x1, y0..y1 (inclusive, clipped to
+ * the map), in row major tile order. out must have room for
+ * si->count[kind] entries. Returns how many were stored.
+ */
+int spatial_rect(const struct spatial_index *si, enum spatial_kind kind, int x0, int y0, int x1, int y1, uint16_t *out);
+
+/* Records of kind within r tiles of (x, y), as for spatial_rect() */
+int spatial_near(const struct spatial_index *si, enum spatial_kind kind, int x, int y, int r, uint16_t *out);
+
+/*
+ * The record of kind closest to (x, y), searching outwards ring by ring,
+ * lowest record index on ties, skipping the record `self` (-1 for none).
+ * Sets *distance. Returns -1 if there is no such record on the map.
+ */
+int spatial_nearest(const struct spatial_index *si, enum spatial_kind kind, int x, int y, int self, int *distance);
+
+#endif
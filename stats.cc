@@ -0,0 +1,274 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/param.h>
+
+#include "stats.h"
+
+__thread struct stats_file *stats_current;
+
+static const char *phase_name[STATS_PHASES] = { "open", "read", "parse", "format", "write" };
+
+static const char *print_name[STATS_PRINTS] = {
+	"head", "player", "other", "colony", "unit", "nation", "tribe", "indian", "stuff",
+	"map", "terrain", "tail", "route", "at", "near", "manifest", "totals", "territory", "path", "ndjson",
+};
+
+/* Files reported by name, the slowest ones */
+#define STATS_SLOWEST 5
+
+static struct {
+	struct stats_file *file;
+	int count;
+	struct stats_file output; // stdout, current on the main thread
+	uint64_t start;
+} stats;
+
+static __thread uint64_t file_start;
+
+void stats_bytes(const struct section_table *table, size_t from, size_t to)
+{
+	if (!stats_current)
+		return;
+
+	for (int s = 0; s < SECTION_COUNT; ++s) {
+		size_t a = MAX(from, table->offset[s]), b = MIN(to, table->offset[s + 1]);
+		if (a < b)
+			stats_current->bytes[s] += b - a;
+	}
+}
+
+void stats_init(int count)
+{
+	stats.file = (struct stats_file *) calloc(count, sizeof (struct stats_file));
+	stats.count = count;
+	stats.start = stats_clock();
+	stats_current = &stats.output;
+}
+
+struct stats_file *stats_begin(int index)
+{
+	struct stats_file *prev = stats_current;
+
+	stats_current = &stats.file[index];
+	file_start = stats_clock();
+	return prev;
+}
+
+void stats_end(struct stats_file *prev, int failed)
+{
+	stats_current->total_ns = stats_clock() - file_start;
+	stats_current->failed = failed;
+	stats_current = prev;
+}
+
+/*
+ * Report
+ */
+
+static int compare_u64(const void *a, const void *b)
+{
+	uint64_t x = *(const uint64_t *) a, y = *(const uint64_t *) b;
+	return (x > y) - (x < y);
+}
+
+void stats_sort(uint64_t *sample, int n)
+{
+	qsort(sample, n, sizeof (uint64_t), compare_u64);
+}
+
+/* Nearest rank */
+uint64_t stats_percentile(const uint64_t *sorted, int n, int p)
+{
+	int rank = (p * n + 99) / 100;
+	return sorted[MAX(rank, 1) - 1];
+}
+
+struct spread {
+	uint64_t total, p50, p90, p99, max;
+};
+
+/* Sorts sample, n > 0 */
+static void spread(uint64_t *sample, int n, struct spread *s)
+{
+	s->total = 0;
+	for (int i = 0; i < n; ++i)
+		s->total += sample[i];
+	stats_sort(sample, n);
+	s->p50 = stats_percentile(sample, n, 50);
+	s->p90 = stats_percentile(sample, n, 90);
+	s->p99 = stats_percentile(sample, n, 99);
+	s->max = sample[n - 1];
+}
+
+/* What is reported per file, as percentiles */
+enum {
+	ROW_FILE = STATS_PHASES, // the phases come first
+	ROW_SYSCALLS,
+	ROW_ALLOCS,
+	ROW_READ,
+	ROW_WRITTEN,
+	ROWS
+};
+
+static const char *row_name[ROWS] = {
+	"open", "read", "parse", "format", "write", "file", "syscalls", "allocations", "bytes read", "bytes written",
+};
+
+static const char *row_key[ROWS] = {
+	"open_ns", "read_ns", "parse_ns", "format_ns", "write_ns", "file_ns", "syscalls", "allocations", "bytes_read", "bytes_written",
+};
+
+static uint64_t row_value(const struct stats_file *f, int row)
+{
+	uint64_t n = 0;
+
+	switch (row) {
+		case ROW_FILE:     return f->total_ns;
+		case ROW_SYSCALLS: return f->syscalls;
+		case ROW_ALLOCS:   return f->allocs;
+		case ROW_WRITTEN:  return f->written;
+		case ROW_READ:
+			for (int s = 0; s < SECTION_COUNT; ++s)
+				n += f->bytes[s];
+			return n;
+		default:
+			return f->ns[row];
+	}
+}
+
+static void json_string(struct sink *out, const char *s)
+{
+	sink_putc(out, '"');
+	for (; *s; ++s) {
+		if (*s == '"' || *s == '\\') {
+			sink_putc(out, '\\');
+			sink_putc(out, *s);
+		} else if ((unsigned char) *s < 0x20) {
+			sink_printf(out, "\\u%04x", *s);
+		} else {
+			sink_putc(out, *s);
+		}
+	}
+	sink_putc(out, '"');
+}
+
+/* Text rows in microseconds for times, as is for counts */
+static void text_row(struct sink *out, const char *name, const struct spread *s, int time)
+{
+	if (time)
+		sink_printf(out, "%-14s %12.3f %10.1f %10.1f %10.1f %10.1f\n", name,
+		            s->total / 1e6, s->p50 / 1e3, s->p90 / 1e3, s->p99 / 1e3, s->max / 1e3);
+	else
+		sink_printf(out, "%-14s %12llu %10llu %10llu %10llu %10llu\n", name, (unsigned long long) s->total,
+		            (unsigned long long) s->p50, (unsigned long long) s->p90,
+		            (unsigned long long) s->p99, (unsigned long long) s->max);
+}
+
+void stats_report(struct sink *out, enum stats_format format, char **files, int jobs)
+{
+	uint64_t wall = stats_clock() - stats.start;
+
+	/* The files that were got to, and the slowest of them */
+	int *done = (int *) malloc(sizeof (int) * MAX(stats.count, 1));
+	int slowest[STATS_SLOWEST], n = 0, failed = 0, slow = 0;
+	for (int i = 0; i < stats.count; ++i) {
+		uint64_t ns = stats.file[i].total_ns;
+		if (!ns)
+			continue;
+		done[n++] = i;
+		failed += stats.file[i].failed != 0;
+
+		int j = MIN(slow, STATS_SLOWEST - 1);
+		if (slow == STATS_SLOWEST && ns <= stats.file[slowest[j]].total_ns)
+			continue;
+		for (; j > 0 && ns > stats.file[slowest[j - 1]].total_ns; --j)
+			slowest[j] = slowest[j - 1];
+		slowest[j] = i;
+		slow = MIN(slow + 1, STATS_SLOWEST);
+	}
+
+	struct spread row[ROWS];
+	uint64_t *sample = (uint64_t *) malloc(sizeof (uint64_t) * MAX(n, 1));
+	for (int r = 0; r < ROWS; ++r) {
+		for (int i = 0; i < n; ++i)
+			sample[i] = row_value(&stats.file[done[i]], r);
+		if (n)
+			spread(sample, n, &row[r]);
+		else
+			memset(&row[r], 0, sizeof (row[r]));
+	}
+	free(sample);
+
+	uint64_t bytes[SECTION_COUNT] = { 0 }, records[STATS_PRINTS] = { 0 };
+	for (int i = 0; i < n; ++i) {
+		const struct stats_file *f = &stats.file[done[i]];
+		for (int s = 0; s < SECTION_COUNT; ++s)
+			bytes[s] += f->bytes[s];
+		for (int p = 0; p < STATS_PRINTS; ++p)
+			records[p] += f->records[p];
+	}
+
+	if (format == STATS_JSON) {
+		sink_printf(out, "{\"files\":%d,\"failed\":%d,\"jobs\":%d,\"wall_ns\":%llu", n, failed, jobs, (unsigned long long) wall);
+		for (int r = 0; r < ROWS; ++r) {
+			sink_putc(out, ',');
+			json_string(out, row_key[r]);
+			sink_printf(out, ":{\"total\":%llu,\"p50\":%llu,\"p90\":%llu,\"p99\":%llu,\"max\":%llu}",
+			            (unsigned long long) row[r].total, (unsigned long long) row[r].p50, (unsigned long long) row[r].p90,
+			            (unsigned long long) row[r].p99, (unsigned long long) row[r].max);
+		}
+		sink_puts(out, ",\"section_bytes\":{");
+		for (int s = 0; s < SECTION_COUNT; ++s)
+			sink_printf(out, "%s\"%s\":%llu", s ? "," : "", section_name[s], (unsigned long long) bytes[s]);
+		sink_puts(out, "},\"records\":{");
+		for (int p = 0; p < STATS_PRINTS; ++p)
+			sink_printf(out, "%s\"%s\":%llu", p ? "," : "", print_name[p], (unsigned long long) records[p]);
+		sink_printf(out, "},\"stdout\":{\"bytes\":%llu,\"syscalls\":%u,\"write_ns\":%llu},\"slowest\":[",
+		            (unsigned long long) stats.output.written, stats.output.syscalls,
+		            (unsigned long long) stats.output.ns[STATS_WRITE]);
+		for (int i = 0; i < slow; ++i) {
+			const struct stats_file *f = &stats.file[slowest[i]];
+			sink_puts(out, i ? ",{\"file\":" : "{\"file\":");
+			json_string(out, files[slowest[i]]);
+			sink_printf(out, ",\"ns\":%llu", (unsigned long long) f->total_ns);
+			for (int p = 0; p < STATS_PHASES; ++p)
+				sink_printf(out, ",\"%s_ns\":%llu", phase_name[p], (unsigned long long) f->ns[p]);
+			sink_putc(out, '}');
+		}
+		sink_puts(out, "]}\n");
+		free(done);
+		return;
+	}
+
+	sink_printf(out, "-- stats: %d files (%d failed) in %.3f ms on %d job%s --\n",
+	            n, failed, wall / 1e6, jobs, jobs == 1 ? "" : "s");
+	sink_printf(out, "%-14s %12s %10s %10s %10s %10s\n", "per file", "total ms", "p50 us", "p90 us", "p99 us", "max us");
+	for (int r = 0; r <= ROW_FILE; ++r)
+		text_row(out, row_name[r], &row[r], 1);
+	sink_printf(out, "%-14s %12s %10s %10s %10s %10s\n", "", "total", "p50", "p90", "p99", "max");
+	for (int r = ROW_FILE + 1; r < ROWS; ++r)
+		text_row(out, row_name[r], &row[r], 0);
+
+	sink_puts(out, "bytes read    ");
+	for (int s = 0; s < SECTION_COUNT; ++s)
+		if (bytes[s])
+			sink_printf(out, " %s %llu", section_name[s], (unsigned long long) bytes[s]);
+	sink_puts(out, "\nrecords       ");
+	for (int p = 0; p < STATS_PRINTS; ++p)
+		if (records[p])
+			sink_printf(out, " %s %llu", print_name[p], (unsigned long long) records[p]);
+	sink_printf(out, "\nstdout         %llu bytes in %u writes, %.3f ms\n", (unsigned long long) stats.output.written,
+	            stats.output.syscalls, stats.output.ns[STATS_WRITE] / 1e6);
+
+	sink_puts(out, "slowest\n");
+	for (int i = 0; i < slow; ++i) {
+		const struct stats_file *f = &stats.file[slowest[i]];
+		sink_printf(out, "%10.1f us  %s (", f->total_ns / 1e3, files[slowest[i]]);
+		for (int p = 0; p < STATS_PHASES; ++p)
+			sink_printf(out, "%s%s %.1f", p ? ", " : "", phase_name[p], f->ns[p] / 1e3);
+		sink_puts(out, ")\n");
+	}
+
+	free(done);
+}
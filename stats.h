@@ -0,0 +1,144 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "loader.h"
+#include "sink.h"
+
+/*
+ * --stats: where the time of a run goes, per file and in total.
+ *
+ * Each file gets a struct stats_file, made current on the thread working
+ * on it by stats_begin(). The loader, the sinks, the patch writer and the
+ * print_* functions add to whatever is current; with --stats off nothing
+ * is, and every hook is one untaken branch.
+ *
+ * The phases:
+ *   open    open(2) and fstat(2) of the save
+ *   read    pread(2) of the selected ranges, or mmap(2) of the whole file
+ *           (whose page faults then land in whatever touches the pages)
+ *   parse   section table, --where masks and --patch edits
+ *   format  the print_* functions
+ *   write   write(2) of output files. Stdout is reported on its own, but
+ *           for a file that fills the buffer of an unthreaded run (-j1),
+ *           whose flushes count to it, under format as well as write
+ *
+ * Syscalls and allocations are the ones these hooks make: the tool's own
+ * calls, not those inside the C library (stdio, qsort and the like).
+ */
+
+enum stats_phase {
+	STATS_OPEN,
+	STATS_READ,
+	STATS_PARSE,
+	STATS_FORMAT,
+	STATS_WRITE,
+	STATS_PHASES
+};
+
+/* The print_* functions, for the records each one printed */
+enum stats_print {
+	STATS_PRINT_HEAD,
+	STATS_PRINT_PLAYER,
+	STATS_PRINT_OTHER,
+	STATS_PRINT_COLONY,
+	STATS_PRINT_UNIT,
+	STATS_PRINT_NATION,
+	STATS_PRINT_TRIBE,
+	STATS_PRINT_INDIAN,
+	STATS_PRINT_STUFF,
+	STATS_PRINT_MAP,
+	STATS_PRINT_TERRAIN,
+	STATS_PRINT_TAIL,
+	STATS_PRINT_ROUTE,
+	STATS_PRINT_AT,
+	STATS_PRINT_NEAR,
+	STATS_PRINT_MANIFEST,
+	STATS_PRINT_TOTALS,
+	STATS_PRINT_TERRITORY,
+	STATS_PRINT_PATH,
+	STATS_PRINT_NDJSON,
+	STATS_PRINTS
+};
+
+struct stats_file {
+	uint64_t ns[STATS_PHASES];
+	uint64_t total_ns;
+	uint64_t bytes[SECTION_COUNT]; // read from the save
+	uint64_t written;
+	uint32_t syscalls;
+	uint32_t allocs;
+	uint32_t records[STATS_PRINTS];
+	int failed;
+};
+
+extern __thread struct stats_file *stats_current;
+
+static inline uint64_t stats_clock(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/* The start of a timed stretch, 0 when nothing is current */
+static inline uint64_t stats_start(void)
+{
+	return stats_current ? stats_clock() : 0;
+}
+
+static inline void stats_stop(enum stats_phase phase, uint64_t start)
+{
+	if (stats_current)
+		stats_current->ns[phase] += stats_clock() - start;
+}
+
+static inline void stats_syscalls(int n)
+{
+	if (stats_current)
+		stats_current->syscalls += n;
+}
+
+static inline void stats_allocs(int n)
+{
+	if (stats_current)
+		stats_current->allocs += n;
+}
+
+static inline void stats_record(enum stats_print print)
+{
+	if (stats_current)
+		++stats_current->records[print];
+}
+
+static inline void stats_written(size_t n)
+{
+	if (stats_current)
+		stats_current->written += n;
+}
+
+/* Bytes [from, to) of a file laid out as table were read */
+void stats_bytes(const struct section_table *table, size_t from, size_t to);
+
+enum stats_format { STATS_TEXT, STATS_JSON };
+
+/* Room for count files, and stdout made current on this thread. Once per run */
+void stats_init(int count);
+
+/* Makes file index current. Returns what was, for stats_end() */
+struct stats_file *stats_begin(int index);
+void stats_end(struct stats_file *prev, int failed);
+
+/* Sorts n samples, for stats_percentile() */
+void stats_sort(uint64_t *sample, int n);
+
+/* The p-th percentile of n sorted samples, n > 0, by nearest rank */
+uint64_t stats_percentile(const uint64_t *sorted, int n, int p);
+
+/* Percentiles over the files and the totals, to out */
+void stats_report(struct sink *out, enum stats_format format, char **files, int jobs);
+
+#endif
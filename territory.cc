@@ -0,0 +1,267 @@
+#include <string.h>
+
+#include "territory.h"
+
+#define ROW_MASK ((UINT64_C(1) << MAP_WIDTH) - 1)
+
+static_assert(MAP_WIDTH <= 64, "a map row in a word");
+
+typedef uint64_t board[MAP_HEIGHT];
+
+/* Row y of a bitboard laid out tile by tile, as map_planes has them */
+static uint64_t board_row(const uint64_t *linear, int y)
+{
+	int i = y * MAP_WIDTH, s = i & 63;
+	uint64_t row = linear[i >> 6] >> s;
+
+	if (s + MAP_WIDTH > 64)
+		row |= linear[(i >> 6) + 1] << (64 - s);
+	return row & ROW_MASK;
+}
+
+/* The tiles of in and their 8 neighbours */
+static void dilate(const uint64_t *in, uint64_t *out)
+{
+	board h;
+
+	for (int y = 0; y < MAP_HEIGHT; ++y)
+		h[y] = (in[y] | in[y] << 1 | in[y] >> 1) & ROW_MASK;
+
+	out[0] = h[0] | h[1];
+	for (int y = 1; y < MAP_HEIGHT - 1; ++y)
+		out[y] = h[y - 1] | h[y] | h[y + 1];
+	out[MAP_HEIGHT - 1] = h[MAP_HEIGHT - 2] | h[MAP_HEIGHT - 1];
+}
+
+static int board_count(const uint64_t *b)
+{
+	int n = 0;
+	for (int y = 0; y < MAP_HEIGHT; ++y)
+		n += __builtin_popcountll(b[y]);
+	return n;
+}
+
+static void board_set(uint64_t *b, int x, int y)
+{
+	if (x < MAP_WIDTH && y < MAP_HEIGHT)
+		b[y] |= UINT64_C(1) << x;
+}
+
+/* Row y of in and its left and right neighbours */
+static inline uint64_t spread(uint64_t row)
+{
+	return (row | row << 1 | row >> 1) & ROW_MASK;
+}
+
+/*
+ * Breadth-first search from the source boards of owners first..last-1,
+ * level by level for all of them at once, through the tiles of passable.
+ * Distances and ownership are kept for the tiles of medium only. Each
+ * owner's frontier is only looked at in the rows it spans.
+ *
+ * Owners from full on stop at tiles someone else is closer to, which
+ * they can neither own nor contest, nor anything behind them.
+ */
+static void search(struct territory *t, board *source, int first, int last, int full,
+                   const uint64_t *passable, const uint64_t *medium, board *owned)
+{
+	board frontier[TERRITORY_OWNERS], reached[TERRITORY_OWNERS], claimed, seen, tie;
+	int lo[TERRITORY_OWNERS], hi[TERRITORY_OWNERS];
+	int active = 0;
+
+	memset(claimed, 0, sizeof (claimed));
+	memset(seen, 0, sizeof (seen));
+	memset(tie, 0, sizeof (tie));
+	for (int o = first; o < last; ++o) {
+		memcpy(frontier[o], source[o], sizeof (board));
+		memcpy(reached[o], source[o], sizeof (board));
+		for (lo[o] = 0; lo[o] < MAP_HEIGHT && !source[o][lo[o]]; ++lo[o])
+			;
+		for (hi[o] = MAP_HEIGHT - 1; hi[o] >= 0 && !source[o][hi[o]]; --hi[o])
+			;
+		if (lo[o] <= hi[o])
+			active |= 1 << o;
+	}
+
+	for (int d = 0; active; ++d) {
+		int top = MAP_HEIGHT, bottom = -1;
+
+		/* The tiles at distance d, and which of them more than one owner reaches first */
+		for (int o = first; o < last; ++o) {
+			if (!(active & (1 << o)))
+				continue;
+			if (lo[o] < top)
+				top = lo[o];
+			if (hi[o] > bottom)
+				bottom = hi[o];
+		}
+		for (int y = top; y <= bottom; ++y)
+			seen[y] = tie[y] = 0;
+
+		for (int o = first; o < last; ++o) {
+			if (!(active & (1 << o)))
+				continue;
+
+			for (int y = lo[o]; y <= hi[o]; ++y) {
+				uint64_t bits = frontier[o][y] & medium[y];
+				uint64_t fresh = bits & ~claimed[y];
+				tie[y] |= seen[y] & fresh;
+				seen[y] |= fresh;
+
+				for (uint8_t *dist = t->dist[o] + y * MAP_WIDTH; bits; bits &= bits - 1)
+					dist[__builtin_ctzll(bits)] = d < TERRITORY_FAR ? d : TERRITORY_FAR;
+			}
+		}
+
+		/* Fresh tiles reached by one owner only are its own; then one step on, in place */
+		for (int o = first; o < last; ++o) {
+			if (!(active & (1 << o)))
+				continue;
+
+			int y0 = lo[o] > 0 ? lo[o] - 1 : 0, y1 = hi[o] < MAP_HEIGHT - 1 ? hi[o] + 1 : MAP_HEIGHT - 1;
+			uint64_t *f = frontier[o], *r = reached[o];
+			uint64_t keep = o < full ? ~UINT64_C(0) : 0;
+			uint64_t above = 0, here = spread(f[y0]);
+
+			lo[o] = MAP_HEIGHT;
+			hi[o] = -1;
+			for (int y = y0; y <= y1; ++y) {
+				uint64_t below = y < MAP_HEIGHT - 1 ? spread(f[y + 1]) : 0;
+
+				owned[o][y] |= f[y] & medium[y] & ~claimed[y] & ~tie[y];
+				f[y] = (above | here | below) & passable[y] & ~r[y] & (keep | ~(claimed[y] | seen[y]));
+				r[y] |= f[y];
+				if (f[y]) {
+					if (lo[o] == MAP_HEIGHT)
+						lo[o] = y;
+					hi[o] = y;
+				}
+				above = here;
+				here = below;
+			}
+			if (hi[o] < 0)
+				active &= ~(1 << o);
+		}
+
+		for (int y = top; y <= bottom; ++y) {
+			claimed[y] |= seen[y];
+			t->contested[y] |= tie[y];
+		}
+	}
+}
+
+void territory_compute(const struct savegame_view *sv, struct territory *t)
+{
+	static __thread struct map_planes mp;
+	board land, water, source[TERRITORY_OWNERS], colony[TERRITORY_EUROPEANS];
+	board owned[TERRITORY_OWNERS], all, other_land, other_water;
+
+	map_decode(sv->map, &mp);
+	for (int y = 0; y < MAP_HEIGHT; ++y) {
+		water[y] = board_row(mp.water[TERRITORY_LAYER], y);
+		land[y] = ~water[y] & ROW_MASK;
+	}
+
+	memset(t, 0, sizeof (*t));
+	memset(t->dist, TERRITORY_FAR, sizeof (t->dist));
+	memset(source, 0, sizeof (source));
+	memset(owned, 0, sizeof (owned));
+
+	for (int i = 0; i < sv->head->colony_count; ++i) {
+		const struct savegame::colony *c = &sv->colony[i];
+		if (c->nation >= TERRITORY_EUROPEANS || c->x >= MAP_WIDTH || c->y >= MAP_HEIGHT)
+			continue;
+		board_set(source[c->nation], c->x, c->y);
+		++t->sources[c->nation];
+	}
+	for (int i = 0; i < sv->head->tribe_count; ++i) {
+		const struct savegame::tribe *tr = &sv->tribe[i];
+		if (tr->nation < TERRITORY_EUROPEANS || tr->nation >= TERRITORY_OWNERS || tr->x >= MAP_WIDTH || tr->y >= MAP_HEIGHT)
+			continue;
+		board_set(source[tr->nation], tr->x, tr->y);
+		++t->sources[tr->nation];
+	}
+	memcpy(colony, source, sizeof (colony));
+
+	/* Land for everyone, then water from the colonies */
+	search(t, source, 0, TERRITORY_OWNERS, TERRITORY_EUROPEANS, land, land, owned);
+	search(t, colony, 0, TERRITORY_EUROPEANS, TERRITORY_EUROPEANS, water, water, owned);
+
+	memset(all, 0, sizeof (all));
+	for (int o = 0; o < TERRITORY_OWNERS; ++o)
+		for (int y = 0; y < MAP_HEIGHT; ++y)
+			all[y] |= owned[o][y];
+
+	memset(t->owner, TERRITORY_NONE, sizeof (t->owner));
+	for (int o = 0; o < TERRITORY_OWNERS; ++o) {
+		/* Borders on land and at sea, not coasts */
+		for (int y = 0; y < MAP_HEIGHT; ++y) {
+			uint64_t others = (all[y] & ~owned[o][y]) | t->contested[y];
+			other_land[y] = others & land[y];
+			other_water[y] = others & water[y];
+		}
+		dilate(other_land, other_land);
+		dilate(other_water, other_water);
+
+		for (int y = 0; y < MAP_HEIGHT; ++y) {
+			uint64_t frontier = owned[o][y] & ((other_land[y] & land[y]) | (other_water[y] & water[y]));
+			t->frontier[y] |= frontier;
+			t->frontier_tiles[o] += __builtin_popcountll(frontier);
+			t->land[o] += __builtin_popcountll(owned[o][y] & land[y]);
+			t->sea[o] += __builtin_popcountll(owned[o][y] & water[y]);
+
+			for (uint64_t bits = owned[o][y]; bits; bits &= bits - 1) {
+				int i = y * MAP_WIDTH + __builtin_ctzll(bits);
+				t->owner[i] = o;
+				if (t->dist[o][i] > t->farthest[o])
+					t->farthest[o] = t->dist[o][i];
+			}
+		}
+	}
+
+	for (int y = 0; y < MAP_HEIGHT; ++y)
+		for (uint64_t bits = t->contested[y]; bits; bits &= bits - 1)
+			t->owner[y * MAP_WIDTH + __builtin_ctzll(bits)] = TERRITORY_CONTESTED;
+
+	t->contested_tiles = board_count(t->contested);
+	t->unreached = MAP_TILES - board_count(all) - t->contested_tiles;
+}
+
+/* Halfway between the terrain and rgb, over the scale x scale block of tile (x, y) */
+static void tint(struct image *img, int scale, int x, int y, const uint8_t *rgb)
+{
+	for (int py = y * scale; py < (y + 1) * scale; ++py) {
+		uint8_t *p = img->rgb + ((size_t) py * img->width + x * scale) * 3;
+		for (int px = 0; px < scale * 3; ++px)
+			p[px] = (p[px] + rgb[px % 3]) / 2;
+	}
+}
+
+void territory_render(const struct savegame_view *sv, const struct territory *t, const struct render_options *ro, struct image *img)
+{
+	static const uint8_t black[3] = { 0, 0, 0 }, white[3] = { 255, 255, 255 };
+	struct render_options terrain = *ro;
+
+	terrain.layer = TERRITORY_LAYER;
+	terrain.overlay = 0;
+	render_map(sv, &terrain, img);
+
+	for (int y = 0; y < MAP_HEIGHT; ++y) {
+		for (int x = 0; x < MAP_WIDTH; ++x) {
+			int o = t->owner[y * MAP_WIDTH + x];
+			if (o == TERRITORY_CONTESTED)
+				image_tile(img, ro->scale, x, y, black);
+			else if (o == TERRITORY_NONE)
+				continue;
+			else if ((t->frontier[y] >> x) & 1)
+				image_tile(img, ro->scale, x, y, nation_rgb[o]);
+			else
+				tint(img, ro->scale, x, y, nation_rgb[o]);
+		}
+	}
+
+	for (int o = 0; o < TERRITORY_OWNERS; ++o)
+		for (int i = 0; i < MAP_TILES; ++i)
+			if (t->dist[o][i] == 0)
+				image_tile(img, ro->scale, i % MAP_WIDTH, i / MAP_WIDTH, white);
+}
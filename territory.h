@@ -0,0 +1,71 @@
+#ifndef TERRITORY_H
+#define TERRITORY_H
+
+#include <stdint.h>
+
+#include "mapplane.h"
+#include "render.h"
+#include "savegame.h"
+
+/*
+ * Who the tiles of the map belong to, by distance to the nearest colony
+ * or village.
+ *
+ * Owners are the nation_list entries: the four European nations, whose
+ * sources are their colonies, and the eight tribes, whose sources are
+ * their villages. Land tiles are reached over land from every owner's
+ * sources; water tiles over water from colonies only (a colony is a port,
+ * and the tribes have no ships). Steps go to any of the 8 neighbours.
+ *
+ * A tile goes to the owner closest to it. A tile that two or more owners
+ * reach at the same distance is contested. A frontier tile is an owned
+ * tile next to one of the same kind, land or water, that is someone
+ * else's or contested.
+ *
+ * The search runs one breadth-first pass for all owners together, on
+ * bitboards with a word per map row, so each step is a few shifts and
+ * masks per row rather than a queue operation per tile.
+ */
+
+#define TERRITORY_OWNERS    12   // nation_list
+#define TERRITORY_EUROPEANS 4    // the first ones, with colonies
+#define TERRITORY_FAR       255  // no path, or farther than a byte holds
+#define TERRITORY_NONE      0xff // owner[] of a tile nobody reaches
+#define TERRITORY_CONTESTED 0xfe // owner[] of a tie
+
+/* The terrain of this map layer decides what is land */
+#define TERRITORY_LAYER 0
+
+struct territory {
+	/*
+	 * Steps to the owner's nearest source, or TERRITORY_FAR. For a tribe
+	 * only as far as the tiles it holds or contests and the ones next to
+	 * them; its search stops where others are closer.
+	 */
+	uint8_t dist[TERRITORY_OWNERS][MAP_TILES];
+	uint8_t owner[MAP_TILES];
+	uint64_t frontier[MAP_HEIGHT];             // row bitboards, bit x of row y
+	uint64_t contested[MAP_HEIGHT];
+
+	/* Per owner: colonies or villages on the map, tiles held, frontier tiles, farthest tile held */
+	int sources[TERRITORY_OWNERS];
+	int land[TERRITORY_OWNERS];
+	int sea[TERRITORY_OWNERS];
+	int frontier_tiles[TERRITORY_OWNERS];
+	int farthest[TERRITORY_OWNERS];
+
+	int contested_tiles;
+	int unreached;
+};
+
+/* Fills in t from sv's map, colonies and tribes */
+void territory_compute(const struct savegame_view *sv, struct territory *t);
+
+/*
+ * Draws t over sv's terrain into img: held tiles tinted with their owner's
+ * nation_rgb, frontier tiles in it, contested tiles black and the colonies
+ * and villages white.
+ */
+void territory_render(const struct savegame_view *sv, const struct territory *t, const struct render_options *ro, struct image *img);
+
+#endif
@@ -0,0 +1,202 @@
+#include <stddef.h>
+#include <string.h>
+#include <sys/param.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define TOTALS_X86 1
+#endif
+
+#include "totals.h"
+
+#define STOCK_OFFSET offsetof(struct savegame::colony, stock)
+#define HOLDS_OFFSET offsetof(struct savegame::unit, holds_occupied)
+
+/* The 16 bytes from holds_occupied on stay within the unit */
+static_assert(HOLDS_OFFSET + 16 <= sizeof (struct savegame::unit), "unit holds");
+
+typedef void (*stock_fn)(const struct savegame::colony *colony, int n, int32_t (*stock)[TOTALS_CARGO]);
+typedef void (*hold_fn)(const struct savegame::unit *unit, int n, int32_t (*hold)[TOTALS_CARGO]);
+
+static void stock_c(const struct savegame::colony *colony, int n, int32_t (*stock)[TOTALS_CARGO])
+{
+	for (int i = 0; i < n; ++i) {
+		unsigned nation = colony[i].nation;
+		if (nation >= TOTALS_NATIONS)
+			continue;
+		for (int k = 0; k < TOTALS_CARGO; ++k)
+			stock[nation][k] += colony[i].stock[k];
+	}
+}
+
+static void hold_c(const struct savegame::unit *unit, int n, int32_t (*hold)[TOTALS_CARGO])
+{
+	for (int i = 0; i < n; ++i) {
+		const struct savegame::unit *u = &unit[i];
+		if (!u->holds_occupied || u->owner >= TOTALS_NATIONS)
+			continue;
+
+		const uint8_t item[6] = {
+			u->cargo_item_0, u->cargo_item_1, u->cargo_item_2,
+			u->cargo_item_3, u->cargo_item_4, u->cargo_item_5 };
+
+		for (int j = 0; j < MIN(u->holds_occupied, 6); ++j)
+			hold[u->owner][item[j]] += u->cargo_hold[j];
+	}
+}
+
+#ifdef TOTALS_X86
+
+__attribute__ ((target ("sse2")))
+static void stock_sse2(const struct savegame::colony *colony, int n, int32_t (*stock)[TOTALS_CARGO])
+{
+	__m128i acc[TOTALS_NATIONS][4];
+	memset(acc, 0, sizeof (acc));
+
+	for (int i = 0; i < n; ++i) {
+		unsigned nation = colony[i].nation;
+		if (nation >= TOTALS_NATIONS)
+			continue;
+
+		const uint8_t *p = (const uint8_t *) &colony[i] + STOCK_OFFSET;
+		__m128i lo = _mm_loadu_si128((const __m128i *) p);
+		__m128i hi = _mm_loadu_si128((const __m128i *) (p + 16));
+
+		/* Each int16 into the top of an int32, and arithmetically back down */
+		__m128i *a = acc[nation];
+		a[0] = _mm_add_epi32(a[0], _mm_srai_epi32(_mm_unpacklo_epi16(lo, lo), 16));
+		a[1] = _mm_add_epi32(a[1], _mm_srai_epi32(_mm_unpackhi_epi16(lo, lo), 16));
+		a[2] = _mm_add_epi32(a[2], _mm_srai_epi32(_mm_unpacklo_epi16(hi, hi), 16));
+		a[3] = _mm_add_epi32(a[3], _mm_srai_epi32(_mm_unpackhi_epi16(hi, hi), 16));
+	}
+
+	for (int nation = 0; nation < TOTALS_NATIONS; ++nation) {
+		for (int k = 0; k < 4; ++k) {
+			__m128i *dst = (__m128i *) (stock[nation] + 4 * k);
+			_mm_storeu_si128(dst, _mm_add_epi32(_mm_loadu_si128(dst), acc[nation][k]));
+		}
+	}
+}
+
+__attribute__ ((target ("avx2")))
+static void stock_avx2(const struct savegame::colony *colony, int n, int32_t (*stock)[TOTALS_CARGO])
+{
+	__m256i acc[TOTALS_NATIONS][2];
+	memset(acc, 0, sizeof (acc));
+
+	for (int i = 0; i < n; ++i) {
+		unsigned nation = colony[i].nation;
+		if (nation >= TOTALS_NATIONS)
+			continue;
+
+		__m256i v = _mm256_loadu_si256((const __m256i *) ((const uint8_t *) &colony[i] + STOCK_OFFSET));
+		acc[nation][0] = _mm256_add_epi32(acc[nation][0], _mm256_cvtepi16_epi32(_mm256_castsi256_si128(v)));
+		acc[nation][1] = _mm256_add_epi32(acc[nation][1], _mm256_cvtepi16_epi32(_mm256_extracti128_si256(v, 1)));
+	}
+
+	for (int nation = 0; nation < TOTALS_NATIONS; ++nation) {
+		for (int k = 0; k < 2; ++k) {
+			__m256i *dst = (__m256i *) (stock[nation] + 8 * k);
+			_mm256_storeu_si256(dst, _mm256_add_epi32(_mm256_loadu_si256(dst), acc[nation][k]));
+		}
+	}
+}
+
+/*
+ * holds_occupied, the six cargo nibbles in three bytes and the six amounts
+ * are one 16 byte load: the nibbles are split and interleaved back into
+ * item order, and amounts past holds_occupied masked to zero, so every unit
+ * adds its six holds without branching on how many are in use.
+ */
+__attribute__ ((target ("sse2")))
+static void hold_sse2(const struct savegame::unit *unit, int n, int32_t (*hold)[TOTALS_CARGO])
+{
+	const __m128i nibble = _mm_set1_epi8(0x0f);
+	const __m128i lane = _mm_setr_epi8(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15);
+	uint8_t item[16], amount[16];
+
+	for (int i = 0; i < n; ++i) {
+		const struct savegame::unit *u = &unit[i];
+		if (!u->holds_occupied || u->owner >= TOTALS_NATIONS)
+			continue;
+
+		__m128i v = _mm_loadu_si128((const __m128i *) ((const uint8_t *) u + HOLDS_OFFSET));
+
+		__m128i packed = _mm_srli_si128(v, 1);
+		__m128i items = _mm_unpacklo_epi8(_mm_and_si128(packed, nibble),
+		                                  _mm_and_si128(_mm_srli_epi16(packed, 4), nibble));
+		__m128i used = _mm_cmplt_epi8(lane, _mm_set1_epi8(MIN(u->holds_occupied, 6)));
+		__m128i amounts = _mm_and_si128(_mm_srli_si128(v, 4), used);
+
+		_mm_storeu_si128((__m128i *) item, items);
+		_mm_storeu_si128((__m128i *) amount, amounts);
+
+		int32_t *row = hold[u->owner];
+		row[item[0]] += amount[0];
+		row[item[1]] += amount[1];
+		row[item[2]] += amount[2];
+		row[item[3]] += amount[3];
+		row[item[4]] += amount[4];
+		row[item[5]] += amount[5];
+	}
+}
+
+#endif
+
+static stock_fn stock_sum;
+static hold_fn hold_sum;
+static const char *kernel_name;
+
+/*
+ * The stock and hold kernels, picked by __builtin_cpu_supports() in a
+ * constructor as map_decode() picks its decoder, so they are set before
+ * any worker thread calls totals_compute()
+ */
+__attribute__ ((constructor))
+static void totals_init(void)
+{
+	stock_sum = stock_c;
+	hold_sum = hold_c;
+	kernel_name = "scalar";
+
+#ifdef TOTALS_X86
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2")) {
+		stock_sum = stock_avx2;
+		hold_sum = hold_sse2;
+		kernel_name = "avx2";
+	} else if (__builtin_cpu_supports("sse2")) {
+		stock_sum = stock_sse2;
+		hold_sum = hold_sse2;
+		kernel_name = "sse2";
+	}
+#endif
+}
+
+void totals_compute(const struct savegame_view *sv, struct totals *t)
+{
+	const struct savegame::colony *colony = sv->colony;
+	int n = sv->head->colony_count;
+
+	memset(t, 0, sizeof (*t));
+
+	for (int i = 0; i < n; ++i) {
+		unsigned nation = colony[i].nation;
+		if (nation >= TOTALS_NATIONS)
+			continue;
+
+		t->colonies[nation] += 1;
+		t->population[nation] += colony[i].population;
+		t->hammers[nation] += colony[i].hammers;
+		if (colony[i].rebel_divisor)
+			t->rebels[nation] += colony[i].population * ((int64_t) colony[i].rebel_dividend * 100 / colony[i].rebel_divisor);
+	}
+
+	stock_sum(colony, n, t->stock);
+	hold_sum(sv->unit, sv->head->unit_count, t->hold);
+}
+
+const char *totals_kernel(void)
+{
+	return kernel_name;
+}
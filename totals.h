@@ -0,0 +1,41 @@
+#ifndef TOTALS_H
+#define TOTALS_H
+
+#include <stdint.h>
+
+#include "savegame.h"
+
+#define TOTALS_NATIONS 4  // the European ones, which own all colonies and goods
+#define TOTALS_CARGO   16 // cargo_list
+
+/*
+ * Per nation sums over a save: goods by cargo in colony warehouses and in
+ * the holds of ships and wagon trains, and the colonies' population,
+ * hammers and rebels. Colonies and units of other owners are left out.
+ */
+struct totals {
+	int32_t stock[TOTALS_NATIONS][TOTALS_CARGO];
+	int32_t hold[TOTALS_NATIONS][TOTALS_CARGO];
+	int32_t colonies[TOTALS_NATIONS];
+	int32_t population[TOTALS_NATIONS];
+	int32_t hammers[TOTALS_NATIONS];
+	int64_t rebels[TOTALS_NATIONS]; // population times rebel percentage, summed
+};
+
+/*
+ * Fills in t. The warehouses are summed 16 stock entries at a time and the
+ * holds unpacked a unit at a time with AVX2 or SSE2 where the CPU has them,
+ * picked once at runtime, and plain C otherwise.
+ */
+void totals_compute(const struct savegame_view *sv, struct totals *t);
+
+/* Name of the kernel totals_compute() uses on this CPU */
+const char *totals_kernel(void);
+
+/* Rebel percentage of nation's colonists as a whole, 0 without any */
+static inline int totals_rebel_percent(const struct totals *t, int nation)
+{
+	return t->population[nation] ? (int) (t->rebels[nation] / t->population[nation]) : 0;
+}
+
+#endif
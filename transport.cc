@@ -0,0 +1,166 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "transport.h"
+#include "stats.h"
+
+#define HAS_PREV 0x80 // reached by a kept link, so not the head of a chain
+
+static void grow(struct transport *tr, int n)
+{
+	if (tr->cap > n)
+		return;
+
+	tr->cap = ++n; // room for cargo_start[n], and never zero
+	tr->next    = (int16_t *) realloc(tr->next,    sizeof (int16_t) * n);
+	tr->chain   = (int16_t *) realloc(tr->chain,   sizeof (int16_t) * n);
+	tr->carrier = (int16_t *) realloc(tr->carrier, sizeof (int16_t) * n);
+	tr->head    = (int16_t *) realloc(tr->head,    sizeof (int16_t) * n);
+	tr->length  = (int16_t *) realloc(tr->length,  sizeof (int16_t) * n);
+	tr->flags   = (uint8_t *) realloc(tr->flags,   n);
+	tr->cargo   = (int16_t *) realloc(tr->cargo,   sizeof (int16_t) * n);
+	tr->cargo_start = (int32_t *) realloc(tr->cargo_start, sizeof (int32_t) * n);
+	stats_allocs(8);
+}
+
+/* Follows the kept links from h, numbering the chain */
+static void walk(struct transport *tr, int h)
+{
+	int c = tr->chain_count++;
+	int n = 0;
+
+	tr->head[c] = h;
+	for (int j = h; j != -1; j = tr->next[j]) {
+		tr->chain[j] = c;
+		++n;
+	}
+	tr->length[c] = n;
+	if (n > tr->longest)
+		tr->longest = n;
+}
+
+/* A ship carries units of its owner on its tile */
+static int carries(const struct savegame::unit *unit, int ship, int j)
+{
+	return ship != -1 && unit[ship].x == unit[j].x && unit[ship].y == unit[j].y && unit[ship].owner == unit[j].owner;
+}
+
+void transport_resolve(struct transport *tr, const struct savegame_view *sv)
+{
+	const struct savegame::unit *unit = sv->unit;
+	int n = sv->head->unit_count;
+
+	grow(tr, n);
+	tr->count = n;
+	tr->chain_count = 0;
+	tr->dangling = tr->one_way = tr->cycles = tr->longest = 0;
+
+	for (int i = 0; i < n; ++i) {
+		tr->flags[i] = unit_is_ship(unit[i].type) ? TRANSPORT_SHIP : 0;
+		tr->chain[i] = -1;
+		tr->carrier[i] = -1;
+	}
+
+	/* Keep the links both ends agree on */
+	for (int i = 0; i < n; ++i) {
+		int j = unit[i].transport_chain.next_unit_idx;
+		int p = unit[i].transport_chain.prev_unit_idx;
+
+		tr->next[i] = -1;
+		if (j != -1) {
+			if (j < 0 || j >= n || j == i) {
+				tr->flags[i] |= TRANSPORT_DANGLING;
+				++tr->dangling;
+			} else if (unit[j].transport_chain.prev_unit_idx != i) {
+				tr->flags[i] |= TRANSPORT_ONE_WAY;
+				++tr->one_way;
+			} else {
+				tr->next[i] = j;
+				tr->flags[j] |= HAS_PREV;
+			}
+		}
+
+		if (p != -1) {
+			if (p < 0 || p >= n || p == i) {
+				tr->flags[i] |= TRANSPORT_DANGLING;
+				++tr->dangling;
+			} else if (unit[p].transport_chain.next_unit_idx != i) {
+				tr->flags[i] |= TRANSPORT_ONE_WAY;
+				++tr->one_way;
+			}
+		}
+	}
+
+	/*
+	 * Every unit has at most one kept link in, so chains are walked from
+	 * the units without one, and what is left over are cycles.
+	 */
+	for (int i = 0; i < n; ++i)
+		if (!(tr->flags[i] & HAS_PREV))
+			walk(tr, i);
+
+	for (int i = 0; i < n; ++i) {
+		if (tr->chain[i] != -1)
+			continue;
+
+		int last = i;
+		for (int j = tr->next[i]; j != i; j = tr->next[j]) {
+			tr->flags[j] |= TRANSPORT_CYCLE;
+			last = j;
+		}
+		tr->flags[i] |= TRANSPORT_CYCLE;
+		tr->next[last] = -1; // cut open before i
+		++tr->cycles;
+		walk(tr, i);
+	}
+
+	/* Cargo goes to the ship before it in its chain, else the chain's first ship */
+	for (int c = 0; c < tr->chain_count; ++c) {
+		int first = -1;
+		for (int j = tr->head[c]; j != -1 && first == -1; j = tr->next[j])
+			if (tr->flags[j] & TRANSPORT_SHIP)
+				first = j;
+		if (first == -1)
+			continue;
+
+		int ship = -1;
+		for (int j = tr->head[c]; j != -1; j = tr->next[j]) {
+			if (tr->flags[j] & TRANSPORT_SHIP)
+				ship = j;
+			else if (carries(unit, ship, j))
+				tr->carrier[j] = ship;
+			else if (carries(unit, first, j))
+				tr->carrier[j] = first;
+		}
+	}
+
+	for (int i = 0; i < n; ++i)
+		tr->flags[i] &= ~HAS_PREV;
+
+	/* Cargo lists by ship, counting sorted on the carrier */
+	int32_t *start = tr->cargo_start;
+	memset(start, 0, sizeof (int32_t) * (n + 1));
+	for (int i = 0; i < n; ++i)
+		if (tr->carrier[i] != -1)
+			++start[tr->carrier[i] + 1];
+	for (int s = 0; s < n; ++s)
+		start[s + 1] += start[s];
+	for (int i = 0; i < n; ++i)
+		if (tr->carrier[i] != -1)
+			tr->cargo[start[tr->carrier[i]]++] = i;
+	memmove(start + 1, start, sizeof (int32_t) * n);
+	start[0] = 0;
+}
+
+void transport_free(struct transport *tr)
+{
+	free(tr->next);
+	free(tr->chain);
+	free(tr->carrier);
+	free(tr->head);
+	free(tr->length);
+	free(tr->flags);
+	free(tr->cargo);
+	free(tr->cargo_start);
+	memset(tr, 0, sizeof (*tr));
+}
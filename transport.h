@@ -0,0 +1,58 @@
+#ifndef TRANSPORT_H
+#define TRANSPORT_H
+
+#include <stdint.h>
+
+#include "loader.h"
+
+/*
+ * The unit transport_chain links resolved into chains of units.
+ *
+ * next_unit_idx / prev_unit_idx make a doubly linked list. A link is kept
+ * only if it points inside the unit array and the unit it points to links
+ * back; everything else is flagged and cut, so the kept links form simple
+ * paths (and possibly cycles, which are flagged and cut open too). Units
+ * in a chain on the same tile as a ship of their owner are its cargo,
+ * assigned to the ship before them in the chain, or failing that the
+ * first ship after.
+ *
+ * Everything is arrays indexed by unit and built in a constant number of
+ * passes over the units.
+ */
+
+/* transport::flags */
+#define TRANSPORT_DANGLING 0x01 // a link points outside the unit array, or at itself
+#define TRANSPORT_ONE_WAY  0x02 // a link the other unit doesn't return
+#define TRANSPORT_CYCLE    0x04 // on a cycle of links
+#define TRANSPORT_SHIP     0x08
+
+struct transport {
+	int count;          // units
+	int16_t *next;      // kept links, -1 for none
+	int16_t *chain;     // chain of each unit
+	int16_t *carrier;   // ship carrying each unit, -1 for none
+	uint8_t *flags;
+
+	/* Units carried by ship s are cargo[cargo_start[s]] up to cargo[cargo_start[s + 1]] */
+	int16_t *cargo;
+	int32_t *cargo_start;
+
+	int chain_count;
+	int16_t *head;      // first unit of each chain
+	int16_t *length;    // units in each chain
+
+	int cap;
+	int dangling, one_way, cycles;
+	int longest;
+};
+
+static inline int unit_is_ship(int type)
+{
+	return type >= 13 && type <= 18; // Caravel to Man-O-War
+}
+
+/* Resolves the links of sv's units into tr, reusing its memory */
+void transport_resolve(struct transport *tr, const struct savegame_view *sv);
+void transport_free(struct transport *tr);
+
+#endif
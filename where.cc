@@ -0,0 +1,449 @@
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/param.h>
+
+#include "where.h"
+
+#define WHERE_MAX_OPS     64
+#define WHERE_MAX_COLUMNS 16
+#define WHERE_MAX_SET     16
+
+enum where_opcode { OP_CMP, OP_RANGE, OP_SET, OP_AND, OP_OR, OP_NOT };
+enum where_cmp { CMP_EQ, CMP_NE, CMP_LT, CMP_LE, CMP_GT, CMP_GE };
+
+struct where_op {
+	enum where_opcode code;
+	int slot;            // into where::column
+	enum where_cmp cmp;
+	int32_t a, b;        // value, or range
+	int32_t set[WHERE_MAX_SET];
+	int set_count;
+};
+
+/* Postfix program over a stack of row masks */
+struct where {
+	const struct table *table;
+	int column[WHERE_MAX_COLUMNS];
+	int column_count;
+	struct where_op op[WHERE_MAX_OPS];
+	int op_count;
+	int depth;
+};
+
+/*
+ * Parser
+ */
+
+struct parser {
+	const char *p;
+	struct where *w;
+	int depth;
+};
+
+static void skip_space(struct parser *ps)
+{
+	while (isspace((unsigned char) *ps->p))
+		++ps->p;
+}
+
+static int accept(struct parser *ps, const char *token)
+{
+	skip_space(ps);
+	size_t n = strlen(token);
+	if (strncmp(ps->p, token, n) != 0)
+		return 0;
+	ps->p += n;
+	return 1;
+}
+
+/* A column name, number or value name: quoted, or letters, digits and _ . - (but not ..) */
+static int parse_word(struct parser *ps, char *word, size_t size)
+{
+	size_t n = 0;
+
+	skip_space(ps);
+	if (*ps->p == '"') {
+		const char *end = strchr(ps->p + 1, '"');
+		if (!end) {
+			fprintf(stderr, "Where: unterminated string\n");
+			return -1;
+		}
+		n = MIN((size_t) (end - ps->p - 1), size - 1);
+		memcpy(word, ps->p + 1, n);
+		word[n] = '\0';
+		ps->p = end + 1;
+		return 0;
+	}
+
+	while (isalnum((unsigned char) *ps->p) || *ps->p == '_' || (*ps->p == '.' && ps->p[1] != '.') ||
+	       (*ps->p == '-' && (n > 0 || isdigit((unsigned char) ps->p[1])))) {
+		if (n + 1 < size)
+			word[n++] = *ps->p;
+		++ps->p;
+	}
+	word[n] = '\0';
+
+	if (n == 0) {
+		fprintf(stderr, "Where: expected a column or value at '%s'\n", ps->p);
+		return -1;
+	}
+	return 0;
+}
+
+static int parse_value(struct parser *ps, const struct column *c, int32_t *v)
+{
+	char word[64];
+	if (parse_word(ps, word, sizeof (word)) == -1)
+		return -1;
+
+	char *end;
+	long n = strtol(word, &end, 10);
+	if (*end == '\0') {
+		*v = n;
+		return 0;
+	}
+
+	for (int i = 0; i < c->name_count; ++i) {
+		if (strcasecmp(c->names[i], word) == 0) {
+			*v = i;
+			return 0;
+		}
+	}
+
+	fprintf(stderr, "Where: '%s' is not a number%s\n", word, c->names ? " or a value of the column" : "");
+	return -1;
+}
+
+static struct where_op *emit(struct parser *ps, enum where_opcode code)
+{
+	struct where *w = ps->w;
+
+	if (w->op_count == WHERE_MAX_OPS) {
+		fprintf(stderr, "Where: expression too long\n");
+		return NULL;
+	}
+
+	ps->depth += (code == OP_AND || code == OP_OR) ? -1 : (code == OP_NOT) ? 0 : 1;
+	if (ps->depth > w->depth)
+		w->depth = ps->depth;
+
+	struct where_op *op = &w->op[w->op_count++];
+	memset(op, 0, sizeof (*op));
+	op->code = code;
+	return op;
+}
+
+/* column op value | column in lo..hi | column in {a, b, ...} */
+static int parse_compare(struct parser *ps)
+{
+	struct where *w = ps->w;
+	char name[64];
+
+	if (parse_word(ps, name, sizeof (name)) == -1)
+		return -1;
+
+	int c = column_find(w->table, name);
+	if (c == -1 || w->table->column[c].get == NULL) {
+		fprintf(stderr, "Where: no column '%s' in %s\n", name, w->table->name);
+		return -1;
+	}
+	const struct column *col = &w->table->column[c];
+
+	int slot;
+	for (slot = 0; slot < w->column_count; ++slot)
+		if (w->column[slot] == c)
+			break;
+	if (slot == w->column_count) {
+		if (w->column_count == WHERE_MAX_COLUMNS) {
+			fprintf(stderr, "Where: too many columns\n");
+			return -1;
+		}
+		w->column[w->column_count++] = c;
+	}
+
+	static const struct { const char *token; enum where_cmp cmp; } cmps[] = {
+		{ "==", CMP_EQ }, { "!=", CMP_NE }, { "<=", CMP_LE }, { ">=", CMP_GE },
+		{ "<",  CMP_LT }, { ">",  CMP_GT }, { "=",  CMP_EQ },
+	};
+
+	for (size_t i = 0; i < sizeof (cmps) / sizeof (cmps[0]); ++i) {
+		if (accept(ps, cmps[i].token)) {
+			struct where_op *op = emit(ps, OP_CMP);
+			if (!op)
+				return -1;
+			op->slot = slot;
+			op->cmp = cmps[i].cmp;
+			return parse_value(ps, col, &op->a);
+		}
+	}
+
+	skip_space(ps);
+	if (strncasecmp(ps->p, "in", 2) != 0 || isalnum((unsigned char) ps->p[2])) {
+		fprintf(stderr, "Where: expected a comparison after '%s'\n", name);
+		return -1;
+	}
+	ps->p += 2;
+
+	if (accept(ps, "{")) {
+		struct where_op *op = emit(ps, OP_SET);
+		if (!op)
+			return -1;
+		op->slot = slot;
+		do {
+			if (op->set_count == WHERE_MAX_SET) {
+				fprintf(stderr, "Where: too many values in set\n");
+				return -1;
+			}
+			if (parse_value(ps, col, &op->set[op->set_count++]) == -1)
+				return -1;
+		} while (accept(ps, ","));
+		if (!accept(ps, "}")) {
+			fprintf(stderr, "Where: expected '}' at '%s'\n", ps->p);
+			return -1;
+		}
+		return 0;
+	}
+
+	struct where_op *op = emit(ps, OP_RANGE);
+	if (!op)
+		return -1;
+	op->slot = slot;
+	if (parse_value(ps, col, &op->a) == -1)
+		return -1;
+	if (!accept(ps, "..")) {
+		fprintf(stderr, "Where: expected lo..hi at '%s'\n", ps->p);
+		return -1;
+	}
+	return parse_value(ps, col, &op->b);
+}
+
+static int parse_or(struct parser *ps);
+
+static int parse_not(struct parser *ps)
+{
+	if (accept(ps, "!")) {
+		if (parse_not(ps) == -1)
+			return -1;
+		return emit(ps, OP_NOT) ? 0 : -1;
+	}
+
+	if (accept(ps, "(")) {
+		if (parse_or(ps) == -1)
+			return -1;
+		if (!accept(ps, ")")) {
+			fprintf(stderr, "Where: expected ')' at '%s'\n", ps->p);
+			return -1;
+		}
+		return 0;
+	}
+
+	return parse_compare(ps);
+}
+
+static int parse_and(struct parser *ps)
+{
+	if (parse_not(ps) == -1)
+		return -1;
+	while (accept(ps, "&&")) {
+		if (parse_not(ps) == -1 || !emit(ps, OP_AND))
+			return -1;
+	}
+	return 0;
+}
+
+static int parse_or(struct parser *ps)
+{
+	if (parse_and(ps) == -1)
+		return -1;
+	while (accept(ps, "||")) {
+		if (parse_and(ps) == -1 || !emit(ps, OP_OR))
+			return -1;
+	}
+	return 0;
+}
+
+struct where *where_compile(const char *text, const struct table *table)
+{
+	struct where *w = (struct where *) calloc(1, sizeof (struct where));
+	w->table = table;
+
+	struct parser ps = { text, w, 0 };
+	if (parse_or(&ps) == -1) {
+		free(w);
+		return NULL;
+	}
+
+	skip_space(&ps);
+	if (*ps.p != '\0') {
+		fprintf(stderr, "Where: unexpected '%s'\n", ps.p);
+		free(w);
+		return NULL;
+	}
+
+	return w;
+}
+
+struct where *where_compile(const char *text)
+{
+	const char *colon = strchr(text, ':');
+	if (!colon) {
+		fprintf(stderr, "Where: expected 'table: expression'\n");
+		return NULL;
+	}
+
+	char name[32];
+	size_t n = MIN((size_t) (colon - text), sizeof (name) - 1);
+	memcpy(name, text, n);
+	name[n] = '\0';
+	while (n > 0 && isspace((unsigned char) name[n - 1]))
+		name[--n] = '\0';
+	char *start = name;
+	while (isspace((unsigned char) *start))
+		++start;
+
+	const struct table *table = column_table(start);
+	if (!table) {
+		fprintf(stderr, "Where: no table '%s'\n", start);
+		return NULL;
+	}
+
+	return where_compile(colon + 1, table);
+}
+
+void where_free(struct where *w)
+{
+	free(w);
+}
+
+const struct table *where_table(const struct where *w)
+{
+	return w->table;
+}
+
+int where_columns(const struct where *w, const int **column)
+{
+	*column = w->column;
+	return w->column_count;
+}
+
+/*
+ * Evaluator
+ */
+
+static void eval_cmp(uint8_t *m, const int32_t *v, int n, enum where_cmp cmp, int32_t a)
+{
+	switch (cmp) {
+		case CMP_EQ: for (int i = 0; i < n; ++i) m[i] = v[i] == a; break;
+		case CMP_NE: for (int i = 0; i < n; ++i) m[i] = v[i] != a; break;
+		case CMP_LT: for (int i = 0; i < n; ++i) m[i] = v[i] <  a; break;
+		case CMP_LE: for (int i = 0; i < n; ++i) m[i] = v[i] <= a; break;
+		case CMP_GT: for (int i = 0; i < n; ++i) m[i] = v[i] >  a; break;
+		case CMP_GE: for (int i = 0; i < n; ++i) m[i] = v[i] >= a; break;
+	}
+}
+
+int where_eval(const struct where *w, const struct savegame_view *sv, uint8_t *mask)
+{
+	static __thread int32_t *values;
+	static __thread size_t values_cap;
+
+	const struct table *t = w->table;
+	int n = t->rows(sv);
+	if (n == 0)
+		return 0;
+
+	if (values_cap < (size_t) w->column_count * n) {
+		values_cap = (size_t) w->column_count * n;
+		values = (int32_t *) realloc(values, sizeof (int32_t) * values_cap);
+	}
+
+	/* Copy out the columns the filter uses */
+	const int32_t *value[WHERE_MAX_COLUMNS];
+	for (int k = 0; k < w->column_count; ++k) {
+		const struct column *c = &t->column[w->column[k]];
+		int32_t *v = values + (size_t) k * n;
+		for (int i = 0; i < n; ++i)
+			v[i] = c->get(sv, i, c->arg);
+		value[k] = v;
+	}
+
+	return where_eval_values(w, n, value, mask);
+}
+
+int where_eval_values(const struct where *w, int n, const int32_t *const *value, uint8_t *mask)
+{
+	static __thread uint8_t *stack;
+	static __thread size_t stack_cap;
+
+	if (n == 0)
+		return 0;
+
+	if (stack_cap < (size_t) w->depth * n) {
+		stack_cap = (size_t) w->depth * n;
+		stack = (uint8_t *) realloc(stack, stack_cap);
+	}
+
+	int sp = 0;
+	for (const struct where_op *op = w->op; op < w->op + w->op_count; ++op) {
+		const int32_t *v = value[op->slot];
+		uint8_t *m = stack + (size_t) sp * n;
+		uint8_t *m1 = m - n;
+
+		switch (op->code) {
+			case OP_CMP:
+				eval_cmp(m, v, n, op->cmp, op->a);
+				++sp;
+				break;
+
+			case OP_RANGE: {
+				uint32_t lo = op->a, span = (uint32_t) op->b - lo;
+				if (op->b < op->a)
+					memset(m, 0, n);
+				else
+					for (int i = 0; i < n; ++i)
+						m[i] = (uint32_t) v[i] - lo <= span;
+				++sp;
+				break;
+			}
+
+			case OP_SET:
+				memset(m, 0, n);
+				for (int s = 0; s < op->set_count; ++s) {
+					int32_t a = op->set[s];
+					for (int i = 0; i < n; ++i)
+						m[i] |= v[i] == a;
+				}
+				++sp;
+				break;
+
+			case OP_AND:
+				m = m1 - n;
+				for (int i = 0; i < n; ++i)
+					m[i] &= m1[i];
+				--sp;
+				break;
+
+			case OP_OR:
+				m = m1 - n;
+				for (int i = 0; i < n; ++i)
+					m[i] |= m1[i];
+				--sp;
+				break;
+
+			case OP_NOT:
+				for (int i = 0; i < n; ++i)
+					m1[i] ^= 1;
+				break;
+		}
+	}
+
+	int count = 0;
+	for (int i = 0; i < n; ++i) {
+		mask[i] = stack[i];
+		count += stack[i];
+	}
+	return count;
+}
@@ -0,0 +1,51 @@
+#ifndef WHERE_H
+#define WHERE_H
+
+#include <stdint.h>
+
+#include "columns.h"
+#include "savegame.h"
+
+/*
+ * Record filters over the column tables (see columns.h):
+ *
+ *   unit: owner == England && type == Dragoon && x in 10..20
+ *   colony: stock.muskets > 100 || !(population >= 3)
+ *   tribe: nation in {Sioux, Apache} && scouted == 0
+ *
+ * Comparisons are ==, !=, <, <=, >, >=, "in lo..hi" and "in {a, b, ...}",
+ * combined with &&, || and !. Values are numbers or, for columns with value
+ * names, names such as England or "Trade goods" (case-insensitive).
+ *
+ * A filter is compiled once into a list of column-at-a-time operations.
+ * Evaluating it copies the columns it uses out of the records into plain
+ * int32 arrays, then runs each operation over every row at once.
+ */
+
+struct where;
+
+/* Returns NULL after printing an error message to stderr */
+struct where *where_compile(const char *text);
+void where_free(struct where *w);
+
+/* Just the expression, over the columns of table */
+struct where *where_compile(const char *text, const struct table *table);
+
+const struct table *where_table(const struct where *w);
+
+/* The columns the filter reads, as indices into where_table(w)->column */
+int where_columns(const struct where *w, const int **column);
+
+/*
+ * Sets mask[i] to 1 for the rows of sv that match, 0 for the rest. mask
+ * has room for where_table(w)->rows(sv) entries. Returns the match count.
+ */
+int where_eval(const struct where *w, const struct savegame_view *sv, uint8_t *mask);
+
+/*
+ * The same over n rows that are already int32 arrays, value[k] holding
+ * the column where_columns() lists k-th.
+ */
+int where_eval_values(const struct where *w, int n, const int32_t *const *value, uint8_t *mask);
+
+#endif